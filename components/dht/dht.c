@@ -0,0 +1,438 @@
+/*
+    * DHT Sensor Reading for ESP-IDF
+    *
+    * This code provides functionality to read temperature and humidity data from DHT11 or DHT22 sensors
+    * using the ESP-IDF framework. It includes error handling, logging, and supports both integer and float
+    * data formats.
+    *
+    * The response is captured either by an RMT RX channel (see dht_rmt.c) or by polling the pin from the
+    * CPU. Both backends produce the same list of level runs, which is decoded by dht_decode.c.
+    * Pins attached with dht_init_sim() get their runs from the virtual sensor in dht_sim.c instead.
+    *
+    * Pins attached with dht_init_timed() are polled with interrupts masked on the calling core and
+    * every edge is timestamped with the CPU cycle counter, so interrupts and the cost of a poll
+    * iteration do not end up in the measured pulse widths; their bits are classified against a
+    * threshold scaled by the sensor's own preamble.
+    *
+*/
+
+#include <string.h>
+#include "dht.h"
+#include "dht_rmt.h"
+#include "dht_sim.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "rom/ets_sys.h"
+#include "driver/gpio.h"
+
+static const char* TAG = "DHT";
+
+#define DHT_TIMEOUT_US 85
+#define DHT_TIMER_INTERVAL 2
+#define DHT_START_PULSE_MS 20
+
+// RMT channel attached to each pin, stored as channel + 1 (0 = CPU polling).
+static uint8_t s_rmt_channel[GPIO_NUM_MAX];
+
+// Pins polled with interrupts masked and edges timed by the cycle counter
+static bool s_timed[GPIO_NUM_MAX];
+static portMUX_TYPE s_timed_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Virtual sensor attached to each pin, and its random state; NULL = real hardware
+static const dht_sim_config_t *s_sim[GPIO_NUM_MAX];
+static uint32_t s_sim_rng[GPIO_NUM_MAX];
+
+// Function to wait for a specific pin state with a timeout
+// Returns 1 if the expected state is reached within the timeout, 0 otherwise.
+// Both the timeout and the duration are measured with the microsecond timer rather
+// than by counting iterations, since each iteration costs more than DHT_TIMER_INTERVAL.
+
+static int dht_await_pin_state(gpio_num_t pin, uint32_t timeout, bool expected_pin_state, uint32_t *duration)
+{
+    int64_t start = esp_timer_get_time();
+    int64_t elapsed = 0;
+
+    do {
+        if (gpio_get_level(pin) == expected_pin_state) {
+            if (duration) {
+                *duration = (uint32_t)elapsed;
+            }
+            return 1;
+        }
+        ets_delay_us(DHT_TIMER_INTERVAL);
+        elapsed = esp_timer_get_time() - start;
+    } while (elapsed < timeout);
+    return 0;
+}
+
+// Function to fetch data from the DHT sensor by polling the pin.
+// It pulls the pin low to initiate the read sequence, then records the duration of every
+// level the sensor drives so the shared decoder can turn them into bits.
+
+static esp_err_t dht_fetch_data(gpio_num_t pin, dht_level_t *runs, size_t max_runs, size_t *count, uint32_t *cpu_us)
+{
+    uint32_t duration;
+    int64_t t0;
+    esp_err_t result = ESP_OK;
+
+    *count = 0;
+    if (max_runs < 2 * DHT_DATA_BITS + 3) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Phase 'A' pulling signal low to start the read sequence.
+    gpio_set_direction(pin, GPIO_MODE_OUTPUT_OD);
+    gpio_set_level(pin, 0);
+    vTaskDelay(pdMS_TO_TICKS(DHT_START_PULSE_MS));
+
+    t0 = esp_timer_get_time();
+    gpio_set_level(pin, 1);
+    gpio_set_direction(pin, GPIO_MODE_INPUT);
+
+    // Step through Phase 'B', 80us low signal from sensor.
+    if (!dht_await_pin_state(pin, DHT_TIMEOUT_US, 0, &duration)) {
+        ESP_LOGE(TAG, "Timeout waiting for start signal low");
+        result = ESP_ERR_TIMEOUT;
+        goto done;
+    }
+    runs[(*count)++] = (dht_level_t){ .duration_us = duration, .level = 1 };
+
+    // Step through Phase 'C', 80us high signal from sensor.
+    if (!dht_await_pin_state(pin, DHT_TIMEOUT_US, 1, &duration)) {
+        ESP_LOGE(TAG, "Timeout waiting for start signal high");
+        result = ESP_ERR_TIMEOUT;
+        goto done;
+    }
+    runs[(*count)++] = (dht_level_t){ .duration_us = duration, .level = 0 };
+
+    // Step through Phase 'D', first data bit starts when the sensor pulls low.
+    if (!dht_await_pin_state(pin, DHT_TIMEOUT_US, 0, &duration)) {
+        ESP_LOGE(TAG, "Timeout waiting for data start");
+        result = ESP_ERR_TIMEOUT;
+        goto done;
+    }
+    runs[(*count)++] = (dht_level_t){ .duration_us = duration, .level = 1 };
+
+    // Record the low and high halves of each of the 40 bits.
+    for (int i = 0; i < DHT_DATA_BITS; i++) {
+        if (!dht_await_pin_state(pin, DHT_TIMEOUT_US, 1, &duration)) {
+            ESP_LOGE(TAG, "Timeout waiting for data bit %d high", i);
+            result = ESP_ERR_TIMEOUT;
+            goto done;
+        }
+        runs[(*count)++] = (dht_level_t){ .duration_us = duration, .level = 0 };
+
+        if (!dht_await_pin_state(pin, DHT_TIMEOUT_US, 0, &duration)) {
+            ESP_LOGE(TAG, "Timeout waiting for data bit %d low", i);
+            result = ESP_ERR_TIMEOUT;
+            goto done;
+        }
+        runs[(*count)++] = (dht_level_t){ .duration_us = duration, .level = 1 };
+    }
+
+done:
+    if (cpu_us) {
+        *cpu_us = (uint32_t)(esp_timer_get_time() - t0);
+    }
+    return result;
+}
+
+// Function to fetch data with edge timestamps from the CPU cycle counter.
+// The start pulse is a task delay as usual; from the release of the line until the last bit the
+// pin is sampled in a tight loop inside a critical section, which masks interrupts on this core
+// for the ~5ms the response takes (at most 2 * DHT_DATA_BITS + 3 runs of DHT_TIMEOUT_US).
+
+static esp_err_t dht_fetch_data_timed(gpio_num_t pin, dht_level_t *runs, size_t max_runs, size_t *count,
+                                      uint32_t *cpu_us)
+{
+    const size_t expected = 2 * DHT_DATA_BITS + 3;
+    uint32_t cycles_per_us = ets_get_cpu_frequency();
+    uint32_t timeout = DHT_TIMEOUT_US * cycles_per_us;
+    int level = 1;
+    size_t n = 0;
+    int core;
+
+    *count = 0;
+    if (max_runs < expected) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Phase 'A'; input stays enabled so the line can be read back right after the release
+    gpio_set_direction(pin, GPIO_MODE_INPUT_OUTPUT_OD);
+    gpio_set_level(pin, 0);
+    vTaskDelay(pdMS_TO_TICKS(DHT_START_PULSE_MS));
+
+    int64_t t0 = esp_timer_get_time();
+    portENTER_CRITICAL(&s_timed_lock);
+    core = xPortGetCoreID();
+    gpio_set_level(pin, 1);
+    uint32_t edge = esp_cpu_get_ccount();
+
+    // Phases 'B' to 'D' and the 40 bits, one run per level change
+    while (n < expected) {
+        uint32_t now;
+        int l;
+
+        do {
+            now = esp_cpu_get_ccount();
+            l = gpio_get_level(pin);
+        } while (l == level && now - edge < timeout);
+        if (l == level) {
+            break;
+        }
+        runs[n++] = (dht_level_t){
+            .duration_us = (now - edge + cycles_per_us / 2) / cycles_per_us,
+            .level = level,
+        };
+        level = l;
+        edge = now;
+    }
+    portEXIT_CRITICAL(&s_timed_lock);
+
+    *count = n;
+    if (cpu_us) {
+        *cpu_us = (uint32_t)(esp_timer_get_time() - t0);
+    }
+    if (portNUM_PROCESSORS > 1 && core != APP_CPU_NUM) {
+        ESP_LOGW(TAG, "Timed read on core %d; pin the reading task to the app core", core);
+    }
+    if (n < expected) {
+        ESP_LOGE(TAG, "Timeout waiting for edge %u of %u", (unsigned)n + 1, (unsigned)expected);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+esp_err_t dht_init_rmt(gpio_num_t pin, rmt_channel_t channel)
+{
+    if (pin < 0 || pin >= GPIO_NUM_MAX || channel >= RMT_CHANNEL_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t result = dht_rmt_init(pin, channel);
+    if (result == ESP_OK) {
+        s_rmt_channel[pin] = (uint8_t)channel + 1;
+        s_timed[pin] = false;
+    }
+    return result;
+}
+
+esp_err_t dht_init_timed(gpio_num_t pin)
+{
+    if (pin < 0 || pin >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_timed[pin] = true;
+    s_rmt_channel[pin] = 0;
+    s_sim[pin] = NULL;
+    return ESP_OK;
+}
+
+esp_err_t dht_init_sim(gpio_num_t pin, const dht_sim_config_t *config)
+{
+    if (pin < 0 || pin >= GPIO_NUM_MAX || config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Fixed seed per pin, so a run with faults enabled can be reproduced
+    s_sim_rng[pin] = 0x9e3779b9u ^ (uint32_t)pin;
+    s_sim[pin] = config;
+    s_rmt_channel[pin] = 0;
+    s_timed[pin] = false;
+    ESP_LOGW(TAG, "GPIO %d reads from a simulated sensor", pin);
+    return ESP_OK;
+}
+
+// Function to produce the runs of a simulated sensor.
+// It blocks for as long as a real start pulse and response would, so timing above it stays realistic.
+
+static esp_err_t dht_sim_capture(dht_sensor_type_t sensor_type, gpio_num_t pin, dht_level_t *runs, size_t max_runs,
+                                 size_t *count, uint32_t *cpu_us)
+{
+    const dht_sim_config_t *sim = s_sim[pin];
+    int16_t humidity, temperature;
+
+    vTaskDelay(pdMS_TO_TICKS(DHT_START_PULSE_MS + 5));
+
+    int64_t t0 = esp_timer_get_time();
+    dht_sim_values(sim, (uint64_t)t0 / 1000, &humidity, &temperature);
+    *count = dht_sim_waveform(sensor_type, humidity, temperature, &sim->faults, &s_sim_rng[pin], runs, max_runs);
+    *cpu_us = (uint32_t)(esp_timer_get_time() - t0);
+    return ESP_OK;
+}
+
+// Function to decode a completed capture.
+// It verifies the checksum and parses the humidity and temperature values.
+
+static esp_err_t dht_decode_capture(dht_sensor_type_t sensor_type, esp_err_t result, bool adaptive,
+                                    const dht_level_t *runs, size_t count, uint32_t cpu_us,
+                                    int16_t *humidity, int16_t *temperature, dht_read_stats_t *stats)
+{
+    uint8_t data[DHT_DATA_BYTES] = {0};
+    dht_decode_timing_t timing = {0};
+
+    int64_t t0 = esp_timer_get_time();
+    dht_decode_status_t decode = DHT_DECODE_SHORT;
+    if (result == ESP_OK) {
+        decode = dht_decode_pulses_ex(runs, count, adaptive, data, &timing);
+    }
+    uint32_t decode_us = (uint32_t)(esp_timer_get_time() - t0);
+
+    if (stats) {
+        stats->cpu_us = cpu_us + decode_us;
+        stats->decode_us = decode_us;
+        stats->decode = decode;
+        stats->timing = timing;
+        memcpy(stats->raw, data, sizeof(data));
+    }
+
+    if (result != ESP_OK) {
+        return result;
+    }
+
+    switch (decode) {
+    case DHT_DECODE_OK:
+        break;
+    case DHT_DECODE_CHECKSUM:
+        ESP_LOGE(TAG, "Checksum failed, data may be corrupted");
+        return ESP_ERR_INVALID_CRC;
+    case DHT_DECODE_NO_PREAMBLE:
+    case DHT_DECODE_SHORT:
+        ESP_LOGE(TAG, "Incomplete response (%u runs, status %d)", (unsigned)count, decode);
+        return ESP_ERR_TIMEOUT;
+    default:
+        ESP_LOGE(TAG, "Malformed response (%u runs, status %d)", (unsigned)count, decode);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    dht_parse_data(sensor_type, data, humidity, temperature);
+
+    ESP_LOGD(TAG, "Raw data: %02x %02x %02x %02x %02x", data[0], data[1], data[2], data[3], data[4]);
+    ESP_LOGD(TAG, "Humidity: %d.%d%%, Temperature: %d.%d°C",
+             *humidity / 10, *humidity % 10, *temperature / 10, *temperature % 10);
+
+    return ESP_OK;
+}
+
+// Function to read data from a single DHT sensor.
+
+esp_err_t dht_read_data_ex(dht_sensor_type_t sensor_type, gpio_num_t pin, int16_t *humidity, int16_t *temperature,
+                           dht_read_stats_t *stats)
+{
+    dht_level_t runs[DHT_RMT_MAX_RUNS];
+    size_t count = 0;
+    uint32_t cpu_us = 0;
+    esp_err_t result;
+
+    if (pin < 0 || pin >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (s_sim[pin]) {
+        result = dht_sim_capture(sensor_type, pin, runs, DHT_RMT_MAX_RUNS, &count, &cpu_us);
+    } else if (s_rmt_channel[pin]) {
+        result = dht_rmt_capture(pin, (rmt_channel_t)(s_rmt_channel[pin] - 1), runs, DHT_RMT_MAX_RUNS, &count, &cpu_us);
+    } else if (s_timed[pin]) {
+        result = dht_fetch_data_timed(pin, runs, DHT_RMT_MAX_RUNS, &count, &cpu_us);
+    } else {
+        result = dht_fetch_data(pin, runs, DHT_RMT_MAX_RUNS, &count, &cpu_us);
+    }
+
+    return dht_decode_capture(sensor_type, result, s_timed[pin], runs, count, cpu_us, humidity, temperature, stats);
+}
+
+// Function to read a group of sensors.
+// RMT-attached sensors go through Phase 'A' together, offset by stagger_ms, and are released in
+// the same order so each line is held low for about DHT_START_PULSE_MS. Their responses are
+// captured in parallel and collected afterwards.
+
+esp_err_t dht_read_group(dht_group_read_t *reads, size_t count, uint32_t stagger_ms)
+{
+    dht_level_t runs[DHT_RMT_MAX_RUNS];
+    size_t n_runs;
+    size_t n_rmt = 0;
+    esp_err_t overall = ESP_OK;
+
+    for (size_t i = 0; i < count; i++) {
+        gpio_num_t pin = reads[i].pin;
+        reads[i].result = ESP_ERR_INVALID_ARG;
+        if (pin < 0 || pin >= GPIO_NUM_MAX || !s_rmt_channel[pin]) {
+            continue;
+        }
+        if (n_rmt++ && stagger_ms) {
+            vTaskDelay(pdMS_TO_TICKS(stagger_ms));
+        }
+        gpio_set_level(pin, 0);
+    }
+
+    if (n_rmt) {
+        uint32_t elapsed_ms = (n_rmt - 1) * stagger_ms;
+        if (elapsed_ms < DHT_START_PULSE_MS) {
+            vTaskDelay(pdMS_TO_TICKS(DHT_START_PULSE_MS - elapsed_ms));
+        }
+
+        size_t released = 0;
+        for (size_t i = 0; i < count; i++) {
+            gpio_num_t pin = reads[i].pin;
+            if (pin < 0 || pin >= GPIO_NUM_MAX || !s_rmt_channel[pin]) {
+                continue;
+            }
+            if (released++ && stagger_ms) {
+                vTaskDelay(pdMS_TO_TICKS(stagger_ms));
+            }
+            int64_t t0 = esp_timer_get_time();
+            dht_rmt_begin(pin, (rmt_channel_t)(s_rmt_channel[pin] - 1));
+            reads[i].stats.cpu_us = (uint32_t)(esp_timer_get_time() - t0);
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            gpio_num_t pin = reads[i].pin;
+            uint32_t finish_us = 0;
+            if (pin < 0 || pin >= GPIO_NUM_MAX || !s_rmt_channel[pin]) {
+                continue;
+            }
+            esp_err_t result = dht_rmt_finish((rmt_channel_t)(s_rmt_channel[pin] - 1), runs, DHT_RMT_MAX_RUNS,
+                                              &n_runs, DHT_RMT_RX_TIMEOUT_MS, &finish_us);
+            reads[i].result = dht_decode_capture(reads[i].type, result, false, runs, n_runs,
+                                                 reads[i].stats.cpu_us + finish_us,
+                                                 &reads[i].humidity, &reads[i].temperature, &reads[i].stats);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        gpio_num_t pin = reads[i].pin;
+        if (pin >= 0 && pin < GPIO_NUM_MAX && !s_rmt_channel[pin]) {
+            reads[i].result = dht_read_data_ex(reads[i].type, pin, &reads[i].humidity, &reads[i].temperature,
+                                               &reads[i].stats);
+        }
+        if (reads[i].result != ESP_OK) {
+            overall = ESP_FAIL;
+        }
+    }
+
+    return overall;
+}
+
+esp_err_t dht_read_data(dht_sensor_type_t sensor_type, gpio_num_t pin, int16_t *humidity, int16_t *temperature)
+{
+    return dht_read_data_ex(sensor_type, pin, humidity, temperature, NULL);
+}
+
+// Function to read temperature and humidity as float values.
+
+esp_err_t dht_read_float_data(dht_sensor_type_t sensor_type, gpio_num_t pin, float *humidity, float *temperature)
+{
+    int16_t h, t;
+    esp_err_t result = dht_read_data(sensor_type, pin, &h, &t);
+
+    if (result == ESP_OK) {
+        *humidity = h / 10.0f;
+        *temperature = t / 10.0f;
+    }
+
+    return result;
+}
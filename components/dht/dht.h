@@ -0,0 +1,129 @@
+#ifndef DHT_H
+#define DHT_H
+
+#include "esp_err.h"
+#include "driver/gpio.h"
+#include "driver/rmt.h"
+#include "dht_decode.h"
+#include "dht_sim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Per-read diagnostics filled in by dht_read_data_ex()
+typedef struct {
+    uint32_t cpu_us;                // CPU time spent in the read (excludes sleeps)
+    uint32_t decode_us;             // Time spent decoding the captured pulses
+    dht_decode_status_t decode;     // Decoder result
+    dht_decode_timing_t timing;     // Bit timing: threshold, closest bit to it, jitter
+    uint8_t raw[DHT_DATA_BYTES];    // Raw frame as received
+} dht_read_stats_t;
+
+// One sensor in a dht_read_group() call
+typedef struct {
+    dht_sensor_type_t type;         // in
+    gpio_num_t pin;                 // in
+    int16_t humidity;               // out, in 0.1%
+    int16_t temperature;            // out, in 0.1°C
+    esp_err_t result;               // out, as returned by dht_read_data_ex()
+    dht_read_stats_t stats;         // out
+} dht_group_read_t;
+
+/**
+ * @brief Capture reads on this pin with an RMT RX channel
+ *
+ * Pins that have not been attached to a channel are read by polling the
+ * GPIO from the CPU.
+ *
+ * @param pin GPIO pin connected to DHT sensor
+ * @param channel RMT channel reserved for this sensor
+ * @return ESP_OK on success, ESP_ERR_* on failure
+ */
+esp_err_t dht_init_rmt(gpio_num_t pin, rmt_channel_t channel);
+
+/**
+ * @brief Read this pin by CPU polling with edges timed by the cycle counter
+ *
+ * Interrupts are masked on the calling core while the ~5ms response is
+ * sampled, so the task doing the reads should be pinned to the app core,
+ * away from the WiFi stack. Bits are classified against a threshold scaled
+ * by the measured preamble, and the margin of the closest bit is reported
+ * in dht_read_stats_t.timing. Replaces any RMT channel attached to the pin.
+ *
+ * @param pin GPIO pin connected to DHT sensor
+ * @return ESP_OK on success, ESP_ERR_* on failure
+ */
+esp_err_t dht_init_timed(gpio_num_t pin);
+
+/**
+ * @brief Serve reads on this pin from a virtual sensor instead of the GPIO
+ *
+ * The simulated waveform goes through the same decoder as a real capture,
+ * so checksum, timeout and filtering paths can be exercised without
+ * hardware. Replaces any RMT channel attached to the pin.
+ *
+ * @param pin GPIO pin the sensor would be connected to
+ * @param config Kept by reference, must stay valid
+ * @return ESP_OK on success, ESP_ERR_* on failure
+ */
+esp_err_t dht_init_sim(gpio_num_t pin, const dht_sim_config_t *config);
+
+/**
+ * @brief Read data from DHT sensor
+ *
+ * @param sensor_type Type of DHT sensor
+ * @param pin GPIO pin connected to DHT sensor
+ * @param humidity Pointer to store humidity value (in 0.1%)
+ * @param temperature Pointer to store temperature value (in 0.1°C)
+ * @return ESP_OK on success, ESP_ERR_* on failure
+ */
+esp_err_t dht_read_data(dht_sensor_type_t sensor_type, gpio_num_t pin, int16_t *humidity, int16_t *temperature);
+
+/**
+ * @brief Read data from DHT sensor and report per-read diagnostics
+ *
+ * @param sensor_type Type of DHT sensor
+ * @param pin GPIO pin connected to DHT sensor
+ * @param humidity Pointer to store humidity value (in 0.1%)
+ * @param temperature Pointer to store temperature value (in 0.1°C)
+ * @param stats Optional, filled in on success and failure
+ * @return ESP_OK on success, ESP_ERR_TIMEOUT if the sensor did not answer,
+ *         ESP_ERR_INVALID_RESPONSE on malformed pulses, ESP_ERR_INVALID_CRC
+ *         on checksum mismatch
+ */
+esp_err_t dht_read_data_ex(dht_sensor_type_t sensor_type, gpio_num_t pin, int16_t *humidity, int16_t *temperature,
+                           dht_read_stats_t *stats);
+
+/**
+ * @brief Read several DHT sensors with overlapping start pulses
+ *
+ * Sensors attached to an RMT channel have their start pulses staggered by
+ * stagger_ms and held concurrently, and their responses are captured in
+ * parallel, so N sensors take roughly one start pulse plus N staggers
+ * instead of N full reads. Sensors read by CPU polling are read one after
+ * another once the RMT captures are done.
+ *
+ * @param reads Sensors to read; results are written back per entry
+ * @param count Number of entries in reads
+ * @param stagger_ms Delay between consecutive start pulses
+ * @return ESP_OK if every sensor was read, ESP_FAIL if any entry failed
+ */
+esp_err_t dht_read_group(dht_group_read_t *reads, size_t count, uint32_t stagger_ms);
+
+/**
+ * @brief Read temperature and humidity as float values
+ *
+ * @param sensor_type Type of DHT sensor
+ * @param pin GPIO pin connected to DHT sensor
+ * @param humidity Pointer to store humidity value (in %)
+ * @param temperature Pointer to store temperature value (in °C)
+ * @return ESP_OK on success, ESP_ERR_* on failure
+ */
+esp_err_t dht_read_float_data(dht_sensor_type_t sensor_type, gpio_num_t pin, float *humidity, float *temperature);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DHT_H
@@ -0,0 +1,155 @@
+/*
+    * DHT pulse train decoder
+    *
+    * Turns a list of captured line-level runs into the 5 DHT data bytes.
+    * Kept free of ESP-IDF headers so it can be built and exercised on the host
+    * against recorded waveforms.
+*/
+
+#include "dht_decode.h"
+
+// Cursor over the captured runs that merges adjacent runs of the same level.
+typedef struct {
+    const dht_level_t *runs;
+    size_t count;
+    size_t pos;
+} run_cursor_t;
+
+// Fetch the next merged run. Returns 0 when the capture is exhausted.
+static int next_run(run_cursor_t *c, uint8_t *level, uint32_t *duration_us)
+{
+    while (c->pos < c->count && c->runs[c->pos].duration_us == 0) {
+        c->pos++;
+    }
+    if (c->pos >= c->count) {
+        return 0;
+    }
+
+    *level = c->runs[c->pos].level;
+    *duration_us = 0;
+    while (c->pos < c->count &&
+           (c->runs[c->pos].level == *level || c->runs[c->pos].duration_us == 0)) {
+        *duration_us += c->runs[c->pos].duration_us;
+        c->pos++;
+    }
+    return 1;
+}
+
+static int in_range(uint32_t v, uint32_t lo, uint32_t hi)
+{
+    return v >= lo && v <= hi;
+}
+
+// Threshold for this frame: the nominal one, scaled by how long the sensor's preamble actually was
+static uint32_t bit_threshold_us(uint32_t preamble_low, uint32_t preamble_high)
+{
+    uint32_t t = (preamble_low + preamble_high) * DHT_BIT_THRESHOLD_US / (2 * DHT_PREAMBLE_NOMINAL_US);
+
+    if (t < DHT_BIT_THRESHOLD_MIN_US) {
+        return DHT_BIT_THRESHOLD_MIN_US;
+    }
+    return t > DHT_BIT_THRESHOLD_MAX_US ? DHT_BIT_THRESHOLD_MAX_US : t;
+}
+
+dht_decode_status_t dht_decode_pulses(const dht_level_t *runs, size_t count, uint8_t data[DHT_DATA_BYTES])
+{
+    return dht_decode_pulses_ex(runs, count, 0, data, NULL);
+}
+
+dht_decode_status_t dht_decode_pulses_ex(const dht_level_t *runs, size_t count, int adaptive,
+                                         uint8_t data[DHT_DATA_BYTES], dht_decode_timing_t *timing)
+{
+    run_cursor_t c = { .runs = runs, .count = count, .pos = 0 };
+    dht_decode_timing_t t = {0};
+    uint8_t level;
+    uint32_t duration;
+    uint32_t prev_low = 0;
+    uint32_t threshold;
+    uint32_t low_min = UINT32_MAX, low_max = 0;
+    uint32_t margin = UINT32_MAX;
+    dht_decode_status_t status = DHT_DECODE_OK;
+    int found = 0;
+
+    // Align on the sensor response: ~80us low followed by ~80us high.
+    while (!found && next_run(&c, &level, &duration)) {
+        if (level == 0) {
+            prev_low = duration;
+        } else if (in_range(prev_low, DHT_PREAMBLE_MIN_US, DHT_PREAMBLE_MAX_US) &&
+                   in_range(duration, DHT_PREAMBLE_MIN_US, DHT_PREAMBLE_MAX_US)) {
+            found = 1;
+            t.preamble_low_us = prev_low;
+            t.preamble_high_us = duration;
+        } else {
+            prev_low = 0;
+        }
+    }
+    if (!found) {
+        status = DHT_DECODE_NO_PREAMBLE;
+        goto out;
+    }
+    threshold = adaptive ? bit_threshold_us(t.preamble_low_us, t.preamble_high_us) : DHT_BIT_THRESHOLD_US;
+    t.threshold_us = threshold;
+
+    for (int i = 0; i < DHT_DATA_BITS; i++) {
+        uint32_t low, high;
+
+        if (!next_run(&c, &level, &low)) {
+            status = DHT_DECODE_SHORT;
+            goto out;
+        }
+        if (level != 0 || low > DHT_BIT_MAX_US) {
+            status = DHT_DECODE_BAD_PULSE;
+            goto out;
+        }
+        if (!next_run(&c, &level, &high)) {
+            status = DHT_DECODE_SHORT;
+            goto out;
+        }
+        if (level != 1 || high > DHT_BIT_MAX_US) {
+            status = DHT_DECODE_BAD_PULSE;
+            goto out;
+        }
+
+        uint8_t b = i / 8;
+        uint8_t m = i % 8;
+        if (!m) {
+            data[b] = 0;
+        }
+        data[b] |= (high > threshold) << (7 - m);
+
+        uint32_t d = high > threshold ? high - threshold : threshold - high;
+        margin = d < margin ? d : margin;
+        low_min = low < low_min ? low : low_min;
+        low_max = low > low_max ? low : low_max;
+        t.bits++;
+    }
+
+    if (!dht_checksum_ok(data)) {
+        status = DHT_DECODE_CHECKSUM;
+    }
+
+out:
+    if (timing) {
+        if (t.bits) {
+            t.margin_us = margin;
+            t.jitter_us = low_max - low_min;
+        }
+        *timing = t;
+    }
+    return status;
+}
+
+void dht_parse_data(dht_sensor_type_t sensor_type, const uint8_t data[DHT_DATA_BYTES],
+                    int16_t *humidity, int16_t *temperature)
+{
+    if (sensor_type == DHT_TYPE_DHT11) {
+        *humidity = data[0] * 10;
+        *temperature = data[2] * 10;
+    } else {    // For DHT22, AM2301.
+        *humidity = ((data[0] << 8) | data[1]);
+        *temperature = ((data[2] << 8) | data[3]);
+        if (*temperature & 0x8000) {
+            *temperature = -(*temperature & 0x7FFF);
+        }
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef DHT_DECODE_H
+#define DHT_DECODE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DHT_DATA_BITS 40
+#define DHT_DATA_BYTES 5
+
+// Preamble pulses from the sensor are ~80us; data bit lows are ~50us.
+#define DHT_PREAMBLE_NOMINAL_US 80
+#define DHT_PREAMBLE_MIN_US 60
+#define DHT_PREAMBLE_MAX_US 200
+// Data bit highs are ~26us for a 0 and ~70us for a 1.
+#define DHT_BIT_THRESHOLD_US 48
+#define DHT_BIT_MAX_US 120
+// An adaptive threshold stays within this range around DHT_BIT_THRESHOLD_US.
+#define DHT_BIT_THRESHOLD_MIN_US 36
+#define DHT_BIT_THRESHOLD_MAX_US 60
+
+// DHT sensor types
+typedef enum {
+    DHT_TYPE_DHT11,
+    DHT_TYPE_DHT22,
+    DHT_TYPE_AM2301
+} dht_sensor_type_t;
+
+// One run of constant line level, as recorded by the capture backend.
+typedef struct {
+    uint16_t duration_us;
+    uint8_t level;
+} dht_level_t;
+
+typedef enum {
+    DHT_DECODE_OK = 0,
+    DHT_DECODE_NO_PREAMBLE,
+    DHT_DECODE_SHORT,
+    DHT_DECODE_BAD_PULSE,
+    DHT_DECODE_CHECKSUM,
+} dht_decode_status_t;
+
+// Bit timing of a decoded pulse train, for judging how close a read came to failing.
+typedef struct {
+    uint16_t preamble_low_us;
+    uint16_t preamble_high_us;
+    uint16_t threshold_us;      // High time above which a bit is a 1
+    uint16_t margin_us;         // Smallest distance of any bit's high time from threshold_us
+    uint16_t jitter_us;         // Spread (max - min) of the bit lows, nominally all ~50us
+    uint8_t bits;               // Bits decoded; margin and jitter cover these
+} dht_decode_timing_t;
+
+/**
+ * @brief Decode a captured DHT pulse train into the 5 raw data bytes
+ *
+ * The capture may start anywhere before the sensor response; the decoder
+ * aligns on the 80us/80us preamble and then reads 40 low/high bit pairs.
+ * Adjacent runs with the same level are merged, so zero-length or split
+ * runs from the capture hardware are tolerated.
+ *
+ * This function has no ESP-IDF dependencies and builds on the host.
+ *
+ * @param runs Captured level runs in time order
+ * @param count Number of entries in runs
+ * @param data Output buffer for the 5 data bytes (including checksum)
+ * @return DHT_DECODE_OK if all bits were read and the checksum matches
+ */
+dht_decode_status_t dht_decode_pulses(const dht_level_t *runs, size_t count, uint8_t data[DHT_DATA_BYTES]);
+
+/**
+ * @brief Decode like dht_decode_pulses() and report the bit timing
+ *
+ * With adaptive set, the 0/1 threshold is scaled by the measured preamble
+ * against its nominal 80us, so a sensor whose clock runs fast or slow is
+ * judged against its own timing; the result is clamped to
+ * DHT_BIT_THRESHOLD_MIN_US..DHT_BIT_THRESHOLD_MAX_US. Otherwise the fixed
+ * DHT_BIT_THRESHOLD_US is used.
+ *
+ * @param timing Optional, filled in as far as decoding got
+ */
+dht_decode_status_t dht_decode_pulses_ex(const dht_level_t *runs, size_t count, int adaptive,
+                                         uint8_t data[DHT_DATA_BYTES], dht_decode_timing_t *timing);
+
+/**
+ * @brief Verify the checksum byte of a raw DHT frame
+ */
+static inline int dht_checksum_ok(const uint8_t data[DHT_DATA_BYTES])
+{
+    return data[4] == ((data[0] + data[1] + data[2] + data[3]) & 0xFF);
+}
+
+/**
+ * @brief Convert a checksummed DHT frame to fixed-point values
+ *
+ * @param sensor_type Type of DHT sensor that produced the frame
+ * @param data The 5 raw data bytes
+ * @param humidity Pointer to store humidity value (in 0.1%)
+ * @param temperature Pointer to store temperature value (in 0.1°C)
+ */
+void dht_parse_data(dht_sensor_type_t sensor_type, const uint8_t data[DHT_DATA_BYTES],
+                    int16_t *humidity, int16_t *temperature);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DHT_DECODE_H
@@ -0,0 +1,120 @@
+/*
+    * RMT based DHT capture backend
+    *
+    * Records the DHT response with the RMT receiver at 1us resolution instead
+    * of polling the pin from the CPU. The recorded runs are decoded afterwards
+    * by dht_decode_pulses().
+*/
+
+#include "dht_rmt.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/ringbuf.h"
+
+static const char* TAG = "DHT_RMT";
+
+// 80MHz APB / 80 = 1 tick per microsecond.
+#define DHT_RMT_CLK_DIV 80
+// The line idles high after the end pulse; stop the capture after 1ms of it.
+#define DHT_RMT_IDLE_US 1000
+// Ignore glitches shorter than ~1.25us (in APB ticks).
+#define DHT_RMT_FILTER_TICKS 100
+#define DHT_RMT_RINGBUF_SIZE 1024
+#define DHT_START_PULSE_MS 20
+
+esp_err_t dht_rmt_init(gpio_num_t pin, rmt_channel_t channel)
+{
+    rmt_config_t cfg = RMT_DEFAULT_CONFIG_RX(pin, channel);
+    cfg.clk_div = DHT_RMT_CLK_DIV;
+    cfg.mem_block_num = 1;
+    cfg.rx_config.idle_threshold = DHT_RMT_IDLE_US;
+    cfg.rx_config.filter_en = true;
+    cfg.rx_config.filter_ticks_thresh = DHT_RMT_FILTER_TICKS;
+
+    esp_err_t err = rmt_config(&cfg);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "rmt_config failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    err = rmt_driver_install(channel, DHT_RMT_RINGBUF_SIZE, 0);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "rmt_driver_install failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    // rmt_config() routes the pad as input only; keep the open-drain driver
+    // so the start pulse can still be sent on the same pin.
+    gpio_set_direction(pin, GPIO_MODE_INPUT_OUTPUT_OD);
+    gpio_set_level(pin, 1);
+
+    return ESP_OK;
+}
+
+void dht_rmt_begin(gpio_num_t pin, rmt_channel_t channel)
+{
+    rmt_rx_start(channel, true);
+    gpio_set_level(pin, 1);
+}
+
+esp_err_t dht_rmt_finish(rmt_channel_t channel, dht_level_t *runs, size_t max_runs, size_t *count,
+                         uint32_t timeout_ms, uint32_t *cpu_us)
+{
+    RingbufHandle_t rb = NULL;
+    size_t size = 0;
+    int64_t t0;
+
+    *count = 0;
+    if (rmt_get_ringbuf_handle(channel, &rb) != ESP_OK || rb == NULL) {
+        rmt_rx_stop(channel);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Phases 'B' to end are recorded by the peripheral.
+    rmt_item32_t *items = (rmt_item32_t *)xRingbufferReceive(rb, &size, pdMS_TO_TICKS(timeout_ms));
+    t0 = esp_timer_get_time();
+    rmt_rx_stop(channel);
+    if (items == NULL) {
+        if (cpu_us) {
+            *cpu_us = (uint32_t)(esp_timer_get_time() - t0);
+        }
+        return ESP_ERR_TIMEOUT;
+    }
+
+    size_t n_items = size / sizeof(rmt_item32_t);
+    for (size_t i = 0; i < n_items && *count + 2 <= max_runs; i++) {
+        runs[(*count)++] = (dht_level_t){ .duration_us = items[i].duration0, .level = items[i].level0 };
+        runs[(*count)++] = (dht_level_t){ .duration_us = items[i].duration1, .level = items[i].level1 };
+    }
+    vRingbufferReturnItem(rb, items);
+    if (cpu_us) {
+        *cpu_us = (uint32_t)(esp_timer_get_time() - t0);
+    }
+
+    ESP_LOGD(TAG, "Captured %u RMT items on channel %d", (unsigned)n_items, channel);
+    return ESP_OK;
+}
+
+esp_err_t dht_rmt_capture(gpio_num_t pin, rmt_channel_t channel,
+                          dht_level_t *runs, size_t max_runs, size_t *count,
+                          uint32_t *cpu_us)
+{
+    uint32_t finish_us = 0;
+    int64_t t0;
+
+    // Phase 'A': hold the line low; the task sleeps rather than spinning.
+    gpio_set_level(pin, 0);
+    vTaskDelay(pdMS_TO_TICKS(DHT_START_PULSE_MS));
+
+    t0 = esp_timer_get_time();
+    dht_rmt_begin(pin, channel);
+    uint32_t begin_us = (uint32_t)(esp_timer_get_time() - t0);
+
+    esp_err_t result = dht_rmt_finish(channel, runs, max_runs, count, DHT_RMT_RX_TIMEOUT_MS, &finish_us);
+
+    if (cpu_us) {
+        *cpu_us = begin_us + finish_us;
+    }
+    return result;
+}
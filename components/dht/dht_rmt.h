@@ -0,0 +1,75 @@
+#ifndef DHT_RMT_H
+#define DHT_RMT_H
+
+#include "esp_err.h"
+#include "driver/gpio.h"
+#include "driver/rmt.h"
+#include "dht_decode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Enough room for a stray edge, the preamble, 40 bits and the end pulse.
+#define DHT_RMT_MAX_RUNS 96
+// A full response takes ~5ms; allow for scheduling latency.
+#define DHT_RMT_RX_TIMEOUT_MS 20
+
+/**
+ * @brief Configure an RMT RX channel to timestamp edges on a DHT data pin
+ *
+ * The pin is left in open-drain input/output mode so the start pulse can be
+ * driven through GPIO while RMT records the response.
+ *
+ * @param pin GPIO pin connected to the DHT data line
+ * @param channel RMT channel reserved for this sensor
+ * @return ESP_OK on success, ESP_ERR_* on failure
+ */
+esp_err_t dht_rmt_init(gpio_num_t pin, rmt_channel_t channel);
+
+/**
+ * @brief Send the start pulse and capture the sensor response with RMT
+ *
+ * The 20ms start pulse is a task delay and the response is recorded by the
+ * RMT peripheral, so the CPU is free for the whole read.
+ *
+ * @param pin GPIO pin connected to the DHT data line
+ * @param channel RMT channel passed to dht_rmt_init()
+ * @param runs Output buffer for the captured level runs
+ * @param max_runs Capacity of runs
+ * @param count Number of runs written
+ * @param cpu_us Optional, CPU time spent outside of blocking waits (in us)
+ * @return ESP_OK on success, ESP_ERR_TIMEOUT if nothing was captured
+ */
+esp_err_t dht_rmt_capture(gpio_num_t pin, rmt_channel_t channel,
+                          dht_level_t *runs, size_t max_runs, size_t *count,
+                          uint32_t *cpu_us);
+
+/**
+ * @brief End the start pulse and arm the RMT receiver
+ *
+ * Split out of dht_rmt_capture() so several sensors can have their start
+ * pulses and responses in flight at the same time. The caller must have
+ * held the line low for the start pulse duration.
+ */
+void dht_rmt_begin(gpio_num_t pin, rmt_channel_t channel);
+
+/**
+ * @brief Wait for the capture armed by dht_rmt_begin() and copy it out
+ *
+ * @param channel RMT channel passed to dht_rmt_begin()
+ * @param runs Output buffer for the captured level runs
+ * @param max_runs Capacity of runs
+ * @param count Number of runs written
+ * @param timeout_ms How long to wait for the capture to complete
+ * @param cpu_us Optional, CPU time spent after the capture completed (in us)
+ * @return ESP_OK on success, ESP_ERR_TIMEOUT if nothing was captured
+ */
+esp_err_t dht_rmt_finish(rmt_channel_t channel, dht_level_t *runs, size_t max_runs, size_t *count,
+                         uint32_t timeout_ms, uint32_t *cpu_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DHT_RMT_H
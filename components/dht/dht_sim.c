@@ -0,0 +1,126 @@
+/*
+    * Virtual DHT sensor
+    *
+    * Produces the pulse train of a DHT11/DHT22 response for given values, with optional timing
+    * jitter, missing bits, corrupted bits and implausible spikes, so the decoder and everything
+    * above it can be exercised without a sensor on the pin. Kept free of ESP-IDF headers like
+    * dht_decode.c.
+*/
+
+#include "dht_sim.h"
+
+// Nominal pulse lengths of a DHT response
+#define SIM_RELEASE_US      30      // Pull-up after the host releases the line
+#define SIM_PREAMBLE_US     80
+#define SIM_BIT_LOW_US      50
+#define SIM_BIT_ZERO_US     26
+#define SIM_BIT_ONE_US      70
+
+static uint32_t next_rand(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static int chance(uint32_t *rng, uint16_t permille)
+{
+    return permille && next_rand(rng) % 1000 < permille;
+}
+
+static uint16_t jittered(uint32_t *rng, uint16_t us, uint16_t jitter)
+{
+    if (jitter == 0) {
+        return us;
+    }
+    int32_t v = (int32_t)us + (int32_t)(next_rand(rng) % (2u * jitter + 1)) - jitter;
+    return v > 1 ? (uint16_t)v : 1;
+}
+
+void dht_sim_encode(dht_sensor_type_t sensor_type, int16_t humidity, int16_t temperature,
+                    uint8_t data[DHT_DATA_BYTES])
+{
+    if (sensor_type == DHT_TYPE_DHT11) {
+        // Integer part in bytes 0 and 2; the decimal bytes are ignored by the parser
+        data[0] = (uint8_t)(humidity / 10);
+        data[1] = (uint8_t)(humidity % 10);
+        data[2] = (uint8_t)(temperature / 10);
+        data[3] = (uint8_t)(temperature % 10);
+    } else {
+        uint16_t t = temperature < 0 ? (uint16_t)(0x8000 | -temperature) : (uint16_t)temperature;
+        data[0] = (uint8_t)(humidity >> 8);
+        data[1] = (uint8_t)humidity;
+        data[2] = (uint8_t)(t >> 8);
+        data[3] = (uint8_t)t;
+    }
+    data[4] = (uint8_t)(data[0] + data[1] + data[2] + data[3]);
+}
+
+void dht_sim_values(const dht_sim_config_t *config, uint64_t t_ms, int16_t *humidity, int16_t *temperature)
+{
+    int32_t phase = 0;              // -1000..1000 along the triangle wave
+
+    if (config->period_s) {
+        uint64_t period_ms = (uint64_t)config->period_s * 1000;
+        uint32_t pos = (uint32_t)(t_ms % period_ms * 4000 / period_ms);    // 0..3999
+        phase = pos < 1000 ? (int32_t)pos :
+                pos < 3000 ? 2000 - (int32_t)pos :
+                (int32_t)pos - 4000;
+    }
+    *temperature = (int16_t)(config->temperature + config->temperature_swing * phase / 1000);
+    *humidity = (int16_t)(config->humidity + config->humidity_swing * phase / 1000);
+}
+
+size_t dht_sim_waveform(dht_sensor_type_t sensor_type, int16_t humidity, int16_t temperature,
+                        const dht_sim_faults_t *faults, uint32_t *rng, dht_level_t *runs, size_t max_runs)
+{
+    static const dht_sim_faults_t none = { 0 };
+    uint8_t data[DHT_DATA_BYTES];
+    size_t n = 0;
+    int dropped = -1;
+
+    if (faults == NULL) {
+        faults = &none;
+    }
+    if (max_runs < 2 * DHT_DATA_BITS + 4) {
+        return 0;
+    }
+
+    runs[n++] = (dht_level_t){ .duration_us = SIM_RELEASE_US, .level = 1 };
+    if (chance(rng, faults->no_response)) {
+        return n;
+    }
+
+    if (chance(rng, faults->spike)) {
+        temperature += 400;         // +40°C, decodes fine but should be caught by filtering
+    }
+    dht_sim_encode(sensor_type, humidity, temperature, data);
+    if (chance(rng, faults->bad_checksum)) {
+        data[next_rand(rng) % 4] ^= (uint8_t)(1u << (next_rand(rng) % 8));
+    }
+    if (chance(rng, faults->dropped_bit)) {
+        dropped = (int)(next_rand(rng) % DHT_DATA_BITS);
+    }
+
+    runs[n++] = (dht_level_t){ .duration_us = jittered(rng, SIM_PREAMBLE_US, faults->jitter_us), .level = 0 };
+    runs[n++] = (dht_level_t){ .duration_us = jittered(rng, SIM_PREAMBLE_US, faults->jitter_us), .level = 1 };
+
+    for (int i = 0; i < DHT_DATA_BITS; i++) {
+        if (i == dropped) {
+            continue;
+        }
+        int one = (data[i / 8] >> (7 - i % 8)) & 1;
+        runs[n++] = (dht_level_t){ .duration_us = jittered(rng, SIM_BIT_LOW_US, faults->jitter_us), .level = 0 };
+        runs[n++] = (dht_level_t){
+            .duration_us = jittered(rng, one ? SIM_BIT_ONE_US : SIM_BIT_ZERO_US, faults->jitter_us),
+            .level = 1,
+        };
+    }
+
+    // End of frame: the sensor pulls low once more, then releases the line
+    runs[n++] = (dht_level_t){ .duration_us = jittered(rng, SIM_BIT_LOW_US, faults->jitter_us), .level = 0 };
+    return n;
+}
@@ -0,0 +1,59 @@
+#ifndef DHT_SIM_H
+#define DHT_SIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "dht_decode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Fault injection for simulated reads; chances are per read, in 1/1000
+typedef struct {
+    uint16_t jitter_us;             // Each pulse is off by up to +/- this much
+    uint16_t no_response;           // Sensor does not answer at all
+    uint16_t dropped_bit;           // One bit's pulses are missing
+    uint16_t bad_checksum;          // One data bit is flipped on the wire
+    uint16_t spike;                 // A valid frame with a wildly wrong value
+} dht_sim_faults_t;
+
+// A virtual sensor: the true values move on a triangle wave around a base
+typedef struct {
+    int16_t temperature;            // Base value, in 0.1°C
+    int16_t humidity;               // Base value, in 0.1%
+    int16_t temperature_swing;      // Peak deviation from the base, in 0.1°C
+    int16_t humidity_swing;         // Peak deviation from the base, in 0.1%
+    uint32_t period_s;              // Period of the triangle wave; 0 = constant
+    dht_sim_faults_t faults;
+} dht_sim_config_t;
+
+/**
+ * @brief Encode values into a 5-byte frame as the given sensor type sends it
+ */
+void dht_sim_encode(dht_sensor_type_t sensor_type, int16_t humidity, int16_t temperature,
+                    uint8_t data[DHT_DATA_BYTES]);
+
+/**
+ * @brief True values of a virtual sensor at a point in time
+ */
+void dht_sim_values(const dht_sim_config_t *config, uint64_t t_ms, int16_t *humidity, int16_t *temperature);
+
+/**
+ * @brief Generate the level runs a sensor would drive for one read
+ *
+ * The output has the same shape as an RMT or polled capture, so it goes
+ * through dht_decode_pulses() unchanged. Like the decoder, this has no
+ * ESP-IDF dependencies and builds on the host.
+ *
+ * @param rng xorshift32 state, must not be 0; advanced by the call
+ * @return Number of runs written to runs
+ */
+size_t dht_sim_waveform(dht_sensor_type_t sensor_type, int16_t humidity, int16_t temperature,
+                        const dht_sim_faults_t *faults, uint32_t *rng, dht_level_t *runs, size_t max_runs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DHT_SIM_H
@@ -0,0 +1,211 @@
+/*
+    * Simulated DHT bus: GPIO, the RMT receiver and virtual sensors, for the host tests
+    *
+    * Each pin can have a virtual sensor from dht_sim.c attached. Holding its line low for at least
+    * SHIM_DHT_MIN_START_US and releasing it makes the sensor answer with the waveform dht_sim_waveform()
+    * generates; an RMT channel receiving on that pin at the time gets it as items, available once the
+    * line has been idle for the channel's idle threshold. Every start pulse is recorded so tests can
+    * check what the sensors were sent.
+*/
+
+#include <string.h>
+#include "driver/gpio.h"
+#include "driver/rmt.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "rom/ets_sys.h"
+#include "dht_line.h"
+#include "shim.h"
+
+#define SHIM_DHT_MIN_START_US   18000   // DHT11 datasheet; the DHT22 needs less
+#define SHIM_DHT_MAX_RUNS       96
+#define SHIM_RMT_IDLE_US        1000    // What dht_rmt.c configures
+
+struct shim_ringbuf {
+    rmt_item32_t items[SHIM_DHT_MAX_RUNS / 2];
+    size_t size;                        // In bytes, 0 = nothing received
+    int64_t ready_us;
+};
+
+static struct {
+    const dht_sim_config_t *sim;
+    dht_sensor_type_t type;
+    uint32_t rng;
+    int level;
+    int64_t low_since_us;
+    shim_dht_pin_stats_t stats;
+} s_pins[GPIO_NUM_MAX];
+
+static struct {
+    gpio_num_t pin;
+    bool installed;
+    bool receiving;
+    struct shim_ringbuf rb;
+} s_rmt[RMT_CHANNEL_MAX];
+
+void shim_dht_attach(gpio_num_t pin, dht_sensor_type_t type, const dht_sim_config_t *sim)
+{
+    s_pins[pin].sim = sim;
+    s_pins[pin].type = type;
+    s_pins[pin].rng = 0x2545F491u ^ (uint32_t)pin;
+    s_pins[pin].level = 1;
+}
+
+void shim_dht_pin_stats(gpio_num_t pin, shim_dht_pin_stats_t *stats)
+{
+    *stats = s_pins[pin].stats;
+}
+
+// The sensor on pin starts its answer now; a receiving channel on the pin records it
+static void respond(gpio_num_t pin)
+{
+    dht_level_t runs[SHIM_DHT_MAX_RUNS];
+    int16_t humidity, temperature;
+    int64_t now = esp_timer_get_time();
+
+    dht_sim_values(s_pins[pin].sim, (uint64_t)now / 1000, &humidity, &temperature);
+    size_t n = dht_sim_waveform(s_pins[pin].type, humidity, temperature, &s_pins[pin].sim->faults,
+                                &s_pins[pin].rng, runs, SHIM_DHT_MAX_RUNS);
+    s_pins[pin].stats.responses += n > 1;
+
+    for (size_t ch = 0; ch < RMT_CHANNEL_MAX; ch++) {
+        struct shim_ringbuf *rb = &s_rmt[ch].rb;
+        if (!s_rmt[ch].receiving || s_rmt[ch].pin != pin || n <= 1) {
+            continue;
+        }
+        int64_t duration_us = 0;
+        size_t items = 0;
+        for (size_t i = 0; i < n; i += 2) {
+            bool pair = i + 1 < n;
+            rb->items[items++] = (rmt_item32_t){
+                .duration0 = runs[i].duration_us, .level0 = runs[i].level,
+                .duration1 = pair ? runs[i + 1].duration_us : 0, .level1 = pair ? runs[i + 1].level : 1,
+            };
+            duration_us += runs[i].duration_us + (pair ? runs[i + 1].duration_us : 0);
+        }
+        rb->size = items * sizeof(rmt_item32_t);
+        rb->ready_us = now + duration_us + SHIM_RMT_IDLE_US;
+    }
+}
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t mode)
+{
+    return pin >= 0 && pin < GPIO_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (pin < 0 || pin >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (level == 0 && s_pins[pin].level == 1) {
+        s_pins[pin].low_since_us = now;
+    } else if (level && s_pins[pin].level == 0) {
+        shim_dht_pin_stats_t *st = &s_pins[pin].stats;
+        uint32_t low_us = (uint32_t)(now - s_pins[pin].low_since_us);
+        st->start_pulses++;
+        if (st->start_pulses == 1 || low_us < st->min_start_us) {
+            st->min_start_us = low_us;
+        }
+        if (low_us > st->max_start_us) {
+            st->max_start_us = low_us;
+        }
+        if (s_pins[pin].sim && low_us >= SHIM_DHT_MIN_START_US) {
+            s_pins[pin].level = 1;
+            respond(pin);
+        }
+    }
+    s_pins[pin].level = level ? 1 : 0;
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t pin)
+{
+    // Polled reads see an idle line and time out
+    return pin >= 0 && pin < GPIO_NUM_MAX ? s_pins[pin].level : 0;
+}
+
+esp_err_t gpio_sleep_sel_dis(gpio_num_t pin)
+{
+    return ESP_OK;
+}
+
+esp_err_t rmt_config(const rmt_config_t *config)
+{
+    if (config->channel >= RMT_CHANNEL_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_rmt[config->channel].pin = config->gpio_num;
+    return ESP_OK;
+}
+
+esp_err_t rmt_driver_install(rmt_channel_t channel, size_t rx_buf_size, int intr_alloc_flags)
+{
+    if (channel >= RMT_CHANNEL_MAX || s_rmt[channel].installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_rmt[channel].installed = true;
+    return ESP_OK;
+}
+
+esp_err_t rmt_rx_start(rmt_channel_t channel, bool rx_idx_rst)
+{
+    s_rmt[channel].receiving = true;
+    s_rmt[channel].rb.size = 0;
+    return ESP_OK;
+}
+
+esp_err_t rmt_rx_stop(rmt_channel_t channel)
+{
+    s_rmt[channel].receiving = false;
+    return ESP_OK;
+}
+
+esp_err_t rmt_get_ringbuf_handle(rmt_channel_t channel, RingbufHandle_t *buf_handle)
+{
+    *buf_handle = s_rmt[channel].installed ? &s_rmt[channel].rb : NULL;
+    return ESP_OK;
+}
+
+void *xRingbufferReceive(RingbufHandle_t rb, size_t *item_size, TickType_t wait)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (rb->size == 0 || rb->ready_us > now + (int64_t)wait * 1000) {
+        vTaskDelay(wait);
+        return NULL;
+    }
+    if (rb->ready_us > now) {
+        shim_time_advance(rb->ready_us - now);
+    }
+    *item_size = rb->size;
+    rb->size = 0;
+    return rb->items;
+}
+
+void vRingbufferReturnItem(RingbufHandle_t rb, void *item)
+{
+}
+
+uint32_t esp_cpu_get_ccount(void)
+{
+    return (uint32_t)(esp_timer_get_time() * 240);
+}
+
+void ets_delay_us(uint32_t us)
+{
+    shim_time_advance(us);
+}
+
+uint32_t ets_get_cpu_frequency(void)
+{
+    return 240;
+}
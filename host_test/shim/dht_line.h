@@ -0,0 +1,24 @@
+#ifndef SHIM_DHT_LINE_H
+#define SHIM_DHT_LINE_H
+
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "dht_sim.h"
+
+// Controls for the simulated DHT bus in dht_line.c, used by the tests only
+
+typedef struct {
+    uint32_t start_pulses;          // Times the line was pulled low and released
+    uint32_t min_start_us;          // Shortest and longest of those low times
+    uint32_t max_start_us;
+    uint32_t responses;             // Times the virtual sensor answered
+} shim_dht_pin_stats_t;
+
+/**
+ * @brief Put a virtual sensor on a pin; sim must stay valid
+ */
+void shim_dht_attach(gpio_num_t pin, dht_sensor_type_t type, const dht_sim_config_t *sim);
+
+void shim_dht_pin_stats(gpio_num_t pin, shim_dht_pin_stats_t *stats);
+
+#endif // SHIM_DHT_LINE_H
@@ -0,0 +1,6 @@
+#ifndef SHIM_ESP32_PM_H
+#define SHIM_ESP32_PM_H
+
+// esp_pm_config_esp32_t is only used under CONFIG_PM_ENABLE, which the host build does not set
+
+#endif // SHIM_ESP32_PM_H
@@ -0,0 +1,9 @@
+#ifndef SHIM_ESP_ATTR_H
+#define SHIM_ESP_ATTR_H
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+
+#endif // SHIM_ESP_ATTR_H
@@ -0,0 +1,9 @@
+#ifndef SHIM_ESP_CPU_H
+#define SHIM_ESP_CPU_H
+
+#include <stdint.h>
+
+// Cycle counter at 240 MHz off the simulated clock
+uint32_t esp_cpu_get_ccount(void);
+
+#endif // SHIM_ESP_CPU_H
@@ -0,0 +1,29 @@
+#ifndef SHIM_ESP_EVENT_H
+#define SHIM_ESP_EVENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+// The default event loop without its task: esp_event_post() calls the matching handlers
+// right away, in the poster's context (see wifi.c)
+typedef const char *esp_event_base_t;
+typedef void *esp_event_handler_instance_t;
+typedef void (*esp_event_handler_t)(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data);
+
+#define ESP_EVENT_ANY_ID        -1
+
+#define ESP_EVENT_DECLARE_BASE(id)  extern esp_event_base_t const id
+#define ESP_EVENT_DEFINE_BASE(id)   esp_event_base_t const id = #id
+
+esp_err_t esp_event_loop_create_default(void);
+esp_err_t esp_event_handler_register(esp_event_base_t base, int32_t event_id,
+                                     esp_event_handler_t handler, void *handler_arg);
+esp_err_t esp_event_handler_instance_register(esp_event_base_t base, int32_t event_id,
+                                              esp_event_handler_t handler, void *handler_arg,
+                                              esp_event_handler_instance_t *instance);
+esp_err_t esp_event_post(esp_event_base_t base, int32_t event_id, const void *event_data,
+                         size_t event_data_size, TickType_t ticks_to_wait);
+
+#endif // SHIM_ESP_EVENT_H
@@ -0,0 +1,13 @@
+#ifndef SHIM_ESP_FREERTOS_HOOKS_H
+#define SHIM_ESP_FREERTOS_HOOKS_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+// The idle hook runs each time the host scheduler finds no task ready (see tasks.c)
+typedef bool (*esp_freertos_idle_cb_t)(void);
+
+esp_err_t esp_register_freertos_idle_hook_for_cpu(esp_freertos_idle_cb_t new_idle_cb, UBaseType_t cpuid);
+
+#endif // SHIM_ESP_FREERTOS_HOOKS_H
@@ -0,0 +1,14 @@
+#ifndef SHIM_ESP_HEAP_CAPS_H
+#define SHIM_ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// There is no ESP heap on the host: the figures are fixed, so heap drift always reads 0
+#define MALLOC_CAP_8BIT         (1 << 2)
+
+size_t heap_caps_get_free_size(uint32_t caps);
+size_t heap_caps_get_minimum_free_size(uint32_t caps);
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+#endif // SHIM_ESP_HEAP_CAPS_H
@@ -0,0 +1,35 @@
+#ifndef SHIM_ESP_LOG_H
+#define SHIM_ESP_LOG_H
+
+#include <stdint.h>
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+// Messages up to this level are printed to stderr; ESP_LOG_WARN unless HOST_TEST_LOG=info|debug
+void shim_log(esp_log_level_t level, const char *tag, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// For dlog.c: the raw writer (no prefix, no newline) and the millisecond timestamp
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+uint32_t esp_log_timestamp(void);
+
+// Per-tag levels as in IDF, ESP_LOG_INFO (the default CONFIG_LOG_DEFAULT_LEVEL) unless set
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+esp_log_level_t esp_log_level_get(const char *tag);
+
+#define ESP_LOGE(tag, format, ...) shim_log(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) shim_log(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) shim_log(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) shim_log(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) shim_log(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+#endif // SHIM_ESP_LOG_H
@@ -0,0 +1,15 @@
+#ifndef SHIM_ESP_MAC_H
+#define SHIM_ESP_MAC_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum {
+    ESP_MAC_WIFI_STA,
+    ESP_MAC_WIFI_SOFTAP,
+} esp_mac_type_t;
+
+// A fixed locally administered address
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type);
+
+#endif // SHIM_ESP_MAC_H
@@ -0,0 +1,19 @@
+#ifndef SHIM_ESP_PM_H
+#define SHIM_ESP_PM_H
+
+#include "esp_err.h"
+
+// Power management locks only count acquisitions; see shim_pm_locks_held() in shim.h
+typedef enum {
+    ESP_PM_CPU_FREQ_MAX,
+    ESP_PM_APB_FREQ_MAX,
+    ESP_PM_NO_LIGHT_SLEEP,
+} esp_pm_lock_type_t;
+
+typedef struct shim_pm_lock *esp_pm_lock_handle_t;
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char *name, esp_pm_lock_handle_t *out_handle);
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle);
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle);
+
+#endif // SHIM_ESP_PM_H
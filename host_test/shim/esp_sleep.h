@@ -0,0 +1,11 @@
+#ifndef SHIM_ESP_SLEEP_H
+#define SHIM_ESP_SLEEP_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Declared for main.c's duty-cycle mode, which the host tests do not build
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us);
+void esp_deep_sleep_start(void);
+
+#endif // SHIM_ESP_SLEEP_H
@@ -0,0 +1,16 @@
+#ifndef SHIM_ESP_SYSTEM_H
+#define SHIM_ESP_SYSTEM_H
+
+#include <stdint.h>
+
+// Deterministic: a fixed-seed xorshift32, reseeded with shim_random_seed()
+uint32_t esp_random(void);
+
+// Fixed figures; there is no ESP heap on the host (see esp_heap_caps.h)
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+
+// Counted instead of restarting; see shim_ota_get_stats() in shim.h
+void esp_restart(void);
+
+#endif // SHIM_ESP_SYSTEM_H
@@ -0,0 +1,187 @@
+/*
+    * RAM-backed flash partition and NVS for the host tests
+    *
+    * The partition enforces what NOR flash does: a write can only clear bits (a write that would
+    * set one is counted as a violation and ANDed in, as the hardware would), and erases cover whole
+    * sectors. NVS is a small table of namespace/key/value entries.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_partition.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "shim.h"
+
+#define SECTOR_SIZE     4096
+#define NVS_ENTRIES     32
+#define NVS_VALUE_MAX   64
+
+static esp_partition_t s_part;
+static uint8_t *s_flash;
+static shim_flash_stats_t s_flash_stats;
+
+static struct {
+    char ns[16];
+    char key[16];
+    uint8_t value[NVS_VALUE_MAX];
+    size_t len;
+} s_nvs[NVS_ENTRIES];
+static const char *s_nvs_open_ns[8];
+static size_t s_nvs_handles;
+
+void shim_partition_create(const char *label, int subtype, uint32_t size)
+{
+    free(s_flash);
+    s_flash = malloc(size);
+    memset(s_flash, 0xFF, size);
+    s_part = (esp_partition_t){ .type = ESP_PARTITION_TYPE_DATA, .subtype = subtype, .size = size };
+    strncpy(s_part.label, label, sizeof(s_part.label) - 1);
+    memset(&s_flash_stats, 0, sizeof(s_flash_stats));
+}
+
+uint8_t *shim_partition_data(void)
+{
+    return s_flash;
+}
+
+void shim_flash_get_stats(shim_flash_stats_t *stats)
+{
+    *stats = s_flash_stats;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    if (s_flash == NULL || type != s_part.type || subtype != s_part.subtype ||
+        (label && strcmp(label, s_part.label) != 0)) {
+        return NULL;
+    }
+    return &s_part;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t size)
+{
+    if (offset + size > part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, s_flash + offset, size);
+    s_flash_stats.reads++;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t offset, const void *src, size_t size)
+{
+    const uint8_t *p = src;
+
+    if (offset + size > part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    for (size_t i = 0; i < size; i++) {
+        if (p[i] & ~s_flash[offset + i]) {
+            s_flash_stats.bit_set_violations++;
+        }
+        s_flash[offset + i] &= p[i];
+    }
+    s_flash_stats.writes++;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t size)
+{
+    if (offset % SECTOR_SIZE || size % SECTOR_SIZE || offset + size > part->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(s_flash + offset, 0xFF, size);
+    s_flash_stats.erases += size / SECTOR_SIZE;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    memset(s_nvs, 0, sizeof(s_nvs));
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *out)
+{
+    if (s_nvs_handles == sizeof(s_nvs_open_ns) / sizeof(s_nvs_open_ns[0])) {
+        s_nvs_handles = 0;
+    }
+    s_nvs_open_ns[s_nvs_handles] = name;
+    *out = (nvs_handle_t)++s_nvs_handles;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return ESP_OK;
+}
+
+static int nvs_find(nvs_handle_t handle, const char *key, bool create)
+{
+    const char *ns = s_nvs_open_ns[handle - 1];
+
+    for (int i = 0; i < NVS_ENTRIES; i++) {
+        if (s_nvs[i].key[0] && strcmp(s_nvs[i].ns, ns) == 0 && strcmp(s_nvs[i].key, key) == 0) {
+            return i;
+        }
+    }
+    for (int i = 0; create && i < NVS_ENTRIES; i++) {
+        if (!s_nvs[i].key[0]) {
+            strncpy(s_nvs[i].ns, ns, sizeof(s_nvs[i].ns) - 1);
+            strncpy(s_nvs[i].key, key, sizeof(s_nvs[i].key) - 1);
+            return i;
+        }
+    }
+    return -1;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *length)
+{
+    int i = nvs_find(handle, key, false);
+
+    if (i < 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (out) {
+        if (*length < s_nvs[i].len) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(out, s_nvs[i].value, s_nvs[i].len);
+    }
+    *length = s_nvs[i].len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    int i = nvs_find(handle, key, true);
+
+    if (i < 0 || length > NVS_VALUE_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(s_nvs[i].value, value, length);
+    s_nvs[i].len = length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out)
+{
+    size_t len = sizeof(*out);
+    return nvs_get_blob(handle, key, out, &len);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    return nvs_set_blob(handle, key, &value, sizeof(value));
+}
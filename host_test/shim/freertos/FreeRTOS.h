@@ -0,0 +1,46 @@
+#ifndef SHIM_FREERTOS_H
+#define SHIM_FREERTOS_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+// One tick per millisecond, as CONFIG_FREERTOS_HZ=1000 in sdkconfig.defaults
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint8_t StackType_t;
+
+#define pdFALSE                 0
+#define pdTRUE                  1
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+#define portMAX_DELAY           UINT32_MAX
+#define configTICK_RATE_HZ      1000
+#define portTICK_PERIOD_MS      1
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms))
+#define portNUM_PROCESSORS      1
+#define tskNO_AFFINITY          0x7FFFFFFF
+#define PRO_CPU_NUM             0
+#define APP_CPU_NUM             1
+
+// Critical sections are no-ops: the modules built here only use them around pin polling.
+// There is one core, so code runs on core 0.
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED    { 0 }
+#define portENTER_CRITICAL(mux)         ((void)(mux))
+#define portEXIT_CRITICAL(mux)          ((void)(mux))
+#define xPortGetCoreID()                PRO_CPU_NUM
+
+#define BIT0    0x01
+#define BIT1    0x02
+#define BIT2    0x04
+#define BIT3    0x08
+#define BIT4    0x10
+
+typedef struct {
+    pthread_mutex_t mutex;
+} StaticSemaphore_t;
+
+#endif // SHIM_FREERTOS_H
@@ -0,0 +1,23 @@
+#ifndef SHIM_EVENT_GROUPS_H
+#define SHIM_EVENT_GROUPS_H
+
+#include "freertos/FreeRTOS.h"
+
+// Without running tasks a wait that is not satisfied advances the simulated clock by its
+// timeout, like the queues; with them it blocks the task until the bits are set
+typedef uint32_t EventBits_t;
+
+typedef struct {
+    EventBits_t bits;
+} StaticEventGroup_t;
+
+typedef StaticEventGroup_t *EventGroupHandle_t;
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buf);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks_to_wait);
+
+#endif // SHIM_EVENT_GROUPS_H
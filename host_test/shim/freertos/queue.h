@@ -0,0 +1,27 @@
+#ifndef SHIM_QUEUE_H
+#define SHIM_QUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+
+// Fixed-size FIFO of copied items, safe across threads. Until shim_tasks_start(), waiting on an
+// empty queue advances the simulated clock by the timeout, as there is no one to fill it
+// meanwhile; after it the task blocks until an item arrives or the timeout passes.
+typedef struct {
+    pthread_mutex_t mutex;
+    uint8_t *storage;
+    size_t item_size;
+    size_t length;
+    size_t head;
+    size_t count;
+} StaticQueue_t;
+
+typedef StaticQueue_t *QueueHandle_t;
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *buf);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#endif // SHIM_QUEUE_H
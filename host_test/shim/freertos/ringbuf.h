@@ -0,0 +1,13 @@
+#ifndef SHIM_RINGBUF_H
+#define SHIM_RINGBUF_H
+
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+
+// Only the RMT receive buffers of dht_line.c; one item at a time
+typedef struct shim_ringbuf *RingbufHandle_t;
+
+void *xRingbufferReceive(RingbufHandle_t ringbuf, size_t *item_size, TickType_t wait);
+void vRingbufferReturnItem(RingbufHandle_t ringbuf, void *item);
+
+#endif // SHIM_RINGBUF_H
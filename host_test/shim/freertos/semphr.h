@@ -0,0 +1,15 @@
+#ifndef SHIM_SEMPHR_H
+#define SHIM_SEMPHR_H
+
+#include "freertos/FreeRTOS.h"
+
+// Mutexes only; the firmware modules built on the host use no counting semaphores.
+// Once tasks run (shim_tasks_start()), a task that finds one taken blocks until it is given.
+typedef StaticSemaphore_t *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buf);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+
+#endif // SHIM_SEMPHR_H
@@ -0,0 +1,447 @@
+/*
+    * esp_http_server stand-in for the host tests
+    *
+    * A connection is an in-memory socket: what the server sends piles up until the test reads it,
+    * and a send that would take the unread bytes past the connection's window is cut short or fails
+    * with HTTPD_SOCK_ERR_TIMEOUT, like a full socket buffer. Handlers run when the test makes a
+    * request; queued work and session closes run when the test calls shim_httpd_run(), which stands
+    * for the httpd task getting back to its loop. shim_httpd_call() routes a request to the handler
+    * the firmware registered for its path and method, or answers 404 like the server would.
+*/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "esp_http_server.h"
+#include "esp_timer.h"
+#include "shim.h"
+
+#define CONNS_MAX       64
+#define FD_BASE         54              // lwIP numbers its sockets from LWIP_SOCKET_OFFSET
+#define OUT_MAX         65536
+#define WORK_MAX        32
+#define URI_MAX         24
+
+typedef struct {
+    bool open;
+    bool closing;                       // Close triggered; done by the next shim_httpd_run()
+    size_t window;
+    char *out;
+    size_t out_len;
+    char status[48];
+    char resp_headers[256];             // Set by the handler for its next response
+    size_t resp_headers_len;
+    const char *headers;                // Request headers, "Name: value\n" lines
+    const char *body;
+    size_t body_len;
+    size_t body_pos;
+    uint32_t recv_us_per_kb;            // Simulated upload speed
+    void *sess_ctx;
+    httpd_free_ctx_fn_t free_ctx;
+} conn_t;
+
+static conn_t s_conns[CONNS_MAX];
+static int s_server;
+static struct {
+    httpd_work_fn_t fn;
+    void *arg;
+} s_work[WORK_MAX];
+static size_t s_work_count;
+static httpd_uri_t s_uris[URI_MAX];
+static size_t s_uri_count;
+static size_t s_uri_limit = URI_MAX;
+
+static conn_t *conn_of(int fd)
+{
+    if (fd < FD_BASE || fd >= FD_BASE + CONNS_MAX || !s_conns[fd - FD_BASE].open) {
+        return NULL;
+    }
+    return &s_conns[fd - FD_BASE];
+}
+
+// Appends up to len bytes within the window; returns the count or HTTPD_SOCK_ERR_*
+static int conn_write(conn_t *c, const char *buf, size_t len)
+{
+    if (c == NULL || c->closing) {
+        return HTTPD_SOCK_ERR_FAIL;
+    }
+    size_t room = c->window > c->out_len ? c->window - c->out_len : 0;
+    if (room == 0 && len > 0) {
+        return HTTPD_SOCK_ERR_TIMEOUT;
+    }
+    if (len > room) {
+        len = room;
+    }
+    memcpy(c->out + c->out_len, buf, len);
+    c->out_len += len;
+    return (int)len;
+}
+
+// A whole response at once; the simulated client always has room for those
+static esp_err_t conn_respond(conn_t *c, const char *body, size_t len)
+{
+    char head[384];
+    int n = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\n%.*s\r\n", c->status[0] ? c->status : "200 OK",
+                     (int)c->resp_headers_len, c->resp_headers);
+
+    c->resp_headers_len = 0;
+    if (c->out_len + (size_t)n + len > OUT_MAX) {
+        return ESP_FAIL;
+    }
+    memcpy(c->out + c->out_len, head, (size_t)n);
+    memcpy(c->out + c->out_len + n, body, len);
+    c->out_len += (size_t)n + len;
+    return ESP_OK;
+}
+
+void *shim_httpd_server(void)
+{
+    return &s_server;
+}
+
+int shim_httpd_connect(size_t window)
+{
+    for (int i = 0; i < CONNS_MAX; i++) {
+        conn_t *c = &s_conns[i];
+        if (!c->open) {
+            if (c->out == NULL) {
+                c->out = malloc(OUT_MAX);
+            }
+            *c = (conn_t){ .open = true, .window = window < OUT_MAX ? window : OUT_MAX, .out = c->out };
+            return FD_BASE + i;
+        }
+    }
+    return -1;
+}
+
+static int run_handler(int fd, int method, const char *uri, const char *headers, const char *body,
+                       size_t body_len, int (*handler)(struct httpd_req *req), void *user_ctx)
+{
+    conn_t *c = conn_of(fd);
+    httpd_req_t req = {
+        .handle = &s_server, .method = method, .uri = uri, .content_len = body_len,
+        .user_ctx = user_ctx, .aux = c,
+    };
+
+    if (c == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    c->status[0] = '\0';
+    c->resp_headers_len = 0;
+    c->headers = headers ? headers : "";
+    c->body = body;
+    c->body_len = body_len;
+    c->body_pos = 0;
+    req.sess_ctx = c->sess_ctx;
+    req.free_ctx = c->free_ctx;
+
+    esp_err_t err = handler(&req);
+    c->sess_ctx = req.sess_ctx;
+    c->free_ctx = req.free_ctx;
+    if (err != ESP_OK) {
+        // The server closes the connection when a handler fails
+        c->closing = true;
+    }
+    return err;
+}
+
+int shim_httpd_request(int fd, int method, const char *uri, const char *headers,
+                       const char *body, size_t body_len, int (*handler)(struct httpd_req *req))
+{
+    return run_handler(fd, method, uri, headers, body, body_len, handler, NULL);
+}
+
+int shim_httpd_call(int fd, int method, const char *uri, const char *headers,
+                    const char *body, size_t body_len)
+{
+    size_t path_len = strcspn(uri, "?");
+
+    for (size_t i = 0; i < s_uri_count; i++) {
+        const httpd_uri_t *u = &s_uris[i];
+        if ((int)u->method == method && strlen(u->uri) == path_len && strncmp(u->uri, uri, path_len) == 0) {
+            return run_handler(fd, method, uri, headers, body, body_len, u->handler, u->user_ctx);
+        }
+    }
+    conn_t *c = conn_of(fd);
+    if (c == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    snprintf(c->status, sizeof(c->status), "404 Not Found");
+    return conn_respond(c, "Nothing matches the given URI", 29);
+}
+
+size_t shim_httpd_read(int fd, char *buf, size_t max)
+{
+    conn_t *c = &s_conns[fd - FD_BASE];
+    size_t n = c->out_len < max ? c->out_len : max;
+
+    if (buf) {
+        memcpy(buf, c->out, n);
+    }
+    memmove(c->out, c->out + n, c->out_len - n);
+    c->out_len -= n;
+    return n;
+}
+
+const char *shim_httpd_status(int fd)
+{
+    conn_t *c = &s_conns[fd - FD_BASE];
+    return c->status[0] ? c->status : "200 OK";
+}
+
+void shim_httpd_set_upload_rate(int fd, uint32_t us_per_kb)
+{
+    s_conns[fd - FD_BASE].recv_us_per_kb = us_per_kb;
+}
+
+bool shim_httpd_is_open(int fd)
+{
+    conn_t *c = conn_of(fd);
+    return c != NULL && !c->closing;
+}
+
+void shim_httpd_close(int fd)
+{
+    conn_t *c = conn_of(fd);
+
+    if (c) {
+        c->closing = true;
+    }
+}
+
+void shim_httpd_run(void)
+{
+    while (s_work_count > 0) {
+        httpd_work_fn_t fn = s_work[0].fn;
+        void *arg = s_work[0].arg;
+        memmove(&s_work[0], &s_work[1], (--s_work_count) * sizeof(s_work[0]));
+        fn(arg);
+    }
+    for (int i = 0; i < CONNS_MAX; i++) {
+        conn_t *c = &s_conns[i];
+        if (c->open && c->closing) {
+            if (c->free_ctx && c->sess_ctx) {
+                c->free_ctx(c->sess_ctx);
+            }
+            c->open = false;
+        }
+    }
+}
+
+int httpd_send(httpd_req_t *req, const char *buf, size_t len)
+{
+    return conn_write(req->aux, buf, len);
+}
+
+int httpd_req_recv(httpd_req_t *req, char *buf, size_t len)
+{
+    conn_t *c = req->aux;
+    size_t n = c->body_len - c->body_pos;
+
+    if (n == 0) {
+        return 0;
+    }
+    if (n > len) {
+        n = len;
+    }
+    memcpy(buf, c->body + c->body_pos, n);
+    c->body_pos += n;
+    if (c->recv_us_per_kb) {
+        shim_time_advance((int64_t)n * c->recv_us_per_kb / 1024);
+    }
+    return (int)n;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *req)
+{
+    return FD_BASE + (int)((conn_t *)req->aux - s_conns);
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *req, const char *field)
+{
+    conn_t *c = req->aux;
+    size_t flen = strlen(field);
+
+    for (const char *line = c->headers; *line; ) {
+        const char *end = strchr(line, '\n');
+        size_t len = end ? (size_t)(end - line) : strlen(line);
+        if (len > flen + 1 && strncasecmp(line, field, flen) == 0 && line[flen] == ':') {
+            const char *v = line + flen + 1;
+            while (*v == ' ') {
+                v++;
+            }
+            return len - (size_t)(v - line);
+        }
+        line += len + (end != NULL);
+    }
+    return 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *req, const char *field, char *val, size_t val_size)
+{
+    conn_t *c = req->aux;
+    size_t len = httpd_req_get_hdr_value_len(req, field);
+
+    if (len == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    for (const char *line = c->headers; *line; line = strchr(line, '\n') + 1) {
+        if (strncasecmp(line, field, strlen(field)) == 0 && line[strlen(field)] == ':') {
+            const char *v = line + strlen(field) + 1;
+            while (*v == ' ') {
+                v++;
+            }
+            size_t n = len < val_size ? len : val_size - 1;
+            memcpy(val, v, n);
+            val[n] = '\0';
+            return len < val_size ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *req, const char *status)
+{
+    conn_t *c = req->aux;
+    snprintf(c->status, sizeof(c->status), "%s", status);
+    return ESP_OK;
+}
+
+static esp_err_t add_resp_header(conn_t *c, const char *field, const char *value)
+{
+    size_t room = sizeof(c->resp_headers) - c->resp_headers_len;
+    int n = snprintf(c->resp_headers + c->resp_headers_len, room, "%s: %s\r\n", field, value);
+
+    if (n < 0 || (size_t)n >= room) {
+        return ESP_ERR_NO_MEM;
+    }
+    c->resp_headers_len += (size_t)n;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *req, const char *type)
+{
+    return add_resp_header(req->aux, "Content-Type", type);
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *req, const char *field, const char *value)
+{
+    return add_resp_header(req->aux, field, value);
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *req, const char *buf, ssize_t len)
+{
+    return conn_respond(req->aux, buf ? buf : "", len < 0 ? strlen(buf) : (size_t)len);
+}
+
+esp_err_t httpd_resp_sendstr(httpd_req_t *req, const char *str)
+{
+    return httpd_resp_send(req, str, HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *req, const char *buf, ssize_t len)
+{
+    if (buf == NULL) {
+        return ESP_OK;
+    }
+    return conn_write(req->aux, buf, len < 0 ? strlen(buf) : (size_t)len) >= 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg)
+{
+    static const char *const status[] = {
+        [HTTPD_500_INTERNAL_SERVER_ERROR] = "500 Internal Server Error",
+        [HTTPD_400_BAD_REQUEST] = "400 Bad Request",
+        [HTTPD_401_UNAUTHORIZED] = "401 Unauthorized",
+        [HTTPD_403_FORBIDDEN] = "403 Forbidden",
+        [HTTPD_404_NOT_FOUND] = "404 Not Found",
+        [HTTPD_411_LENGTH_REQUIRED] = "411 Length Required",
+    };
+
+    httpd_resp_set_status(req, status[error] ? status[error] : "500 Internal Server Error");
+    return httpd_resp_sendstr(req, msg ? msg : "");
+}
+
+int httpd_socket_send(httpd_handle_t server, int sockfd, const char *buf, size_t len, int flags)
+{
+    return conn_write(conn_of(sockfd), buf, len);
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t server, int sockfd)
+{
+    conn_t *c = conn_of(sockfd);
+
+    if (c == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    c->closing = true;
+    return ESP_OK;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t server, httpd_work_fn_t work, void *arg)
+{
+    if (s_work_count == WORK_MAX) {
+        return ESP_FAIL;
+    }
+    s_work[s_work_count].fn = work;
+    s_work[s_work_count].arg = arg;
+    s_work_count++;
+    return ESP_OK;
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
+{
+    s_uri_count = 0;
+    s_uri_limit = config->max_uri_handlers < URI_MAX ? config->max_uri_handlers : URI_MAX;
+    *handle = &s_server;
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler)
+{
+    for (size_t i = 0; i < s_uri_count; i++) {
+        if (s_uris[i].method == uri_handler->method && strcmp(s_uris[i].uri, uri_handler->uri) == 0) {
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+    if (s_uri_count == s_uri_limit) {
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+    // Like the real server, keep only the pointer: the URI string must outlive the registration
+    s_uris[s_uri_count++] = *uri_handler;
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    const char *q = strchr(r->uri, '?');
+
+    if (q == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (buf_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    snprintf(buf, buf_len, "%s", q + 1);
+    return strlen(q + 1) < buf_len ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size)
+{
+    size_t klen = strlen(key);
+
+    for (const char *p = qry; *p; ) {
+        size_t len = strcspn(p, "&");
+        if (len > klen && strncmp(p, key, klen) == 0 && p[klen] == '=') {
+            size_t vlen = len - klen - 1;
+            size_t n = vlen < val_size ? vlen : val_size - 1;
+            memcpy(val, p + klen + 1, n);
+            val[n] = '\0';
+            return vlen < val_size ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+        }
+        p += len + (p[len] == '&');
+    }
+    return ESP_ERR_NOT_FOUND;
+}
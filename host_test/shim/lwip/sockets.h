@@ -0,0 +1,10 @@
+#ifndef SHIM_LWIP_SOCKETS_H
+#define SHIM_LWIP_SOCKETS_H
+
+// The lwIP socket API is the BSD one
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#endif // SHIM_LWIP_SOCKETS_H
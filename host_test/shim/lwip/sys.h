@@ -0,0 +1,6 @@
+#ifndef SHIM_LWIP_SYS_H
+#define SHIM_LWIP_SYS_H
+
+// Included by main.c; nothing in it is used
+
+#endif // SHIM_LWIP_SYS_H
@@ -0,0 +1,31 @@
+/*
+    * Host stand-in for main/metrics.c in the unit tests
+    *
+    * Counters are the real ones from metrics.h; histograms only keep the number of
+    * observations and the largest, for the tests to check. test_app builds the real
+    * main/metrics.c instead, on the shim scheduler's run time statistics.
+*/
+
+#include "metrics.h"
+#include "shim.h"
+
+atomic_uint metrics_counters[METRIC_COUNTER_COUNT];
+
+static struct {
+    uint32_t count;
+    uint32_t max_us;
+} s_hist[METRIC_HIST_COUNT];
+
+void metrics_observe_us(metric_hist_t hist, uint32_t us)
+{
+    s_hist[hist].count++;
+    if (us > s_hist[hist].max_us) {
+        s_hist[hist].max_us = us;
+    }
+}
+
+void shim_metrics_hist(int hist, uint32_t *count, uint32_t *max_us)
+{
+    *count = s_hist[hist].count;
+    *max_us = s_hist[hist].max_us;
+}
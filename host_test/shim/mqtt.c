@@ -0,0 +1,294 @@
+/*
+    * esp-mqtt client backed by a broker stand-in, for the host tests
+    *
+    * A connect attempt takes SHIM_MQTT_CONNECT_US of simulated time and then raises CONNECTED if the
+    * broker is up, DISCONNECTED if it is not, like the real client does for a refused connection.
+    * Taking the broker down, or the station losing its link (see wifi.c), drops the session with a
+    * DISCONNECTED event. There is no reconnect of its own; the firmware disables that. QoS 1
+    * publishes are acknowledged SHIM_MQTT_PUBACK_US later unless the session is gone by then.
+    *
+    * The broker keeps the last SHIM_MQTT_LOG_MAX publishes for the tests (shim_mqtt_message()),
+    * and sends a publish on a topic the session subscribed to back to the client as DATA,
+    * SHIM_MQTT_DELIVERY_US after it was published. Topic filters must match exactly.
+*/
+
+#include <string.h>
+#include "esp_timer.h"
+#include "mqtt_client.h"
+#include "shim.h"
+#include "shim_internal.h"
+
+#define SHIM_MQTT_CONNECT_US    20000
+#define SHIM_MQTT_PUBACK_US     5000
+#define SHIM_MQTT_INFLIGHT_MAX  32
+#define SHIM_MQTT_SUBS_MAX      8
+#define SHIM_MQTT_DELIVERY_MAX  8
+
+struct shim_mqtt_client {
+    esp_event_handler_t handler;
+    void *handler_args;
+    esp_timer_handle_t connect_timer;
+    esp_timer_handle_t puback_timer;
+    esp_timer_handle_t delivery_timer;
+    bool started;
+    bool connected;
+    int next_msg_id;
+    int inflight[SHIM_MQTT_INFLIGHT_MAX];
+    size_t inflight_count;
+    char subs[SHIM_MQTT_SUBS_MAX][SHIM_MQTT_TOPIC_MAX];
+    size_t sub_count;
+    uint32_t delivery[SHIM_MQTT_DELIVERY_MAX];  // Log entries on their way back to the client
+    size_t delivery_count;
+};
+
+static struct shim_mqtt_client s_client;
+static bool s_broker_up = true;
+static bool s_link_up = true;       // Until wifi.c says otherwise the network is just there
+static shim_mqtt_stats_t s_stats;
+static shim_mqtt_message_t s_log[SHIM_MQTT_LOG_MAX];
+
+static void dispatch_event(esp_mqtt_event_t *event)
+{
+    event->client = &s_client;
+    if (s_client.handler) {
+        s_client.handler(s_client.handler_args, "MQTT_EVENTS", event->event_id, event);
+    }
+}
+
+static void dispatch(esp_mqtt_event_id_t id, int msg_id)
+{
+    esp_mqtt_event_t event = { .event_id = id, .msg_id = msg_id };
+    dispatch_event(&event);
+}
+
+static void drop_session(void)
+{
+    s_client.connected = false;
+    s_client.inflight_count = 0;
+    s_client.sub_count = 0;
+    s_client.delivery_count = 0;
+    esp_timer_stop(s_client.puback_timer);
+    esp_timer_stop(s_client.delivery_timer);
+}
+
+static void connect_done(void *arg)
+{
+    if (!s_client.started) {
+        return;
+    }
+    if (s_broker_up && s_link_up) {
+        s_client.connected = true;
+        s_stats.sessions++;
+        dispatch(MQTT_EVENT_CONNECTED, 0);
+    } else {
+        s_stats.refused++;
+        dispatch(MQTT_EVENT_DISCONNECTED, 0);
+    }
+}
+
+static void delivery_due(void *arg)
+{
+    size_t n = s_client.delivery_count;
+    uint32_t seqs[SHIM_MQTT_DELIVERY_MAX];
+
+    memcpy(seqs, s_client.delivery, n * sizeof(seqs[0]));
+    s_client.delivery_count = 0;
+    for (size_t i = 0; i < n && s_client.connected; i++) {
+        shim_mqtt_message_t *m = &s_log[seqs[i] % SHIM_MQTT_LOG_MAX];
+        esp_mqtt_event_t event = {
+            .event_id = MQTT_EVENT_DATA,
+            .topic = m->topic, .topic_len = (int)strlen(m->topic),
+            .data = m->data, .data_len = (int)m->len, .total_data_len = (int)m->len,
+        };
+        s_stats.delivered++;
+        dispatch_event(&event);
+    }
+}
+
+static bool subscribed(const char *topic)
+{
+    for (size_t i = 0; i < s_client.sub_count; i++) {
+        if (strcmp(s_client.subs[i], topic) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// What the broker received, in the log and on its way to a subscriber
+static void broker_receive(const char *topic, const char *data, int len, int qos, int retain)
+{
+    uint32_t seq = s_stats.publishes;
+    shim_mqtt_message_t *m = &s_log[seq % SHIM_MQTT_LOG_MAX];
+
+    if (data && len == 0) {
+        len = (int)strlen(data);
+    }
+    *m = (shim_mqtt_message_t){ .len = (size_t)len, .qos = qos, .retain = retain != 0,
+                                .time_us = esp_timer_get_time() };
+    strncpy(m->topic, topic, sizeof(m->topic) - 1);
+    if (m->len > sizeof(m->data) - 1) {
+        m->len = sizeof(m->data) - 1;
+    }
+    memcpy(m->data, data, m->len);
+    s_stats.publishes++;
+
+    if (subscribed(topic) && s_client.delivery_count < SHIM_MQTT_DELIVERY_MAX) {
+        s_client.delivery[s_client.delivery_count++] = seq;
+        if (!esp_timer_is_active(s_client.delivery_timer)) {
+            esp_timer_start_once(s_client.delivery_timer, SHIM_MQTT_DELIVERY_US);
+        }
+    }
+}
+
+static void puback_due(void *arg)
+{
+    size_t n = s_client.inflight_count;
+    int ids[SHIM_MQTT_INFLIGHT_MAX];
+
+    memcpy(ids, s_client.inflight, n * sizeof(ids[0]));
+    s_client.inflight_count = 0;
+    for (size_t i = 0; i < n && s_client.connected; i++) {
+        s_stats.acked++;
+        dispatch(MQTT_EVENT_PUBLISHED, ids[i]);
+    }
+}
+
+// Starts a connect attempt unless one is already under way
+static esp_err_t begin_connect(void)
+{
+    if (s_client.connected || esp_timer_is_active(s_client.connect_timer)) {
+        return ESP_FAIL;
+    }
+    s_stats.attempts++;
+    return esp_timer_start_once(s_client.connect_timer, SHIM_MQTT_CONNECT_US);
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    const esp_timer_create_args_t connect_args = { .callback = connect_done, .name = "shim_mqtt_conn" };
+    const esp_timer_create_args_t puback_args = { .callback = puback_due, .name = "shim_mqtt_ack" };
+    const esp_timer_create_args_t delivery_args = { .callback = delivery_due, .name = "shim_mqtt_data" };
+
+    s_stats.clients++;
+    if (s_stats.clients > 1) {
+        // A second client would be a second connection to the broker
+        return &s_client;
+    }
+    esp_timer_create(&connect_args, &s_client.connect_timer);
+    esp_timer_create(&puback_args, &s_client.puback_timer);
+    esp_timer_create(&delivery_args, &s_client.delivery_timer);
+    return &s_client;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, int32_t event,
+                                         esp_event_handler_t handler, void *handler_args)
+{
+    client->handler = handler;
+    client->handler_args = handler_args;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    if (client->started) {
+        return ESP_FAIL;
+    }
+    client->started = true;
+    return begin_connect();
+}
+
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client)
+{
+    return client->started ? begin_connect() : ESP_FAIL;
+}
+
+esp_err_t esp_mqtt_client_disconnect(esp_mqtt_client_handle_t client)
+{
+    drop_session();
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client)
+{
+    drop_session();
+    client->started = false;
+    esp_timer_stop(client->connect_timer);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
+{
+    esp_mqtt_client_stop(client);
+    s_stats.clients--;
+    return ESP_OK;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+                            int len, int qos, int retain)
+{
+    if (!client->connected) {
+        return -1;
+    }
+    broker_receive(topic, data, len, qos, retain);
+    if (qos == 0) {
+        return 0;
+    }
+    if (client->inflight_count == SHIM_MQTT_INFLIGHT_MAX) {
+        return -1;
+    }
+    int msg_id = ++client->next_msg_id;
+    client->inflight[client->inflight_count++] = msg_id;
+    if (!esp_timer_is_active(client->puback_timer)) {
+        esp_timer_start_once(client->puback_timer, SHIM_MQTT_PUBACK_US);
+    }
+    return msg_id;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    if (!client->connected) {
+        return -1;
+    }
+    if (!subscribed(topic) && client->sub_count < SHIM_MQTT_SUBS_MAX) {
+        strncpy(client->subs[client->sub_count++], topic, SHIM_MQTT_TOPIC_MAX - 1);
+    }
+    return ++client->next_msg_id;
+}
+
+static void lose_session(void)
+{
+    if (s_client.connected) {
+        drop_session();
+        dispatch(MQTT_EVENT_DISCONNECTED, 0);
+    }
+}
+
+void shim_mqtt_broker_set(bool up)
+{
+    s_broker_up = up;
+    if (!up) {
+        lose_session();
+    }
+}
+
+void shim_mqtt_link_set(bool up)
+{
+    s_link_up = up;
+    if (!up) {
+        lose_session();
+    }
+}
+
+const shim_mqtt_message_t *shim_mqtt_message(uint32_t n)
+{
+    if (n >= s_stats.publishes || s_stats.publishes - n > SHIM_MQTT_LOG_MAX) {
+        return NULL;
+    }
+    return &s_log[n % SHIM_MQTT_LOG_MAX];
+}
+
+void shim_mqtt_get_stats(shim_mqtt_stats_t *stats)
+{
+    *stats = s_stats;
+}
@@ -0,0 +1,13 @@
+#ifndef SHIM_NVS_FLASH_H
+#define SHIM_NVS_FLASH_H
+
+#include "esp_err.h"
+
+// The in-memory NVS of flash.c needs no initialisation; these always succeed
+#define ESP_ERR_NVS_NO_FREE_PAGES       0x110d
+#define ESP_ERR_NVS_NEW_VERSION_FOUND   0x1110
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
+
+#endif // SHIM_NVS_FLASH_H
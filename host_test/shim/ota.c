@@ -0,0 +1,242 @@
+/*
+    * OTA, power management and SHA-256 stand-ins for main/ota.c
+    *
+    * The update slot only records how many bytes were written and whether the image started with
+    * the ESP image magic; nothing is stored. esp_restart() is counted, not performed, and the
+    * running app describes itself as version "host". SHA-256 is a straight FIPS 180-4
+    * implementation so the tests can hash images with the same calls.
+*/
+
+#include <string.h>
+#include "esp_ota_ops.h"
+#include "esp_pm.h"
+#include "esp_system.h"
+#include "mbedtls/sha256.h"
+#include "shim.h"
+
+#define ESP_IMAGE_MAGIC     0xE9
+
+static const esp_partition_t s_slots[2] = {
+    { .type = ESP_PARTITION_TYPE_APP, .subtype = 0x10, .address = 0x20000, .size = 0x180000, .label = "ota_0" },
+    { .type = ESP_PARTITION_TYPE_APP, .subtype = 0x11, .address = 0x1a0000, .size = 0x180000, .label = "ota_1" },
+};
+static shim_ota_stats_t s_ota;
+static bool s_open;
+static bool s_bad_magic;
+static int s_pm_held;
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle)
+{
+    if (partition != &s_slots[1] || s_open) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_open = true;
+    s_bad_magic = false;
+    s_ota.begun++;
+    s_ota.bytes = 0;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
+{
+    if (!s_open) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_ota.bytes == 0 && size > 0 && ((const uint8_t *)data)[0] != ESP_IMAGE_MAGIC) {
+        s_bad_magic = true;
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    if (s_ota.bytes + size > s_slots[1].size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    s_ota.bytes += (uint32_t)size;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    if (!s_open) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_open = false;
+    return s_bad_magic || s_ota.bytes == 0 ? ESP_ERR_OTA_VALIDATE_FAILED : ESP_OK;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    s_open = false;
+    s_ota.aborted++;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    s_ota.boot_set++;
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    return &s_slots[1];
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void)
+{
+    return &s_slots[0];
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *partition, esp_ota_img_states_t *state)
+{
+    *state = ESP_OTA_IMG_VALID;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void)
+{
+    return ESP_OK;
+}
+
+const esp_app_desc_t *esp_ota_get_app_description(void)
+{
+    static const esp_app_desc_t desc = {
+        .version = "host", .project_name = "officetemp", .time = __TIME__, .date = __DATE__, .idf_ver = "host",
+    };
+    return &desc;
+}
+
+void esp_restart(void)
+{
+    s_ota.restarts++;
+}
+
+void shim_ota_get_stats(shim_ota_stats_t *stats)
+{
+    *stats = s_ota;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char *name, esp_pm_lock_handle_t *out_handle)
+{
+    static int handle;
+
+    *out_handle = (esp_pm_lock_handle_t)&handle;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle)
+{
+    s_pm_held++;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle)
+{
+    s_pm_held--;
+    return ESP_OK;
+}
+
+int shim_pm_locks_held(void)
+{
+    return s_pm_held;
+}
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static uint32_t ror(uint32_t x, unsigned n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+static void sha256_block(mbedtls_sha256_context *ctx, const unsigned char *p)
+{
+    uint32_t w[64], s[8];
+
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    memcpy(s, ctx->state, sizeof(s));
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = s[7] + (ror(s[4], 6) ^ ror(s[4], 11) ^ ror(s[4], 25)) + ((s[4] & s[5]) ^ (~s[4] & s[6])) + K[i] + w[i];
+        uint32_t t2 = (ror(s[0], 2) ^ ror(s[0], 13) ^ ror(s[0], 22)) + ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+        memmove(&s[1], &s[0], 7 * sizeof(s[0]));
+        s[4] += t1;
+        s[0] = t1 + t2;
+    }
+    for (int i = 0; i < 8; i++) {
+        ctx->state[i] += s[i];
+    }
+}
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+int mbedtls_sha256_starts_ret(mbedtls_sha256_context *ctx, int is224)
+{
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    if (is224) {
+        return -1;
+    }
+    memcpy(ctx->state, init, sizeof(init));
+    ctx->total = 0;
+    return 0;
+}
+
+int mbedtls_sha256_update_ret(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
+{
+    while (ilen > 0) {
+        size_t used = ctx->total % 64;
+        size_t n = 64 - used < ilen ? 64 - used : ilen;
+        memcpy(ctx->buffer + used, input, n);
+        ctx->total += n;
+        input += n;
+        ilen -= n;
+        if (ctx->total % 64 == 0) {
+            sha256_block(ctx, ctx->buffer);
+        }
+    }
+    return 0;
+}
+
+int mbedtls_sha256_finish_ret(mbedtls_sha256_context *ctx, unsigned char output[32])
+{
+    uint64_t bits = ctx->total * 8;
+    unsigned char pad[72] = { 0x80 };
+    size_t used = ctx->total % 64;
+    size_t n = used < 56 ? 56 - used : 120 - used;
+
+    for (int i = 0; i < 8; i++) {
+        pad[n + i] = (unsigned char)(bits >> (56 - 8 * i));
+    }
+    mbedtls_sha256_update_ret(ctx, pad, n + 8);
+    for (int i = 0; i < 8; i++) {
+        output[4 * i] = (unsigned char)(ctx->state[i] >> 24);
+        output[4 * i + 1] = (unsigned char)(ctx->state[i] >> 16);
+        output[4 * i + 2] = (unsigned char)(ctx->state[i] >> 8);
+        output[4 * i + 3] = (unsigned char)ctx->state[i];
+    }
+    return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef SHIM_ETS_SYS_H
+#define SHIM_ETS_SYS_H
+
+#include <stdint.h>
+
+// Busy waits advance the simulated clock
+void ets_delay_us(uint32_t us);
+uint32_t ets_get_cpu_frequency(void);
+
+#endif // SHIM_ETS_SYS_H
@@ -0,0 +1,332 @@
+/*
+    * Host implementations of the ESP-IDF and FreeRTOS calls used by the modules in host_test
+    *
+    * Time is simulated: esp_timer_get_time() only moves through shim_time_advance() and
+    * vTaskDelay(), and esp_timer callbacks run synchronously from there, in due order. Once the
+    * tasks run (see tasks.c) the clock is moved by the idle task instead, and the callbacks run
+    * on the esp_timer task. gettimeofday() follows the same clock.
+*/
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_now.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "shim.h"
+#include "shim_internal.h"
+
+#define SHIM_TIMERS_MAX 32
+#define SHIM_LOG_TAGS_MAX 16
+#define SHIM_HEAP_FREE  (160 * 1024)
+
+struct shim_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    bool used;
+    bool active;
+    int64_t due_us;
+    uint64_t period_us;         // 0 = one-shot
+};
+
+static int64_t s_now_us;
+static struct shim_timer s_timers[SHIM_TIMERS_MAX];
+static uint32_t s_random = 0x9E3779B9;
+static esp_now_recv_cb_t s_espnow_recv_cb;
+static struct {
+    const char *tag;
+    esp_log_level_t level;
+} s_log_tags[SHIM_LOG_TAGS_MAX];
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+    default: return "ESP_ERR_UNKNOWN";
+    }
+}
+
+static esp_log_level_t log_threshold(void)
+{
+    static esp_log_level_t level = ESP_LOG_NONE;
+
+    if (level == ESP_LOG_NONE) {
+        const char *env = getenv("HOST_TEST_LOG");
+        level = env && strcmp(env, "debug") == 0 ? ESP_LOG_DEBUG :
+                env && strcmp(env, "info") == 0 ? ESP_LOG_INFO : ESP_LOG_WARN;
+    }
+    return level;
+}
+
+void shim_log(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    static const char letters[] = "NEWIDV";
+    va_list ap;
+
+    if (level > log_threshold()) {
+        return;
+    }
+    fprintf(stderr, "%c (%lld) %s: ", letters[level], (long long)(s_now_us / 1000), tag);
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+uint32_t esp_random(void)
+{
+    s_random ^= s_random << 13;
+    s_random ^= s_random >> 17;
+    s_random ^= s_random << 5;
+    return s_random;
+}
+
+void shim_random_seed(uint32_t seed)
+{
+    s_random = seed ? seed : 0x9E3779B9;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    va_list ap;
+
+    if (level > log_threshold()) {
+        return;
+    }
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    for (size_t i = 0; i < SHIM_LOG_TAGS_MAX; i++) {
+        if (s_log_tags[i].tag == NULL || strcmp(s_log_tags[i].tag, tag) == 0) {
+            s_log_tags[i].tag = tag;
+            s_log_tags[i].level = level;
+            return;
+        }
+    }
+}
+
+esp_log_level_t esp_log_level_get(const char *tag)
+{
+    for (size_t i = 0; i < SHIM_LOG_TAGS_MAX && s_log_tags[i].tag != NULL; i++) {
+        if (strcmp(s_log_tags[i].tag, tag) == 0) {
+            return s_log_tags[i].level;
+        }
+    }
+    return ESP_LOG_INFO;
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return (uint32_t)(s_now_us / 1000);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return s_now_us;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out)
+{
+    for (size_t i = 0; i < SHIM_TIMERS_MAX; i++) {
+        if (!s_timers[i].used) {
+            s_timers[i] = (struct shim_timer){ .callback = args->callback, .arg = args->arg, .used = true };
+            *out = &s_timers[i];
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = true;
+    timer->due_us = s_now_us + (int64_t)timeout_us;
+    timer->period_us = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    esp_err_t err = esp_timer_start_once(timer, period_us);
+    timer->period_us = period_us;
+    return err;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    timer->used = false;
+    timer->active = false;
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    return timer->active;
+}
+
+// Earliest active timer due by until, NULL if none
+static struct shim_timer *next_timer(int64_t until)
+{
+    struct shim_timer *next = NULL;
+
+    for (size_t i = 0; i < SHIM_TIMERS_MAX; i++) {
+        struct shim_timer *t = &s_timers[i];
+        if (t->used && t->active && t->due_us <= until && (!next || t->due_us < next->due_us)) {
+            next = t;
+        }
+    }
+    return next;
+}
+
+static void fire(struct shim_timer *t)
+{
+    if (t->period_us) {
+        t->due_us += (int64_t)t->period_us;
+    } else {
+        t->active = false;
+    }
+    t->callback(t->arg);
+}
+
+int64_t shim_timer_next_due(void)
+{
+    struct shim_timer *t = next_timer(INT64_MAX);
+    return t ? t->due_us : INT64_MAX;
+}
+
+void shim_timer_run_due(void)
+{
+    struct shim_timer *t;
+
+    while ((t = next_timer(s_now_us)) != NULL) {
+        fire(t);
+    }
+}
+
+void shim_clock_set(int64_t us)
+{
+    s_now_us = us;
+}
+
+void shim_time_advance(int64_t us)
+{
+    int64_t end = s_now_us + us;
+    struct shim_timer *t;
+
+    if (shim_tasks_running()) {
+        shim_task_sleep(us);
+        return;
+    }
+    while ((t = next_timer(end)) != NULL) {
+        if (t->due_us > s_now_us) {
+            s_now_us = t->due_us;
+        }
+        fire(t);
+    }
+    s_now_us = end;
+}
+
+int gettimeofday(struct timeval *restrict tv, void *restrict tz)
+{
+    tv->tv_sec = s_now_us / 1000000;
+    tv->tv_usec = s_now_us % 1000000;
+    return 0;
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return SHIM_HEAP_FREE;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    return SHIM_HEAP_FREE;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    return SHIM_HEAP_FREE;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    return SHIM_HEAP_FREE;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return SHIM_HEAP_FREE / 2;
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    static const uint8_t base[6] = { 0x02, 0x00, 0x00, 0x12, 0x34, 0x56 };
+
+    memcpy(mac, base, sizeof(base));
+    mac[5] += (uint8_t)type;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb)
+{
+    s_espnow_recv_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    return len <= 250 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_now_recv_cb_t shim_espnow_recv_cb(void)
+{
+    return s_espnow_recv_cb;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(s_now_us / 1000);
+}
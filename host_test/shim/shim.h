@@ -0,0 +1,189 @@
+#ifndef SHIM_H
+#define SHIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct httpd_req;
+
+// Controls for the host shims, used by the tests only
+
+/**
+ * @brief Move the simulated clock forward, running esp_timer callbacks as they fall due
+ */
+void shim_time_advance(int64_t us);
+
+/**
+ * @brief Priority the calling task currently runs at, for vTaskPrioritySet() checks
+ */
+unsigned shim_task_priority(void);
+
+/**
+ * @brief Start running the tasks created so far, and any created later, on the scheduler
+ *
+ * Until this is called tasks are only recorded and shim_time_advance() runs the timers itself.
+ * Afterwards the caller is the "main" task at priority 5, and shim_time_advance() blocks it
+ * while the others run on the simulated clock. There is no going back; a test that calls
+ * this is the only one in its executable.
+ */
+void shim_tasks_start(void);
+
+typedef struct {
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t erases;                // In 4KB sectors
+    uint32_t bit_set_violations;    // Written bytes that tried to turn a 0 bit back into 1
+} shim_flash_stats_t;
+
+/**
+ * @brief Create (or replace) the one flash partition, fully erased
+ */
+void shim_partition_create(const char *label, int subtype, uint32_t size);
+
+/**
+ * @brief Raw contents of the partition, for corrupting it or checking what was written
+ */
+uint8_t *shim_partition_data(void);
+
+void shim_flash_get_stats(shim_flash_stats_t *stats);
+
+typedef struct {
+    uint32_t clients;               // esp_mqtt_client_init() calls
+    uint32_t attempts;              // Connect attempts started
+    uint32_t refused;               // Attempts made while the broker was down
+    uint32_t sessions;              // Successful connects
+    uint32_t publishes;
+    uint32_t acked;                 // PUBACKs delivered
+    uint32_t delivered;             // Publishes sent back to a subscriber
+} shim_mqtt_stats_t;
+
+#define SHIM_MQTT_LOG_MAX       128
+#define SHIM_MQTT_TOPIC_MAX     64
+#define SHIM_MQTT_DELIVERY_US   4000    // Broker to subscriber
+
+typedef struct {
+    char topic[SHIM_MQTT_TOPIC_MAX];
+    char data[1536];                // NUL-terminated; longer payloads are cut
+    size_t len;
+    int qos;
+    bool retain;
+    int64_t time_us;                // When the broker received it
+} shim_mqtt_message_t;
+
+/**
+ * @brief Bring the broker stand-in up or down; going down drops the current session
+ */
+void shim_mqtt_broker_set(bool up);
+
+void shim_mqtt_get_stats(shim_mqtt_stats_t *stats);
+
+/**
+ * @brief The n-th message the broker received, counting from 0
+ *
+ * @return NULL if there is no such message yet or it has left the log
+ */
+const shim_mqtt_message_t *shim_mqtt_message(uint32_t n);
+
+#define SHIM_WIFI_SCAN_US       1500000
+#define SHIM_WIFI_CONNECT_US    500000
+
+/**
+ * @brief Add or change an access point; taking the associated one down disconnects the station
+ */
+void shim_wifi_ap_set(const char *ssid, int8_t rssi, bool up);
+
+/**
+ * @brief Observations of a metrics histogram so far and the largest value
+ */
+void shim_metrics_hist(int hist, uint32_t *count, uint32_t *max_us);
+
+/**
+ * @brief Tasks created so far, other than the shim's own
+ */
+unsigned shim_tasks_created(void);
+
+/**
+ * @brief The ESP-NOW receive callback registered last, NULL if none
+ */
+void (*shim_espnow_recv_cb(void))(const uint8_t *mac_addr, const uint8_t *data, int data_len);
+
+/**
+ * @brief Handle to pass where the firmware expects its httpd_handle_t
+ */
+void *shim_httpd_server(void);
+
+/**
+ * @brief Open a client connection whose socket takes at most window unread bytes
+ *
+ * @return The server-side socket fd, -1 if all connections are in use
+ */
+int shim_httpd_connect(size_t window);
+
+/**
+ * @brief Run a handler for a request on the connection, as the httpd task would
+ *
+ * headers are "Name: value" lines separated by '\n'; body is what httpd_req_recv() returns.
+ * A handler that fails gets its connection closed.
+ */
+int shim_httpd_request(int fd, int method, const char *uri, const char *headers,
+                       const char *body, size_t body_len, int (*handler)(struct httpd_req *req));
+
+/**
+ * @brief Send a request to the handler registered for its path and method, 404 if none
+ *
+ * Otherwise as shim_httpd_request(); uri may carry a query string.
+ */
+int shim_httpd_call(int fd, int method, const char *uri, const char *headers,
+                    const char *body, size_t body_len);
+
+/**
+ * @brief What the client reads off the connection: up to max bytes, removed from the socket
+ *
+ * buf may be NULL to discard them.
+ */
+size_t shim_httpd_read(int fd, char *buf, size_t max);
+
+/**
+ * @brief Status line of the last response on the connection, "200 OK" unless set
+ */
+const char *shim_httpd_status(int fd);
+
+/**
+ * @brief Simulated time httpd_req_recv() takes per KB of request body on the connection
+ */
+void shim_httpd_set_upload_rate(int fd, uint32_t us_per_kb);
+
+bool shim_httpd_is_open(int fd);
+
+/**
+ * @brief The client hangs up; the session is closed by the next shim_httpd_run()
+ */
+void shim_httpd_close(int fd);
+
+/**
+ * @brief The httpd task's turn: run queued work, then close the sessions marked for closing
+ */
+void shim_httpd_run(void);
+
+typedef struct {
+    uint32_t begun;                 // esp_ota_begin() calls
+    uint32_t bytes;                 // Written to the update slot by the last update
+    uint32_t aborted;
+    uint32_t boot_set;              // esp_ota_set_boot_partition() calls
+    uint32_t restarts;              // esp_restart() calls
+} shim_ota_stats_t;
+
+void shim_ota_get_stats(shim_ota_stats_t *stats);
+
+/**
+ * @brief Power management locks currently acquired, across all handles
+ */
+int shim_pm_locks_held(void);
+
+/**
+ * @brief Restart the esp_random() sequence
+ */
+void shim_random_seed(uint32_t seed);
+
+#endif // SHIM_H
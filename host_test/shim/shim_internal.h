@@ -0,0 +1,39 @@
+#ifndef SHIM_INTERNAL_H
+#define SHIM_INTERNAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Calls between the shim files; the tests use shim.h
+
+/**
+ * @brief Due time of the earliest active esp_timer, INT64_MAX if none
+ */
+int64_t shim_timer_next_due(void);
+
+/**
+ * @brief Run the callbacks of every esp_timer due by now, in due order
+ */
+void shim_timer_run_due(void);
+
+/**
+ * @brief Move the simulated clock to us without running anything
+ */
+void shim_clock_set(int64_t us);
+
+/**
+ * @brief Whether shim_tasks_start() was called, so tasks block instead of advancing the clock
+ */
+bool shim_tasks_running(void);
+
+/**
+ * @brief Block the current task for us of simulated time while the others run
+ */
+void shim_task_sleep(int64_t us);
+
+/**
+ * @brief The station got or lost its IP link; the broker is only reachable with it
+ */
+void shim_mqtt_link_set(bool up);
+
+#endif // SHIM_INTERNAL_H
@@ -0,0 +1,634 @@
+/*
+    * FreeRTOS tasks, queues, mutexes and event groups for the host tests
+    *
+    * Until shim_tasks_start() there is no scheduler: created tasks are only recorded, and a call
+    * that would block advances the simulated clock by its timeout instead, as the unit tests drive
+    * the modules from one thread. Mutexes are real pthread mutexes so modules can also be driven
+    * from several threads.
+    *
+    * After shim_tasks_start() every task runs on a thread of its own, one at a time: a task keeps
+    * the CPU until it blocks, or until it makes a task of higher priority ready, and the next one
+    * is the highest-priority ready task, the longest ready first among equals. The thread that
+    * called shim_tasks_start() is the task "main", at the priority of the httpd task. esp_timer
+    * callbacks run on an "esp_timer" task at the priority IDF gives it, so they can block like
+    * the real ones. When no task is ready the idle task moves the clock to the next wake-up or
+    * timer; that time is its run time, and each such pass calls the idle hooks. There is no time
+    * slicing and no preemption by time: a task that never blocks stalls everything else.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_freertos_hooks.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "shim.h"
+#include "shim_internal.h"
+
+#define SHIM_TASKS_MAX          16
+#define SHIM_IDLE_HOOKS_MAX     4
+#define SHIM_MAIN_PRIORITY      5       // CONFIG_ESP_HTTPD task priority default
+#define SHIM_TIMER_PRIORITY     22      // CONFIG_ESP_TIMER_TASK priority in IDF
+
+struct shim_task {
+    const char *name;
+    TaskFunction_t fn;
+    void *arg;
+    UBaseType_t priority;
+    uint32_t stack_bytes;
+    pthread_t thread;
+    pthread_cond_t wake;
+    bool ready;                 // Runnable; the current task is ready until it blocks
+    bool deleted;
+    uint64_t ready_seq;         // Order among ready tasks of the same priority
+    int64_t wake_us;            // Timeout of a blocked task, INT64_MAX = none
+    const void *waiting_on;     // Queue, mutex or event group it is blocked on, NULL = a delay
+    uint32_t run_us;
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct shim_task s_tasks[SHIM_TASKS_MAX] = {
+    [0] = { .name = "main", .priority = SHIM_MAIN_PRIORITY, .ready = true, .wake_us = INT64_MAX,
+            .wake = PTHREAD_COND_INITIALIZER },
+};
+static size_t s_task_count = 1;
+static struct shim_task s_timer_task = {
+    .name = "esp_timer", .priority = SHIM_TIMER_PRIORITY, .wake_us = INT64_MAX, .wake = PTHREAD_COND_INITIALIZER,
+};
+static struct shim_task s_idle = { .name = "IDLE0", .wake_us = INT64_MAX };
+static struct shim_task *s_current = &s_tasks[0];
+static bool s_running;
+static uint64_t s_seq;
+static esp_freertos_idle_cb_t s_idle_hooks[SHIM_IDLE_HOOKS_MAX];
+
+bool shim_tasks_running(void)
+{
+    return s_running;
+}
+
+static struct shim_task *task_of(TaskHandle_t handle)
+{
+    return handle ? handle : s_current;
+}
+
+static int64_t deadline_of(TickType_t ticks)
+{
+    return ticks == portMAX_DELAY ? INT64_MAX : esp_timer_get_time() + (int64_t)ticks * 1000;
+}
+
+static void make_ready(struct shim_task *t)
+{
+    t->ready = true;
+    t->ready_seq = ++s_seq;
+    t->wake_us = INT64_MAX;
+    t->waiting_on = NULL;
+}
+
+static void for_each_task(void (*fn)(struct shim_task *t))
+{
+    for (size_t i = 0; i < s_task_count; i++) {
+        fn(&s_tasks[i]);
+    }
+    fn(&s_timer_task);
+}
+
+static struct shim_task *best_ready(void)
+{
+    struct shim_task *best = NULL;
+
+    for (size_t i = 0; i <= s_task_count; i++) {
+        struct shim_task *t = i < s_task_count ? &s_tasks[i] : &s_timer_task;
+        if (t->ready && !t->deleted &&
+            (!best || t->priority > best->priority || (t->priority == best->priority && t->ready_seq < best->ready_seq))) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+static void dump_task(struct shim_task *t)
+{
+    if (!t->deleted) {
+        fprintf(stderr, "  %-16s prio %2u, waiting on %p\n", t->name, t->priority, t->waiting_on);
+    }
+}
+
+// Wakes the tasks whose timeout has passed, and the timer task if a timer is due
+static void wake_due(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    for (size_t i = 0; i <= s_task_count; i++) {
+        struct shim_task *t = i < s_task_count ? &s_tasks[i] : &s_timer_task;
+        if (!t->ready && !t->deleted && t->wake_us <= now) {
+            make_ready(t);
+        }
+    }
+    if (!s_timer_task.ready && shim_timer_next_due() <= now) {
+        make_ready(&s_timer_task);
+    }
+}
+
+// The next task to run; with none ready the idle task moves the clock on. s_lock held.
+static struct shim_task *pick_next(void)
+{
+    while (1) {
+        wake_due();
+        struct shim_task *next = best_ready();
+        if (next) {
+            return next;
+        }
+
+        int64_t until = shim_timer_next_due();
+        for (size_t i = 0; i < s_task_count; i++) {
+            if (!s_tasks[i].deleted && s_tasks[i].wake_us < until) {
+                until = s_tasks[i].wake_us;
+            }
+        }
+        if (until == INT64_MAX) {
+            fprintf(stderr, "shim: every task is blocked for ever:\n");
+            for_each_task(dump_task);
+            abort();
+        }
+        int64_t now = esp_timer_get_time();
+        if (until > now) {
+            s_idle.run_us += (uint32_t)(until - now);
+            shim_clock_set(until);
+        }
+        for (size_t i = 0; i < SHIM_IDLE_HOOKS_MAX && s_idle_hooks[i]; i++) {
+            s_idle_hooks[i]();
+        }
+    }
+}
+
+// Hands the CPU on and returns once self runs again (never, if it is deleted). s_lock held.
+static void switch_away(struct shim_task *self)
+{
+    struct shim_task *next = pick_next();
+
+    if (next == self) {
+        return;
+    }
+    s_current = next;
+    pthread_cond_signal(&next->wake);
+    while (!self->deleted && s_current != self) {
+        pthread_cond_wait(&self->wake, &s_lock);
+    }
+}
+
+// Blocks the current task on obj (NULL = just the deadline) until woken or deadline. s_lock held.
+static void wait_for(const void *obj, int64_t deadline_us)
+{
+    struct shim_task *self = s_current;
+
+    self->ready = false;
+    self->waiting_on = obj;
+    self->wake_us = deadline_us;
+    switch_away(self);
+}
+
+// Makes the tasks blocked on obj ready to check it again, and lets a higher-priority one run
+static void wake_waiters(const void *obj)
+{
+    bool preempt = false;
+
+    for (size_t i = 0; i <= s_task_count; i++) {
+        struct shim_task *t = i < s_task_count ? &s_tasks[i] : &s_timer_task;
+        if (!t->ready && !t->deleted && t->waiting_on == obj) {
+            make_ready(t);
+            preempt |= t->priority > s_current->priority;
+        }
+    }
+    if (preempt) {
+        switch_away(s_current);
+    }
+}
+
+static void *task_thread(void *arg)
+{
+    struct shim_task *t = arg;
+
+    pthread_mutex_lock(&s_lock);
+    while (s_current != t) {
+        pthread_cond_wait(&t->wake, &s_lock);
+    }
+    pthread_mutex_unlock(&s_lock);
+
+    t->fn(t->arg);
+
+    // A task function must not return on FreeRTOS; treat it as deleting itself
+    pthread_mutex_lock(&s_lock);
+    t->deleted = true;
+    t->ready = false;
+    switch_away(t);
+    pthread_mutex_unlock(&s_lock);
+    return NULL;
+}
+
+static void timer_task(void *arg)
+{
+    while (1) {
+        shim_timer_run_due();
+        pthread_mutex_lock(&s_lock);
+        if (shim_timer_next_due() > esp_timer_get_time()) {
+            wait_for(&s_timer_task, INT64_MAX);
+        }
+        pthread_mutex_unlock(&s_lock);
+    }
+}
+
+static void spawn(struct shim_task *t)
+{
+    pthread_cond_init(&t->wake, NULL);
+    make_ready(t);
+    if (pthread_create(&t->thread, NULL, task_thread, t) != 0) {
+        fprintf(stderr, "shim: cannot start a thread for task '%s'\n", t->name);
+        abort();
+    }
+    pthread_detach(t->thread);
+}
+
+void shim_tasks_start(void)
+{
+    pthread_mutex_lock(&s_lock);
+    s_running = true;
+    s_timer_task.fn = timer_task;
+    spawn(&s_timer_task);
+    s_timer_task.ready = false;
+    s_timer_task.waiting_on = &s_timer_task;
+    for (size_t i = 1; i < s_task_count; i++) {
+        spawn(&s_tasks[i]);
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+unsigned shim_tasks_created(void)
+{
+    return (unsigned)(s_task_count - 1);
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                                           UBaseType_t priority, StackType_t *stack, StaticTask_t *tcb,
+                                           BaseType_t core)
+{
+    pthread_mutex_lock(&s_lock);
+    if (s_task_count == SHIM_TASKS_MAX) {
+        pthread_mutex_unlock(&s_lock);
+        return NULL;
+    }
+    struct shim_task *t = &s_tasks[s_task_count++];
+    *t = (struct shim_task){
+        .name = name, .fn = fn, .arg = arg, .priority = priority,
+        .stack_bytes = stack_depth * sizeof(StackType_t), .wake_us = INT64_MAX,
+    };
+    if (s_running) {
+        spawn(t);
+        if (t->priority > s_current->priority) {
+            switch_away(s_current);
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return t;
+}
+
+void shim_task_sleep(int64_t us)
+{
+    pthread_mutex_lock(&s_lock);
+    wait_for(NULL, esp_timer_get_time() + us);
+    pthread_mutex_unlock(&s_lock);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    if (!s_running) {
+        shim_time_advance((int64_t)ticks * 1000);
+        return;
+    }
+    pthread_mutex_lock(&s_lock);
+    if (ticks == 0) {
+        // A yield: behind the other ready tasks of the same priority
+        make_ready(s_current);
+        switch_away(s_current);
+    } else {
+        wait_for(NULL, deadline_of(ticks));
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+void vTaskDelayUntil(TickType_t *previous_wake, TickType_t increment)
+{
+    TickType_t now = xTaskGetTickCount();
+
+    *previous_wake += increment;
+    if ((int32_t)(*previous_wake - now) > 0) {
+        vTaskDelay(*previous_wake - now);
+    }
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    struct shim_task *t = task_of(task);
+
+    if (!s_running || t != s_current) {
+        t->deleted = true;
+        t->ready = false;
+        return;
+    }
+    pthread_mutex_lock(&s_lock);
+    t->deleted = true;
+    t->ready = false;
+    switch_away(t);
+    pthread_mutex_unlock(&s_lock);
+    // The thread parks here for good; its stack stays valid like the static one on the device
+    while (1) {
+        pthread_mutex_lock(&s_lock);
+        pthread_cond_wait(&t->wake, &s_lock);
+        pthread_mutex_unlock(&s_lock);
+    }
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return s_current;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    return task_of(task)->priority;
+}
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority)
+{
+    task_of(task)->priority = priority;
+}
+
+unsigned shim_task_priority(void)
+{
+    return s_current->priority;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    return task_of(task)->stack_bytes / sizeof(StackType_t);
+}
+
+void vTaskGetInfo(TaskHandle_t task, TaskStatus_t *status, BaseType_t get_free_stack, eTaskState state)
+{
+    struct shim_task *t = task_of(task);
+
+    *status = (TaskStatus_t){
+        .xHandle = t,
+        .pcTaskName = t->name,
+        .eCurrentState = t->deleted ? eDeleted : t == s_current ? eRunning : t->ready ? eReady : eBlocked,
+        .uxCurrentPriority = t->priority,
+        .uxBasePriority = t->priority,
+        .ulRunTimeCounter = t->run_us,
+        .usStackHighWaterMark = t->stack_bytes / sizeof(StackType_t),
+        .xCoreID = tskNO_AFFINITY,
+    };
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *tasks, UBaseType_t max, uint32_t *total_run_time)
+{
+    UBaseType_t n = 0;
+
+    if (max < s_task_count + 2) {
+        return 0;
+    }
+    for (size_t i = 0; i < s_task_count; i++) {
+        if (!s_tasks[i].deleted) {
+            vTaskGetInfo(&s_tasks[i], &tasks[n++], pdTRUE, eInvalid);
+        }
+    }
+    vTaskGetInfo(&s_timer_task, &tasks[n++], pdTRUE, eInvalid);
+    vTaskGetInfo(&s_idle, &tasks[n++], pdTRUE, eInvalid);
+    if (total_run_time) {
+        *total_run_time = (uint32_t)esp_timer_get_time();
+    }
+    return n;
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpu)
+{
+    return &s_idle;
+}
+
+esp_err_t esp_register_freertos_idle_hook_for_cpu(esp_freertos_idle_cb_t new_idle_cb, UBaseType_t cpuid)
+{
+    for (size_t i = 0; i < SHIM_IDLE_HOOKS_MAX; i++) {
+        if (s_idle_hooks[i] == NULL) {
+            s_idle_hooks[i] = new_idle_cb;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buf)
+{
+    pthread_mutex_init(&buf->mutex, NULL);
+    return buf;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    StaticSemaphore_t *buf = malloc(sizeof(*buf));
+    return buf ? xSemaphoreCreateMutexStatic(buf) : NULL;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait)
+{
+    if (wait == 0) {
+        return pthread_mutex_trylock(&sem->mutex) == 0 ? pdTRUE : pdFALSE;
+    }
+    if (!s_running) {
+        pthread_mutex_lock(&sem->mutex);
+        return pdTRUE;
+    }
+
+    int64_t deadline = deadline_of(wait);
+    BaseType_t ok = pdTRUE;
+    pthread_mutex_lock(&s_lock);
+    while (pthread_mutex_trylock(&sem->mutex) != 0) {
+        if (esp_timer_get_time() >= deadline) {
+            ok = pdFALSE;
+            break;
+        }
+        wait_for(sem, deadline);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ok;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    pthread_mutex_unlock(&sem->mutex);
+    if (s_running) {
+        pthread_mutex_lock(&s_lock);
+        wake_waiters(sem);
+        pthread_mutex_unlock(&s_lock);
+    }
+    return pdTRUE;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *buf)
+{
+    *buf = (StaticQueue_t){ .storage = storage, .item_size = item_size, .length = length };
+    pthread_mutex_init(&buf->mutex, NULL);
+    return buf;
+}
+
+static bool queue_put(QueueHandle_t queue, const void *item)
+{
+    bool ok = false;
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->count < queue->length) {
+        size_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(queue->storage + tail * queue->item_size, item, queue->item_size);
+        queue->count++;
+        ok = true;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return ok;
+}
+
+static bool queue_get(QueueHandle_t queue, void *item)
+{
+    bool ok = false;
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->count > 0) {
+        memcpy(item, queue->storage + queue->head * queue->item_size, queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        ok = true;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return ok;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+    if (!s_running) {
+        return queue_put(queue, item) ? pdTRUE : pdFALSE;
+    }
+
+    int64_t deadline = deadline_of(wait);
+    BaseType_t ok = pdTRUE;
+    pthread_mutex_lock(&s_lock);
+    while (!queue_put(queue, item)) {
+        if (esp_timer_get_time() >= deadline) {
+            ok = pdFALSE;
+            break;
+        }
+        wait_for(queue, deadline);
+    }
+    if (ok) {
+        wake_waiters(queue);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ok;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait)
+{
+    if (!s_running) {
+        bool ok = queue_get(queue, item);
+        if (!ok && wait > 0 && wait != portMAX_DELAY) {
+            vTaskDelay(wait);
+        }
+        return ok ? pdTRUE : pdFALSE;
+    }
+
+    int64_t deadline = deadline_of(wait);
+    BaseType_t ok = pdTRUE;
+    pthread_mutex_lock(&s_lock);
+    while (!queue_get(queue, item)) {
+        if (esp_timer_get_time() >= deadline) {
+            ok = pdFALSE;
+            break;
+        }
+        wait_for(queue, deadline);
+    }
+    if (ok) {
+        wake_waiters(queue);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ok;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->mutex);
+    UBaseType_t count = (UBaseType_t)queue->count;
+    pthread_mutex_unlock(&queue->mutex);
+    return count;
+}
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buf)
+{
+    buf->bits = 0;
+    return buf;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    if (!s_running) {
+        group->bits |= bits;
+        return group->bits;
+    }
+    pthread_mutex_lock(&s_lock);
+    group->bits |= bits;
+    EventBits_t now = group->bits;
+    wake_waiters(group);
+    pthread_mutex_unlock(&s_lock);
+    return now;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    EventBits_t before = group->bits;
+
+    group->bits &= ~bits;
+    return before;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    return group->bits;
+}
+
+static bool bits_met(EventBits_t have, EventBits_t want, BaseType_t wait_for_all)
+{
+    return wait_for_all ? (have & want) == want : (have & want) != 0;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks_to_wait)
+{
+    EventBits_t have;
+
+    if (!s_running) {
+        if (!bits_met(group->bits, bits, wait_for_all) && ticks_to_wait != portMAX_DELAY) {
+            vTaskDelay(ticks_to_wait);
+        }
+    } else {
+        int64_t deadline = deadline_of(ticks_to_wait);
+        pthread_mutex_lock(&s_lock);
+        while (!bits_met(group->bits, bits, wait_for_all) && esp_timer_get_time() < deadline) {
+            wait_for(group, deadline);
+        }
+        pthread_mutex_unlock(&s_lock);
+    }
+    have = group->bits;
+    if (clear_on_exit && bits_met(have, bits, wait_for_all)) {
+        group->bits &= ~bits;
+    }
+    return have;
+}
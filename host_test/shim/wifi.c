@@ -0,0 +1,326 @@
+/*
+    * WiFi station, netif and the default event loop for the host tests
+    *
+    * The access points are whatever the test sets up with shim_wifi_ap_set(). A scan takes
+    * SHIM_WIFI_SCAN_US of simulated time and finds the APs that are up; a connect takes
+    * SHIM_WIFI_CONNECT_US and succeeds if an AP with the configured SSID (and BSSID, if pinned)
+    * is up, raising STA_CONNECTED and GOT_IP, or fails with NO_AP_FOUND. Passwords are not
+    * checked. Taking the AP down disconnects the station with BEACON_TIMEOUT, and the broker
+    * stand-in in mqtt.c is only reachable while the station has its address.
+    *
+    * The event loop has no task of its own: esp_event_post() calls the matching handlers right
+    * away, in the poster's context. The driver posts its events from esp_timer callbacks, so
+    * the handlers still run one at a time, on the esp_timer task.
+*/
+
+#include <string.h>
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "shim.h"
+#include "shim_internal.h"
+
+#define SHIM_WIFI_APS_MAX       4
+#define SHIM_EVENT_HANDLERS_MAX 16
+
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+
+struct esp_netif_obj {
+    int unused;
+};
+
+static struct {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} s_handlers[SHIM_EVENT_HANDLERS_MAX];
+static size_t s_handler_count;
+
+static struct {
+    char ssid[33];
+    int8_t rssi;
+    bool up;
+} s_aps[SHIM_WIFI_APS_MAX];
+static size_t s_ap_count;
+
+static struct {
+    bool init;
+    bool started;
+    wifi_mode_t mode;
+    wifi_sta_config_t sta;
+    esp_timer_handle_t scan_timer;
+    esp_timer_handle_t connect_timer;
+    int ap;                             // Associated AP, -1 = none
+    wifi_ap_record_t scan[SHIM_WIFI_APS_MAX];
+    uint16_t scan_count;
+} s_wifi = { .ap = -1 };
+
+static struct esp_netif_obj s_netif_sta, s_netif_ap;
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t base, int32_t event_id,
+                                     esp_event_handler_t handler, void *handler_arg)
+{
+    return esp_event_handler_instance_register(base, event_id, handler, handler_arg, NULL);
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t base, int32_t event_id,
+                                              esp_event_handler_t handler, void *handler_arg,
+                                              esp_event_handler_instance_t *instance)
+{
+    if (s_handler_count == SHIM_EVENT_HANDLERS_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_handlers[s_handler_count] = (typeof(s_handlers[0])){
+        .base = base, .id = event_id, .handler = handler, .arg = handler_arg,
+    };
+    if (instance) {
+        *instance = &s_handlers[s_handler_count];
+    }
+    s_handler_count++;
+    return ESP_OK;
+}
+
+esp_err_t esp_event_post(esp_event_base_t base, int32_t event_id, const void *event_data,
+                         size_t event_data_size, TickType_t ticks_to_wait)
+{
+    for (size_t i = 0; i < s_handler_count; i++) {
+        if (s_handlers[i].base == base && (s_handlers[i].id == ESP_EVENT_ANY_ID || s_handlers[i].id == event_id)) {
+            s_handlers[i].handler(s_handlers[i].arg, base, event_id, (void *)event_data);
+        }
+    }
+    return ESP_OK;
+}
+
+static void ap_bssid(size_t idx, uint8_t bssid[6])
+{
+    static const uint8_t base[6] = { 0x02, 0x00, 0x00, 0x00, 0x01, 0x00 };
+
+    memcpy(bssid, base, sizeof(base));
+    bssid[5] = (uint8_t)idx;
+}
+
+static void post_disconnected(uint8_t reason)
+{
+    wifi_event_sta_disconnected_t ev = { .reason = reason };
+
+    memcpy(ev.ssid, s_wifi.sta.ssid, sizeof(ev.ssid));
+    ev.ssid_len = (uint8_t)strnlen((const char *)ev.ssid, sizeof(ev.ssid));
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &ev, sizeof(ev), 0);
+}
+
+// Drops the association, if any, and reports it
+static void lose_link(uint8_t reason)
+{
+    if (s_wifi.ap < 0) {
+        return;
+    }
+    s_wifi.ap = -1;
+    shim_mqtt_link_set(false);
+    post_disconnected(reason);
+}
+
+static void scan_done(void *arg)
+{
+    s_wifi.scan_count = 0;
+    for (size_t i = 0; i < s_ap_count; i++) {
+        if (s_aps[i].up) {
+            wifi_ap_record_t *r = &s_wifi.scan[s_wifi.scan_count++];
+            *r = (wifi_ap_record_t){ .primary = 6, .rssi = s_aps[i].rssi, .authmode = WIFI_AUTH_WPA2_PSK };
+            ap_bssid(i, r->bssid);
+            memcpy(r->ssid, s_aps[i].ssid, sizeof(r->ssid));
+        }
+    }
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, NULL, 0, 0);
+}
+
+static void connect_done(void *arg)
+{
+    int found = -1;
+
+    for (size_t i = 0; i < s_ap_count; i++) {
+        uint8_t bssid[6];
+        ap_bssid(i, bssid);
+        if (s_aps[i].up && strncmp(s_aps[i].ssid, (const char *)s_wifi.sta.ssid, sizeof(s_wifi.sta.ssid)) == 0 &&
+            (!s_wifi.sta.bssid_set || memcmp(bssid, s_wifi.sta.bssid, sizeof(bssid)) == 0) &&
+            (found < 0 || s_aps[i].rssi > s_aps[found].rssi)) {
+            found = (int)i;
+        }
+    }
+    if (found < 0) {
+        post_disconnected(WIFI_REASON_NO_AP_FOUND);
+        return;
+    }
+
+    ip_event_got_ip_t got_ip = {
+        .esp_netif = &s_netif_sta,
+        .ip_info = {
+            .ip = { ESP_IP4TOADDR(192, 168, 1, 50) },
+            .netmask = { ESP_IP4TOADDR(255, 255, 255, 0) },
+            .gw = { ESP_IP4TOADDR(192, 168, 1, 1) },
+        },
+        .ip_changed = true,
+    };
+    s_wifi.ap = found;
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, NULL, 0, 0);
+    shim_mqtt_link_set(true);
+    esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &got_ip, sizeof(got_ip), 0);
+}
+
+esp_err_t esp_netif_init(void)
+{
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void)
+{
+    return &s_netif_sta;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_ap(void)
+{
+    return &s_netif_ap;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)
+{
+    const esp_timer_create_args_t scan_args = { .callback = scan_done, .name = "shim_wifi_scan" };
+    const esp_timer_create_args_t connect_args = { .callback = connect_done, .name = "shim_wifi_conn" };
+
+    if (s_wifi.init) {
+        return ESP_OK;
+    }
+    s_wifi.init = true;
+    esp_timer_create(&scan_args, &s_wifi.scan_timer);
+    esp_timer_create(&connect_args, &s_wifi.connect_timer);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    if (!s_wifi.init) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    s_wifi.mode = mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mode(wifi_mode_t *mode)
+{
+    *mode = s_wifi.mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    if (!s_wifi.init) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    if (interface == WIFI_IF_STA) {
+        s_wifi.sta = conf->sta;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    if (!s_wifi.init) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    s_wifi.started = true;
+    if (s_wifi.mode == WIFI_MODE_STA || s_wifi.mode == WIFI_MODE_APSTA) {
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_START, NULL, 0, 0);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_stop(void)
+{
+    s_wifi.started = false;
+    esp_timer_stop(s_wifi.scan_timer);
+    esp_timer_stop(s_wifi.connect_timer);
+    lose_link(WIFI_REASON_ASSOC_LEAVE);
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_STOP, NULL, 0, 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect(void)
+{
+    if (!s_wifi.started) {
+        return ESP_ERR_WIFI_NOT_STARTED;
+    }
+    if (s_wifi.ap >= 0) {
+        return ESP_ERR_WIFI_CONN;
+    }
+    esp_timer_stop(s_wifi.connect_timer);
+    return esp_timer_start_once(s_wifi.connect_timer, SHIM_WIFI_CONNECT_US);
+}
+
+esp_err_t esp_wifi_disconnect(void)
+{
+    if (!s_wifi.started) {
+        return ESP_ERR_WIFI_NOT_STARTED;
+    }
+    esp_timer_stop(s_wifi.connect_timer);
+    lose_link(WIFI_REASON_ASSOC_LEAVE);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_start(const wifi_scan_config_t *config, bool block)
+{
+    if (!s_wifi.started) {
+        return ESP_ERR_WIFI_NOT_STARTED;
+    }
+    if (esp_timer_is_active(s_wifi.scan_timer)) {
+        return ESP_ERR_WIFI_STATE;
+    }
+    return esp_timer_start_once(s_wifi.scan_timer, SHIM_WIFI_SCAN_US);
+}
+
+esp_err_t esp_wifi_scan_get_ap_records(uint16_t *number, wifi_ap_record_t *ap_records)
+{
+    uint16_t n = *number < s_wifi.scan_count ? *number : s_wifi.scan_count;
+
+    memcpy(ap_records, s_wifi.scan, n * sizeof(ap_records[0]));
+    *number = n;
+    s_wifi.scan_count = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    if (s_wifi.ap < 0) {
+        return ESP_ERR_WIFI_NOT_CONNECT;
+    }
+    *ap_info = (wifi_ap_record_t){ .primary = 6, .rssi = s_aps[s_wifi.ap].rssi, .authmode = WIFI_AUTH_WPA2_PSK };
+    ap_bssid((size_t)s_wifi.ap, ap_info->bssid);
+    memcpy(ap_info->ssid, s_aps[s_wifi.ap].ssid, sizeof(ap_info->ssid));
+    return ESP_OK;
+}
+
+void shim_wifi_ap_set(const char *ssid, int8_t rssi, bool up)
+{
+    size_t i;
+
+    for (i = 0; i < s_ap_count && strcmp(s_aps[i].ssid, ssid) != 0; i++) {
+    }
+    if (i == s_ap_count) {
+        if (s_ap_count == SHIM_WIFI_APS_MAX) {
+            return;
+        }
+        s_ap_count++;
+        strncpy(s_aps[i].ssid, ssid, sizeof(s_aps[i].ssid) - 1);
+    }
+    s_aps[i].rssi = rssi;
+    s_aps[i].up = up;
+    if (!up && s_wifi.ap == (int)i) {
+        lose_link(WIFI_REASON_BEACON_TIMEOUT);
+    }
+}
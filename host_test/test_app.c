@@ -0,0 +1,244 @@
+/*
+    * The whole firmware on the host: app_main() and its tasks on the shim scheduler
+    *
+    * A virtual DHT11 answers on the sensor pin and an access point of the first configured
+    * network is up. Everything else is the firmware as built for the device: dht11_task samples
+    * through sensors.c, publish_task sends through publish_sensor_state() to the broker stand-in,
+    * the HTTP handlers answer on the URIs start_webserver() registered, and the status task
+    * follows WiFi and the sensor. The test moves the simulated clock and checks what comes out.
+*/
+
+#define WIFI_SSID_1 "office"
+#define WIFI_PASS_1 "office-pass"
+#define WIFI_SSID_2 ""
+#define WIFI_PASS_2 ""
+#include "main.c"
+
+#include "dht_line.h"
+#include "shim.h"
+#include "test_util.h"
+
+#define STATE_TOPIC     MQTT_COMBINED_QUANTITY "/state"
+#define NONE            UINT32_MAX
+
+static dht_sim_config_t s_sim = {
+    .temperature = 210,
+    .humidity = 450,
+};
+
+static void advance_ms(uint32_t ms)
+{
+    shim_time_advance((int64_t)ms * 1000);
+}
+
+static uint32_t messages(void)
+{
+    shim_mqtt_stats_t st;
+    shim_mqtt_get_stats(&st);
+    return st.publishes;
+}
+
+// First message on topic from the n-th on, NONE if there is none
+static uint32_t find(uint32_t from, const char *topic)
+{
+    for (uint32_t n = from; n < messages(); n++) {
+        const shim_mqtt_message_t *m = shim_mqtt_message(n);
+        if (m && strcmp(m->topic, topic) == 0) {
+            return n;
+        }
+    }
+    return NONE;
+}
+
+// One request on a fresh connection; returns the response with the status line
+static const char *http(int method, const char *uri)
+{
+    static char resp[4096];
+    int fd = shim_httpd_connect(sizeof(resp));
+
+    shim_httpd_call(fd, method, uri, NULL, NULL, 0);
+    size_t n = shim_httpd_read(fd, resp, sizeof(resp) - 1);
+    resp[n] = '\0';
+    shim_httpd_close(fd);
+    shim_httpd_run();
+    return resp;
+}
+
+static void check_boot(void)
+{
+    // Scan, connect, broker session; the first publish_task run after that resyncs
+    advance_ms(10000);
+
+    wifi_select_info_t wi;
+    wifi_select_get_info(&wi);
+    CHECK(wifi_connected);
+    CHECK(mqtt_link_connected());
+    CHECK(wi.ssid && strcmp(wi.ssid, "office") == 0);
+    CHECK_EQ(wi.via, WIFI_SELECT_VIA_SCAN);
+    CHECK_EQ(shim_tasks_created(), 5);      // status, dlog and the three of app_main()
+
+    const shim_mqtt_message_t *m = shim_mqtt_message(find(0, "homeassistant/sensor/temperature/config"));
+    CHECK(m && m->retain && m->qos == MQTT_QOS_DISCOVERY && strstr(m->data, "\"state_topic\": \"climate/state\""));
+    m = shim_mqtt_message(find(0, "homeassistant/sensor/humidity/config"));
+    CHECK(m && m->retain && strstr(m->data, "value_json.humidity"));
+
+    // dht_sim through the decoder, the filter and the seqlock to the JSON on the wire
+    m = shim_mqtt_message(find(0, STATE_TOPIC));
+    CHECK(m && m->qos == MQTT_QOS_COMBINED && !m->retain);
+    CHECK(m && strcmp(m->data, "{\"temperature\":21.0,\"humidity\":45.0}") == 0);
+    CHECK_EQ(metrics_boot_phase_ms(METRIC_BOOT_GOT_IP), SHIM_WIFI_SCAN_US / 1000 + SHIM_WIFI_CONNECT_US / 1000);
+    CHECK_EQ(status_state(), STATUS_NORMAL);
+}
+
+static void check_heartbeat_and_deadband(void)
+{
+    uint32_t first = find(0, STATE_TOPIC);
+    int64_t last_us = shim_mqtt_message(first)->time_us;
+
+    // Unchanged readings only go out with the heartbeat
+    advance_ms(3 * MQTT_HEARTBEAT_MS);
+    unsigned beats = 0;
+    for (uint32_t n = find(first + 1, STATE_TOPIC); n != NONE; n = find(n + 1, STATE_TOPIC)) {
+        int64_t t = shim_mqtt_message(n)->time_us;
+        CHECK(t - last_us >= (int64_t)MQTT_HEARTBEAT_MS * 1000);
+        CHECK(t - last_us <= (int64_t)(MQTT_HEARTBEAT_MS + 5000) * 1000);
+        last_us = t;
+        beats++;
+    }
+    CHECK(beats >= 2 && beats <= 3);
+
+    // A step past the deadband goes out well before the next heartbeat
+    uint32_t from = messages();
+    int64_t step_us = esp_timer_get_time();
+    s_sim.temperature = 230;
+    advance_ms(30000);
+    uint32_t n = find(from, STATE_TOPIC);
+    CHECK(n != NONE);
+    if (n != NONE) {
+        CHECK(shim_mqtt_message(n)->time_us - step_us < (int64_t)MQTT_HEARTBEAT_MS * 1000);
+        CHECK(strstr(shim_mqtt_message(n)->data, "\"temperature\":21.0") == NULL);
+    }
+    advance_ms(60000);
+    reading_t r;
+    sensor_latest(0, &r);
+    CHECK_EQ(r.temperature, 230);
+}
+
+static void check_probe(void)
+{
+    metrics_hist_summary_t rt;
+
+    // The broker hands the probe back SHIM_MQTT_DELIVERY_US after it got it
+    metrics_hist_summary(METRIC_HIST_MQTT_ROUNDTRIP, &rt);
+    CHECK(rt.count >= 5);
+    CHECK_EQ(rt.sum_us, (uint64_t)rt.count * SHIM_MQTT_DELIVERY_US);
+    CHECK_EQ(metrics_counter(METRIC_MQTT_PROBES), rt.count);
+}
+
+static void check_broker_outage(void)
+{
+    wal_stats_t wal;
+    uint32_t from;
+
+    shim_mqtt_broker_set(false);
+    advance_ms(100);
+    CHECK(!mqtt_link_connected());
+    from = messages();
+    advance_ms(60000);
+    CHECK_EQ(messages(), from);
+    wal_get_stats(&wal);
+    CHECK(wal.pending >= 3);
+
+    // Back up: discovery and a forced state again, then the offline log in QoS 1 batches
+    shim_mqtt_broker_set(true);
+    advance_ms(120000);
+    CHECK(mqtt_link_connected());
+    CHECK(find(from, "homeassistant/sensor/temperature/config") != NONE);
+    CHECK(find(from, STATE_TOPIC) != NONE);
+    uint32_t n = find(from, MQTT_BACKLOG_TOPIC);
+    CHECK(n != NONE);
+    if (n != NONE) {
+        CHECK_EQ(shim_mqtt_message(n)->qos, MQTT_QOS_BACKLOG);
+        CHECK(strncmp(shim_mqtt_message(n)->data, "[{\"sensor\":\"room\"", 17) == 0);
+    }
+    wal_get_stats(&wal);
+    CHECK_EQ(wal.pending, 0);
+    CHECK(wal.replayed >= 3);
+}
+
+static void check_http(void)
+{
+    const char *resp;
+
+    resp = http(HTTP_GET, "/temperature");
+    CHECK(strncmp(resp, "HTTP/1.1 200 OK", 15) == 0 && strstr(resp, "{\"temperature\":23.0}"));
+    resp = http(HTTP_GET, "/status");
+    CHECK(strstr(resp, "\"wifi_connected\":true") && strstr(resp, "\"sensor_ok\":true"));
+    resp = http(HTTP_GET, "/sensor/room");
+    CHECK(strstr(resp, "\"name\":\"room\""));
+    // Chunked, so no status line of its own
+    resp = http(HTTP_GET, "/metrics");
+    CHECK(strstr(resp, "dht_reads_total "));
+    resp = http(HTTP_GET, "/perf");
+    CHECK(strncmp(resp, "HTTP/1.1 200 OK", 15) == 0 && strstr(resp, "\"version\":\"host\""));
+    CHECK(strstr(resp, "\"read_failures\":0,"));
+    resp = http(HTTP_GET, "/nowhere");
+    CHECK(strncmp(resp, "HTTP/1.1 404", 12) == 0);
+
+    // A shorter publish period takes effect on the publisher's next round
+    resp = http(HTTP_POST, "/config?publish_ms=1000");
+    CHECK(strstr(resp, "\"publish_ms\":1000"));
+    resp = http(HTTP_GET, "/config");
+    CHECK(strstr(resp, "\"publish_ms\":1000"));
+    advance_ms(5000);
+    uint32_t runs = s_publish_loop.runs;
+    advance_ms(10000);
+    CHECK(s_publish_loop.runs - runs >= 9);
+    http(HTTP_POST, "/config?publish_ms=5000");
+}
+
+static void check_status(void)
+{
+    // A sensor that stops answering goes stale, and back once it answers again
+    s_sim.faults.no_response = 1000;
+    advance_ms(SENSOR_STALE_MS + 30000);
+    CHECK_EQ(status_state(), STATUS_ERROR);
+    CHECK(!status_sensor_online());
+    s_sim.faults.no_response = 0;
+    advance_ms(30000);
+    CHECK_EQ(status_state(), STATUS_NORMAL);
+
+    // Losing the AP takes the broker session with it; the cached AP is tried first on return
+    shim_mqtt_stats_t before, after;
+    shim_mqtt_get_stats(&before);
+    shim_wifi_ap_set("office", -50, false);
+    advance_ms(100);
+    CHECK(!wifi_connected);
+    CHECK(!mqtt_link_connected());
+    CHECK_EQ(status_state(), STATUS_ERROR);
+    shim_wifi_ap_set("office", -50, true);
+    advance_ms(30000);
+    shim_mqtt_get_stats(&after);
+    CHECK(wifi_connected);
+    CHECK(mqtt_link_connected());
+    CHECK_EQ(after.sessions, before.sessions + 1);
+    CHECK_EQ(status_state(), STATUS_NORMAL);
+}
+
+int main(void)
+{
+    shim_partition_create(WAL_PARTITION_LABEL, WAL_PARTITION_SUBTYPE, 16 * 4096);
+    shim_dht_attach(GPIO_NUM_18, DHT_TYPE_DHT11, &s_sim);
+    shim_wifi_ap_set("office", -50, true);
+    shim_wifi_ap_set("neighbour", -40, true);
+    shim_tasks_start();
+
+    app_main();
+    check_boot();
+    check_heartbeat_and_deadband();
+    check_probe();
+    check_broker_outage();
+    check_http();
+    check_status();
+    return TEST_RESULT();
+}
@@ -0,0 +1,279 @@
+/*
+    * CBOR writer against the RFC 8949 Appendix A examples, plus size and encode time against JSON
+    *
+    * Every example the writer can produce (integers, simple values, text, definite arrays and
+    * maps) must come out byte for byte as in the RFC. The reading payload is then encoded both ways
+    * as the MQTT state and /sensor responses do, and walked item by item to check it is complete.
+*/
+
+#include <string.h>
+#include "cbor_writer.h"
+#include "json_writer.h"
+#include "test_util.h"
+
+#define ENCODES 200000
+
+static size_t unhex(const char *hex, uint8_t *out)
+{
+    size_t n = 0;
+
+    for (; hex[0] && hex[1]; hex += 2) {
+        unsigned v;
+        sscanf(hex, "%2x", &v);
+        out[n++] = (uint8_t)v;
+    }
+    return n;
+}
+
+static void expect(const cbor_writer_t *w, const char *hex, const char *what)
+{
+    uint8_t want[64];
+    size_t n = unhex(hex, want);
+
+    if (w->overflow || w->len != n || memcmp(w->buf, want, n) != 0) {
+        fprintf(stderr, "%s: got", what);
+        for (size_t i = 0; i < w->len; i++) {
+            fprintf(stderr, " %02x", w->buf[i]);
+        }
+        fprintf(stderr, ", want %s\n", hex);
+        s_test_failures++;
+    }
+}
+
+static void rfc_vectors(void)
+{
+    static const struct {
+        uint64_t value;
+        const char *hex;
+    } uints[] = {
+        { 0, "00" }, { 1, "01" }, { 10, "0a" }, { 23, "17" }, { 24, "1818" }, { 25, "1819" },
+        { 100, "1864" }, { 1000, "1903e8" }, { 1000000, "1a000f4240" },
+        { 1000000000000ull, "1b000000e8d4a51000" }, { 18446744073709551615ull, "1bffffffffffffffff" },
+    };
+    static const struct {
+        int64_t value;
+        const char *hex;
+    } ints[] = {
+        { -1, "20" }, { -10, "29" }, { -100, "3863" }, { -1000, "3903e7" },
+        { INT64_MIN, "3b7fffffffffffffff" }, { 0, "00" }, { 500, "1901f4" },
+    };
+    static const struct {
+        const char *value;
+        const char *hex;
+    } strs[] = {
+        { "", "60" }, { "a", "6161" }, { "IETF", "6449455446" }, { "\"\\", "62225c" },
+        { "\xc3\xbc", "62c3bc" }, { "\xe6\xb0\xb4", "63e6b0b4" },
+    };
+    uint8_t buf[64];
+    cbor_writer_t w;
+
+    for (size_t i = 0; i < sizeof(uints) / sizeof(uints[0]); i++) {
+        cbor_init(&w, buf, sizeof(buf));
+        cbor_uint(&w, NULL, uints[i].value);
+        expect(&w, uints[i].hex, "uint");
+    }
+    for (size_t i = 0; i < sizeof(ints) / sizeof(ints[0]); i++) {
+        cbor_init(&w, buf, sizeof(buf));
+        cbor_int(&w, NULL, ints[i].value);
+        expect(&w, ints[i].hex, "int");
+    }
+    for (size_t i = 0; i < sizeof(strs) / sizeof(strs[0]); i++) {
+        cbor_init(&w, buf, sizeof(buf));
+        cbor_str(&w, NULL, strs[i].value);
+        expect(&w, strs[i].hex, "text");
+    }
+
+    cbor_init(&w, buf, sizeof(buf));
+    cbor_bool(&w, NULL, false);
+    cbor_bool(&w, NULL, true);
+    expect(&w, "f4f5", "false, true");
+
+    cbor_init(&w, buf, sizeof(buf));
+    cbor_arr(&w, NULL, 0);
+    expect(&w, "80", "[]");
+
+    cbor_init(&w, buf, sizeof(buf));
+    cbor_arr(&w, NULL, 3);
+    cbor_uint(&w, NULL, 1);
+    cbor_uint(&w, NULL, 2);
+    cbor_uint(&w, NULL, 3);
+    expect(&w, "83010203", "[1, 2, 3]");
+
+    cbor_init(&w, buf, sizeof(buf));
+    cbor_arr(&w, NULL, 3);
+    cbor_uint(&w, NULL, 1);
+    cbor_arr(&w, NULL, 2);
+    cbor_uint(&w, NULL, 2);
+    cbor_uint(&w, NULL, 3);
+    cbor_arr(&w, NULL, 2);
+    cbor_uint(&w, NULL, 4);
+    cbor_uint(&w, NULL, 5);
+    expect(&w, "8301820203820405", "[1, [2, 3], [4, 5]]");
+
+    cbor_init(&w, buf, sizeof(buf));
+    cbor_map(&w, NULL, 0);
+    expect(&w, "a0", "{}");
+
+    cbor_init(&w, buf, sizeof(buf));
+    cbor_map(&w, NULL, 2);
+    cbor_uint(&w, "a", 1);
+    cbor_arr(&w, "b", 2);
+    cbor_uint(&w, NULL, 2);
+    cbor_uint(&w, NULL, 3);
+    expect(&w, "a26161016162820203", "{\"a\": 1, \"b\": [2, 3]}");
+
+    cbor_init(&w, buf, sizeof(buf));
+    cbor_arr(&w, NULL, 2);
+    cbor_str(&w, NULL, "a");
+    cbor_map(&w, NULL, 1);
+    cbor_str(&w, "b", "c");
+    expect(&w, "826161a161626163", "[\"a\", {\"b\": \"c\"}]");
+
+    cbor_init(&w, buf, sizeof(buf));
+    cbor_map(&w, NULL, 5);
+    cbor_str(&w, "a", "A");
+    cbor_str(&w, "b", "B");
+    cbor_str(&w, "c", "C");
+    cbor_str(&w, "d", "D");
+    cbor_str(&w, "e", "E");
+    expect(&w, "a56161614161626142616361436164614461656145", "{\"a\": \"A\", ... \"e\": \"E\"}");
+
+    // A 24-element array needs the one-byte length form
+    cbor_init(&w, buf, sizeof(buf));
+    cbor_arr(&w, NULL, 25);
+    for (int i = 1; i <= 25; i++) {
+        cbor_uint(&w, NULL, (uint64_t)i);
+    }
+    expect(&w, "98190102030405060708090a0b0c0d0e0f101112131415161718181819", "[1, ..., 25]");
+}
+
+static void overflow(void)
+{
+    uint8_t buf[8];
+    cbor_writer_t w;
+
+    // Exactly full is fine; one byte more is flagged and nothing partial is appended
+    cbor_init(&w, buf, 9);
+    cbor_uint(&w, NULL, UINT64_MAX);
+    CHECK(!w.overflow);
+    CHECK_EQ(w.len, 9);
+
+    cbor_init(&w, buf, sizeof(buf));
+    cbor_str(&w, NULL, "1234");
+    CHECK_EQ(w.len, 5);
+    cbor_uint(&w, NULL, 1000000);
+    CHECK(w.overflow);
+    CHECK_EQ(w.len, 5);
+    cbor_uint(&w, NULL, 1);
+    CHECK(w.overflow);
+    CHECK_EQ(w.len, 5);
+}
+
+// Skip one well-formed item; returns the offset after it, or 0 if it runs past len
+static size_t skip_item(const uint8_t *p, size_t len, size_t off)
+{
+    if (off >= len) {
+        return 0;
+    }
+    uint8_t major = p[off] >> 5, info = p[off] & 0x1f;
+    uint64_t arg = info;
+    off++;
+    if (info >= 24 && info <= 27) {
+        size_t n = (size_t)1 << (info - 24);
+        if (off + n > len) {
+            return 0;
+        }
+        for (arg = 0; n--; ) {
+            arg = arg << 8 | p[off++];
+        }
+    } else if (info > 27) {
+        return 0;
+    }
+    switch (major) {
+    case 0: case 1: case 7:
+        return off;
+    case 2: case 3:
+        return off + arg <= len ? off + arg : 0;
+    case 4: case 5:
+        for (uint64_t i = 0; i < (major == 5 ? 2 * arg : arg); i++) {
+            if ((off = skip_item(p, len, off)) == 0) {
+                return 0;
+            }
+        }
+        return off;
+    default:
+        return 0;
+    }
+}
+
+// The six fields of encode_reading_cbor(), and the same fields as JSON with the JSON payloads' key names
+static void reading_cbor(cbor_writer_t *w, uint32_t seq, uint64_t ts, int16_t t, int16_t h)
+{
+    cbor_map(w, NULL, 6);
+    cbor_str(w, "id", "room");
+    cbor_uint(w, "seq", seq);
+    cbor_uint(w, "ts", ts);
+    cbor_int(w, "t", t);
+    cbor_int(w, "h", h);
+    cbor_bool(w, "ok", true);
+}
+
+static void reading_json(json_writer_t *w, uint32_t seq, uint64_t ts, int16_t t, int16_t h)
+{
+    json_obj_open(w, NULL);
+    json_str(w, "id", "room");
+    json_uint(w, "seq", seq);
+    json_uint(w, "ts", ts);
+    json_tenths(w, "temperature", t);
+    json_tenths(w, "humidity", h);
+    json_bool(w, "ok", true);
+    json_obj_close(w);
+}
+
+static void size_and_time(void)
+{
+    uint8_t cbuf[64];
+    char jbuf[128];
+    cbor_writer_t cw;
+    json_writer_t jw;
+    size_t cbytes = 0, jbytes = 0;
+    int64_t t0;
+
+    t0 = test_now_ns();
+    for (uint32_t i = 0; i < ENCODES; i++) {
+        cbor_init(&cw, cbuf, sizeof(cbuf));
+        reading_cbor(&cw, i, 3600000 + i * 3000ull, (int16_t)(200 + i % 100), (int16_t)(400 + i % 300));
+        cbytes += cw.len;
+        CHECK(!cw.overflow);
+    }
+    double cbor_ns = (double)(test_now_ns() - t0) / ENCODES;
+
+    t0 = test_now_ns();
+    for (uint32_t i = 0; i < ENCODES; i++) {
+        json_init(&jw, jbuf, sizeof(jbuf));
+        reading_json(&jw, i, 3600000 + i * 3000ull, (int16_t)(200 + i % 100), (int16_t)(400 + i % 300));
+        jbytes += jw.len;
+        CHECK(!jw.overflow);
+    }
+    double json_ns = (double)(test_now_ns() - t0) / ENCODES;
+
+    // The last reading encoded is one complete map and nothing else
+    CHECK_EQ(skip_item(cbuf, cw.len, 0), cw.len);
+    CHECK_EQ(cbuf[0], 0xa6);
+    // Cut off anywhere, it is no longer complete
+    for (size_t n = 1; n < cw.len; n++) {
+        CHECK_EQ(skip_item(cbuf, n, 0), 0);
+    }
+
+    printf("reading: CBOR %.1f bytes in %.0f ns, JSON %.1f bytes in %.0f ns\n",
+           (double)cbytes / ENCODES, cbor_ns, (double)jbytes / ENCODES, json_ns);
+    CHECK(cbytes * 10 < jbytes * 6);
+}
+
+int main(void)
+{
+    rfc_vectors();
+    overflow();
+    size_and_time();
+    return TEST_RESULT();
+}
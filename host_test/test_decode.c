@@ -0,0 +1,128 @@
+/*
+    * Decoder regression suite and microbenchmark
+    *
+    * Thousands of simulated captures per sensor type go through dht_decode_pulses(): clean ones and
+    * increasingly jittered ones must decode to exactly the encoded values, and injected faults must
+    * never come back as a good frame. The time per decode is measured over the whole set.
+*/
+
+#include <string.h>
+#include "dht_decode.h"
+#include "dht_sim.h"
+#include "test_util.h"
+
+#define CAPTURES        5000
+#define BENCH_ROUNDS    20
+
+typedef struct {
+    dht_level_t runs[96];
+    size_t count;
+    uint8_t data[DHT_DATA_BYTES];
+} capture_t;
+
+static capture_t s_captures[CAPTURES];
+
+static const struct {
+    dht_sensor_type_t type;
+    const char *name;
+    int16_t hum_min, hum_max;
+    int16_t temp_min, temp_max;
+} s_types[] = {
+    { DHT_TYPE_DHT11, "DHT11", 200, 900, 0, 500 },
+    { DHT_TYPE_DHT22, "DHT22", 0, 1000, -400, 800 },
+    { DHT_TYPE_AM2301, "AM2301", 0, 1000, -400, 800 },
+};
+
+static int16_t rand_between(uint32_t *rng, int16_t lo, int16_t hi)
+{
+    return (int16_t)(lo + (int32_t)(test_rand(rng) % (uint32_t)(hi - lo + 1)));
+}
+
+// Fill s_captures and return how many decoded; a good status must always carry the encoded bytes
+static unsigned run_set(size_t t, const dht_sim_faults_t *faults, uint32_t *rng, unsigned *wrong)
+{
+    unsigned ok = 0;
+
+    for (size_t i = 0; i < CAPTURES; i++) {
+        capture_t *c = &s_captures[i];
+        int16_t hum = rand_between(rng, s_types[t].hum_min, s_types[t].hum_max);
+        int16_t temp = rand_between(rng, s_types[t].temp_min, s_types[t].temp_max);
+        uint8_t data[DHT_DATA_BYTES];
+
+        dht_sim_encode(s_types[t].type, hum, temp, c->data);
+        c->count = dht_sim_waveform(s_types[t].type, hum, temp, faults, rng,
+                                    c->runs, sizeof(c->runs) / sizeof(c->runs[0]));
+        if (dht_decode_pulses(c->runs, c->count, data) != DHT_DECODE_OK) {
+            continue;
+        }
+        ok++;
+        if (memcmp(data, c->data, DHT_DATA_BYTES) != 0) {
+            (*wrong)++;
+            continue;
+        }
+        int16_t h, v;
+        dht_parse_data(s_types[t].type, data, &h, &v);
+        if (s_types[t].type == DHT_TYPE_DHT11) {
+            // Only whole units travel in a DHT11 frame
+            hum -= hum % 10;
+            temp -= temp % 10;
+        }
+        if (h != hum || v != temp) {
+            (*wrong)++;
+        }
+    }
+    return ok;
+}
+
+static double bench_ns(void)
+{
+    uint8_t data[DHT_DATA_BYTES];
+    volatile unsigned sink = 0;
+    int64_t t0 = test_now_ns();
+
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        for (size_t i = 0; i < CAPTURES; i++) {
+            sink += dht_decode_pulses(s_captures[i].runs, s_captures[i].count, data);
+        }
+    }
+    (void)sink;
+    return (double)(test_now_ns() - t0) / (BENCH_ROUNDS * CAPTURES);
+}
+
+int main(void)
+{
+    uint32_t rng = 0x9E3779B9;
+
+    for (size_t t = 0; t < sizeof(s_types) / sizeof(s_types[0]); t++) {
+        unsigned wrong = 0;
+
+        // Jitter up to the point where a 26us zero and a 70us one still fall on their side of 48us
+        for (uint16_t jitter = 0; jitter <= 20; jitter += 4) {
+            dht_sim_faults_t faults = { .jitter_us = jitter };
+            unsigned ok = run_set(t, &faults, &rng, &wrong);
+            CHECK_EQ(ok, CAPTURES);
+            printf("%-6s jitter +/-%2u us: %u/%u decoded, %.0f ns/decode\n",
+                   s_types[t].name, jitter, ok, CAPTURES, bench_ns());
+        }
+
+        // Beyond that bits start to flip. The 8-bit sum misses some multi-bit errors (a 0->1 flip
+        // in a data byte and the same one in the checksum cancel out), which is reported, not asserted.
+        for (uint16_t jitter = 24; jitter <= 32; jitter += 4) {
+            dht_sim_faults_t faults = { .jitter_us = jitter };
+            unsigned missed = 0;
+            unsigned ok = run_set(t, &faults, &rng, &missed);
+            printf("%-6s jitter +/-%2u us: %u/%u decoded (%.1f%% error rate, %u wrong frames passed the checksum)\n",
+                   s_types[t].name, jitter, ok, CAPTURES, 100.0 * (CAPTURES - ok) / CAPTURES, missed);
+        }
+
+        // Missing answers, missing bits and corrupted bits are all reported, never decoded
+        dht_sim_faults_t faults = { .jitter_us = 4, .no_response = 200, .dropped_bit = 200, .bad_checksum = 200 };
+        unsigned ok = run_set(t, &faults, &rng, &wrong);
+        CHECK(ok > CAPTURES * 4 / 10 && ok < CAPTURES * 6 / 10);
+        printf("%-6s with faults:      %u/%u decoded, %.0f ns/decode\n",
+               s_types[t].name, ok, CAPTURES, bench_ns());
+
+        CHECK_EQ(wrong, 0);
+    }
+    return TEST_RESULT();
+}
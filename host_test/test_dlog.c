@@ -0,0 +1,45 @@
+/*
+    * Deferred log ring before the drain task starts, and level filtering
+    *
+    * app_main logs before dlog_init(); those records must wait in the ring rather than be counted
+    * as dropped. Sites filtered by esp_log_level_set() must not take a slot at all.
+*/
+
+#include "dlog.h"
+#include "test_util.h"
+
+static const char *TAG = "test";
+
+int main(void)
+{
+    dlog_stats_t st;
+
+    // The drain task is not run on the host, so nothing leaves the ring in this test
+    for (int i = 0; i < DLOG_RING_SIZE; i++) {
+        DLOGI(TAG, "early record %d", i);
+    }
+    dlog_get_stats(&st);
+    CHECK_EQ(st.written, DLOG_RING_SIZE);
+    CHECK_EQ(st.dropped, 0);
+
+    DLOGI(TAG, "one too many");
+    dlog_get_stats(&st);
+    CHECK_EQ(st.dropped, 1);
+
+    // Below the tag's level: neither written nor dropped
+    DLOGD(TAG, "filtered %d", 1);
+    esp_log_level_set(TAG, ESP_LOG_WARN);
+    DLOGI(TAG, "filtered %d", 2);
+    dlog_get_stats(&st);
+    CHECK_EQ(st.written, DLOG_RING_SIZE);
+    CHECK_EQ(st.dropped, 1);
+
+    // Once enabled the site queues again (and finds the ring still full)
+    esp_log_level_set(TAG, ESP_LOG_DEBUG);
+    DLOGD(TAG, "enabled %d", 3);
+    dlog_get_stats(&st);
+    CHECK_EQ(st.dropped, 2);
+
+    dlog_init();
+    return TEST_RESULT();
+}
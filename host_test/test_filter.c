@@ -0,0 +1,226 @@
+/*
+    * Reading filter on replayed noisy traces
+    *
+    * Traces are replayed through filter_update() at the sampler's pace, with the default filter
+    * settings from sensors.c: sensor noise and spikes must be absorbed, real level changes and
+    * changes across a deep-sleep gap must come through, and a true 0.0 reading is just a value.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "filter.h"
+#include "test_util.h"
+
+#define PERIOD_US   3000000
+
+// As s_default_filter in sensors.c
+static const filter_config_t s_cfg = {
+    .median_window = 3,
+    .ema_alpha = 96,
+    .temp_step = 20,
+    .temp_slew = 1,
+    .hum_step = 50,
+    .hum_slew = 5,
+    .max_rejects = 3,
+};
+
+// A DHT11 trace as the driver delivered it: whole degrees, one read that passed the checksum
+// with a corrupted temperature byte, and one 0/0 frame
+static const int16_t s_dht11_temp[] = {
+    220, 220, 230, 220, 220, 220, 230, 230, 220, 220, 630, 220, 230, 220, 220, 0, 220, 230, 230, 230,
+};
+static const int16_t s_dht11_hum[] = {
+    410, 410, 410, 420, 410, 410, 410, 400, 410, 410, 410, 410, 410, 420, 410, 0, 410, 410, 410, 410,
+};
+
+static int16_t noise(uint32_t *rng, int amplitude)
+{
+    return (int16_t)((int)(test_rand(rng) % (2u * amplitude + 1)) - amplitude);
+}
+
+static void dht11_trace(void)
+{
+    filter_state_t st = {0};
+    size_t n = sizeof(s_dht11_temp) / sizeof(s_dht11_temp[0]);
+    unsigned rejected = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        int16_t t = s_dht11_temp[i], h = s_dht11_hum[i];
+        if (filter_update(&st, &s_cfg, (int64_t)i * PERIOD_US, &t, &h) == FILTER_REJECTED) {
+            rejected++;
+            CHECK(i == 10 || i == 15);
+            continue;
+        }
+        CHECK(t >= 220 && t <= 230);
+        CHECK(h >= 400 && h <= 420);
+    }
+    CHECK_EQ(rejected, 2);
+    CHECK_EQ(st.rejected, 2);
+    CHECK_EQ(st.accepted, n - 2);
+}
+
+// DHT22 at a steady level with +/-0.3 C and +/-0.8% of noise and a spike every 50 samples
+static void noisy_steady(void)
+{
+    filter_state_t st = {0};
+    uint32_t rng = 12345;
+    double raw_sq = 0, out_sq = 0, raw_hsq = 0, out_hsq = 0;
+    unsigned spikes = 0, rejected = 0, n = 0;
+
+    for (int i = 0; i < 2000; i++) {
+        int16_t t = (int16_t)(215 + noise(&rng, 3)), h = (int16_t)(450 + noise(&rng, 8));
+        int16_t raw_t = t, raw_h = h;
+        if (i % 50 == 49) {
+            t += 400;
+            spikes++;
+        }
+        if (filter_update(&st, &s_cfg, (int64_t)i * PERIOD_US, &t, &h) == FILTER_REJECTED) {
+            rejected++;
+            continue;
+        }
+        CHECK(abs(t - 215) <= 3);
+        CHECK(abs(h - 450) <= 8);
+        if (i > 5) {
+            raw_sq += (raw_t - 215) * (raw_t - 215);
+            raw_hsq += (raw_h - 450) * (raw_h - 450);
+            out_sq += (t - 215) * (t - 215);
+            out_hsq += (h - 450) * (h - 450);
+            n++;
+        }
+    }
+    printf("steady: noise power T %.2f -> %.2f, H %.2f -> %.2f (0.1 units^2); %u of %u spikes rejected\n",
+           raw_sq / n, out_sq / n, raw_hsq / n, out_hsq / n, rejected, spikes);
+    CHECK_EQ(rejected, spikes);
+    // Median of 3 and an EMA of ~0.375 should take out well over half the noise power
+    CHECK(out_sq < raw_sq * 0.4);
+    CHECK(out_hsq < raw_hsq * 0.4);
+}
+
+// A heater comes on: +5 C at once and held. The filter holds out max_rejects samples, then follows.
+static void step_change(void)
+{
+    filter_state_t st = {0};
+    int16_t t, h;
+    int i = 0;
+
+    for (; i < 20; i++) {
+        t = 200, h = 500;
+        CHECK_EQ(filter_update(&st, &s_cfg, (int64_t)i * PERIOD_US, &t, &h), FILTER_ACCEPTED);
+    }
+    for (int k = 0; k < s_cfg.max_rejects; k++, i++) {
+        t = 250, h = 500;
+        CHECK_EQ(filter_update(&st, &s_cfg, (int64_t)i * PERIOD_US, &t, &h), FILTER_REJECTED);
+    }
+    t = 250, h = 500;
+    CHECK_EQ(filter_update(&st, &s_cfg, (int64_t)i++ * PERIOD_US, &t, &h), FILTER_ACCEPTED);
+    CHECK_EQ(t, 250);           // Restarted at the new level, not smoothed towards it
+    for (int k = 0; k < 10; k++, i++) {
+        t = 250, h = 500;
+        CHECK_EQ(filter_update(&st, &s_cfg, (int64_t)i * PERIOD_US, &t, &h), FILTER_ACCEPTED);
+        CHECK_EQ(t, 250);
+    }
+}
+
+// A ramp of 0.5 C per minute is within the slew allowance and is followed with a small lag
+static void slow_ramp(void)
+{
+    filter_state_t st = {0};
+    int max_lag = 0;
+
+    for (int i = 0; i < 400; i++) {
+        int16_t truth = (int16_t)(180 + i * 3 * 5 / 60);
+        int16_t t = truth, h = 500;
+        CHECK_EQ(filter_update(&st, &s_cfg, (int64_t)i * PERIOD_US, &t, &h), FILTER_ACCEPTED);
+        max_lag = truth - t > max_lag ? truth - t : max_lag;
+    }
+    printf("ramp: filtered value lags by up to %d (0.1 C)\n", max_lag);
+    CHECK(max_lag <= 2);
+}
+
+// Across a 10 minute deep sleep the slew allowance grows with the gap, so a change is accepted
+static void sleep_gap(void)
+{
+    filter_state_t st = {0};
+    int16_t t, h;
+
+    for (int i = 0; i < 5; i++) {
+        t = 200, h = 500;
+        filter_update(&st, &s_cfg, (int64_t)i * PERIOD_US, &t, &h);
+    }
+    t = 260, h = 600;
+    CHECK_EQ(filter_update(&st, &s_cfg, 4LL * PERIOD_US + 600000000, &t, &h), FILTER_ACCEPTED);
+
+    // The same jump 3 s later is an outlier
+    t = 320, h = 700;
+    CHECK_EQ(filter_update(&st, &s_cfg, 4LL * PERIOD_US + 603000000, &t, &h), FILTER_REJECTED);
+}
+
+// 0.0 C and 0.0% are ordinary values, not a failure marker
+static void zero_is_a_value(void)
+{
+    filter_state_t st = {0};
+
+    for (int i = 0; i < 10; i++) {
+        int16_t t = (int16_t)(i % 2 ? -1 : 0), h = 0;
+        CHECK_EQ(filter_update(&st, &s_cfg, (int64_t)i * PERIOD_US, &t, &h), FILTER_ACCEPTED);
+        CHECK(t >= -1 && t <= 0);
+        CHECK_EQ(h, 0);
+    }
+}
+
+static void config_edges(void)
+{
+    filter_config_t cfg = s_cfg;
+    filter_state_t st = {0};
+    uint32_t rng = 99;
+
+    // Window 1 and alpha 256 pass samples through unchanged; out-of-range settings mean the same
+    const uint8_t windows[] = { 1, 0, FILTER_WINDOW_MAX + 1 };
+    const uint16_t alphas[] = { 256, 0, 1000 };
+    for (size_t k = 0; k < 3; k++) {
+        cfg.median_window = windows[k];
+        cfg.ema_alpha = alphas[k];
+        memset(&st, 0, sizeof(st));
+        for (int i = 0; i < 50; i++) {
+            int16_t raw = (int16_t)(215 + noise(&rng, 5));
+            int16_t t = raw, h = 450;
+            CHECK_EQ(filter_update(&st, &cfg, (int64_t)i * PERIOD_US, &t, &h), FILTER_ACCEPTED);
+            CHECK_EQ(t, raw);
+        }
+    }
+
+    // Shrinking the window mid-run starts it over instead of reading past its end
+    cfg = s_cfg;
+    cfg.median_window = FILTER_WINDOW_MAX;
+    memset(&st, 0, sizeof(st));
+    for (int i = 0; i < 30; i++) {
+        int16_t t = 215, h = 450;
+        if (i == 15) {
+            cfg.median_window = 3;
+        }
+        CHECK_EQ(filter_update(&st, &cfg, (int64_t)i * PERIOD_US, &t, &h), FILTER_ACCEPTED);
+        CHECK_EQ(t, 215);
+        CHECK(st.count <= cfg.median_window);
+    }
+
+    // A reset forgets the level but keeps the counters
+    uint32_t accepted = st.accepted;
+    filter_reset(&st);
+    CHECK(!st.primed);
+    CHECK_EQ(st.accepted, accepted);
+    int16_t t = 400, h = 900;
+    CHECK_EQ(filter_update(&st, &cfg, 31LL * PERIOD_US, &t, &h), FILTER_ACCEPTED);
+    CHECK_EQ(t, 400);
+}
+
+int main(void)
+{
+    dht11_trace();
+    noisy_steady();
+    step_change();
+    slow_ramp();
+    sleep_gap();
+    zero_is_a_value();
+    config_edges();
+    return TEST_RESULT();
+}
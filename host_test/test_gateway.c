@@ -0,0 +1,160 @@
+/*
+    * Gateway under load from 100 nodes, with a broker outage
+    *
+    * The gateway task is an endless loop, so gateway.c is included here and its loop body
+    * (handle_packet() per queued packet, flush_pending() every batch_ms) runs on the simulated
+    * clock. Packets go in through the ESP-NOW receive callback, as from the WiFi task. Each of
+    * 100 nodes sends every 5 s for 60 s, every 50th packet twice, like sim_task; the broker
+    * refuses batches for 3 s in the middle. Every reading must be published exactly once.
+*/
+
+#include "gateway.c"
+
+#include <stdlib.h>
+#include "shim.h"
+#include "test_util.h"
+
+#define NODES           100
+#define SEND_MS         5000
+#define RUN_MS          60000
+#define TICK_MS         10
+#define OUTAGE_FROM_MS  20000
+#define OUTAGE_MS       3000
+#define READINGS        (NODES * RUN_MS / SEND_MS)
+
+static bool s_broker_up = true;
+static unsigned s_peers_announced;
+static unsigned s_messages;
+static unsigned s_refused;
+static size_t s_max_message;
+static uint32_t s_last_seq[NODES];
+static unsigned s_published[NODES];
+static unsigned s_out_of_order;
+
+static void peer_added(size_t idx)
+{
+    s_peers_announced++;
+}
+
+// Picks "<3 MAC bytes>_sim": {"seq": n} out of a batch and checks each reading arrives once, in order
+static bool publish(const char *payload, size_t len)
+{
+    if (!s_broker_up) {
+        s_refused++;
+        return false;
+    }
+    s_messages++;
+    if (len > s_max_message) {
+        s_max_message = len;
+    }
+    CHECK_EQ(strlen(payload), len);
+    CHECK(payload[0] == '{' && payload[len - 1] == '}');
+
+    for (const char *p = payload; (p = strstr(p, "_sim\":{")) != NULL; p++) {
+        unsigned hi, lo;
+        const char *seq = strstr(p, "\"seq\":");
+        CHECK(seq != NULL && sscanf(p - 4, "%2x%2x", &hi, &lo) == 2);
+        if (seq == NULL) {
+            break;
+        }
+        unsigned node = (hi << 8) | lo;
+        uint32_t n = (uint32_t)strtoul(seq + 6, NULL, 10);
+        CHECK(node < NODES);
+        if (node < NODES) {
+            s_out_of_order += n != s_last_seq[node] + 1;
+            s_last_seq[node] = n;
+            s_published[node]++;
+        }
+    }
+    return true;
+}
+
+static const gateway_config_t s_config = {
+    .transport = GATEWAY_TRANSPORT_ESPNOW,
+    .batch_ms = 1000,
+    .on_peer_added = peer_added,
+    .publish_batch = publish,
+};
+
+int main(void)
+{
+    static uint32_t seq[NODES];
+    uint32_t sent = 0, repeats = 0;
+    int64_t next_flush_us;
+
+    CHECK_EQ(gateway_init(&s_config), ESP_OK);
+    esp_now_recv_cb_t recv = shim_espnow_recv_cb();
+    CHECK(recv != NULL);
+    if (recv == NULL) {
+        return TEST_RESULT();
+    }
+    next_flush_us = esp_timer_get_time() + s_config.batch_ms * 1000LL;
+
+    for (int64_t t_ms = 0; t_ms < RUN_MS + 2000; t_ms += TICK_MS) {
+        s_broker_up = t_ms < OUTAGE_FROM_MS || t_ms >= OUTAGE_FROM_MS + OUTAGE_MS;
+
+        // Nodes spread evenly over the send interval
+        for (unsigned node = 0; node < NODES && t_ms < RUN_MS; node++) {
+            if (t_ms % SEND_MS != node * SEND_MS / NODES) {
+                continue;
+            }
+            peer_packet_t pkt = {
+                .magic = PEER_MAGIC,
+                .version = PEER_VERSION,
+                .boot = 7,
+                .flags = PEER_FLAG_VALID,
+                .seq = ++seq[node],
+                .temperature = (int16_t)(200 + node % 50),
+                .humidity = (int16_t)(400 + node % 100),
+                .name = "sim",
+            };
+            const uint8_t mac[6] = { 0x02, 'S', 'I', 'M', (uint8_t)(node >> 8), (uint8_t)node };
+            recv(mac, (const uint8_t *)&pkt, sizeof(pkt));
+            if (++sent % 50 == 0) {
+                recv(mac, (const uint8_t *)&pkt, sizeof(pkt));
+                repeats++;
+            }
+        }
+
+        // One pass of gateway_task
+        rx_item_t item;
+        while (xQueueReceive(s_queue, &item, 0) == pdTRUE) {
+            handle_packet(&item);
+        }
+        if (esp_timer_get_time() >= next_flush_us) {
+            flush_pending();
+            next_flush_us += s_config.batch_ms * 1000LL;
+        }
+        shim_time_advance(TICK_MS * 1000);
+    }
+
+    unsigned total = 0, missing = 0;
+    for (unsigned node = 0; node < NODES; node++) {
+        total += s_published[node];
+        missing += s_published[node] != RUN_MS / SEND_MS;
+    }
+    gateway_stats_t st;
+    gateway_get_stats(&st);
+    uint32_t delays, max_delay_us;
+    shim_metrics_hist(METRIC_HIST_GATEWAY_DELAY, &delays, &max_delay_us);
+    printf("gateway: %u packets (%u repeats) -> %u readings in %u messages (largest %zu bytes), "
+           "%u refused during the outage, longest wait %u ms\n",
+           sent + repeats, repeats, total, s_messages, s_max_message, s_refused, max_delay_us / 1000);
+
+    CHECK_EQ(sent, READINGS);
+    CHECK_EQ(total, READINGS);
+    CHECK_EQ(missing, 0);
+    CHECK_EQ(s_out_of_order, 0);
+    CHECK_EQ(repeats, READINGS / 50);
+    CHECK_EQ(metrics_counter(METRIC_GATEWAY_DUPLICATES), repeats);
+    CHECK_EQ(metrics_counter(METRIC_GATEWAY_PACKETS), sent + repeats);
+    CHECK_EQ(metrics_counter(METRIC_GATEWAY_DROPPED), 0);
+    CHECK_EQ(st.peers, NODES);
+    CHECK_EQ(st.pending, 0);
+    CHECK_EQ(s_peers_announced, NODES);
+    CHECK(s_refused > 0);
+    CHECK(s_max_message < GATEWAY_BATCH_BYTES);
+    // Held back by the outage at most, plus one batch interval
+    CHECK(max_delay_us <= (OUTAGE_MS + s_config.batch_ms + TICK_MS) * 1000);
+    return TEST_RESULT();
+}
@@ -0,0 +1,105 @@
+/*
+    * Group read throughput on the simulated DHT bus
+    *
+    * Reads 1 to 8 RMT-attached virtual sensors with dht_read_group(), which staggers the start pulses
+    * and captures the responses in parallel, and one after another with dht_read_data_ex(), and
+    * compares the simulated wall time of the two. Also checks that every sensor gets a start pulse
+    * of at least 18 ms, that each returns its own values, and that a dead sensor costs the group one
+    * receive timeout rather than stalling it.
+*/
+
+#include "dht.h"
+#include "dht_line.h"
+#include "esp_timer.h"
+#include "shim.h"
+#include "test_util.h"
+
+#define STAGGER_MS      2               // SENSOR_STAGGER_MS in sensors.h
+#define FIRST_PIN       13
+#define MAX_SENSORS     RMT_CHANNEL_MAX
+
+static dht_sim_config_t s_sim[MAX_SENSORS];
+
+static int64_t read_group(dht_group_read_t *reads, size_t n)
+{
+    int64_t t0 = esp_timer_get_time();
+    dht_read_group(reads, n, STAGGER_MS);
+    return esp_timer_get_time() - t0;
+}
+
+static int64_t read_one_by_one(dht_group_read_t *reads, size_t n)
+{
+    int64_t t0 = esp_timer_get_time();
+    for (size_t i = 0; i < n; i++) {
+        reads[i].result = dht_read_data_ex(reads[i].type, reads[i].pin, &reads[i].humidity,
+                                           &reads[i].temperature, &reads[i].stats);
+    }
+    return esp_timer_get_time() - t0;
+}
+
+static void check_values(const dht_group_read_t *reads, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        CHECK_EQ(reads[i].result, ESP_OK);
+        CHECK_EQ(reads[i].temperature, s_sim[i].temperature);
+        CHECK_EQ(reads[i].humidity, s_sim[i].humidity);
+    }
+}
+
+int main(void)
+{
+    dht_group_read_t reads[MAX_SENSORS];
+
+    for (size_t i = 0; i < MAX_SENSORS; i++) {
+        s_sim[i] = (dht_sim_config_t){ .temperature = (int16_t)(180 + 10 * i), .humidity = (int16_t)(350 + 25 * i) };
+        gpio_num_t pin = (gpio_num_t)(FIRST_PIN + i);
+        dht_sensor_type_t type = i % 2 ? DHT_TYPE_DHT11 : DHT_TYPE_AM2301;
+        if (type == DHT_TYPE_DHT11) {
+            s_sim[i].temperature -= s_sim[i].temperature % 10;     // Whole units only
+            s_sim[i].humidity -= s_sim[i].humidity % 10;
+        }
+        shim_dht_attach(pin, type, &s_sim[i]);
+        CHECK_EQ(dht_init_rmt(pin, (rmt_channel_t)i), ESP_OK);
+        reads[i] = (dht_group_read_t){ .type = type, .pin = pin };
+    }
+
+    printf("sensors  one-by-one  group  speedup\n");
+    for (size_t n = 1; n <= MAX_SENSORS; n *= 2) {
+        int64_t serial_us = read_one_by_one(reads, n);
+        check_values(reads, n);
+        shim_time_advance(2000000);     // Sensors need 2 s between reads
+        int64_t group_us = read_group(reads, n);
+        check_values(reads, n);
+        shim_time_advance(2000000);
+        printf("%7zu  %7.1f ms  %5.1f ms  %5.2fx\n", n, serial_us / 1000.0, group_us / 1000.0,
+               (double)serial_us / (double)group_us);
+
+        // Staggered start pulses plus staggered releases, then one response in parallel
+        int64_t stagger_us = (int64_t)(n - 1) * STAGGER_MS * 1000;
+        CHECK(group_us <= (stagger_us > 20000 ? stagger_us : 20000) + stagger_us + 8000);
+        if (n == MAX_SENSORS) {
+            CHECK(group_us * 4 < serial_us);
+        }
+    }
+
+    for (size_t i = 0; i < MAX_SENSORS; i++) {
+        shim_dht_pin_stats_t st;
+        shim_dht_pin_stats(reads[i].pin, &st);
+        CHECK(st.start_pulses > 0);
+        CHECK_EQ(st.responses, st.start_pulses);
+        CHECK(st.min_start_us >= 18000);
+        CHECK(st.max_start_us <= 25000);
+    }
+
+    // A sensor that never answers: the others are read as usual, at the cost of one receive timeout
+    s_sim[3].faults.no_response = 1000;
+    int64_t healthy_us = read_group(reads, MAX_SENSORS - 1);
+    shim_time_advance(2000000);
+    int64_t group_us = read_group(reads, MAX_SENSORS);
+    for (size_t i = 0; i < MAX_SENSORS; i++) {
+        CHECK_EQ(reads[i].result, i == 3 ? ESP_ERR_TIMEOUT : ESP_OK);
+    }
+    printf("one dead sensor of %d: group read %.1f ms\n", MAX_SENSORS, group_us / 1000.0);
+    CHECK(group_us <= healthy_us + 2 * STAGGER_MS * 1000 + 21000);
+    return TEST_RESULT();
+}
@@ -0,0 +1,78 @@
+/*
+    * History delta records at the edges of their range
+    *
+    * A stable sensor is sampled every SENSOR_STALE_MS / 2, the longest sample_max_ms the scheduler
+    * accepts; those samples must pack into delta records rather than open a block each. Value steps
+    * at the edges of the 11-bit deltas must come back exactly, and steps or gaps beyond them must
+    * start a new block without losing the sample.
+*/
+
+#include <string.h>
+#include "esp_timer.h"
+#include "history.h"
+#include "sensors.h"
+#include "shim.h"
+#include "test_util.h"
+
+#define SAMPLES     (HISTORY_BLOCK_SAMPLES * 2 + 10)
+
+static history_sample_t s_want[SAMPLES + 8];
+static size_t s_n;
+
+static void append(int64_t t_us, int16_t temp, int16_t hum)
+{
+    reading_t r = { .valid = true, .have_value = true, .timestamp_us = t_us, .temperature = temp, .humidity = hum };
+
+    history_append(0, &r);
+    s_want[s_n++] = (history_sample_t){ .t_ms = (uint64_t)t_us / 1000, .temperature = temp, .humidity = hum };
+}
+
+int main(void)
+{
+    history_sample_t out[HISTORY_BLOCK_SAMPLES];
+    history_stats_t stats;
+    int64_t t = 1000000;
+    int16_t temp = 215, hum = 450;
+
+    history_init();
+
+    // Stable sensor at the longest sample period, alternating small steps
+    for (int i = 0; i < SAMPLES; i++) {
+        append(t, temp, hum);
+        t += (int64_t)SENSOR_STALE_MS / 2 * 1000;
+        temp += i % 2 ? 1 : -1;
+    }
+    history_get_stats(&stats);
+    CHECK_EQ(stats.blocks_used, 3);
+
+    // Steps at the limits of a delta record stay in the block
+    temp = s_want[s_n - 1].temperature;
+    append(t, temp + 1023, hum - 1024);
+    hum -= 1024;
+    t += 100000;
+    append(t, temp, hum);
+    // Beyond them, in value or in time, a new block starts
+    t += 100000;
+    append(t, temp + 1024, hum);
+    t += (int64_t)HISTORY_MAX_GAP_MS * 1000;
+    append(t, temp, hum);
+    t += (int64_t)HISTORY_MAX_GAP_MS * 1000 + 100000;
+    append(t, temp, -1);
+    history_get_stats(&stats);
+    CHECK_EQ(stats.blocks_used, 5);
+    CHECK_EQ(stats.samples, s_n);
+
+    history_cursor_t cursor = { .sensor = 0 };
+    size_t count, got = 0;
+    while (history_next_block(&cursor, out, &count)) {
+        for (size_t i = 0; i < count && got < s_n; i++, got++) {
+            CHECK_EQ(out[i].t_ms, s_want[got].t_ms);
+            CHECK_EQ(out[i].temperature, s_want[got].temperature);
+            CHECK_EQ(out[i].humidity, s_want[got].humidity);
+        }
+    }
+    CHECK_EQ(got, s_n);
+    printf("history: %zu samples in %u blocks (%u bytes), up to %u ms apart\n",
+           s_n, stats.blocks_used, stats.bytes_used, HISTORY_MAX_GAP_MS);
+    return TEST_RESULT();
+}
@@ -0,0 +1,207 @@
+/*
+    * Cached HTTP responses: ETag/304 and Cache-Control behaviour, and what the cache saves
+    *
+    * The behaviour checks drive http_cache_send() the way the /sensor/<name> handler does. The
+    * benchmark then serves the same request three ways: rendering the JSON every time (a new key
+    * per request, which is what every poll cost before the cache), a cached body, and a 304 for a
+    * client that revalidates with the current ETag. Host time per request covers the handler and
+    * the shim's response copy, so the ratios matter more than the absolute numbers.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "http_cache.h"
+#include "metrics.h"
+#include "shim.h"
+#include "test_util.h"
+
+#define SAMPLE_PERIOD_MS    3000
+#define BENCH_REQUESTS      200000
+
+static http_cache_t s_cache;
+static http_cache_t s_small;
+static reading_t s_reading;
+static uint32_t s_key;
+static const char *s_name = "server_rack";
+
+static uint32_t sample_period_ms(void)
+{
+    return SAMPLE_PERIOD_MS;
+}
+
+static void render_cbor(cbor_writer_t *w, size_t idx, const reading_t *r)
+{
+    cbor_map(w, NULL, 3);
+    cbor_str(w, "id", s_name);
+    cbor_uint(w, "seq", r->seq);
+    cbor_int(w, "t", r->temperature);
+}
+
+static const http_cache_config_t s_config = {
+    .render_cbor = render_cbor,
+    .sample_period_ms = sample_period_ms,
+};
+
+// Same shape as main.c's render_sensor()
+static void render_sensor(json_writer_t *w, size_t idx, const reading_t *r)
+{
+    json_obj_open(w, NULL);
+    json_str(w, "name", s_name);
+    json_tenths(w, "temperature", r->temperature);
+    json_tenths(w, "humidity", r->humidity);
+    json_bool(w, "sensor_ok", r->valid);
+    json_obj_close(w);
+}
+
+static esp_err_t sensor_handler(httpd_req_t *req)
+{
+    return http_cache_send(req, "/sensor/server_rack", &s_cache, s_key, 0, &s_reading, render_sensor,
+                           esp_timer_get_time());
+}
+
+static esp_err_t small_handler(httpd_req_t *req)
+{
+    return http_cache_send(req, "/small", &s_small, s_key, 0, &s_reading, render_sensor, esp_timer_get_time());
+}
+
+// Makes a request and returns the whole response, headers and body
+static const char *get(int fd, const char *headers, esp_err_t (*handler)(httpd_req_t *req))
+{
+    static char buf[1024];
+
+    shim_httpd_request(fd, HTTP_GET, "/sensor/server_rack", headers, NULL, 0, handler);
+    buf[shim_httpd_read(fd, buf, sizeof(buf) - 1)] = '\0';
+    return buf;
+}
+
+static void behaviour(int fd)
+{
+    char hdr[160];
+    const char *resp;
+
+    s_reading = (reading_t){ .seq = 7, .valid = true, .have_value = true, .temperature = 215, .humidity = 450,
+                             .timestamp_us = esp_timer_get_time() };
+    s_key = s_reading.seq;
+    shim_time_advance(1000000);
+
+    // First request renders; max-age runs to the next sample, 2 s away
+    resp = get(fd, NULL, sensor_handler);
+    CHECK(strncmp(resp, "HTTP/1.1 200 OK\r\n", 17) == 0);
+    CHECK(strstr(resp, "ETag: \"00000007\"\r\n") != NULL);
+    CHECK(strstr(resp, "Cache-Control: max-age=2\r\n") != NULL);
+    CHECK(strstr(resp, "Content-Type: application/json\r\n") != NULL);
+    CHECK(strstr(resp, "\r\n\r\n{\"name\":\"server_rack\",\"temperature\":21.5,\"humidity\":45.0,\"sensor_ok\":true}") != NULL);
+    CHECK_EQ(metrics_counter(METRIC_HTTP_CACHE_RENDERS), 1);
+
+    // Same reading: served from the cache
+    resp = get(fd, NULL, sensor_handler);
+    CHECK(strstr(resp, "\"temperature\":21.5") != NULL);
+    CHECK_EQ(metrics_counter(METRIC_HTTP_CACHE_RENDERS), 1);
+
+    // Revalidation with the current ETag, alone or in a list
+    resp = get(fd, "If-None-Match: \"00000007\"\n", sensor_handler);
+    CHECK(strncmp(resp, "HTTP/1.1 304 Not Modified\r\n", 27) == 0);
+    CHECK(strstr(resp, "ETag: \"00000007\"\r\n") != NULL);
+    CHECK(strcmp(strstr(resp, "\r\n\r\n"), "\r\n\r\n") == 0);
+    resp = get(fd, "If-None-Match: \"00000005\", \"00000007\"\n", sensor_handler);
+    CHECK(strncmp(resp, "HTTP/1.1 304", 12) == 0);
+    CHECK_EQ(metrics_counter(METRIC_HTTP_NOT_MODIFIED), 2);
+
+    // A new sample changes the key: one render, the old ETag no longer matches
+    shim_time_advance(2000000);
+    s_reading.seq = 8;
+    s_reading.temperature = 216;
+    s_reading.timestamp_us = esp_timer_get_time();
+    s_key = s_reading.seq;
+    resp = get(fd, "If-None-Match: \"00000007\"\n", sensor_handler);
+    CHECK(strncmp(resp, "HTTP/1.1 200 OK", 15) == 0);
+    CHECK(strstr(resp, "ETag: \"00000008\"\r\n") != NULL);
+    CHECK(strstr(resp, "Cache-Control: max-age=3\r\n") != NULL);
+    CHECK(strstr(resp, "\"temperature\":21.6") != NULL);
+    CHECK_EQ(metrics_counter(METRIC_HTTP_CACHE_RENDERS), 2);
+
+    // A sample that is overdue is not cacheable at all
+    shim_time_advance(5000000);
+    resp = get(fd, NULL, sensor_handler);
+    CHECK(strstr(resp, "Cache-Control: max-age=0\r\n") != NULL);
+
+    // CBOR is encoded per request under its own ETag and leaves the JSON cache alone
+    resp = get(fd, "Accept: application/cbor\n", sensor_handler);
+    CHECK(strstr(resp, "Content-Type: application/cbor\r\n") != NULL);
+    CHECK(strstr(resp, "ETag: \"00000008c\"\r\n") != NULL);
+    CHECK_EQ(metrics_counter(METRIC_HTTP_CACHE_RENDERS), 2);
+    resp = get(fd, "Accept: application/cbor\nIf-None-Match: \"00000008c\"\n", sensor_handler);
+    CHECK(strncmp(resp, "HTTP/1.1 304", 12) == 0);
+    resp = get(fd, "If-None-Match: \"00000008c\"\n", sensor_handler);
+    CHECK(strncmp(resp, "HTTP/1.1 200 OK", 15) == 0);
+    CHECK(strstr(resp, "Content-Type: application/json\r\n") != NULL);
+
+    // An Accept header longer than the buffer still picks CBOR from its first media types
+    snprintf(hdr, sizeof(hdr), "Accept: application/cbor, %.*s\n", 100,
+             "application/json;q=0.9, text/plain;q=0.5, text/html;q=0.4, application/xml;q=0.3, */*;q=0.1");
+    resp = get(fd, hdr, sensor_handler);
+    CHECK(strstr(resp, "Content-Type: application/cbor\r\n") != NULL);
+
+    // A body that does not fit is a 500 and is never cached or counted as a render
+    s_name = "a_sensor_name_long_enough_that_the_rendered_document_no_longer_fits_in_the_cache_body_buffer";
+    resp = get(fd, NULL, small_handler);
+    CHECK(strncmp(resp, "HTTP/1.1 500", 12) == 0);
+    CHECK(!s_small.valid);
+    CHECK_EQ(metrics_counter(METRIC_HTTP_CACHE_RENDERS), 2);
+    s_name = "server_rack";
+}
+
+typedef enum {
+    BENCH_RENDER,                       // New key every request
+    BENCH_CACHED,
+    BENCH_NOT_MODIFIED,
+} bench_t;
+
+// Returns host ns per request
+static double bench(int fd, bench_t mode)
+{
+    const char *headers = mode == BENCH_NOT_MODIFIED ? "If-None-Match: \"00000100\"\n" : NULL;
+    uint32_t renders = metrics_counter(METRIC_HTTP_CACHE_RENDERS);
+
+    s_key = 0x100;
+    s_cache.valid = false;
+    int64_t t0 = test_now_ns();
+    for (int i = 0; i < BENCH_REQUESTS; i++) {
+        if (mode == BENCH_RENDER) {
+            s_key++;
+        }
+        shim_httpd_request(fd, HTTP_GET, "/sensor/server_rack", headers, NULL, 0, sensor_handler);
+        shim_httpd_read(fd, NULL, SIZE_MAX);
+    }
+    int64_t ns = test_now_ns() - t0;
+
+    renders = metrics_counter(METRIC_HTTP_CACHE_RENDERS) - renders;
+    CHECK_EQ(renders, mode == BENCH_RENDER ? BENCH_REQUESTS : 1);
+    return (double)ns / BENCH_REQUESTS;
+}
+
+int main(void)
+{
+    http_cache_init(&s_config);
+    int fd = shim_httpd_connect(65536);
+    CHECK(fd >= 0);
+
+    behaviour(fd);
+
+    uint32_t requests = metrics_counter(METRIC_HTTP_REQUESTS);
+    uint32_t not_modified = metrics_counter(METRIC_HTTP_NOT_MODIFIED);
+    s_reading.timestamp_us = esp_timer_get_time();
+    double render = bench(fd, BENCH_RENDER);
+    double cached = bench(fd, BENCH_CACHED);
+    double revalidated = bench(fd, BENCH_NOT_MODIFIED);
+    CHECK_EQ(metrics_counter(METRIC_HTTP_REQUESTS) - requests, 3 * BENCH_REQUESTS);
+    CHECK_EQ(metrics_counter(METRIC_HTTP_NOT_MODIFIED) - not_modified, BENCH_REQUESTS);
+
+    printf("http_cache: %d requests each; render every time %.0f ns (%.0f req/s), cached %.0f ns (%.0f req/s, %.2fx), "
+           "304 %.0f ns (%.0f req/s, %.2fx)\n", BENCH_REQUESTS,
+           render, 1e9 / render, cached, 1e9 / cached, render / cached,
+           revalidated, 1e9 / revalidated, render / revalidated);
+    CHECK(cached < render);
+    return TEST_RESULT();
+}
@@ -0,0 +1,78 @@
+/*
+    * JSON writer output and overflow behaviour
+    *
+    * Callers rely on two things: a document that fits comes out exactly as expected, and one that
+    * does not sets overflow while the buffer stays NUL terminated at the last complete piece.
+*/
+
+#include <string.h>
+#include "json_writer.h"
+#include "test_util.h"
+
+static void output(void)
+{
+    char buf[256];
+    json_writer_t w;
+
+    json_init(&w, buf, sizeof(buf));
+    json_obj_open(&w, NULL);
+    json_str(&w, "sensor", "room");
+    json_tenths(&w, "temperature", -5);
+    json_tenths(&w, "humidity", 1000);
+    json_tenths(&w, "min", INT32_MIN);
+    json_uint(&w, "max", UINT64_MAX);
+    json_int(&w, "neg", INT64_MIN);
+    json_bool(&w, "ok", true);
+    json_arr_open(&w, "a");
+    json_uint(&w, NULL, 0);
+    json_obj_open(&w, NULL);
+    json_obj_close(&w);
+    json_arr_close(&w);
+    json_obj_close(&w);
+
+    const char *want = "{\"sensor\":\"room\",\"temperature\":-0.5,\"humidity\":100.0,"
+                       "\"min\":-214748364.8,\"max\":18446744073709551615,"
+                       "\"neg\":-9223372036854775808,\"ok\":true,\"a\":[0,{}]}";
+    CHECK(!w.overflow);
+    CHECK(strcmp(buf, want) == 0);
+    CHECK_EQ(w.len, strlen(want));
+    if (strcmp(buf, want) != 0) {
+        fprintf(stderr, "got  %s\nwant %s\n", buf, want);
+    }
+}
+
+static void overflow(void)
+{
+    char buf[16];
+    json_writer_t w;
+
+    // 15 characters plus the NUL fill the buffer exactly
+    json_init(&w, buf, sizeof(buf));
+    json_obj_open(&w, NULL);
+    json_uint(&w, "abcdefg", 123);
+    json_obj_close(&w);
+    CHECK(!w.overflow);
+    CHECK(strcmp(buf, "{\"abcdefg\":123}") == 0);
+
+    // One more character does not fit; everything after the cut is dropped
+    json_init(&w, buf, sizeof(buf));
+    json_obj_open(&w, NULL);
+    json_uint(&w, "abcdefg", 1234);
+    size_t len = w.len;
+    json_obj_close(&w);
+    json_bool(&w, "x", false);
+    CHECK(w.overflow);
+    CHECK_EQ(w.len, len);
+    CHECK_EQ(strlen(buf), w.len);
+
+    // A zero-sized buffer is an overflow from the start
+    json_init(&w, buf, 0);
+    CHECK(w.overflow);
+}
+
+int main(void)
+{
+    output();
+    overflow();
+    return TEST_RESULT();
+}
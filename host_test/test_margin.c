@@ -0,0 +1,76 @@
+/*
+    * Bit margin sweep: adaptive against fixed threshold
+    *
+    * Simulated DHT22 captures with +/-2 us of edge jitter are stretched as if the sensor's clock ran
+    * at 80% to 130% of nominal, and decoded with the fixed 48 us threshold and with the threshold
+    * scaled from the measured preamble. The smallest margin any bit had is what tells how close a
+    * read came to failing, so that is what is compared.
+*/
+
+#include "dht_decode.h"
+#include "dht_sim.h"
+#include "test_util.h"
+
+#define CAPTURES    2000
+#define JITTER_US   2
+
+typedef struct {
+    unsigned ok;
+    unsigned margin_min;
+    uint64_t margin_sum;
+} sweep_t;
+
+static void decode(const dht_level_t *runs, size_t n, int adaptive, sweep_t *s)
+{
+    uint8_t data[DHT_DATA_BYTES];
+    dht_decode_timing_t t;
+
+    if (dht_decode_pulses_ex(runs, n, adaptive, data, &t) != DHT_DECODE_OK) {
+        return;
+    }
+    s->ok++;
+    s->margin_sum += t.margin_us;
+    if (t.margin_us < s->margin_min) {
+        s->margin_min = t.margin_us;
+    }
+}
+
+int main(void)
+{
+    const dht_sim_faults_t faults = { .jitter_us = JITTER_US };
+    uint32_t rng = 0x1234567;
+
+    printf("clock  fixed: ok  min  mean   adaptive: ok  min  mean\n");
+    for (unsigned pct = 80; pct <= 130; pct += 5) {
+        sweep_t fixed = { .margin_min = UINT32_MAX }, adaptive = { .margin_min = UINT32_MAX };
+
+        for (int i = 0; i < CAPTURES; i++) {
+            dht_level_t runs[96];
+            int16_t hum = (int16_t)(test_rand(&rng) % 1001);
+            int16_t temp = (int16_t)(test_rand(&rng) % 1201) - 400;
+            size_t n = dht_sim_waveform(DHT_TYPE_DHT22, hum, temp, &faults, &rng, runs, 96);
+
+            for (size_t j = 0; j < n; j++) {
+                runs[j].duration_us = (uint16_t)((runs[j].duration_us * pct + 50) / 100);
+            }
+            decode(runs, n, 0, &fixed);
+            decode(runs, n, 1, &adaptive);
+        }
+
+        printf("%4u%%  %9u %4u %5.1f  %11u %4u %5.1f\n", pct,
+               fixed.ok, fixed.margin_min, fixed.ok ? (double)fixed.margin_sum / fixed.ok : 0.0,
+               adaptive.ok, adaptive.margin_min, adaptive.ok ? (double)adaptive.margin_sum / adaptive.ok : 0.0);
+
+        // Every read decodes either way across the whole range
+        CHECK_EQ(fixed.ok, CAPTURES);
+        CHECK_EQ(adaptive.ok, CAPTURES);
+        // At nominal speed the preamble's own jitter moves the adaptive threshold by a couple of
+        // us; away from it the adaptive threshold keeps the margin that the fixed one loses
+        CHECK(adaptive.margin_min + 3 >= fixed.margin_min);
+        CHECK(adaptive.margin_min >= 12);
+        if (pct <= 85 || pct >= 115) {
+            CHECK(adaptive.margin_min > fixed.margin_min + 4);
+        }
+    }
+    return TEST_RESULT();
+}
@@ -0,0 +1,148 @@
+/*
+    * MQTT connection manager under a reconnect storm
+    *
+    * Drives mqtt_link against the broker stand-in in shim/mqtt.c: WiFi flapping with the broker
+    * dropping each time, a long broker outage, repeated GOT_IP events while connected, and a stop
+    * and restart. Checks that there is only ever one client, that discovery goes out exactly once per
+    * session, and that retries back off to the cap and pause while the network is down.
+*/
+
+#include "esp_timer.h"
+#include "mqtt_link.h"
+#include "shim.h"
+#include "test_util.h"
+
+#define BACKOFF_MIN_MS  1000            // As in mqtt_link.c
+#define BACKOFF_MAX_MS  60000
+#define FLAPS           50
+
+static unsigned s_connected_calls;
+static unsigned s_disconnected_calls;
+static unsigned s_discovery;
+
+static void on_connected(void)
+{
+    s_connected_calls++;
+    // What main.c does per session: retained discovery config at QoS 1
+    if (esp_mqtt_client_publish(mqtt_link_client(), "homeassistant/sensor/x/config", "{}", 2, 1, 1) > 0) {
+        s_discovery++;
+    }
+}
+
+static void on_disconnected(void)
+{
+    s_disconnected_calls++;
+}
+
+static const mqtt_link_config_t s_config = {
+    .uri = "mqtt://broker.invalid",
+    .on_connected = on_connected,
+    .on_disconnected = on_disconnected,
+};
+
+static uint32_t attempts(void)
+{
+    shim_mqtt_stats_t st;
+    shim_mqtt_get_stats(&st);
+    return st.attempts;
+}
+
+int main(void)
+{
+    uint32_t rng = 0x13579BDF;
+    shim_mqtt_stats_t st;
+    mqtt_link_stats_t link;
+
+    CHECK_EQ(mqtt_link_init(&s_config), ESP_OK);
+    CHECK_EQ(mqtt_link_init(&s_config), ESP_OK);
+    mqtt_link_network_up();
+    shim_time_advance(100000);
+    CHECK(mqtt_link_connected());
+    CHECK_EQ(s_discovery, 1);
+
+    // WiFi flapping: the session drops with it, GOT_IP sometimes arrives twice
+    for (int i = 0; i < FLAPS; i++) {
+        shim_mqtt_broker_set(false);
+        mqtt_link_network_down();
+        uint32_t attempts_before = attempts();
+        shim_time_advance((int64_t)(test_rand(&rng) % 90000) * 1000);
+        CHECK_EQ(attempts(), attempts_before);      // Nothing while the network is down
+        shim_mqtt_broker_set(true);
+        mqtt_link_network_up();
+        if (test_rand(&rng) % 4 == 0) {
+            mqtt_link_network_up();
+        }
+        shim_time_advance(100000);
+        CHECK(mqtt_link_connected());
+    }
+    shim_mqtt_get_stats(&st);
+    CHECK_EQ(st.clients, 1);
+    CHECK_EQ(st.sessions, 1 + FLAPS);
+    CHECK_EQ(s_connected_calls, st.sessions);
+    CHECK_EQ(s_discovery, st.sessions);
+    CHECK_EQ(s_disconnected_calls, FLAPS);
+    CHECK_EQ(st.acked, s_discovery);
+
+    // GOT_IP while connected (e.g. a DHCP renewal) must not touch the session
+    uint32_t sessions = st.sessions;
+    for (int i = 0; i < 100; i++) {
+        mqtt_link_network_up();
+        shim_time_advance(10000);
+    }
+    shim_mqtt_get_stats(&st);
+    CHECK_EQ(st.sessions, sessions);
+    CHECK_EQ(s_disconnected_calls, FLAPS);
+
+    // Ten minutes without a broker: attempts back off to the cap, with jitter on top
+    shim_mqtt_broker_set(false);
+    uint32_t start_attempts = attempts();
+    int64_t last_us = -1, outage_start = esp_timer_get_time();
+    uint32_t expected_ms = 2 * BACKOFF_MIN_MS;     // The first attempt already used the minimum
+    unsigned gaps = 0;
+    while (esp_timer_get_time() - outage_start < 600 * 1000000LL) {
+        uint32_t before = attempts();
+        shim_time_advance(10000);
+        if (attempts() == before) {
+            continue;
+        }
+        int64_t now = esp_timer_get_time();
+        if (last_us >= 0) {
+            int64_t gap_ms = (now - last_us) / 1000;
+            // Delay plus up to 25% jitter, plus the 20 ms the refused attempt took
+            CHECK(gap_ms >= expected_ms);
+            CHECK(gap_ms <= expected_ms + expected_ms / 4 + 40);
+            expected_ms = expected_ms * 2 > BACKOFF_MAX_MS ? BACKOFF_MAX_MS : expected_ms * 2;
+            gaps++;
+        }
+        last_us = now;
+    }
+    uint32_t outage_attempts = attempts() - start_attempts;
+    mqtt_link_get_stats(&link);
+    printf("mqtt_link: %u connect attempts in a 10 min outage, backoff now %u ms\n",
+           outage_attempts, link.backoff_ms);
+    CHECK(gaps >= 5);
+    CHECK(outage_attempts <= 16);
+    CHECK_EQ(link.backoff_ms, BACKOFF_MAX_MS);
+
+    // The broker comes back: connected within one capped retry, and the backoff starts over
+    shim_mqtt_broker_set(true);
+    shim_time_advance((BACKOFF_MAX_MS + BACKOFF_MAX_MS / 4 + 100) * 1000LL);
+    CHECK(mqtt_link_connected());
+    mqtt_link_get_stats(&link);
+    CHECK_EQ(link.backoff_ms, 0);
+
+    // Stop before deep sleep, then a fresh start on the same client
+    mqtt_link_stop();
+    CHECK(!mqtt_link_connected());
+    uint32_t stopped_attempts = attempts();
+    shim_time_advance(120 * 1000000LL);
+    CHECK_EQ(attempts(), stopped_attempts);
+    mqtt_link_network_up();
+    shim_time_advance(100000);
+    CHECK(mqtt_link_connected());
+
+    shim_mqtt_get_stats(&st);
+    CHECK_EQ(st.clients, 1);
+    CHECK_EQ(s_discovery, st.sessions);
+    return TEST_RESULT();
+}
@@ -0,0 +1,229 @@
+/*
+    * POST /ota over a slow link while /stream has subscribers
+    *
+    * httpd runs one handler at a time, so an upload holds off everything else on the server until
+    * it ends. A 900 KB image is sent at 40 ms per KB (about 37 s) while two sensors push a reading
+    * every 3 s. Without the upload hooks the stream's subscribers fall more than
+    * STREAM_CLIENT_QUEUE events behind and are dropped as too slow once the flush finally runs;
+    * with stream_pause()/stream_resume() they stay subscribed and get the latest readings as soon
+    * as the upload ends. The longest silence a subscriber sees is reported; it is the upload time.
+    * The upload itself must be hashed, accepted and followed by a restart, and a bad digest must
+    * leave no PM lock held and the task priority restored.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "mbedtls/sha256.h"
+#include "ota.h"
+#include "sensors.h"
+#include "shim.h"
+#include "stream.h"
+#include "test_util.h"
+
+#define SENSORS         2
+#define CLIENTS         3
+#define SAMPLE_US       3000000
+#define IMAGE_BYTES     (900 * 1024)
+#define UPLOAD_US_PER_KB 40000
+
+static const sensor_def_t s_defs[SENSORS] = { { .name = "desk" }, { .name = "window" } };
+
+size_t sensor_count(void)
+{
+    return SENSORS;
+}
+
+const sensor_def_t *sensor_def(size_t idx)
+{
+    return idx < SENSORS ? &s_defs[idx] : NULL;
+}
+
+static unsigned s_before_restart;
+
+static void before_restart(void)
+{
+    s_before_restart++;
+}
+
+static ota_config_t s_ota_config = { .token = "secret", .before_restart = before_restart };
+
+typedef struct {
+    int fd;
+    unsigned events;
+    int64_t last_event_us;
+    int64_t silence_us_max;             // Longest time between events while subscribed
+} client_t;
+
+static client_t s_clients[CLIENTS];
+static reading_t s_readings[SENSORS];
+
+// The sampler, running next to the httpd task: fires from the clock even during the upload
+static void sample_cb(void *arg)
+{
+    for (size_t s = 0; s < SENSORS; s++) {
+        s_readings[s].seq++;
+        s_readings[s].timestamp_us = esp_timer_get_time();
+        stream_push(s, &s_readings[s]);
+    }
+}
+
+static void client_read(client_t *c)
+{
+    char buf[4096];
+    size_t n = shim_httpd_read(c->fd, buf, sizeof(buf) - 1);
+    unsigned events = 0;
+
+    buf[n] = '\0';
+    for (const char *p = buf; (p = strstr(p, "event: reading")) != NULL; p++) {
+        events++;
+    }
+    if (events > 0) {
+        int64_t now = esp_timer_get_time();
+        if (c->events > 0 && now - c->last_event_us > c->silence_us_max) {
+            c->silence_us_max = now - c->last_event_us;
+        }
+        c->events += events;
+        c->last_event_us = now;
+    }
+}
+
+static void subscribe(void)
+{
+    for (size_t i = 0; i < CLIENTS; i++) {
+        s_clients[i] = (client_t){ .fd = shim_httpd_connect(16384) };
+        shim_httpd_request(s_clients[i].fd, HTTP_GET, "/stream", NULL, NULL, 0, stream_handler);
+        CHECK_EQ(strcmp(shim_httpd_status(s_clients[i].fd), "200 OK"), 0);
+        client_read(&s_clients[i]);
+    }
+}
+
+// The httpd task's turns between requests: every sample is flushed and read right away
+static void idle(int samples)
+{
+    for (int i = 0; i < samples; i++) {
+        shim_time_advance(SAMPLE_US);
+        shim_httpd_run();
+        for (size_t c = 0; c < CLIENTS; c++) {
+            if (shim_httpd_is_open(s_clients[c].fd)) {
+                client_read(&s_clients[c]);
+            }
+        }
+    }
+}
+
+// Returns the upload's wall time on the simulated clock
+static int64_t upload(const uint8_t *image, const char *sha_hex, const char *expect_status)
+{
+    char headers[160];
+    int fd = shim_httpd_connect(4096);
+
+    snprintf(headers, sizeof(headers), "Authorization: Bearer secret\nX-Image-SHA256: %s\n", sha_hex);
+    shim_httpd_set_upload_rate(fd, UPLOAD_US_PER_KB);
+    int64_t t0 = esp_timer_get_time();
+    shim_httpd_request(fd, HTTP_POST, "/ota", headers, (const char *)image, IMAGE_BYTES, ota_handler);
+    int64_t elapsed = esp_timer_get_time() - t0;
+    CHECK_EQ(strncmp(shim_httpd_status(fd), expect_status, strlen(expect_status)), 0);
+    shim_httpd_close(fd);
+    return elapsed;
+}
+
+int main(void)
+{
+    static uint8_t image[IMAGE_BYTES];
+    unsigned char digest[32];
+    char sha_hex[65], bad_hex[65];
+    uint32_t rng = 0x12345678;
+    esp_timer_handle_t sampler;
+    stream_stats_t st;
+    shim_ota_stats_t os;
+
+    for (size_t i = 0; i < sizeof(image); i++) {
+        image[i] = (uint8_t)test_rand(&rng);
+    }
+    image[0] = 0xE9;
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts_ret(&sha, 0);
+    mbedtls_sha256_update_ret(&sha, image, sizeof(image));
+    mbedtls_sha256_finish_ret(&sha, digest);
+    for (size_t i = 0; i < 32; i++) {
+        snprintf(sha_hex + 2 * i, 3, "%02x", digest[i]);
+    }
+    memcpy(bad_hex, sha_hex, sizeof(bad_hex));
+    bad_hex[0] = bad_hex[0] == '0' ? '1' : '0';
+
+    // The shim's SHA-256 against the FIPS 180-4 "abc" vector
+    mbedtls_sha256_starts_ret(&sha, 0);
+    mbedtls_sha256_update_ret(&sha, (const unsigned char *)"abc", 3);
+    mbedtls_sha256_finish_ret(&sha, digest);
+    CHECK(digest[0] == 0xba && digest[1] == 0x78 && digest[30] == 0x15 && digest[31] == 0xad);
+
+    for (size_t s = 0; s < SENSORS; s++) {
+        s_readings[s] = (reading_t){ .valid = true, .have_value = true, .temperature = 215, .humidity = 450 };
+    }
+    stream_init(shim_httpd_server());
+    CHECK_EQ(ota_init(&s_ota_config), ESP_OK);
+    const esp_timer_create_args_t args = { .callback = sample_cb, .name = "sampler" };
+    esp_timer_create(&args, &sampler);
+    esp_timer_start_periodic(sampler, SAMPLE_US);
+
+    // A wrong token never gets to the body
+    int fd = shim_httpd_connect(4096);
+    shim_httpd_request(fd, HTTP_POST, "/ota", "Authorization: Bearer nope\n", (const char *)image, 16, ota_handler);
+    CHECK_EQ(strncmp(shim_httpd_status(fd), "401", 3), 0);
+    shim_httpd_close(fd);
+
+    // Without the hooks: the subscribers are dropped once the queued flush runs
+    subscribe();
+    idle(10);
+    unsigned priority = shim_task_priority();
+    int64_t stall_unhooked = upload(image, bad_hex, "400");
+    shim_httpd_run();
+    stream_get_stats(&st);
+    unsigned dropped_unhooked = st.dropped_clients;
+    CHECK_EQ(dropped_unhooked, CLIENTS);
+    shim_ota_get_stats(&os);
+    CHECK_EQ(os.aborted, 1);
+    CHECK_EQ(os.boot_set, 0);
+    CHECK_EQ(shim_pm_locks_held(), 0);
+    CHECK_EQ(shim_task_priority(), priority);
+    shim_httpd_run();
+
+    // With them: everyone stays, and the latest readings go out as soon as the upload ends
+    s_ota_config.upload_start = stream_pause;
+    s_ota_config.upload_end = stream_resume;
+    subscribe();
+    idle(10);
+    unsigned events_before = s_clients[0].events;
+    int64_t stall = upload(image, sha_hex, "200");
+    shim_httpd_run();
+    for (size_t c = 0; c < CLIENTS; c++) {
+        client_read(&s_clients[c]);
+        CHECK(shim_httpd_is_open(s_clients[c].fd));
+        CHECK_EQ(s_clients[c].events, events_before + SENSORS);
+    }
+    stream_get_stats(&st);
+    CHECK_EQ(st.dropped_clients, dropped_unhooked);
+    CHECK_EQ(st.skipped_clients, CLIENTS);
+    shim_ota_get_stats(&os);
+    CHECK_EQ(os.bytes, IMAGE_BYTES);
+    CHECK_EQ(os.boot_set, 1);
+    CHECK_EQ(shim_pm_locks_held(), 0);
+    CHECK_EQ(shim_task_priority(), priority);
+
+    // Streaming carries on normally until the restart a second after the response
+    idle(1);
+    CHECK_EQ(s_clients[0].events, events_before + 2 * SENSORS);
+    shim_ota_get_stats(&os);
+    CHECK_EQ(os.restarts, 1);
+    CHECK_EQ(s_before_restart, 1);
+
+    printf("ota: %u KB in %.1f s (%.1f s without hooks); without hooks %u/%u stream clients dropped, "
+           "with them 0 dropped and %u skipped ahead; longest stream silence %.1f s\n",
+           IMAGE_BYTES / 1024, stall / 1e6, stall_unhooked / 1e6, dropped_unhooked, CLIENTS,
+           st.skipped_clients, s_clients[0].silence_us_max / 1e6);
+    CHECK(s_clients[0].silence_us_max >= stall);
+    CHECK(s_clients[0].silence_us_max < stall + SAMPLE_US);
+    return TEST_RESULT();
+}
@@ -0,0 +1,129 @@
+/*
+    * Repeatable end-to-end benchmark: the firmware on the host against the shim broker
+    *
+    *   test_perf [result.json]
+    *
+    * Boots app_main() like test_app, with the sampler pinned to 1 s and a sensor whose readings
+    * move, then takes a /perf snapshot, runs LOAD_S simulated seconds with a GET LOAD_PATH every
+    * LOAD_INTERVAL_MS, and takes a second one. Sample-to-publish and the probe round trip come
+    * from the firmware's own histograms on the simulated clock, so they only change when the code
+    * does; the handler figures are host CPU time per request. The document (both snapshots and
+    * the load figures) goes to the file given, or to stdout; tools/perf_bench.py host turns it
+    * into a result its diff command compares.
+*/
+
+#define WIFI_SSID_1 "office"
+#define WIFI_PASS_1 "office-pass"
+#define WIFI_SSID_2 ""
+#define WIFI_PASS_2 ""
+#include "main.c"
+
+#include "dht_line.h"
+#include "shim.h"
+#include "test_util.h"
+
+#define LOAD_S              600
+#define LOAD_INTERVAL_MS    100
+#define LOAD_PATH           "/status"
+#define REQUESTS            (LOAD_S * 1000 / LOAD_INTERVAL_MS)
+
+static const dht_sim_config_t s_sim = {
+    .temperature = 215,
+    .humidity = 450,
+    .temperature_swing = 30,
+    .humidity_swing = 80,
+    .period_s = 300,
+};
+
+static char s_resp[8192];
+static char s_before[sizeof(s_resp)];
+static int64_t s_request_ns[REQUESTS];
+
+// One request on a fresh connection; returns the body, NULL unless it was answered 200
+static const char *http(int method, const char *uri)
+{
+    int fd = shim_httpd_connect(sizeof(s_resp));
+
+    shim_httpd_call(fd, method, uri, NULL, NULL, 0);
+    size_t n = shim_httpd_read(fd, s_resp, sizeof(s_resp) - 1);
+    s_resp[n] = '\0';
+    shim_httpd_close(fd);
+    shim_httpd_run();
+
+    const char *body = strstr(s_resp, "\r\n\r\n");
+    return strncmp(s_resp, "HTTP/1.1 200 OK", 15) == 0 && body ? body + 4 : NULL;
+}
+
+static int cmp_ns(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted values, in ms
+static double percentile_ms(const int64_t *sorted, size_t n, unsigned p)
+{
+    return n ? sorted[(n - 1) * p / 100] / 1e6 : 0.0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned errors = 0;
+    int64_t cpu_ns = 0;
+
+    shim_partition_create(WAL_PARTITION_LABEL, WAL_PARTITION_SUBTYPE, 16 * 4096);
+    shim_dht_attach(GPIO_NUM_18, DHT_TYPE_DHT11, &s_sim);
+    shim_wifi_ap_set("office", -50, true);
+    shim_tasks_start();
+    app_main();
+
+    // Connected and past the first resync before the window opens
+    shim_time_advance(10 * 1000000LL);
+    CHECK(mqtt_link_connected());
+    CHECK(http(HTTP_POST, "/config?sample_min_ms=1000&sample_max_ms=1000") != NULL);
+    shim_time_advance(60 * 1000000LL);
+
+    const char *perf = http(HTTP_GET, "/perf");
+    CHECK(perf != NULL);
+    snprintf(s_before, sizeof(s_before), "%s", perf ? perf : "null");
+
+    int64_t wall_t0 = test_now_ns();
+    for (unsigned i = 0; i < REQUESTS; i++) {
+        shim_time_advance(LOAD_INTERVAL_MS * 1000);
+        int64_t t0 = test_now_ns();
+        const char *body = http(HTTP_GET, LOAD_PATH);
+        s_request_ns[i] = test_now_ns() - t0;
+        cpu_ns += s_request_ns[i];
+        errors += body == NULL;
+    }
+    double wall_s = (double)(test_now_ns() - wall_t0) / 1e9;
+    qsort(s_request_ns, REQUESTS, sizeof(s_request_ns[0]), cmp_ns);
+
+    perf = http(HTTP_GET, "/perf");
+    CHECK(perf != NULL);
+    CHECK_EQ(errors, 0);
+
+    // The shim broker answers the probe after a fixed delay, so every round trip is that long
+    metrics_hist_summary_t rt, sp;
+    metrics_hist_summary(METRIC_HIST_MQTT_ROUNDTRIP, &rt);
+    metrics_hist_summary(METRIC_HIST_SAMPLE_TO_PUBLISH, &sp);
+    CHECK(rt.count >= LOAD_S * 1000 / MQTT_PROBE_INTERVAL_MS);
+    CHECK_EQ(rt.sum_us, (uint64_t)rt.count * SHIM_MQTT_DELIVERY_US);
+    CHECK(sp.count > 0);
+
+    FILE *out = argc > 1 ? fopen(argv[1], "w") : stdout;
+    CHECK(out != NULL);
+    if (out) {
+        fprintf(out, "{\"load\":{\"path\":\"%s\",\"interval_ms\":%u,\"requests\":%u,\"errors\":%u,"
+                     "\"cpu_ms\":%.3f,\"p50_ms\":%.6f,\"p90_ms\":%.6f,\"p99_ms\":%.6f,\"max_ms\":%.6f},"
+                     "\"wall_s\":%.3f,\"before\":%s,\"after\":%s}\n",
+                LOAD_PATH, LOAD_INTERVAL_MS, REQUESTS, errors, cpu_ns / 1e6,
+                percentile_ms(s_request_ns, REQUESTS, 50), percentile_ms(s_request_ns, REQUESTS, 90),
+                percentile_ms(s_request_ns, REQUESTS, 99), s_request_ns[REQUESTS - 1] / 1e6,
+                wall_s, s_before, perf ? perf : "null");
+        if (out != stdout) {
+            fclose(out);
+        }
+    }
+    return TEST_RESULT();
+}
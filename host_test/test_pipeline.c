@@ -0,0 +1,125 @@
+/*
+    * End-to-end run of the reading path on the host
+    *
+    * A virtual DHT22 drives waveforms through the decoder, the filter, the seqlock and the history
+    * ring, and the history is rendered as JSON the way /history does, all on the simulated clock.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "dht_decode.h"
+#include "dht_sim.h"
+#include "filter.h"
+#include "history.h"
+#include "json_writer.h"
+#include "reading.h"
+#include "esp_timer.h"
+#include "shim.h"
+#include "test_util.h"
+
+#define SAMPLES         600
+#define SAMPLE_US       3000000
+
+static const dht_sim_config_t s_sensor = {
+    .temperature = 215,
+    .humidity = 450,
+    .temperature_swing = 15,
+    .humidity_swing = 40,
+    .period_s = 600,
+    .faults = { .jitter_us = 4, .dropped_bit = 20, .bad_checksum = 20, .spike = 10 },
+};
+
+static const filter_config_t s_filter = {
+    .median_window = 3,
+    .ema_alpha = 96,
+    .temp_step = 20,
+    .temp_slew = 1,
+    .hum_step = 50,
+    .hum_slew = 5,
+    .max_rejects = 3,
+};
+
+int main(void)
+{
+    reading_store_t store = {0};
+    filter_state_t filter = {0};
+    uint32_t rng = 0x2545F491;
+    dht_level_t runs[128];
+    unsigned decoded = 0, rejected = 0, published = 0;
+
+    history_init();
+
+    for (int i = 0; i < SAMPLES; i++) {
+        int16_t true_hum, true_temp, hum, temp;
+        uint8_t data[DHT_DATA_BYTES];
+
+        shim_time_advance(SAMPLE_US);
+        dht_sim_values(&s_sensor, (uint64_t)(esp_timer_get_time() / 1000), &true_hum, &true_temp);
+        size_t n = dht_sim_waveform(DHT_TYPE_DHT22, true_hum, true_temp, &s_sensor.faults, &rng,
+                                    runs, sizeof(runs) / sizeof(runs[0]));
+
+        reading_t r;
+        reading_store_read(&store, &r);
+        r.valid = false;
+        if (dht_decode_pulses(runs, n, data) == DHT_DECODE_OK) {
+            decoded++;
+            dht_parse_data(DHT_TYPE_DHT22, data, &hum, &temp);
+            if (filter_update(&filter, &s_filter, esp_timer_get_time(), &temp, &hum) == FILTER_ACCEPTED) {
+                r.valid = r.have_value = true;
+                r.timestamp_us = esp_timer_get_time();
+                r.temperature = temp;
+                r.humidity = hum;
+                // Smoothing lags a slow triangle wave by a few tenths at most
+                CHECK(abs(temp - true_temp) <= 5);
+                CHECK(abs(hum - true_hum) <= 15);
+            } else {
+                rejected++;
+            }
+        }
+        reading_store_publish(&store, &r);
+        published++;
+        history_append(0, &r);
+    }
+
+    reading_t last;
+    CHECK(reading_store_read(&store, &last));
+    CHECK_EQ(last.seq, published);
+
+    // Every accepted sample comes back out of the history, in time order
+    history_cursor_t cursor = { .sensor = 0 };
+    history_sample_t samples[HISTORY_BLOCK_SAMPLES];
+    size_t count, total = 0;
+    uint64_t prev_ms = 0;
+    static char body[64 * 1024];
+    json_writer_t w;
+
+    json_init(&w, body, sizeof(body));
+    json_arr_open(&w, NULL);
+    while (history_next_block(&cursor, samples, &count)) {
+        for (size_t i = 0; i < count; i++) {
+            CHECK(samples[i].t_ms > prev_ms);
+            prev_ms = samples[i].t_ms;
+            json_obj_open(&w, NULL);
+            json_uint(&w, "t", samples[i].t_ms);
+            json_tenths(&w, "temperature", samples[i].temperature);
+            json_tenths(&w, "humidity", samples[i].humidity);
+            json_obj_close(&w);
+        }
+        total += count;
+    }
+    json_arr_close(&w);
+
+    CHECK_EQ(total, decoded - rejected);
+    CHECK(decoded > SAMPLES * 9 / 10);
+    CHECK(!w.overflow);
+    CHECK(w.len == strlen(body));
+    CHECK(body[0] == '[' && body[w.len - 1] == ']');
+
+    history_stats_t stats;
+    history_get_stats(&stats);
+    CHECK_EQ(stats.samples, total);
+
+    printf("pipeline: %u samples, %u decoded, %u rejected, %zu in history (%u bytes), %zu bytes JSON\n",
+           published, decoded, rejected, total, stats.bytes_used, w.len);
+    return TEST_RESULT();
+}
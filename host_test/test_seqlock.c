@@ -0,0 +1,100 @@
+/*
+    * Seqlock stress test: one writer, three readers
+    *
+    * The writer publishes readings whose fields are all derived from one counter, so a reader that
+    * mixed fields from two publishes would see them disagree. Readers also check that what they see
+    * never goes backwards.
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "reading.h"
+#include "test_util.h"
+
+#define PUBLISHES   2000000
+#define READERS     3
+
+static reading_store_t s_store;
+static atomic_bool s_done;
+
+typedef struct {
+    unsigned reads;
+    unsigned torn;
+    unsigned backwards;
+} reader_stats_t;
+
+static reading_t make(uint32_t n)
+{
+    return (reading_t){
+        .timestamp_us = (int64_t)n * 1000003,
+        .temperature = (int16_t)(n & 0x7FFF),
+        .humidity = (int16_t)(~n & 0x7FFF),
+        .valid = n & 1,
+        .have_value = true,
+    };
+}
+
+static void *writer(void *arg)
+{
+    for (uint32_t n = 1; n <= PUBLISHES; n++) {
+        reading_t r = make(n);
+        reading_store_publish(&s_store, &r);
+    }
+    atomic_store(&s_done, true);
+    return NULL;
+}
+
+static void *reader(void *arg)
+{
+    reader_stats_t *st = arg;
+    uint32_t last_seq = 0;
+
+    while (!atomic_load(&s_done)) {
+        reading_t r;
+        if (!reading_store_read(&s_store, &r)) {
+            continue;
+        }
+        st->reads++;
+        // Publish n gets seq n, so the sequence number says which values belong with it
+        reading_t want = make(r.seq);
+        if (r.timestamp_us != want.timestamp_us || r.temperature != want.temperature ||
+            r.humidity != want.humidity || r.valid != want.valid || !r.have_value) {
+            st->torn++;
+        }
+        if (r.seq < last_seq) {
+            st->backwards++;
+        }
+        last_seq = r.seq;
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t w, r[READERS];
+    reader_stats_t stats[READERS] = {0};
+    reading_t last;
+
+    CHECK(!reading_store_read(&s_store, &last));
+
+    for (int i = 0; i < READERS; i++) {
+        pthread_create(&r[i], NULL, reader, &stats[i]);
+    }
+    int64_t t0 = test_now_ns();
+    pthread_create(&w, NULL, writer, NULL);
+    pthread_join(w, NULL);
+    double ms = (double)(test_now_ns() - t0) / 1e6;
+    for (int i = 0; i < READERS; i++) {
+        pthread_join(r[i], NULL);
+        printf("reader %d: %u reads, %u torn, %u out of order\n", i, stats[i].reads, stats[i].torn, stats[i].backwards);
+        CHECK(stats[i].reads > 0);
+        CHECK_EQ(stats[i].torn, 0);
+        CHECK_EQ(stats[i].backwards, 0);
+    }
+    printf("%u publishes in %.0f ms\n", PUBLISHES, ms);
+
+    CHECK(reading_store_read(&s_store, &last));
+    CHECK_EQ(last.seq, PUBLISHES);
+    CHECK_EQ(last.temperature, make(PUBLISHES).temperature);
+    return TEST_RESULT();
+}
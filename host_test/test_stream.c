@@ -0,0 +1,173 @@
+/*
+    * /stream under load: many clients, a slow one and a stuck one
+    *
+    * 40 clients ask for the stream; the first STREAM_MAX_CLIENTS get it and the rest are turned
+    * away with 503. Four sensors then push a reading every 3 s for 10 minutes. One subscriber has a
+    * socket buffer too small for its initial backlog, so its first events go out in pieces over
+    * several pushes; one never reads and must be dropped once its socket buffer is full, without
+    * holding anyone up. Every other subscriber
+    * must get every event, whole and in order. The host time
+    * from stream_push() to the last client having the event is reported as the push latency.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "sensors.h"
+#include "shim.h"
+#include "stream.h"
+#include "test_util.h"
+
+#define SENSORS         4
+#define CLIENTS         40
+#define CYCLES          200             // 10 minutes of 3 s read cycles
+#define STUCK           1               // Index among the subscribers
+#define SLOW            2
+#define WINDOW          16384
+#define SLOW_WINDOW     256             // Less than the headers and the initial events
+
+static const sensor_def_t s_defs[SENSORS] = {
+    { .name = "desk" }, { .name = "window" }, { .name = "door" }, { .name = "server_rack" },
+};
+
+size_t sensor_count(void)
+{
+    return SENSORS;
+}
+
+const sensor_def_t *sensor_def(size_t idx)
+{
+    return idx < SENSORS ? &s_defs[idx] : NULL;
+}
+
+typedef struct {
+    int fd;
+    char buf[4096];
+    size_t len;
+    uint32_t last_seq[SENSORS];
+    unsigned events;
+    unsigned gaps;
+} client_t;
+
+static client_t s_sub[STREAM_MAX_CLIENTS];
+
+// Reads what is there and checks each complete event: known sensor, seq one up from the last
+static void client_read(client_t *c)
+{
+    c->len += shim_httpd_read(c->fd, c->buf + c->len, sizeof(c->buf) - 1 - c->len);
+    c->buf[c->len] = '\0';
+
+    char *start = c->buf, *end;
+    while ((end = strstr(start, "\n\n")) != NULL) {
+        *end = '\0';
+        const char *data = strstr(start, "data: {\"sensor\":\"");
+        if (data != NULL) {
+            const char *name = data + strlen("data: {\"sensor\":\"");
+            const char *seq = strstr(name, "\"seq\":");
+            size_t s = 0;
+            while (s < SENSORS && strncmp(name, s_defs[s].name, strlen(s_defs[s].name)) != 0) {
+                s++;
+            }
+            CHECK(s < SENSORS && seq != NULL && strstr(start, "\"humidity\":") != NULL);
+            if (s < SENSORS && seq != NULL) {
+                uint32_t n = (uint32_t)strtoul(seq + 6, NULL, 10);
+                c->gaps += c->last_seq[s] != 0 && n != c->last_seq[s] + 1;
+                c->last_seq[s] = n;
+                c->events++;
+            }
+        }
+        start = end + 2;
+    }
+    c->len -= (size_t)(start - c->buf);
+    memmove(c->buf, start, c->len);
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+int main(void)
+{
+    static int64_t latency_ns[CYCLES * SENSORS];
+    reading_t r[SENSORS] = { 0 };
+    unsigned subscribed = 0, refused = 0;
+    stream_stats_t st;
+
+    stream_init(shim_httpd_server());
+    for (size_t s = 0; s < SENSORS; s++) {
+        r[s] = (reading_t){ .seq = 1, .valid = true, .have_value = true, .temperature = 215, .humidity = 450 };
+        stream_push(s, &r[s]);
+    }
+
+    for (int i = 0; i < CLIENTS; i++) {
+        bool slow = subscribed == SLOW;
+        int fd = shim_httpd_connect(slow ? SLOW_WINDOW : WINDOW);
+        CHECK(fd >= 0);
+        shim_httpd_request(fd, HTTP_GET, "/stream", NULL, NULL, 0, stream_handler);
+        if (strcmp(shim_httpd_status(fd), "200 OK") == 0) {
+            s_sub[subscribed++].fd = fd;
+        } else {
+            CHECK_EQ(strncmp(shim_httpd_status(fd), "503", 3), 0);
+            refused++;
+            shim_httpd_close(fd);
+        }
+    }
+    shim_httpd_run();
+    CHECK_EQ(subscribed, STREAM_MAX_CLIENTS);
+    CHECK_EQ(refused, CLIENTS - STREAM_MAX_CLIENTS);
+    for (size_t i = 0; i < subscribed; i++) {
+        if (i != STUCK) {
+            client_read(&s_sub[i]);
+        }
+    }
+    // New subscribers start with the latest event of each sensor
+    CHECK_EQ(s_sub[0].events, SENSORS);
+
+    size_t n_lat = 0;
+    for (int cycle = 0; cycle < CYCLES; cycle++) {
+        if (cycle == 10) {
+            stream_get_stats(&st);      // Restart the latency maximum once the slow client caught up
+        }
+        shim_time_advance(3000000);
+        for (size_t s = 0; s < SENSORS; s++) {
+            r[s].seq++;
+            r[s].temperature = (int16_t)(215 + cycle % 7 - (int)s);
+            int64_t t0 = test_now_ns();
+            stream_push(s, &r[s]);
+            shim_httpd_run();
+            for (size_t i = 0; i < subscribed; i++) {
+                if (i != STUCK) {
+                    client_read(&s_sub[i]);
+                }
+            }
+            latency_ns[n_lat++] = test_now_ns() - t0;
+        }
+    }
+
+    stream_get_stats(&st);
+    qsort(latency_ns, n_lat, sizeof(latency_ns[0]), cmp_i64);
+    printf("stream: %u subscribers (%u refused), %u events, %u deliveries, %u dropped; "
+           "push to last client p50 %.1f us, p99 %.1f us, max %.1f us\n",
+           subscribed, refused, st.events, st.sent, st.dropped_clients,
+           latency_ns[n_lat / 2] / 1000.0, latency_ns[n_lat * 99 / 100] / 1000.0, latency_ns[n_lat - 1] / 1000.0);
+
+    for (size_t i = 0; i < subscribed; i++) {
+        if (i == STUCK) {
+            continue;
+        }
+        CHECK_EQ(s_sub[i].gaps, 0);
+        CHECK_EQ(s_sub[i].len, 0);
+        CHECK_EQ(s_sub[i].events, SENSORS * (CYCLES + 1));
+    }
+    // The stuck client went once it was STREAM_CLIENT_QUEUE events behind; its slot is free again
+    CHECK(!shim_httpd_is_open(s_sub[STUCK].fd));
+    CHECK_EQ(st.dropped_clients, 1);
+    CHECK_EQ(st.clients, STREAM_MAX_CLIENTS - 1);
+    CHECK_EQ(st.latency_us_max, 0);     // Since then every event went out right after its push
+    int fd = shim_httpd_connect(WINDOW);
+    shim_httpd_request(fd, HTTP_GET, "/stream", NULL, NULL, 0, stream_handler);
+    CHECK_EQ(strcmp(shim_httpd_status(fd), "200 OK"), 0);
+    return TEST_RESULT();
+}
@@ -0,0 +1,50 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Minimal checks for the host tests: failures are counted and printed, and
+// TEST_RESULT() turns the count into the exit status ctest looks at.
+
+static int s_test_failures;
+
+#define CHECK(cond) do {                                                            \
+        if (!(cond)) {                                                              \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);\
+            s_test_failures++;                                                      \
+        }                                                                           \
+    } while (0)
+
+#define CHECK_EQ(a, b) do {                                                         \
+        long long _a = (long long)(a), _b = (long long)(b);                         \
+        if (_a != _b) {                                                             \
+            fprintf(stderr, "%s:%d: %s == %s failed: %lld != %lld\n",               \
+                    __FILE__, __LINE__, #a, #b, _a, _b);                            \
+            s_test_failures++;                                                      \
+        }                                                                           \
+    } while (0)
+
+#define TEST_RESULT() (s_test_failures == 0 ? (printf("PASS\n"), 0) :               \
+                       (printf("FAIL (%d)\n", s_test_failures), 1))
+
+// Wall clock for the benchmarks, in ns
+static inline int64_t test_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// xorshift32, the generator dht_sim uses; state must not be 0
+static inline uint32_t test_rand(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+#endif // TEST_UTIL_H
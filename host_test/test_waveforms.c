@@ -0,0 +1,152 @@
+/*
+    * Reference DHT waveforms through the decoder
+    *
+    * The captures below have the shapes the two backends hand to dht_decode_pulses(): RMT items
+    * unpacked into level runs (ending with the zero-length idle terminator) and the polled capture,
+    * which starts in the tail of the host start pulse. Pulse lengths are spread over the datasheet
+    * tolerances rather than nominal, and the AM2301 one comes from a sensor clocked 18% slow.
+*/
+
+#include <string.h>
+#include "dht_decode.h"
+#include "test_util.h"
+
+static const dht_level_t s_dht11_rmt[] = {
+    { 29, 1 }, { 86, 0 }, { 85, 1 }, { 54, 0 }, { 25, 1 }, { 49, 0 }, { 29, 1 }, { 49, 0 },
+    { 68, 1 }, { 54, 0 }, { 26, 1 }, { 49, 0 }, { 68, 1 }, { 55, 0 }, { 22, 1 }, { 53, 0 },
+    { 29, 1 }, { 49, 0 }, { 67, 1 }, { 55, 0 }, { 23, 1 }, { 47, 0 }, { 22, 1 }, { 50, 0 },
+    { 25, 1 }, { 47, 0 }, { 29, 1 }, { 52, 0 }, { 29, 1 }, { 50, 0 }, { 25, 1 }, { 51, 0 },
+    { 29, 1 }, { 47, 0 }, { 23, 1 }, { 54, 0 }, { 26, 1 }, { 53, 0 }, { 23, 1 }, { 51, 0 },
+    { 27, 1 }, { 50, 0 }, { 75, 1 }, { 51, 0 }, { 22, 1 }, { 48, 0 }, { 68, 1 }, { 53, 0 },
+    { 68, 1 }, { 51, 0 }, { 73, 1 }, { 48, 0 }, { 22, 1 }, { 47, 0 }, { 25, 1 }, { 50, 0 },
+    { 22, 1 }, { 54, 0 }, { 28, 1 }, { 53, 0 }, { 28, 1 }, { 48, 0 }, { 25, 1 }, { 51, 0 },
+    { 27, 1 }, { 48, 0 }, { 26, 1 }, { 52, 0 }, { 22, 1 }, { 53, 0 }, { 68, 1 }, { 49, 0 },
+    { 25, 1 }, { 48, 0 }, { 22, 1 }, { 47, 0 }, { 29, 1 }, { 54, 0 }, { 24, 1 }, { 55, 0 },
+    { 25, 1 }, { 54, 0 }, { 25, 1 }, { 49, 0 }, { 0, 1 },
+};
+
+static const dht_level_t s_dht22_rmt_negative[] = {
+    { 28, 1 }, { 84, 0 }, { 79, 1 }, { 53, 0 }, { 28, 1 }, { 50, 0 }, { 22, 1 }, { 51, 0 },
+    { 26, 1 }, { 47, 0 }, { 25, 1 }, { 49, 0 }, { 28, 1 }, { 48, 0 }, { 22, 1 }, { 49, 0 },
+    { 70, 1 }, { 54, 0 }, { 71, 1 }, { 47, 0 }, { 27, 1 }, { 51, 0 }, { 73, 1 }, { 48, 0 },
+    { 68, 1 }, { 48, 0 }, { 25, 1 }, { 50, 0 }, { 67, 1 }, { 52, 0 }, { 27, 1 }, { 54, 0 },
+    { 69, 1 }, { 54, 0 }, { 69, 1 }, { 53, 0 }, { 69, 1 }, { 49, 0 }, { 26, 1 }, { 50, 0 },
+    { 25, 1 }, { 50, 0 }, { 24, 1 }, { 55, 0 }, { 25, 1 }, { 53, 0 }, { 29, 1 }, { 48, 0 },
+    { 28, 1 }, { 47, 0 }, { 23, 1 }, { 48, 0 }, { 22, 1 }, { 55, 0 }, { 26, 1 }, { 50, 0 },
+    { 73, 1 }, { 51, 0 }, { 28, 1 }, { 54, 0 }, { 71, 1 }, { 55, 0 }, { 24, 1 }, { 48, 0 },
+    { 69, 1 }, { 50, 0 }, { 74, 1 }, { 55, 0 }, { 23, 1 }, { 51, 0 }, { 25, 1 }, { 50, 0 },
+    { 22, 1 }, { 48, 0 }, { 71, 1 }, { 53, 0 }, { 74, 1 }, { 50, 0 }, { 22, 1 }, { 47, 0 },
+    { 24, 1 }, { 51, 0 }, { 72, 1 }, { 55, 0 }, { 0, 1 },
+};
+
+static const dht_level_t s_dht22_polled[] = {
+    { 1200, 0 }, { 31, 1 }, { 80, 0 }, { 79, 1 }, { 52, 0 }, { 26, 1 }, { 54, 0 }, { 29, 1 },
+    { 55, 0 }, { 26, 1 }, { 47, 0 }, { 24, 1 }, { 54, 0 }, { 29, 1 }, { 51, 0 }, { 24, 1 },
+    { 47, 0 }, { 25, 1 }, { 54, 0 }, { 70, 1 }, { 51, 0 }, { 29, 1 }, { 49, 0 }, { 70, 1 },
+    { 48, 0 }, { 76, 1 }, { 55, 0 }, { 74, 1 }, { 47, 0 }, { 71, 1 }, { 52, 0 }, { 74, 1 },
+    { 48, 0 }, { 76, 1 }, { 48, 0 }, { 30, 1 }, { 47, 0 }, { 31, 1 }, { 47, 0 }, { 30, 1 },
+    { 53, 0 }, { 24, 1 }, { 48, 0 }, { 25, 1 }, { 48, 0 }, { 25, 1 }, { 51, 0 }, { 30, 1 },
+    { 52, 0 }, { 30, 1 }, { 54, 0 }, { 31, 1 }, { 54, 0 }, { 77, 1 }, { 48, 0 }, { 77, 1 },
+    { 55, 0 }, { 69, 1 }, { 51, 0 }, { 70, 1 }, { 54, 0 }, { 24, 1 }, { 50, 0 }, { 70, 1 },
+    { 54, 0 }, { 76, 1 }, { 51, 0 }, { 24, 1 }, { 52, 0 }, { 28, 1 }, { 49, 0 }, { 72, 1 },
+    { 55, 0 }, { 71, 1 }, { 52, 0 }, { 76, 1 }, { 54, 0 }, { 27, 1 }, { 52, 0 }, { 75, 1 },
+    { 51, 0 }, { 27, 1 }, { 53, 0 }, { 72, 1 }, { 50, 0 },
+};
+
+static const dht_level_t s_am2301_slow[] = {
+    { 28, 1 }, { 95, 0 }, { 97, 1 }, { 59, 0 }, { 28, 1 }, { 57, 0 }, { 34, 1 }, { 61, 0 },
+    { 25, 1 }, { 56, 0 }, { 30, 1 }, { 57, 0 }, { 27, 1 }, { 63, 0 }, { 34, 1 }, { 60, 0 },
+    { 82, 1 }, { 62, 0 }, { 33, 1 }, { 64, 0 }, { 34, 1 }, { 61, 0 }, { 34, 1 }, { 61, 0 },
+    { 80, 1 }, { 55, 0 }, { 30, 1 }, { 55, 0 }, { 30, 1 }, { 61, 0 }, { 83, 1 }, { 55, 0 },
+    { 81, 1 }, { 62, 0 }, { 34, 1 }, { 59, 0 }, { 25, 1 }, { 60, 0 }, { 29, 1 }, { 57, 0 },
+    { 25, 1 }, { 56, 0 }, { 34, 1 }, { 56, 0 }, { 31, 1 }, { 56, 0 }, { 29, 1 }, { 59, 0 },
+    { 34, 1 }, { 60, 0 }, { 28, 1 }, { 55, 0 }, { 87, 1 }, { 64, 0 }, { 79, 1 }, { 57, 0 },
+    { 29, 1 }, { 60, 0 }, { 84, 1 }, { 64, 0 }, { 28, 1 }, { 62, 0 }, { 29, 1 }, { 56, 0 },
+    { 86, 1 }, { 62, 0 }, { 28, 1 }, { 63, 0 }, { 87, 1 }, { 59, 0 }, { 79, 1 }, { 62, 0 },
+    { 88, 1 }, { 64, 0 }, { 84, 1 }, { 63, 0 }, { 84, 1 }, { 59, 0 }, { 27, 1 }, { 56, 0 },
+    { 82, 1 }, { 59, 0 }, { 33, 1 }, { 56, 0 }, { 0, 1 },
+};
+
+typedef struct {
+    const char *name;
+    const dht_level_t *runs;
+    size_t count;
+    dht_sensor_type_t type;
+    uint8_t data[DHT_DATA_BYTES];
+    int16_t humidity;
+    int16_t temperature;
+} reference_t;
+
+#define REF(r) r, sizeof(r) / sizeof(r[0])
+
+static const reference_t s_refs[] = {
+    { "dht11_rmt", REF(s_dht11_rmt), DHT_TYPE_DHT11, { 41, 0, 23, 0, 64 }, 410, 230 },
+    { "dht22_rmt_negative", REF(s_dht22_rmt_negative), DHT_TYPE_DHT22, { 0x03, 0x6B, 0x80, 0x2B, 0x19 }, 875, -43 },
+    { "dht22_polled", REF(s_dht22_polled), DHT_TYPE_DHT22, { 0x01, 0x7E, 0x00, 0xF6, 0x75 }, 382, 246 },
+    { "am2301_slow", REF(s_am2301_slow), DHT_TYPE_AM2301, { 0x02, 0x26, 0x00, 0xD2, 0xFA }, 550, 210 },
+};
+
+static void check_reference(const reference_t *ref)
+{
+    uint8_t data[DHT_DATA_BYTES];
+    int16_t hum, temp;
+    dht_decode_timing_t fixed, adaptive;
+
+    CHECK_EQ(dht_decode_pulses(ref->runs, ref->count, data), DHT_DECODE_OK);
+    CHECK(memcmp(data, ref->data, DHT_DATA_BYTES) == 0);
+    dht_parse_data(ref->type, data, &hum, &temp);
+    CHECK_EQ(hum, ref->humidity);
+    CHECK_EQ(temp, ref->temperature);
+
+    CHECK_EQ(dht_decode_pulses_ex(ref->runs, ref->count, 0, data, &fixed), DHT_DECODE_OK);
+    CHECK_EQ(dht_decode_pulses_ex(ref->runs, ref->count, 1, data, &adaptive), DHT_DECODE_OK);
+    CHECK(memcmp(data, ref->data, DHT_DATA_BYTES) == 0);
+    CHECK_EQ(fixed.bits, DHT_DATA_BITS);
+    CHECK_EQ(fixed.threshold_us, DHT_BIT_THRESHOLD_US);
+    CHECK(fixed.margin_us > 0);
+    CHECK(fixed.jitter_us < 10);
+    printf("%-20s preamble %u/%u us, margin %u us fixed, %u us adaptive (threshold %u us), jitter %u us\n",
+           ref->name, fixed.preamble_low_us, fixed.preamble_high_us, fixed.margin_us,
+           adaptive.margin_us, adaptive.threshold_us, fixed.jitter_us);
+
+    // Runs split by the capture hardware (a glitch filtered out, an item boundary) merge back
+    dht_level_t split[2 * 128];
+    size_t n = 0;
+    for (size_t i = 0; i < ref->count; i++) {
+        uint16_t d = ref->runs[i].duration_us;
+        split[n++] = (dht_level_t){ .duration_us = d / 3, .level = ref->runs[i].level };
+        split[n++] = (dht_level_t){ .duration_us = 0, .level = !ref->runs[i].level };
+        split[n++] = (dht_level_t){ .duration_us = d - d / 3, .level = ref->runs[i].level };
+        if (n + 3 > sizeof(split) / sizeof(split[0])) {
+            break;
+        }
+    }
+    memset(data, 0, sizeof(data));
+    CHECK_EQ(dht_decode_pulses(split, n, data), DHT_DECODE_OK);
+    CHECK(memcmp(data, ref->data, DHT_DATA_BYTES) == 0);
+
+    // A capture cut short by a full RMT buffer, and one that missed the preamble
+    CHECK_EQ(dht_decode_pulses(ref->runs, ref->count / 2, data), DHT_DECODE_SHORT);
+    size_t skip = ref->runs[0].duration_us > DHT_PREAMBLE_MAX_US ? 4 : 3;     // Runs up to the first bit
+    // Without the preamble a slow sensor's 1 bit can pass for one, but the frame still comes up short
+    CHECK(dht_decode_pulses(ref->runs + skip, ref->count - skip, data) != DHT_DECODE_OK);
+
+    // Any single flipped bit is caught by the checksum
+    for (size_t i = 0; i < ref->count; i++) {
+        dht_level_t bad[128];
+        memcpy(bad, ref->runs, ref->count * sizeof(bad[0]));
+        if (i < skip || bad[i].level != 1 || bad[i].duration_us == 0) {
+            continue;
+        }
+        bad[i].duration_us = bad[i].duration_us > DHT_BIT_THRESHOLD_US ? 26 : 70;
+        CHECK_EQ(dht_decode_pulses(bad, ref->count, data), DHT_DECODE_CHECKSUM);
+    }
+}
+
+int main(void)
+{
+    for (size_t i = 0; i < sizeof(s_refs) / sizeof(s_refs[0]); i++) {
+        check_reference(&s_refs[i]);
+    }
+    return TEST_RESULT();
+}
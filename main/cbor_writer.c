@@ -0,0 +1,124 @@
+/*
+    * Minimal CBOR writer for compact MQTT payloads and HTTP responses
+    *
+    * Only what readings need: unsigned and negative integers, booleans, text strings and
+    * definite-length maps and arrays. Every item starts with a major type and the shortest
+    * argument encoding, so small integers and short keys take one byte of overhead.
+*/
+
+#include <string.h>
+#include "cbor_writer.h"
+
+#define CBOR_UINT   0
+#define CBOR_NEGINT 1
+#define CBOR_TEXT   3
+#define CBOR_ARRAY  4
+#define CBOR_MAP    5
+#define CBOR_FALSE  0xf4
+#define CBOR_TRUE   0xf5
+
+static void put(cbor_writer_t *w, const void *s, size_t n)
+{
+    if (w->overflow || w->len + n > w->cap) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(w->buf + w->len, s, n);
+    w->len += n;
+}
+
+// Major type in the top 3 bits, then the argument in as few bytes as it fits
+static void put_head(cbor_writer_t *w, uint8_t major, uint64_t arg)
+{
+    uint8_t head[9];
+    size_t n;
+
+    major <<= 5;
+    if (arg < 24) {
+        head[0] = major | (uint8_t)arg;
+        n = 1;
+    } else if (arg <= 0xff) {
+        head[0] = major | 24;
+        n = 2;
+    } else if (arg <= 0xffff) {
+        head[0] = major | 25;
+        n = 3;
+    } else if (arg <= 0xffffffff) {
+        head[0] = major | 26;
+        n = 5;
+    } else {
+        head[0] = major | 27;
+        n = 9;
+    }
+    for (size_t i = n - 1; i > 0; i--) {
+        head[i] = (uint8_t)arg;
+        arg >>= 8;
+    }
+    put(w, head, n);
+}
+
+static void put_text(cbor_writer_t *w, const char *s)
+{
+    size_t n = strlen(s);
+
+    put_head(w, CBOR_TEXT, n);
+    put(w, s, n);
+}
+
+static void put_key(cbor_writer_t *w, const char *key)
+{
+    if (key) {
+        put_text(w, key);
+    }
+}
+
+void cbor_init(cbor_writer_t *w, uint8_t *buf, size_t cap)
+{
+    w->buf = buf;
+    w->cap = cap;
+    w->len = 0;
+    w->overflow = false;
+}
+
+void cbor_map(cbor_writer_t *w, const char *key, size_t pairs)
+{
+    put_key(w, key);
+    put_head(w, CBOR_MAP, pairs);
+}
+
+void cbor_arr(cbor_writer_t *w, const char *key, size_t items)
+{
+    put_key(w, key);
+    put_head(w, CBOR_ARRAY, items);
+}
+
+void cbor_uint(cbor_writer_t *w, const char *key, uint64_t value)
+{
+    put_key(w, key);
+    put_head(w, CBOR_UINT, value);
+}
+
+void cbor_int(cbor_writer_t *w, const char *key, int64_t value)
+{
+    put_key(w, key);
+    if (value >= 0) {
+        put_head(w, CBOR_UINT, (uint64_t)value);
+    } else {
+        // -1 - n, computed without overflowing on INT64_MIN
+        put_head(w, CBOR_NEGINT, ~(uint64_t)value);
+    }
+}
+
+void cbor_bool(cbor_writer_t *w, const char *key, bool value)
+{
+    uint8_t b = value ? CBOR_TRUE : CBOR_FALSE;
+
+    put_key(w, key);
+    put(w, &b, 1);
+}
+
+void cbor_str(cbor_writer_t *w, const char *key, const char *value)
+{
+    put_key(w, key);
+    put_text(w, value);
+}
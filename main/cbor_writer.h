@@ -0,0 +1,44 @@
+#ifndef CBOR_WRITER_H
+#define CBOR_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Appends CBOR (RFC 8949) into a caller-owned buffer, mirroring json_writer.h.
+// Maps and arrays have a definite length, given when they are opened. Output
+// that does not fit sets overflow and is dropped.
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    bool overflow;
+} cbor_writer_t;
+
+/**
+ * @brief Start writing into buf, discarding previous content
+ */
+void cbor_init(cbor_writer_t *w, uint8_t *buf, size_t cap);
+
+/**
+ * @brief Open a map of pairs key/value pairs, or an array of items values
+ *
+ * @param key Key in the enclosing map, or NULL at the top level and inside arrays
+ */
+void cbor_map(cbor_writer_t *w, const char *key, size_t pairs);
+void cbor_arr(cbor_writer_t *w, const char *key, size_t items);
+
+void cbor_uint(cbor_writer_t *w, const char *key, uint64_t value);
+void cbor_int(cbor_writer_t *w, const char *key, int64_t value);
+void cbor_bool(cbor_writer_t *w, const char *key, bool value);
+void cbor_str(cbor_writer_t *w, const char *key, const char *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CBOR_WRITER_H
@@ -0,0 +1,199 @@
+/*
+    * Deferred binary logging
+    *
+    * Producers claim a slot of a bounded ring with one compare-and-swap on the write index and
+    * publish it through the slot's sequence number, so any task can log without locks and without
+    * touching the UART. A single low-priority task drains the ring in order and does all of the
+    * formatting. When the ring is full the record is dropped and counted instead of blocking.
+*/
+
+#include <string.h>
+#include "dlog.h"
+#include "esp_cpu.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mem_plan.h"
+
+#define DLOG_DRAIN_INTERVAL_MS  50
+
+_Static_assert((DLOG_RING_SIZE & (DLOG_RING_SIZE - 1)) == 0, "DLOG_RING_SIZE must be a power of two");
+
+// Slot sequence numbers are stored minus the slot index, so the zeroed ring is ready before
+// dlog_init() and records written early in boot are kept
+typedef struct {
+    atomic_uint seq;                // == position when free, position + 1 when filled
+    const dlog_site_t *site;
+    const char *tag;
+    uint32_t ts_ms;
+    uint8_t nargs;
+    uintptr_t args[DLOG_MAX_ARGS];
+} slot_t;
+
+static slot_t s_ring[DLOG_RING_SIZE];
+static atomic_uint s_write_pos;
+static atomic_uint s_read_pos;      // Written by the drain task only
+
+static atomic_uint s_written;
+static atomic_uint s_dropped;
+static atomic_uint s_suppressed;
+// Cost accounting, reset by every dlog_get_stats() so the sums cannot wrap
+static atomic_uint s_write_cycles;
+static atomic_uint s_write_count;
+static atomic_uint s_print_cycles;
+static atomic_uint s_print_count;
+
+static unsigned slot_seq(const slot_t *slot, unsigned pos)
+{
+    return atomic_load_explicit(&slot->seq, memory_order_acquire) + (pos & (DLOG_RING_SIZE - 1));
+}
+
+static void slot_set_seq(slot_t *slot, unsigned pos, unsigned seq)
+{
+    atomic_store_explicit(&slot->seq, seq - (pos & (DLOG_RING_SIZE - 1)), memory_order_release);
+}
+
+void dlog_write(dlog_site_t *site, const char *tag, const uintptr_t *args, size_t nargs)
+{
+    uint32_t start = esp_cpu_get_ccount();
+    uint32_t now = esp_log_timestamp();
+
+    // Filtered by esp_log_level_set(): not worth a slot or the drain task's time
+    if (site->level > esp_log_level_get(tag)) {
+        return;
+    }
+    if (site->min_interval_ms) {
+        unsigned last = atomic_load_explicit(&site->last_ms, memory_order_relaxed);
+        if (last != 0 && now - last < site->min_interval_ms) {
+            atomic_fetch_add_explicit(&site->suppressed, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&s_suppressed, 1, memory_order_relaxed);
+            return;
+        }
+        atomic_store_explicit(&site->last_ms, now ? now : 1, memory_order_relaxed);
+    }
+
+    unsigned pos = atomic_load_explicit(&s_write_pos, memory_order_relaxed);
+    slot_t *slot;
+    for (;;) {
+        slot = &s_ring[pos & (DLOG_RING_SIZE - 1)];
+        unsigned seq = slot_seq(slot, pos);
+        int diff = (int)(seq - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&s_write_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Slot still holds a record from the previous lap
+            atomic_fetch_add_explicit(&s_dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&s_write_pos, memory_order_relaxed);
+        }
+    }
+
+    slot->site = site;
+    slot->tag = tag;
+    slot->ts_ms = now;
+    slot->nargs = (uint8_t)nargs;
+    memcpy(slot->args, args, nargs * sizeof(uintptr_t));
+    slot_set_seq(slot, pos, pos + 1);
+
+    atomic_fetch_add_explicit(&s_written, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_write_cycles, esp_cpu_get_ccount() - start, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_write_count, 1, memory_order_relaxed);
+}
+
+static char level_letter(esp_log_level_t level)
+{
+    switch (level) {
+    case ESP_LOG_ERROR: return 'E';
+    case ESP_LOG_WARN:  return 'W';
+    case ESP_LOG_INFO:  return 'I';
+    case ESP_LOG_DEBUG: return 'D';
+    default:            return 'V';
+    }
+}
+
+static void print_record(const slot_t *slot)
+{
+    dlog_site_t *site = (dlog_site_t *)slot->site;
+    uintptr_t a[DLOG_MAX_ARGS] = {0};
+    memcpy(a, slot->args, slot->nargs * sizeof(uintptr_t));
+
+    // Same layout as ESP_LOGx, timestamped when the record was written
+    esp_log_write(site->level, slot->tag, "%c (%u) %s: ", level_letter(site->level),
+                  (unsigned)slot->ts_ms, slot->tag);
+    esp_log_write(site->level, slot->tag, site->fmt, a[0], a[1], a[2], a[3], a[4], a[5]);
+
+    unsigned suppressed = atomic_exchange_explicit(&site->suppressed, 0, memory_order_relaxed);
+    if (suppressed) {
+        esp_log_write(site->level, slot->tag, " (+%u suppressed)", suppressed);
+    }
+    esp_log_write(site->level, slot->tag, "\n");
+}
+
+static void dlog_task(void *pvParameters)
+{
+    unsigned reported_drops = 0;
+
+    while (1) {
+        unsigned pos = atomic_load_explicit(&s_read_pos, memory_order_relaxed);
+        for (;;) {
+            slot_t *slot = &s_ring[pos & (DLOG_RING_SIZE - 1)];
+            if (slot_seq(slot, pos) != pos + 1) {
+                break;
+            }
+
+            uint32_t start = esp_cpu_get_ccount();
+            print_record(slot);
+            atomic_fetch_add_explicit(&s_print_cycles, esp_cpu_get_ccount() - start, memory_order_relaxed);
+            atomic_fetch_add_explicit(&s_print_count, 1, memory_order_relaxed);
+
+            slot_set_seq(slot, pos, pos + DLOG_RING_SIZE);
+            atomic_store_explicit(&s_read_pos, ++pos, memory_order_relaxed);
+        }
+
+        unsigned dropped = atomic_load_explicit(&s_dropped, memory_order_relaxed);
+        if (dropped != reported_drops) {
+            ESP_LOGW("dlog", "%u log records dropped (ring full)", dropped - reported_drops);
+            reported_drops = dropped;
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(DLOG_DRAIN_INTERVAL_MS));
+    }
+}
+
+void dlog_init(void)
+{
+    static bool started;
+
+    if (started) {
+        return;
+    }
+    started = true;
+    MEM_PLAN_TASK(dlog_task, "dlog_task", STACK_DLOG_TASK, NULL, 1);
+}
+
+void dlog_flush(uint32_t timeout_ms)
+{
+    unsigned target = atomic_load_explicit(&s_write_pos, memory_order_relaxed);
+
+    while ((int)(target - atomic_load_explicit(&s_read_pos, memory_order_relaxed)) > 0 && timeout_ms > 0) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        timeout_ms = timeout_ms > 10 ? timeout_ms - 10 : 0;
+    }
+}
+
+void dlog_get_stats(dlog_stats_t *stats)
+{
+    unsigned writes = atomic_exchange_explicit(&s_write_count, 0, memory_order_relaxed);
+    unsigned write_cycles = atomic_exchange_explicit(&s_write_cycles, 0, memory_order_relaxed);
+    unsigned prints = atomic_exchange_explicit(&s_print_count, 0, memory_order_relaxed);
+    unsigned print_cycles = atomic_exchange_explicit(&s_print_cycles, 0, memory_order_relaxed);
+
+    stats->written = atomic_load_explicit(&s_written, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&s_dropped, memory_order_relaxed);
+    stats->suppressed = atomic_load_explicit(&s_suppressed, memory_order_relaxed);
+    stats->write_cycles_avg = writes ? write_cycles / writes : 0;
+    stats->print_cycles_avg = prints ? print_cycles / prints : 0;
+}
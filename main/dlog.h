@@ -0,0 +1,87 @@
+#ifndef DLOG_H
+#define DLOG_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "esp_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Deferred logging: the caller only copies a pointer to its call site and up to
+// DLOG_MAX_ARGS integer arguments into a lock-free ring; a low-priority task
+// formats and prints them later. Arguments must be integers or pointers to
+// strings that outlive the call (wrap those in DLOG_STR). No floats. Records above
+// LOG_LOCAL_LEVEL compile away, and those filtered by esp_log_level_set() are not queued.
+#define DLOG_MAX_ARGS       6
+#define DLOG_RING_SIZE      64      // Records, must be a power of two
+
+// One per DLOG call site, created by the macros below
+typedef struct {
+    const char *fmt;
+    esp_log_level_t level;
+    uint32_t min_interval_ms;       // 0 = no rate limit
+    atomic_uint last_ms;            // 0 = never logged
+    atomic_uint suppressed;         // Rate limited since the last record
+} dlog_site_t;
+
+typedef struct {
+    uint32_t written;
+    uint32_t dropped;               // Ring was full
+    uint32_t suppressed;            // Rate limited
+    uint32_t write_cycles_avg;      // CPU cycles the caller spent per record
+    uint32_t print_cycles_avg;      // CPU cycles formatting and printing took per record,
+                                    // i.e. what an ESP_LOGx at the call site would have cost
+} dlog_stats_t;
+
+#define DLOG_STR(s)         ((uintptr_t)(const char *)(s))
+
+// Expands a value in 0.1 units to three arguments for "%s%d.%d"
+#define DLOG_TENTHS(v)      ((v) < 0 ? DLOG_STR("-") : DLOG_STR("")), (uintptr_t)(abs(v) / 10), (uintptr_t)(abs(v) % 10)
+
+/**
+ * @brief Log through the ring, printing at most once per interval_ms from this call site
+ */
+#define DLOG_RL(lvl, tag, interval_ms, format, ...) do { if ((lvl) <= LOG_LOCAL_LEVEL) { \
+        static dlog_site_t _dlog_site = { .fmt = (format), .level = (lvl), .min_interval_ms = (interval_ms) }; \
+        const uintptr_t _dlog_args[] = { 0, ##__VA_ARGS__ }; \
+        _Static_assert(sizeof(_dlog_args) / sizeof(_dlog_args[0]) - 1 <= DLOG_MAX_ARGS, "too many DLOG arguments"); \
+        dlog_write(&_dlog_site, (tag), _dlog_args + 1, sizeof(_dlog_args) / sizeof(_dlog_args[0]) - 1); \
+    } } while (0)
+
+#define DLOGE(tag, format, ...) DLOG_RL(ESP_LOG_ERROR, tag, 0, format, ##__VA_ARGS__)
+#define DLOGW(tag, format, ...) DLOG_RL(ESP_LOG_WARN, tag, 0, format, ##__VA_ARGS__)
+#define DLOGI(tag, format, ...) DLOG_RL(ESP_LOG_INFO, tag, 0, format, ##__VA_ARGS__)
+#define DLOGD(tag, format, ...) DLOG_RL(ESP_LOG_DEBUG, tag, 0, format, ##__VA_ARGS__)
+
+/**
+ * @brief Start the drain task
+ *
+ * Records written before this are kept in the ring (up to DLOG_RING_SIZE) and
+ * printed once the task runs.
+ */
+void dlog_init(void);
+
+/**
+ * @brief Queue one record; never blocks. Use the DLOG macros instead of calling this directly.
+ */
+void dlog_write(dlog_site_t *site, const char *tag, const uintptr_t *args, size_t nargs);
+
+/**
+ * @brief Wait until the drain task has printed everything queued so far, e.g. before deep sleep
+ */
+void dlog_flush(uint32_t timeout_ms);
+
+/**
+ * @brief Counters since boot; the cycle averages cover the time since the previous call
+ */
+void dlog_get_stats(dlog_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DLOG_H
@@ -0,0 +1,106 @@
+/*
+    * Reading filter: outlier rejection, median and EMA
+    *
+    * A raw sample is first compared with the last accepted one. A jump larger than the step
+    * allowance plus the slew rate times the elapsed time is rejected, unless max_rejects samples
+    * in a row have disagreed, which is taken as a real level change and restarts the filter. An
+    * accepted sample goes into a small median window, and the median is smoothed with an EMA in
+    * 24.8 fixed point.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "filter.h"
+
+void filter_reset(filter_state_t *st)
+{
+    uint32_t accepted = st->accepted;
+    uint32_t rejected = st->rejected;
+
+    memset(st, 0, sizeof(*st));
+    st->accepted = accepted;
+    st->rejected = rejected;
+}
+
+static bool plausible(int32_t delta, int16_t step, int16_t slew, int64_t dt_us)
+{
+    int64_t limit = step + (int64_t)slew * dt_us / 1000000;
+    return labs(delta) <= limit;
+}
+
+static int16_t median(const int16_t *values, uint8_t count)
+{
+    int16_t sorted[FILTER_WINDOW_MAX];
+
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t j = i;
+        while (j > 0 && sorted[j - 1] > values[i]) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = values[i];
+    }
+    return sorted[(count - 1) / 2];
+}
+
+static int16_t ema_step(int32_t *ema, int16_t value, uint16_t alpha)
+{
+    *ema += (int32_t)((int64_t)alpha * (((int32_t)value << 8) - *ema) / 256);
+    return (int16_t)((*ema + 128) >> 8);
+}
+
+filter_result_t filter_update(filter_state_t *st, const filter_config_t *cfg, int64_t t_us,
+                              int16_t *temp, int16_t *hum)
+{
+    uint8_t window = cfg->median_window;
+
+    if (window < 1 || window > FILTER_WINDOW_MAX) {
+        window = 1;
+    }
+
+    if (st->primed) {
+        int64_t dt_us = t_us > st->last_us ? t_us - st->last_us : 0;
+        if (!plausible(*temp - st->last_temp, cfg->temp_step, cfg->temp_slew, dt_us) ||
+            !plausible(*hum - st->last_hum, cfg->hum_step, cfg->hum_slew, dt_us)) {
+            if (++st->rejects <= cfg->max_rejects) {
+                st->rejected++;
+                return FILTER_REJECTED;
+            }
+            // Consistently away from the old level: the environment changed, start over
+            filter_reset(st);
+        }
+    }
+
+    st->rejects = 0;
+    st->last_temp = *temp;
+    st->last_hum = *hum;
+    st->last_us = t_us;
+    st->accepted++;
+
+    if (window > 1) {
+        if (st->count > window || st->pos >= window) {
+            st->count = 0;          // Window shrunk by a config change
+            st->pos = 0;
+        }
+        st->temp[st->pos] = *temp;
+        st->hum[st->pos] = *hum;
+        st->pos = (st->pos + 1) % window;
+        if (st->count < window) {
+            st->count++;
+        }
+        *temp = median(st->temp, st->count);
+        *hum = median(st->hum, st->count);
+    }
+
+    if (!st->primed) {
+        st->ema_temp = (int32_t)*temp << 8;
+        st->ema_hum = (int32_t)*hum << 8;
+        st->primed = true;
+        return FILTER_ACCEPTED;
+    }
+
+    uint16_t alpha = cfg->ema_alpha >= 1 && cfg->ema_alpha <= 256 ? cfg->ema_alpha : 256;
+    *temp = ema_step(&st->ema_temp, *temp, alpha);
+    *hum = ema_step(&st->ema_hum, *hum, alpha);
+    return FILTER_ACCEPTED;
+}
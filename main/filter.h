@@ -0,0 +1,68 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Largest median window; the state is sized for it
+#define FILTER_WINDOW_MAX 7
+
+typedef struct {
+    uint8_t median_window;      // Odd, 1..FILTER_WINDOW_MAX; 1 disables the median
+    uint16_t ema_alpha;         // Weight of a new sample in 1/256, 1..256; 256 disables smoothing
+    int16_t temp_step;          // Change always accepted between samples (covers resolution), 0.1°C
+    int16_t temp_slew;          // Further change accepted per second, 0.1°C
+    int16_t hum_step;           // As above, 0.1%
+    int16_t hum_slew;
+    uint8_t max_rejects;        // Consecutive outliers after which the new level is taken as real
+} filter_config_t;
+
+typedef enum {
+    FILTER_ACCEPTED,            // Sample used; outputs updated
+    FILTER_REJECTED,            // Implausible jump; outputs unchanged
+} filter_result_t;
+
+// Per-sensor filter state; plain data so it can live in RTC memory
+typedef struct {
+    int16_t temp[FILTER_WINDOW_MAX];
+    int16_t hum[FILTER_WINDOW_MAX];
+    uint8_t count;              // Samples in the window
+    uint8_t pos;                // Next window slot
+    uint8_t rejects;            // Consecutive rejected samples
+    bool primed;
+    int16_t last_temp;          // Last accepted raw sample, reference for the slew check
+    int16_t last_hum;
+    int64_t last_us;
+    int32_t ema_temp;           // Smoothed values in 0.1 units << 8
+    int32_t ema_hum;
+    uint32_t accepted;
+    uint32_t rejected;
+} filter_state_t;
+
+/**
+ * @brief Forget all history; the next sample is accepted as is
+ */
+void filter_reset(filter_state_t *st);
+
+/**
+ * @brief Run one raw sample through slew check, median and EMA
+ *
+ * Has no dependencies beyond the C library, so noisy traces can be replayed
+ * through it on the host.
+ *
+ * @param t_us Time of the sample on a clock that keeps running across deep sleep
+ * @param temp In: raw temperature; out: filtered value if accepted (0.1°C)
+ * @param hum In: raw humidity; out: filtered value if accepted (0.1%)
+ */
+filter_result_t filter_update(filter_state_t *st, const filter_config_t *cfg, int64_t t_us,
+                              int16_t *temp, int16_t *hum);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FILTER_H
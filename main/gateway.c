@@ -0,0 +1,440 @@
+/*
+    * Gateway mode: many sensor nodes, one broker connection
+    *
+    * Nodes broadcast a fixed 32-byte packet per reading over ESP-NOW (or UDP). The gateway
+    * queues what it receives, drops duplicates by sequence number per peer, and publishes the
+    * latest reading of every peer that changed as one JSON object per batch interval, split
+    * into messages of at most GATEWAY_BATCH_BYTES. Peers are identified by the sender's MAC and
+    * sensor index and named "<last 3 MAC bytes>_<sensor name>".
+    *
+    * The peer table only grows and is written by the gateway task alone; names never change
+    * once a peer is added, so other tasks can read them for HA discovery without a lock.
+*/
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include "gateway.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_now.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "json_writer.h"
+#include "mem_plan.h"
+#include "metrics.h"
+
+static const char *TAG = "gateway";
+
+#define PEER_MAGIC              0xD7
+#define PEER_VERSION            1
+#define PEER_FLAG_VALID         0x01
+
+#define GATEWAY_QUEUE_LEN       64
+#define GATEWAY_BATCH_BYTES     1024
+#define GATEWAY_SIM_TICK_MS     10
+
+// On the wire, little-endian as laid out (both ends are ESP32s)
+typedef struct __attribute__((packed)) {
+    uint8_t magic;
+    uint8_t version;
+    uint8_t node[6];                // Sender's station MAC
+    uint16_t boot;                  // Random per boot; a new value restarts duplicate detection
+    uint8_t sensor;                 // Index in the sender's sensor table
+    uint8_t flags;
+    uint32_t seq;                   // reading_t.seq
+    int16_t temperature;            // in 0.1°C
+    int16_t humidity;               // in 0.1%
+    char name[12];                  // Sensor name, NUL padded; 12 characters from older senders are unterminated
+} peer_packet_t;
+
+_Static_assert(sizeof(peer_packet_t) == 32, "peer packet layout changed");
+
+typedef struct {
+    peer_packet_t pkt;
+    int64_t rx_us;
+} rx_item_t;
+
+typedef struct {
+    uint8_t node[6];
+    uint8_t sensor;
+    bool pending;                   // Latest reading not published yet
+    uint16_t boot;
+    uint32_t seq;
+    int16_t temperature;
+    int16_t humidity;
+    bool valid;
+    int64_t rx_us;                  // Arrival of the oldest unpublished reading
+    char name[GATEWAY_NAME_MAX];
+} peer_t;
+
+static const gateway_config_t *s_cfg;
+static QueueHandle_t s_queue;
+static StaticQueue_t s_queue_buf;
+static uint8_t s_queue_storage[GATEWAY_QUEUE_LEN * sizeof(rx_item_t)];
+static peer_t s_peers[GATEWAY_MAX_PEERS];
+static atomic_uint s_peer_count;
+static uint32_t s_batches;
+static uint32_t s_sim_sent;
+
+static const uint8_t s_broadcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+// Node side
+static gateway_transport_t s_node_transport;
+static int s_node_sock = -1;
+static struct sockaddr_in s_node_dest;
+static uint8_t s_node_mac[6];
+static uint16_t s_node_boot;
+
+static void enqueue(const peer_packet_t *pkt)
+{
+    rx_item_t item = { .pkt = *pkt, .rx_us = esp_timer_get_time() };
+
+    if (xQueueSend(s_queue, &item, 0) != pdTRUE) {
+        metrics_inc(METRIC_GATEWAY_DROPPED);
+    }
+}
+
+// Runs on the WiFi task, so it only hands the packet over
+static void espnow_recv_cb(const uint8_t *mac_addr, const uint8_t *data, int data_len)
+{
+    peer_packet_t pkt;
+
+    if (data_len != sizeof(pkt)) {
+        metrics_inc(METRIC_GATEWAY_DROPPED);
+        return;
+    }
+    memcpy(&pkt, data, sizeof(pkt));
+    // The radio knows the real sender
+    memcpy(pkt.node, mac_addr, sizeof(pkt.node));
+    enqueue(&pkt);
+}
+
+static void udp_rx_task(void *pvParameters)
+{
+    uint8_t buf[64];
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(s_cfg->udp_port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+
+    if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        ESP_LOGE(TAG, "Cannot listen on UDP port %u", s_cfg->udp_port);
+        vTaskDelete(NULL);
+        return;
+    }
+    while (1) {
+        int len = recvfrom(sock, buf, sizeof(buf), 0, NULL, NULL);
+        if (len == sizeof(peer_packet_t)) {
+            enqueue((const peer_packet_t *)buf);
+        } else if (len >= 0) {
+            metrics_inc(METRIC_GATEWAY_DROPPED);
+        }
+    }
+}
+
+// Peer names end up in topics, unique IDs and templates; keep them to [A-Za-z0-9_-]
+static void peer_name(const peer_packet_t *pkt, char *buf, size_t len)
+{
+    snprintf(buf, len, "%02x%02x%02x_%.*s", pkt->node[3], pkt->node[4], pkt->node[5],
+             (int)strnlen(pkt->name, sizeof(pkt->name)), pkt->name);
+    for (char *c = buf; *c; c++) {
+        if (!((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') || *c == '-')) {
+            *c = '_';
+        }
+    }
+}
+
+static peer_t *find_or_add_peer(const peer_packet_t *pkt)
+{
+    size_t count = atomic_load_explicit(&s_peer_count, memory_order_relaxed);
+
+    for (size_t i = 0; i < count; i++) {
+        if (s_peers[i].sensor == pkt->sensor && memcmp(s_peers[i].node, pkt->node, sizeof(pkt->node)) == 0) {
+            return &s_peers[i];
+        }
+    }
+    if (count == GATEWAY_MAX_PEERS) {
+        return NULL;
+    }
+
+    peer_t *p = &s_peers[count];
+    memset(p, 0, sizeof(*p));
+    memcpy(p->node, pkt->node, sizeof(p->node));
+    p->sensor = pkt->sensor;
+    p->boot = pkt->boot;
+    p->seq = pkt->seq - 1;
+    peer_name(pkt, p->name, sizeof(p->name));
+    // Publish the entry only once its name is complete
+    atomic_store_explicit(&s_peer_count, count + 1, memory_order_release);
+
+    ESP_LOGI(TAG, "New peer '%s' (%u total)", p->name, (unsigned)(count + 1));
+    if (s_cfg->on_peer_added) {
+        s_cfg->on_peer_added(count);
+    }
+    return p;
+}
+
+static void handle_packet(const rx_item_t *item)
+{
+    const peer_packet_t *pkt = &item->pkt;
+
+    if (pkt->magic != PEER_MAGIC || pkt->version != PEER_VERSION) {
+        metrics_inc(METRIC_GATEWAY_DROPPED);
+        return;
+    }
+    peer_t *p = find_or_add_peer(pkt);
+    if (p == NULL) {
+        metrics_inc(METRIC_GATEWAY_DROPPED);
+        return;
+    }
+    metrics_inc(METRIC_GATEWAY_PACKETS);
+
+    // Nodes may broadcast a reading more than once; anything not newer is a repeat
+    if (p->boot == pkt->boot && (int32_t)(pkt->seq - p->seq) <= 0) {
+        metrics_inc(METRIC_GATEWAY_DUPLICATES);
+        return;
+    }
+    p->boot = pkt->boot;
+    p->seq = pkt->seq;
+    p->temperature = pkt->temperature;
+    p->humidity = pkt->humidity;
+    p->valid = pkt->flags & PEER_FLAG_VALID;
+    if (!p->pending) {
+        p->pending = true;
+        p->rx_us = item->rx_us;
+    }
+}
+
+static void write_peer(json_writer_t *w, const peer_t *p)
+{
+    json_obj_open(w, p->name);
+    json_tenths(w, "temperature", p->temperature);
+    json_tenths(w, "humidity", p->humidity);
+    json_uint(w, "seq", p->seq);
+    json_bool(w, "ok", p->valid);
+    json_obj_close(w);
+}
+
+// Sends the peers in batch[0..n) as one message; false if the callback refused it
+static bool publish_batch(json_writer_t *w, const uint16_t *batch, size_t n)
+{
+    json_obj_close(w);
+    if (!s_cfg->publish_batch(w->buf, w->len)) {
+        return false;
+    }
+
+    int64_t now = esp_timer_get_time();
+    for (size_t i = 0; i < n; i++) {
+        peer_t *p = &s_peers[batch[i]];
+        p->pending = false;
+        metrics_observe_us(METRIC_HIST_GATEWAY_DELAY, (uint32_t)(now - p->rx_us));
+    }
+    s_batches++;
+    metrics_inc(METRIC_GATEWAY_BATCHES);
+    return true;
+}
+
+static void flush_pending(void)
+{
+    static char buf[GATEWAY_BATCH_BYTES];
+    static uint16_t batch[GATEWAY_MAX_PEERS];
+    size_t count = atomic_load_explicit(&s_peer_count, memory_order_relaxed);
+    size_t n = 0;
+    json_writer_t w;
+
+    json_init(&w, buf, sizeof(buf));
+    json_obj_open(&w, NULL);
+    for (size_t i = 0; i < count; i++) {
+        if (!s_peers[i].pending) {
+            continue;
+        }
+        json_writer_t before = w;
+        write_peer(&w, &s_peers[i]);
+        // Keep one byte for the closing brace
+        if (w.overflow || w.len + 1 >= w.cap) {
+            w = before;
+            w.buf[w.len] = '\0';
+            if (n == 0 || !publish_batch(&w, batch, n)) {
+                return;
+            }
+            n = 0;
+            json_init(&w, buf, sizeof(buf));
+            json_obj_open(&w, NULL);
+            write_peer(&w, &s_peers[i]);
+        }
+        batch[n++] = (uint16_t)i;
+    }
+    if (n) {
+        publish_batch(&w, batch, n);
+    }
+}
+
+static void gateway_task(void *pvParameters)
+{
+    int64_t next_us = esp_timer_get_time() + (int64_t)s_cfg->batch_ms * 1000;
+
+    while (1) {
+        rx_item_t item;
+        int64_t wait_us = next_us - esp_timer_get_time();
+        TickType_t wait = wait_us > 0 ? pdMS_TO_TICKS(wait_us / 1000) : 0;
+
+        if (xQueueReceive(s_queue, &item, wait) == pdTRUE) {
+            handle_packet(&item);
+        }
+        int64_t now = esp_timer_get_time();
+        if (now >= next_us) {
+            flush_pending();
+            next_us += (int64_t)s_cfg->batch_ms * 1000;
+            if (next_us <= now) {
+                next_us = now + (int64_t)s_cfg->batch_ms * 1000;
+            }
+        }
+    }
+}
+
+// Load generator: sim_nodes synthetic nodes, each sending every sim_interval_ms through the
+// same queue as real packets. Every 50th packet is sent twice to exercise duplicate detection.
+static void sim_task(void *pvParameters)
+{
+    static uint32_t seq[GATEWAY_MAX_PEERS];
+    uint16_t nodes = s_cfg->sim_nodes > GATEWAY_MAX_PEERS ? GATEWAY_MAX_PEERS : s_cfg->sim_nodes;
+    TickType_t last_wake = xTaskGetTickCount();
+    uint64_t credit = 0;
+    uint16_t next = 0;
+
+    ESP_LOGW(TAG, "Simulating %u nodes, one packet each per %u ms", nodes, (unsigned)s_cfg->sim_interval_ms);
+    while (1) {
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(GATEWAY_SIM_TICK_MS));
+        credit += (uint64_t)nodes * GATEWAY_SIM_TICK_MS;
+        while (credit >= s_cfg->sim_interval_ms) {
+            credit -= s_cfg->sim_interval_ms;
+            peer_packet_t pkt = {
+                .magic = PEER_MAGIC,
+                .version = PEER_VERSION,
+                .node = { 0x02, 'S', 'I', 'M', (uint8_t)(next >> 8), (uint8_t)next },
+                .boot = 1,
+                .flags = PEER_FLAG_VALID,
+                .seq = ++seq[next],
+                .temperature = (int16_t)(200 + next % 50 + (int)(esp_random() % 5)),
+                .humidity = (int16_t)(400 + next % 100 + (int)(esp_random() % 10)),
+                .name = "sim",
+            };
+            enqueue(&pkt);
+            if (++s_sim_sent % 50 == 0) {
+                enqueue(&pkt);
+            }
+            next = (uint16_t)((next + 1) % nodes);
+        }
+    }
+}
+
+esp_err_t gateway_init(const gateway_config_t *config)
+{
+    s_cfg = config;
+    s_queue = xQueueCreateStatic(GATEWAY_QUEUE_LEN, sizeof(rx_item_t), s_queue_storage, &s_queue_buf);
+
+    if (config->transport == GATEWAY_TRANSPORT_ESPNOW) {
+        esp_err_t err = esp_now_init();
+        if (err == ESP_OK) {
+            err = esp_now_register_recv_cb(espnow_recv_cb);
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "ESP-NOW init failed: %s", esp_err_to_name(err));
+            return err;
+        }
+    } else {
+        MEM_PLAN_TASK(udp_rx_task, "gw_udp", STACK_GATEWAY_UDP_TASK, NULL, 5);
+    }
+
+    MEM_PLAN_TASK(gateway_task, "gateway", STACK_GATEWAY_TASK, NULL, 4);
+    if (config->sim_nodes) {
+        MEM_PLAN_TASK(sim_task, "gw_sim", STACK_GATEWAY_SIM_TASK, NULL, 3);
+    }
+    ESP_LOGI(TAG, "Gateway listening on %s, batching every %u ms",
+             config->transport == GATEWAY_TRANSPORT_ESPNOW ? "ESP-NOW" : "UDP", (unsigned)config->batch_ms);
+    return ESP_OK;
+}
+
+size_t gateway_peer_count(void)
+{
+    return atomic_load_explicit(&s_peer_count, memory_order_acquire);
+}
+
+const char *gateway_peer_name(size_t idx)
+{
+    return idx < gateway_peer_count() ? s_peers[idx].name : NULL;
+}
+
+void gateway_get_stats(gateway_stats_t *stats)
+{
+    size_t count = gateway_peer_count();
+
+    stats->peers = count;
+    stats->pending = 0;
+    for (size_t i = 0; i < count; i++) {
+        stats->pending += s_peers[i].pending;
+    }
+    stats->batches = s_batches;
+    stats->sim_sent = s_sim_sent;
+}
+
+esp_err_t gateway_node_init(gateway_transport_t transport, uint16_t udp_port)
+{
+    s_node_transport = transport;
+    s_node_boot = (uint16_t)esp_random();
+    esp_read_mac(s_node_mac, ESP_MAC_WIFI_STA);
+
+    if (transport == GATEWAY_TRANSPORT_ESPNOW) {
+        esp_now_peer_info_t peer = { .ifidx = WIFI_IF_STA, .encrypt = false };
+        memcpy(peer.peer_addr, s_broadcast, sizeof(s_broadcast));
+        esp_err_t err = esp_now_init();
+        if (err == ESP_OK) {
+            err = esp_now_add_peer(&peer);
+        }
+        return err;
+    }
+
+    int broadcast = 1;
+    s_node_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (s_node_sock < 0) {
+        return ESP_FAIL;
+    }
+    setsockopt(s_node_sock, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+    s_node_dest.sin_family = AF_INET;
+    s_node_dest.sin_port = htons(udp_port);
+    s_node_dest.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+    return ESP_OK;
+}
+
+esp_err_t gateway_node_send(uint8_t sensor, const char *name, const reading_t *r)
+{
+    peer_packet_t pkt = {
+        .magic = PEER_MAGIC,
+        .version = PEER_VERSION,
+        .boot = s_node_boot,
+        .sensor = sensor,
+        .flags = r->valid ? PEER_FLAG_VALID : 0,
+        .seq = r->seq,
+        .temperature = r->temperature,
+        .humidity = r->humidity,
+    };
+
+    memcpy(pkt.node, s_node_mac, sizeof(pkt.node));
+    // pkt is zeroed, so the name stays terminated
+    strncpy(pkt.name, name, sizeof(pkt.name) - 1);
+
+    if (s_node_transport == GATEWAY_TRANSPORT_ESPNOW) {
+        return esp_now_send(s_broadcast, (const uint8_t *)&pkt, sizeof(pkt));
+    }
+    if (sendto(s_node_sock, &pkt, sizeof(pkt), 0, (struct sockaddr *)&s_node_dest, sizeof(s_node_dest)) < 0) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,85 @@
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "reading.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Role of this device in a gateway setup
+#define GATEWAY_MODE_OFF        0   // Publishes its own readings over MQTT
+#define GATEWAY_MODE_NODE       1   // Sends its readings to a gateway, no broker connection
+#define GATEWAY_MODE_GATEWAY    2   // Also collects and publishes the readings of nodes
+
+#define GATEWAY_MAX_PEERS       128
+#define GATEWAY_NAME_MAX        24  // "<node id>_<sensor name>" incl. NUL
+
+typedef enum {
+    GATEWAY_TRANSPORT_ESPNOW,       // Broadcast on the WiFi channel; nodes must be on the gateway's channel
+    GATEWAY_TRANSPORT_UDP,          // Broadcast datagrams on the local network, for testing
+} gateway_transport_t;
+
+typedef struct {
+    gateway_transport_t transport;
+    uint16_t udp_port;
+    uint32_t batch_ms;              // Longest a reading waits for the next batch
+    uint16_t sim_nodes;             // Synthetic nodes injected for load testing, 0 = off
+    uint32_t sim_interval_ms;       // How often each synthetic node sends
+    // Called on the gateway task when a peer is seen for the first time
+    void (*on_peer_added)(size_t idx);
+    // Called on the gateway task with one batch message; returning false keeps
+    // its readings pending for the next batch (e.g. while the broker is down)
+    bool (*publish_batch)(const char *payload, size_t len);
+} gateway_config_t;
+
+typedef struct {
+    uint32_t peers;
+    uint32_t pending;               // Peers with a reading waiting for a batch
+    uint32_t batches;               // Batch messages published
+    uint32_t sim_sent;              // Packets injected by the load generator
+} gateway_stats_t;
+
+/**
+ * @brief Start receiving node readings and publishing them in batches
+ *
+ * Must be called after WiFi is started. The configuration must outlive the
+ * module. Batches are JSON objects keyed by peer name:
+ * {"a1b2c3_room": {"temperature": 23.5, "humidity": 45.1, "seq": 17}, ...}
+ */
+esp_err_t gateway_init(const gateway_config_t *config);
+
+/**
+ * @brief Number of peers seen; peers are never removed
+ */
+size_t gateway_peer_count(void);
+
+/**
+ * @brief Name of a peer, valid for the lifetime of the program; NULL if out of range
+ */
+const char *gateway_peer_name(size_t idx);
+
+void gateway_get_stats(gateway_stats_t *stats);
+
+/**
+ * @brief Prepare to send readings to a gateway; must be called after WiFi is started
+ */
+esp_err_t gateway_node_init(gateway_transport_t transport, uint16_t udp_port);
+
+/**
+ * @brief Send one sensor's reading to the gateway
+ *
+ * @param sensor Index in this node's sensor table
+ * @param name Sensor name, truncated to 11 characters and NUL-terminated on the wire
+ */
+esp_err_t gateway_node_send(uint8_t sensor, const char *name, const reading_t *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GATEWAY_H
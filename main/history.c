@@ -0,0 +1,202 @@
+/*
+    * Compact in-RAM history of readings
+    *
+    * Samples are delta encoded into fixed-size blocks so a few tens of KB hold hours of readings.
+    * Blocks are handed out round robin; a sensor keeps appending to its open block until it is
+    * full or a delta does not fit, and the oldest block is evicted when the ring wraps.
+*/
+
+#include <string.h>
+#include "history.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define DELTA_RECORDS   (HISTORY_BLOCK_SAMPLES - 1)
+#define DT_MAX          0x3FF
+#define DV_MIN          (-1024)
+#define DV_MAX          1023
+
+_Static_assert(DT_MAX * 100 == HISTORY_MAX_GAP_MS, "HISTORY_MAX_GAP_MS does not match the delta record");
+
+typedef struct {
+    uint32_t gen;               // Allocation number, 0 = free
+    uint32_t t0_ds;             // Time of the key sample, in 0.1s since boot
+    uint32_t last_ds;           // Time of the newest sample
+    int16_t temp0;
+    int16_t hum0;
+    int16_t last_temp;
+    int16_t last_hum;
+    uint8_t sensor;
+    uint8_t count;              // Samples in the block, including the key sample
+    uint16_t reserved;
+} block_hdr_t;
+
+typedef struct {
+    block_hdr_t hdr;
+    uint32_t rec[DELTA_RECORDS];
+} block_t;
+
+_Static_assert(sizeof(block_t) == HISTORY_BLOCK_SIZE, "history block layout does not match HISTORY_BLOCK_SIZE");
+
+static block_t s_blocks[HISTORY_BLOCKS];
+static uint32_t s_next_block;
+static uint32_t s_next_gen = 1;
+static uint32_t s_append_us_max;
+static SemaphoreHandle_t s_lock;
+static StaticSemaphore_t s_lock_buf;
+
+// Open block per sensor, identified by index and generation so an evicted
+// block is noticed.
+static struct {
+    uint32_t idx;
+    uint32_t gen;
+} s_open[HISTORY_MAX_SENSORS];
+
+void history_init(void)
+{
+    s_lock = xSemaphoreCreateMutexStatic(&s_lock_buf);
+}
+
+static void start_block(uint8_t sensor, uint32_t t_ds, int16_t temp, int16_t hum)
+{
+    uint32_t idx = s_next_block;
+    block_t *b = &s_blocks[idx];
+
+    s_next_block = (s_next_block + 1) % HISTORY_BLOCKS;
+
+    memset(&b->hdr, 0, sizeof(b->hdr));
+    b->hdr.gen = s_next_gen++;
+    if (s_next_gen == 0) {
+        s_next_gen = 1;
+    }
+    b->hdr.t0_ds = b->hdr.last_ds = t_ds;
+    b->hdr.temp0 = b->hdr.last_temp = temp;
+    b->hdr.hum0 = b->hdr.last_hum = hum;
+    b->hdr.sensor = sensor;
+    b->hdr.count = 1;
+
+    s_open[sensor].idx = idx;
+    s_open[sensor].gen = b->hdr.gen;
+}
+
+void history_append(uint8_t sensor, const reading_t *reading)
+{
+    if (!reading->valid || sensor >= HISTORY_MAX_SENSORS || s_lock == NULL) {
+        return;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    uint32_t t_ds = (uint32_t)(reading->timestamp_us / 100000);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    block_t *b = &s_blocks[s_open[sensor].idx];
+    bool open = s_open[sensor].gen != 0 && b->hdr.gen == s_open[sensor].gen && b->hdr.count < HISTORY_BLOCK_SAMPLES;
+
+    int32_t dt = (int32_t)(t_ds - b->hdr.last_ds);
+    int32_t dtemp = reading->temperature - b->hdr.last_temp;
+    int32_t dhum = reading->humidity - b->hdr.last_hum;
+
+    if (open && dt >= 0 && dt <= DT_MAX &&
+        dtemp >= DV_MIN && dtemp <= DV_MAX && dhum >= DV_MIN && dhum <= DV_MAX) {
+        b->rec[b->hdr.count - 1] = ((uint32_t)dt << 22) | (((uint32_t)dtemp & 0x7FF) << 11) | ((uint32_t)dhum & 0x7FF);
+        b->hdr.count++;
+        b->hdr.last_ds = t_ds;
+        b->hdr.last_temp = reading->temperature;
+        b->hdr.last_hum = reading->humidity;
+    } else {
+        start_block(sensor, t_ds, reading->temperature, reading->humidity);
+    }
+
+    xSemaphoreGive(s_lock);
+
+    uint32_t elapsed = (uint32_t)(esp_timer_get_time() - t0);
+    if (elapsed > s_append_us_max) {
+        s_append_us_max = elapsed;
+    }
+}
+
+// Sign-extend an 11-bit field
+static int32_t sext11(uint32_t v)
+{
+    return (v & 0x400) ? (int32_t)(v | 0xFFFFF800u) : (int32_t)v;
+}
+
+bool history_next_block(history_cursor_t *cursor, history_sample_t *out, size_t *count)
+{
+    block_t copy;
+    bool found = false;
+
+    *count = 0;
+    if (s_lock == NULL) {
+        return false;
+    }
+
+    // Pick the oldest block of this sensor that has not been returned yet.
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (uint32_t i = 0; i < HISTORY_BLOCKS; i++) {
+        const block_t *b = &s_blocks[i];
+        if (b->hdr.gen == 0 || b->hdr.sensor != cursor->sensor || b->hdr.gen < cursor->next_gen) {
+            continue;
+        }
+        if (!found || b->hdr.gen < copy.hdr.gen) {
+            copy.hdr = b->hdr;
+            found = true;
+        }
+    }
+    if (found) {
+        for (uint32_t i = 0; i < HISTORY_BLOCKS; i++) {
+            if (s_blocks[i].hdr.gen == copy.hdr.gen) {
+                memcpy(copy.rec, s_blocks[i].rec, (copy.hdr.count - 1) * sizeof(uint32_t));
+                break;
+            }
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    if (!found) {
+        return false;
+    }
+    cursor->next_gen = copy.hdr.gen + 1;
+
+    uint32_t t_ds = copy.hdr.t0_ds;
+    int32_t temp = copy.hdr.temp0;
+    int32_t hum = copy.hdr.hum0;
+    for (uint32_t i = 0; i < copy.hdr.count; i++) {
+        if (i > 0) {
+            uint32_t r = copy.rec[i - 1];
+            t_ds += r >> 22;
+            temp += sext11((r >> 11) & 0x7FF);
+            hum += sext11(r & 0x7FF);
+        }
+        uint64_t t_ms = (uint64_t)t_ds * 100;
+        if (t_ms > cursor->since_ms) {
+            out[*count] = (history_sample_t){ .t_ms = t_ms, .temperature = (int16_t)temp, .humidity = (int16_t)hum };
+            (*count)++;
+        }
+    }
+
+    return true;
+}
+
+void history_get_stats(history_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (s_lock == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (uint32_t i = 0; i < HISTORY_BLOCKS; i++) {
+        const block_hdr_t *h = &s_blocks[i].hdr;
+        if (h->gen == 0) {
+            continue;
+        }
+        stats->blocks_used++;
+        stats->samples += h->count;
+        stats->bytes_used += sizeof(block_hdr_t) + (h->count - 1) * sizeof(uint32_t);
+    }
+    stats->append_us_max = s_append_us_max;
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,80 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "reading.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The ring is a fixed array of blocks; each block starts with one absolute
+// sample and is followed by 4-byte delta records (10-bit time delta in 0.1s,
+// 11-bit temperature and humidity deltas in 0.1 units).
+#define HISTORY_BLOCK_SIZE      256
+#define HISTORY_BLOCKS          128     // 32KB, ~6h per sensor at 3s
+#define HISTORY_BLOCK_SAMPLES   59      // 1 key sample + 58 delta records
+#define HISTORY_MAX_SENSORS     8
+// Longest gap between samples a delta record holds; a longer one starts a new block
+#define HISTORY_MAX_GAP_MS      102300
+
+// One decoded sample
+typedef struct {
+    uint64_t t_ms;              // Milliseconds since boot
+    int16_t temperature;        // in 0.1°C
+    int16_t humidity;           // in 0.1%
+} history_sample_t;
+
+// Reader position for history_next_block()
+typedef struct {
+    uint8_t sensor;
+    uint64_t since_ms;          // Only samples newer than this are returned
+    uint32_t next_gen;          // Internal, set to 0 to start from the oldest block
+} history_cursor_t;
+
+// Occupancy figures for status reporting
+typedef struct {
+    uint32_t samples;
+    uint32_t blocks_used;
+    uint32_t bytes_used;
+    uint32_t append_us_max;     // Slowest history_append() so far
+} history_stats_t;
+
+/**
+ * @brief Create the ring lock; call once before any other history function
+ */
+void history_init(void);
+
+/**
+ * @brief Append a valid reading to a sensor's history
+ *
+ * Invalid readings and sensors beyond HISTORY_MAX_SENSORS are ignored.
+ * When the ring is full the oldest block of any sensor is evicted.
+ */
+void history_append(uint8_t sensor, const reading_t *reading);
+
+/**
+ * @brief Decode the next block of a sensor's history, oldest first
+ *
+ * Only the ring lock is held while the block is copied, so callers can
+ * format and send the samples without blocking the sampler.
+ *
+ * @param cursor Reader position, updated on return
+ * @param out Buffer for at least HISTORY_BLOCK_SAMPLES samples
+ * @param count Number of samples written (may be 0 if all were too old)
+ * @return false when there are no more blocks
+ */
+bool history_next_block(history_cursor_t *cursor, history_sample_t *out, size_t *count);
+
+/**
+ * @brief Current ring occupancy
+ */
+void history_get_stats(history_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HISTORY_H
@@ -0,0 +1,125 @@
+/*
+    * Pre-rendered HTTP responses with ETag/304 and Cache-Control
+    *
+    * The readings behind /temperature, /humidity, /status and the per-sensor paths change once per
+    * sample, while wall displays poll them every second. Each path keeps its last rendered body
+    * together with the key (reading sequence number) it was rendered for, so a request between
+    * samples is a header lookup and one send. The ETag is the key, and max-age runs until the next
+    * sample is due.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "http_cache.h"
+#include "dlog.h"
+#include "metrics.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "http_cache";
+
+static const http_cache_config_t *s_cfg;
+
+void http_cache_init(const http_cache_config_t *config)
+{
+    s_cfg = config;
+}
+
+void http_request_done(int64_t start)
+{
+    metrics_inc(METRIC_HTTP_REQUESTS);
+    metrics_observe_us(METRIC_HIST_HTTP, (uint32_t)(esp_timer_get_time() - start));
+}
+
+// True if the client asked for CBOR; JSON stays the default for everything else
+static bool accepts_cbor(httpd_req_t *req)
+{
+    char value[96];
+
+    // A truncated header still holds its first media types
+    esp_err_t err = httpd_req_get_hdr_value_str(req, "Accept", value, sizeof(value));
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return false;
+    }
+    return strstr(value, "application/cbor") != NULL;
+}
+
+// True if the request's If-None-Match lists etag
+static bool etag_matches(httpd_req_t *req, const char *etag)
+{
+    char value[64];
+
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", value, sizeof(value)) != ESP_OK) {
+        return false;
+    }
+    return strcmp(value, "*") == 0 || strstr(value, etag) != NULL;
+}
+
+esp_err_t http_cache_send(httpd_req_t *req, const char *path, http_cache_t *c, uint32_t key,
+                          size_t idx, const reading_t *r, http_render_t render, int64_t start)
+{
+    char cache_control[24];
+    char cbor_etag[24];
+    const char *etag = c->etag;
+    bool cbor = s_cfg->render_cbor && accepts_cbor(req);
+    esp_err_t err;
+
+    if (cbor) {
+        snprintf(cbor_etag, sizeof(cbor_etag), "\"%08xc\"", (unsigned)key);
+        etag = cbor_etag;
+    } else if (!c->valid || c->key != key) {
+        json_writer_t w;
+        json_init(&w, c->body, sizeof(c->body));
+        render(&w, idx, r);
+        if (w.overflow) {
+            // Never cache or send a cut-off document
+            c->valid = false;
+            DLOG_RL(ESP_LOG_ERROR, TAG, 10000, "GET %s: response does not fit in %u bytes",
+                    DLOG_STR(path), (unsigned)sizeof(c->body));
+            http_request_done(start);
+            return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Response too large");
+        }
+        c->len = w.len;
+        c->key = key;
+        c->valid = true;
+        snprintf(c->etag, sizeof(c->etag), "\"%08x\"", (unsigned)key);
+        metrics_inc(METRIC_HTTP_CACHE_RENDERS);
+    }
+
+    // Until the next sample; readings carry the time they were taken
+    int64_t next_us = r->timestamp_us + (int64_t)s_cfg->sample_period_ms() * 1000;
+    int64_t left_us = next_us - esp_timer_get_time();
+    snprintf(cache_control, sizeof(cache_control), "max-age=%u", left_us > 0 ? (unsigned)(left_us / 1000000) : 0);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", cache_control);
+    httpd_resp_set_hdr(req, "Vary", "Accept");
+
+    if (etag_matches(req, etag)) {
+        DLOG_RL(ESP_LOG_INFO, TAG, 1000, "HTTP Request: GET %s (not modified)", DLOG_STR(path));
+        metrics_inc(METRIC_HTTP_NOT_MODIFIED);
+        httpd_resp_set_status(req, "304 Not Modified");
+        err = httpd_resp_send(req, NULL, 0);
+    } else if (cbor) {
+        uint8_t body[64];
+        cbor_writer_t w;
+        cbor_init(&w, body, sizeof(body));
+        s_cfg->render_cbor(&w, idx, r);
+        if (w.overflow) {
+            // Only a very long sensor name gets here; a cut-off map would not decode
+            DLOG_RL(ESP_LOG_ERROR, TAG, 10000, "GET %s: CBOR reading does not fit in %u bytes",
+                    DLOG_STR(path), (unsigned)sizeof(body));
+            err = httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Response too large");
+        } else {
+            DLOG_RL(ESP_LOG_INFO, TAG, 1000, "HTTP Request: GET %s (%u bytes CBOR)", DLOG_STR(path), w.len);
+            httpd_resp_set_type(req, "application/cbor");
+            err = httpd_resp_send(req, (const char *)w.buf, w.len);
+        }
+    } else {
+        DLOG_RL(ESP_LOG_INFO, TAG, 1000, "HTTP Request: GET %s (%u bytes)", DLOG_STR(path), c->len);
+        ESP_LOGD(TAG, "Response Data: %.*s", c->len, c->body);
+        httpd_resp_set_type(req, "application/json");
+        err = httpd_resp_send(req, c->body, c->len);
+    }
+    http_request_done(start);
+    return err;
+}
@@ -0,0 +1,62 @@
+#ifndef HTTP_CACHE_H
+#define HTTP_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "cbor_writer.h"
+#include "json_writer.h"
+#include "reading.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A rendered JSON response, reused until the data behind it changes. Only the httpd
+// task touches these, so they need no lock.
+typedef struct {
+    bool valid;
+    uint32_t key;                   // Reading sequence number, plus flags for /status
+    uint16_t len;
+    char etag[24];
+    char body[128];
+} http_cache_t;
+
+typedef void (*http_render_t)(json_writer_t *w, size_t idx, const reading_t *r);
+
+typedef struct {
+    // Encodes a reading for clients that accept application/cbor; it is cheap enough not to cache
+    void (*render_cbor)(cbor_writer_t *w, size_t idx, const reading_t *r);
+    // Current time between samples, for Cache-Control
+    uint32_t (*sample_period_ms)(void);
+} http_cache_config_t;
+
+/**
+ * @brief Set the encoders and clock used by http_cache_send(); the configuration must outlive the module
+ */
+void http_cache_init(const http_cache_config_t *config);
+
+/**
+ * @brief Serve a cached response, rendering it only when key changed
+ *
+ * Clients may cache the response until the next sample is due; a revalidation
+ * with a current ETag gets an empty 304. Counts the request like http_request_done().
+ *
+ * @param path Request path for the log; must outlive the request (it is logged asynchronously)
+ * @param start esp_timer_get_time() at handler entry
+ */
+esp_err_t http_cache_send(httpd_req_t *req, const char *path, http_cache_t *cache, uint32_t key,
+                          size_t idx, const reading_t *r, http_render_t render, int64_t start);
+
+/**
+ * @brief Count a handled request and record how long the handler ran since start
+ */
+void http_request_done(int64_t start);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HTTP_CACHE_H
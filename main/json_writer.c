@@ -0,0 +1,142 @@
+/*
+    * Minimal JSON writer for HTTP responses and MQTT payloads
+    *
+    * Readings are fixed-point integers, so numbers are rendered digit by digit instead of through
+    * printf. Everything is appended into a caller-supplied buffer and the length is tracked, so
+    * callers never need strlen or a heap allocation.
+*/
+
+#include <string.h>
+#include "json_writer.h"
+
+static void put(json_writer_t *w, const char *s, size_t n)
+{
+    if (w->overflow || w->len + n >= w->cap) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(w->buf + w->len, s, n);
+    w->len += n;
+    w->buf[w->len] = '\0';
+}
+
+static void put_char(json_writer_t *w, char c)
+{
+    put(w, &c, 1);
+}
+
+static void put_u64(json_writer_t *w, uint64_t v)
+{
+    char digits[20];
+    size_t n = sizeof(digits);
+
+    do {
+        digits[--n] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    put(w, digits + n, sizeof(digits) - n);
+}
+
+static void put_key(json_writer_t *w, const char *key)
+{
+    if (w->need_comma) {
+        put_char(w, ',');
+    }
+    if (key) {
+        put_char(w, '"');
+        put(w, key, strlen(key));
+        put(w, "\":", 2);
+    }
+    w->need_comma = true;
+}
+
+void json_init(json_writer_t *w, char *buf, size_t cap)
+{
+    w->buf = buf;
+    w->cap = cap;
+    w->len = 0;
+    w->need_comma = false;
+    w->overflow = cap == 0;
+    if (cap) {
+        buf[0] = '\0';
+    }
+}
+
+void json_obj_open(json_writer_t *w, const char *key)
+{
+    put_key(w, key);
+    put_char(w, '{');
+    w->need_comma = false;
+}
+
+void json_obj_close(json_writer_t *w)
+{
+    put_char(w, '}');
+    w->need_comma = true;
+}
+
+void json_arr_open(json_writer_t *w, const char *key)
+{
+    put_key(w, key);
+    put_char(w, '[');
+    w->need_comma = false;
+}
+
+void json_arr_close(json_writer_t *w)
+{
+    put_char(w, ']');
+    w->need_comma = true;
+}
+
+void json_tenths(json_writer_t *w, const char *key, int32_t value)
+{
+    uint32_t mag = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+
+    put_key(w, key);
+    if (value < 0) {
+        put_char(w, '-');
+    }
+    put_u64(w, mag / 10);
+    put_char(w, '.');
+    put_char(w, (char)('0' + mag % 10));
+}
+
+void json_uint(json_writer_t *w, const char *key, uint64_t value)
+{
+    put_key(w, key);
+    put_u64(w, value);
+}
+
+void json_int(json_writer_t *w, const char *key, int64_t value)
+{
+    put_key(w, key);
+    if (value < 0) {
+        put_char(w, '-');
+        put_u64(w, 0u - (uint64_t)value);
+    } else {
+        put_u64(w, (uint64_t)value);
+    }
+}
+
+void json_bool(json_writer_t *w, const char *key, bool value)
+{
+    put_key(w, key);
+    if (value) {
+        put(w, "true", 4);
+    } else {
+        put(w, "false", 5);
+    }
+}
+
+void json_str(json_writer_t *w, const char *key, const char *value)
+{
+    put_key(w, key);
+    put_char(w, '"');
+    for (const char *p = value; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            put_char(w, '\\');
+        }
+        put_char(w, *p);
+    }
+    put_char(w, '"');
+}
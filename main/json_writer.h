@@ -0,0 +1,53 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Appends JSON into a caller-owned buffer. Values are rendered from integers
+// (readings are kept in 0.1 units), so no float formatting is involved.
+// The buffer is always NUL terminated; output that does not fit sets overflow
+// and is dropped.
+typedef struct {
+    char *buf;
+    size_t cap;
+    size_t len;
+    bool need_comma;
+    bool overflow;
+} json_writer_t;
+
+/**
+ * @brief Start writing into buf, discarding previous content
+ */
+void json_init(json_writer_t *w, char *buf, size_t cap);
+
+/**
+ * @brief Open/close an object or array
+ *
+ * @param key Member name, or NULL at the top level and inside arrays
+ */
+void json_obj_open(json_writer_t *w, const char *key);
+void json_obj_close(json_writer_t *w);
+void json_arr_open(json_writer_t *w, const char *key);
+void json_arr_close(json_writer_t *w);
+
+/**
+ * @brief Write a value given in 0.1 units as a decimal number, e.g. 235 -> 23.5
+ */
+void json_tenths(json_writer_t *w, const char *key, int32_t value);
+
+void json_uint(json_writer_t *w, const char *key, uint64_t value);
+void json_int(json_writer_t *w, const char *key, int64_t value);
+void json_bool(json_writer_t *w, const char *key, bool value);
+void json_str(json_writer_t *w, const char *key, const char *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_WRITER_H
@@ -2,11 +2,15 @@
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <stdatomic.h>
+#include <sys/time.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "freertos/event_groups.h"
 #include "esp_system.h"
+#include "esp_attr.h"
+#include "esp_sleep.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
@@ -16,20 +20,43 @@
 #include "esp_http_server.h"
 #include "lwip/err.h"
 #include "lwip/sys.h"
-#include "esp_rom_sys.h"
 #include "mqtt_client.h"
+#include "esp_timer.h"
+#include "esp_ota_ops.h"
+#include "esp_pm.h"
+#include "esp32/pm.h"
+#include "sensors.h"
+#include "history.h"
+#include "wal.h"
+#include "json_writer.h"
+#include "cbor_writer.h"
+#include "dlog.h"
+#include "metrics.h"
+#include "wifi_select.h"
+#include "mqtt_link.h"
+#include "stream.h"
+#include "http_cache.h"
+#include "sched.h"
+#include "gateway.h"
+#include "mem_plan.h"
+#include "status.h"
+#include "ota.h"
 
 static const char *TAG = "environmental_conditions_monitor";
 
 // Pin definitions
 #define STATUS_LED_PIN GPIO_NUM_2
-#define DHT11_PIN GPIO_NUM_18
+// DHT sensor pins and types are listed in the sensor table in sensors.c
 
 // WiFi credentials -- Edit these with your actual WiFi network details.
+// Networks with an empty SSID are ignored; the strongest reachable one is used.
+// A build (or the host test) may define them instead.
+#ifndef WIFI_SSID_1
 #define WIFI_SSID_1 ""
 #define WIFI_PASS_1 ""
 #define WIFI_SSID_2 ""
 #define WIFI_PASS_2 ""
+#endif
 
 #define AP_SSID "Fallback_Hotspot"
 #define AP_PASS "llnDapo0emZw"
@@ -40,28 +67,112 @@ static const char *TAG = "environmental_conditions_monitor";
 // HA discovery prefix
 #define HA_DISCOVERY_PREFIX     "homeassistant"
 
-// Unique IDs for sensors
-#define HA_TEMP_UNIQUE_ID       "temperature"
-#define HA_HUM_UNIQUE_ID        "humidity"
+// Topics and unique IDs are derived per sensor by sensor_topic()/sensor_unique_id():
+// the primary sensor keeps the original names ("temperature/state", unique ID
+// "temperature"), other sensors are prefixed with their name ("attic/temperature/state",
+// unique ID "attic_temperature").
+#define MQTT_TOPIC_MAX          64
 
-// Discovery topics
-#define HA_TEMP_CONFIG_TOPIC    HA_DISCOVERY_PREFIX "/sensor/" HA_TEMP_UNIQUE_ID "/config"
-#define HA_HUM_CONFIG_TOPIC     HA_DISCOVERY_PREFIX "/sensor/" HA_HUM_UNIQUE_ID  "/config"
+// State publishing: 1 = one combined message per sensor on "climate/state"
+// ({"temperature": .., "humidity": ..}), 0 = separate temperature/humidity topics
+#define MQTT_PUBLISH_COMBINED   1
+#define MQTT_COMBINED_QUANTITY  "climate"
 
-// State topics (where we publish readings)
-#define MQTT_TEMP_STATE_TOPIC   "temperature/state"
-#define MQTT_HUM_STATE_TOPIC    "humidity/state"
+// State payload encodings. JSON goes to the topics above, which Home Assistant discovery
+// points at. CBOR carries the full reading (see encode_reading_cbor()) on "reading/cbor",
+// or "<name>/reading/cbor", for ingestion pipelines that do not need the JSON.
+#define MQTT_STATE_JSON         1
+#define MQTT_STATE_CBOR         0
+#define MQTT_CBOR_QUANTITY      "reading"
+#define MQTT_CBOR_SUFFIX        "cbor"
 
+// A value is only republished once it moves by at least the deadband (0.1 units)
+// from the last published value, or when nothing was sent for MQTT_HEARTBEAT_MS.
+#define MQTT_DEADBAND_TEMP      5       // 0.5°C
+#define MQTT_DEADBAND_HUM       10      // 1.0%
+#define MQTT_HEARTBEAT_MS       60000
 
-// Global variables
-static bool led_error_state = false;
-static bool wifi_connected = false;
-static float room_temp = 0.0;
-static float room_humidity = 0.0;
-static bool sensor_connectivity = false;
+// QoS per topic
+#define MQTT_QOS_COMBINED       0
+#define MQTT_QOS_TEMPERATURE    0
+#define MQTT_QOS_HUMIDITY       0
+#define MQTT_QOS_CBOR           0
+#define MQTT_QOS_DISCOVERY      1
+#define MQTT_QOS_BACKLOG        1
+
+// Battery duty-cycle mode: 1 = wake every DUTY_CYCLE_INTERVAL_S, read, publish only if
+// something changed (or the heartbeat is due), then deep sleep. No web server or LED.
+#define DUTY_CYCLE_MODE             0
+#define DUTY_CYCLE_INTERVAL_S       60
+#define DUTY_CYCLE_CONNECT_TIMEOUT_MS 8000
+#define DUTY_CYCLE_REPLAY_BATCHES   5
+// How long to wait for the broker to acknowledge the QoS 1 publishes before going back to sleep
+#define DUTY_CYCLE_ACK_TIMEOUT_MS   3000
+
+// Readings logged to flash while offline are replayed in batches on this topic
+#define MQTT_BACKLOG_TOPIC      "backlog"
+#define WAL_REPLAY_BATCH        10
+#define WAL_REPLAY_INTERVAL_MS  1000
+// A batch not acknowledged within this time is sent again (it may then arrive twice)
+#define WAL_REPLAY_ACK_TIMEOUT_MS 15000
+
+// Broker round trip: every MQTT_PROBE_INTERVAL_MS the publisher sends its send time to a
+// topic the device subscribes to, and the delay until it comes back is recorded
+#define MQTT_PROBE_TOPIC        "probe"
+#define MQTT_PROBE_INTERVAL_MS  30000
+
+// Gateway mode (see gateway.h): nodes hand their readings to one gateway over ESP-NOW
+// (or UDP broadcast) instead of each holding a broker connection, and the gateway
+// publishes them in batches on GATEWAY_STATE_TOPIC with HA discovery per node sensor.
+// GATEWAY_SIM_NODES > 0 adds that many synthetic nodes on a gateway, as a load test.
+#define GATEWAY_MODE            GATEWAY_MODE_OFF
+#define GATEWAY_TRANSPORT       GATEWAY_TRANSPORT_ESPNOW
+#define GATEWAY_UDP_PORT        47900
+#define GATEWAY_STATE_TOPIC     "gateway/state"
+#define GATEWAY_BATCH_MS        1000
+#define GATEWAY_SIM_NODES       0
+#define GATEWAY_SIM_INTERVAL_MS 5000
+#define MQTT_QOS_GATEWAY        0
+
+// Reconnect soak test: 0 = off, otherwise drop WiFi this many times, each time once the
+// broker session is back, to check that free heap stays flat (drift in the memory report)
+#define SOAK_RECONNECTS         0
+
+// Status log period; the status task sleeps on events in between
+#define STATUS_REPORT_MS        10000
+
+// Power management: the CPU scales between POWER_MIN_FREQ_MHZ and the configured maximum,
+// and with POWER_LIGHT_SLEEP the chip light-sleeps whenever all tasks are blocked (needs
+// CONFIG_PM_ENABLE and CONFIG_FREERTOS_USE_TICKLESS_IDLE). WiFi stays associated through
+// DTIM wakeups, which adds up to a beacon interval of latency to HTTP and MQTT. A gateway
+// listens for node packets all the time and never light-sleeps.
+#define POWER_MIN_FREQ_MHZ      40
+#define POWER_LIGHT_SLEEP       (GATEWAY_MODE != GATEWAY_MODE_GATEWAY)
+
+// Bearer token for firmware uploads to POST /ota; empty disables the endpoint
+#define OTA_TOKEN               ""
+
+#if DUTY_CYCLE_MODE && GATEWAY_MODE != GATEWAY_MODE_OFF
+#error "Gateway mode needs the always-on firmware"
+#endif
+
+
+// Global status flags, shared between the event loop, httpd and app tasks.
+// Readings themselves are published through the per-sensor seqlock in sensors.c;
+// the LED and sensor connectivity are tracked by the status task in status.c.
+static atomic_bool wifi_connected = false;
+static atomic_bool mqtt_resync = false;    // Republish all state after a (re)connect
+
+// Timing of the sampler and publisher loops
+static sched_loop_t s_sample_loop;
+static sched_loop_t s_publish_loop;
+
+// URIs for the per-sensor HTTP handlers, which must outlive registration
+static char s_sensor_uris[SENSOR_MAX][32];
 
 // WiFi event group
 static EventGroupHandle_t s_wifi_event_group;
+static StaticEventGroup_t s_wifi_event_group_buf;
 #define WIFI_CONNECTED_BIT BIT0
 #define WIFI_FAIL_BIT BIT1
 
@@ -69,64 +180,438 @@ static EventGroupHandle_t s_wifi_event_group;
 static void wifi_init_sta(void);
 static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
 static void dht11_task(void *pvParameters);
-static void led_blink_task(void *pvParameters);
-static void sensor_check_task(void *pvParameters);
-static bool read_dht11(float *temperature, float *humidity);
+static void status_report(void);
+static void wal_replay_task(void *pvParameters);
+static void publish_task(void *pvParameters);
 static void configure_gpio(void);
 static esp_err_t temp_handler(httpd_req_t *req);
 static esp_err_t humidity_handler(httpd_req_t *req);
 static esp_err_t status_handler(httpd_req_t *req);
+static esp_err_t sensor_handler(httpd_req_t *req);
+static esp_err_t history_handler(httpd_req_t *req);
+static esp_err_t metrics_handler(httpd_req_t *req);
+static esp_err_t perf_handler(httpd_req_t *req);
+static esp_err_t config_get_handler(httpd_req_t *req);
+static esp_err_t config_post_handler(httpd_req_t *req);
 static void start_webserver(void);
-static void start_mqtt(void);
 static void publish_ha_discovery(void);
+static void sensor_topic(size_t idx, const char *quantity, char *buf, size_t len);
+static void sensor_topic_suffix(size_t idx, const char *quantity, const char *suffix, char *buf, size_t len);
+static void sensor_unique_id(size_t idx, const char *quantity, char *buf, size_t len);
+
+// The full reading as a CBOR map, for MQTT and for HTTP clients that accept it:
+// {"id": name, "seq": n, "ts": ms since boot when measured, "t": 0.1°C, "h": 0.1%, "ok": valid}
+static void encode_reading_cbor(cbor_writer_t *w, size_t idx, const reading_t *r)
+{
+    cbor_map(w, NULL, 6);
+    cbor_str(w, "id", sensor_def(idx)->name);
+    cbor_uint(w, "seq", r->seq);
+    cbor_uint(w, "ts", (uint64_t)r->timestamp_us / 1000);
+    cbor_int(w, "t", r->temperature);
+    cbor_int(w, "h", r->humidity);
+    cbor_bool(w, "ok", r->valid);
+}
+
+// QoS 1 publishes handed to the client, and PUBACKs received for them, since boot
+static atomic_uint s_qos_sent;
+static atomic_uint s_qos_acked;
+
+// All publishes go through here so they are counted and timed
+static int mqtt_publish(const char *topic, const char *data, int len, int qos, int retain)
+{
+    int64_t start = esp_timer_get_time();
+    int msg_id = esp_mqtt_client_publish(mqtt_link_client(), topic, data, len, qos, retain);
+
+    metrics_observe_us(METRIC_HIST_PUBLISH, (uint32_t)(esp_timer_get_time() - start));
+    metrics_inc(msg_id < 0 ? METRIC_MQTT_PUBLISH_FAILURES : METRIC_MQTT_PUBLISHES);
+    if (qos > 0 && msg_id > 0) {
+        atomic_fetch_add(&s_qos_sent, 1);
+    }
+    return msg_id;
+}
 
-static esp_mqtt_client_handle_t mqtt_client = NULL;
+// Publishes a rendered JSON payload, or counts a failure if it was cut short by its buffer
+static int mqtt_publish_json(const char *topic, const json_writer_t *w, int qos, int retain)
+{
+    if (w->overflow) {
+        DLOG_RL(ESP_LOG_ERROR, TAG, 10000, "JSON payload does not fit in %u bytes, not published", w->cap);
+        metrics_inc(METRIC_MQTT_PUBLISH_FAILURES);
+        return -1;
+    }
+    return mqtt_publish(topic, w->buf, w->len, qos, retain);
+}
+
+static http_cache_t s_cache_temperature;
+static http_cache_t s_cache_humidity;
+static http_cache_t s_cache_status;
+static http_cache_t s_cache_sensor[SENSOR_MAX];
+
+static const http_cache_config_t s_http_cache_config = {
+    .render_cbor = encode_reading_cbor,
+    .sample_period_ms = sched_sample_period,
+};
+
+static void render_temperature(json_writer_t *w, size_t idx, const reading_t *r)
+{
+    json_obj_open(w, NULL);
+    json_tenths(w, "temperature", r->temperature);
+    json_obj_close(w);
+}
+
+static void render_humidity(json_writer_t *w, size_t idx, const reading_t *r)
+{
+    json_obj_open(w, NULL);
+    json_tenths(w, "humidity", r->humidity);
+    json_obj_close(w);
+}
+
+static void render_status(json_writer_t *w, size_t idx, const reading_t *r)
+{
+    json_obj_open(w, NULL);
+    json_tenths(w, "temperature", r->temperature);
+    json_tenths(w, "humidity", r->humidity);
+    json_bool(w, "wifi_connected", wifi_connected);
+    json_bool(w, "sensor_ok", status_sensor_online());
+    json_obj_close(w);
+}
+
+static void render_sensor(json_writer_t *w, size_t idx, const reading_t *r)
+{
+    json_obj_open(w, NULL);
+    json_str(w, "name", sensor_def(idx)->name);
+    json_tenths(w, "temperature", r->temperature);
+    json_tenths(w, "humidity", r->humidity);
+    json_bool(w, "sensor_ok", sensor_online(r));
+    json_obj_close(w);
+}
 
 // HTTP server handlers
 static esp_err_t temp_handler(httpd_req_t *req)
 {
-    char response[100];
-    snprintf(response, sizeof(response), "{\"temperature\": %.2f}", room_temp);
-    
-    ESP_LOGI(TAG, "HTTP Request: GET /temperature");
-    ESP_LOGI(TAG, "Response Data: %s", response);
-    ESP_LOGI(TAG, "Data Packet Size: %d bytes", strlen(response));
-    
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, response, strlen(response));
-    return ESP_OK;
+    int64_t start = esp_timer_get_time();
+    reading_t r;
+    sensor_latest(0, &r);
+
+    return http_cache_send(req, "/temperature", &s_cache_temperature, r.seq, 0, &r, render_temperature, start);
 }
 
 static esp_err_t humidity_handler(httpd_req_t *req)
 {
-    char response[100];
-    snprintf(response, sizeof(response), "{\"humidity\": %.2f}", room_humidity);
-    
-    ESP_LOGI(TAG, "HTTP Request: GET /humidity");
-    ESP_LOGI(TAG, "Response Data: %s", response);
-    ESP_LOGI(TAG, "Data Packet Size: %d bytes", strlen(response));
-    
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, response, strlen(response));
-    return ESP_OK;
+    int64_t start = esp_timer_get_time();
+    reading_t r;
+    sensor_latest(0, &r);
+
+    return http_cache_send(req, "/humidity", &s_cache_humidity, r.seq, 0, &r, render_humidity, start);
 }
 
 static esp_err_t status_handler(httpd_req_t *req)
 {
-    char response[200];
-    snprintf(response, sizeof(response), 
-        "{\"temperature\": %.2f, \"humidity\": %.2f, \"wifi_connected\": %s, \"sensor_ok\": %s}", 
-        room_temp, room_humidity, 
-        wifi_connected ? "true" : "false",
-        sensor_connectivity ? "true" : "false");
-    
-    ESP_LOGI(TAG, "HTTP Request: GET /status");
-    ESP_LOGI(TAG, "Response Data: %s", response);
-    ESP_LOGI(TAG, "Data Packet Size: %d bytes", strlen(response));
-    
+    int64_t start = esp_timer_get_time();
+    reading_t r;
+    sensor_latest(0, &r);
+
+    // The flags change independently of the readings, so they are part of the key
+    uint32_t key = (r.seq << 2) | (wifi_connected ? 2 : 0) | (status_sensor_online() ? 1 : 0);
+    return http_cache_send(req, "/status", &s_cache_status, key, 0, &r, render_status, start);
+}
+
+static esp_err_t sensor_handler(httpd_req_t *req)
+{
+    int64_t start = esp_timer_get_time();
+    size_t idx = (size_t)(uintptr_t)req->user_ctx;
+    reading_t r;
+    sensor_latest(idx, &r);
+
+    return http_cache_send(req, s_sensor_uris[idx], &s_cache_sensor[idx], r.seq, idx, &r, render_sensor, start);
+}
+
+static void render_loop_stats(json_writer_t *w, const char *key, sched_loop_t *loop)
+{
+    sched_loop_stats_t st;
+    sched_loop_stats(loop, &st);
+
+    json_obj_open(w, key);
+    json_uint(w, "runs", st.runs);
+    json_uint(w, "overruns", st.overruns);
+    json_uint(w, "jitter_us_avg", st.jitter_us_avg);
+    json_uint(w, "jitter_us_max", st.jitter_us_max);
+    json_int(w, "drift_ms", st.drift_ms);
+    json_obj_close(w);
+}
+
+static esp_err_t send_config(httpd_req_t *req, int64_t start)
+{
+    static char buf[384];           // httpd runs handlers one at a time
+    json_writer_t w;
+    sched_config_t cfg;
+    sched_get_config(&cfg);
+
+    json_init(&w, buf, sizeof(buf));
+    json_obj_open(&w, NULL);
+    json_uint(&w, "sample_min_ms", cfg.sample_min_ms);
+    json_uint(&w, "sample_max_ms", cfg.sample_max_ms);
+    json_uint(&w, "publish_ms", cfg.publish_ms);
+    json_tenths(&w, "change_temp", cfg.change_temp);
+    json_tenths(&w, "change_hum", cfg.change_hum);
+    json_uint(&w, "sample_period_ms", sched_sample_period());
+    render_loop_stats(&w, "sampler", &s_sample_loop);
+    render_loop_stats(&w, "publisher", &s_publish_loop);
+    json_obj_close(&w);
+
+    if (w.overflow) {
+        ESP_LOGE(TAG, "/config document does not fit in %u bytes", (unsigned)sizeof(buf));
+        http_request_done(start);
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Response too large");
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    esp_err_t err = httpd_resp_send(req, w.buf, w.len);
+    http_request_done(start);
+    return err;
+}
+
+// GET /config: scheduling parameters and loop timing statistics
+static esp_err_t config_get_handler(httpd_req_t *req)
+{
+    return send_config(req, esp_timer_get_time());
+}
+
+// Reads one numeric query parameter; tenths = true parses "0.5" as 5
+static bool query_number(const char *query, const char *key, bool tenths, int32_t *out)
+{
+    char value[16];
+    char *end;
+
+    if (httpd_query_key_value(query, key, value, sizeof(value)) != ESP_OK) {
+        return false;
+    }
+    if (tenths) {
+        *out = (int32_t)lroundf(strtof(value, &end) * 10.0f);
+    } else {
+        *out = (int32_t)strtol(value, &end, 10);
+    }
+    return end != value && *end == '\0';
+}
+
+// POST /config?sample_min_ms=..&sample_max_ms=..&publish_ms=..&change_temp=..&change_hum=..
+// Omitted parameters keep their value; the result is stored in NVS.
+static esp_err_t config_post_handler(httpd_req_t *req)
+{
+    int64_t start = esp_timer_get_time();
+    char query[160];
+    sched_config_t cfg;
+    int32_t v;
+    bool bad = false;
+
+    sched_get_config(&cfg);
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (query_number(query, "sample_min_ms", false, &v)) {
+            cfg.sample_min_ms = v > 0 ? (uint32_t)v : 0;
+        }
+        if (query_number(query, "sample_max_ms", false, &v)) {
+            cfg.sample_max_ms = v > 0 ? (uint32_t)v : 0;
+        }
+        if (query_number(query, "publish_ms", false, &v)) {
+            cfg.publish_ms = v > 0 ? (uint32_t)v : 0;
+        }
+        if (query_number(query, "change_temp", true, &v)) {
+            bad |= v < 0 || v > INT16_MAX;
+            cfg.change_temp = (int16_t)v;
+        }
+        if (query_number(query, "change_hum", true, &v)) {
+            bad |= v < 0 || v > INT16_MAX;
+            cfg.change_hum = (int16_t)v;
+        }
+    }
+
+    esp_err_t err = bad ? ESP_ERR_INVALID_ARG : sched_set_config(&cfg);
+    if (err == ESP_ERR_INVALID_ARG) {
+        http_request_done(start);
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Out of range");
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Schedule applied but not saved: %s", esp_err_to_name(err));
+    }
+    return send_config(req, start);
+}
+
+// Streams the history ring as JSON using chunked encoding, one ring block at a time,
+// so the response is never held in memory in full.
+static esp_err_t send_history(httpd_req_t *req, size_t idx, uint64_t since_ms)
+{
+    static history_sample_t samples[HISTORY_BLOCK_SAMPLES];  // httpd runs handlers on one task
+    static char chunk[512];
+    history_cursor_t cursor = { .sensor = (uint8_t)idx, .since_ms = since_ms };
+    json_writer_t w;
+    size_t n;
+    uint32_t total = 0;
+
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, response, strlen(response));
-    return ESP_OK;
+    json_init(&w, chunk, sizeof(chunk));
+    json_obj_open(&w, NULL);
+    json_str(&w, "sensor", sensor_def(idx)->name);
+    json_arr_open(&w, "samples");
+
+    while (history_next_block(&cursor, samples, &n)) {
+        for (size_t i = 0; i < n; i++) {
+            // Flush before a sample could overflow; the writer keeps its comma state
+            if (w.cap - w.len < 48) {
+                if (httpd_resp_send_chunk(req, w.buf, w.len) != ESP_OK) {
+                    return ESP_FAIL;
+                }
+                w.len = 0;
+            }
+            json_arr_open(&w, NULL);
+            json_uint(&w, NULL, samples[i].t_ms);
+            json_tenths(&w, NULL, samples[i].temperature);
+            json_tenths(&w, NULL, samples[i].humidity);
+            json_arr_close(&w);
+            total++;
+        }
+    }
+
+    json_arr_close(&w);
+    json_obj_close(&w);
+    if (w.overflow) {
+        // Chunks already went out; dropping the connection is the only way to flag the error
+        ESP_LOGE(TAG, "/history chunk overflowed, aborting the response");
+        return ESP_FAIL;
+    }
+    if (httpd_resp_send_chunk(req, w.buf, w.len) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    DLOG_RL(ESP_LOG_INFO, TAG, 1000, "History: sent %u samples", total);
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static esp_err_t history_handler(httpd_req_t *req)
+{
+    int64_t start = esp_timer_get_time();
+    char query[64];
+    char value[32];
+    uint64_t since_ms = 0;
+    size_t idx = 0;
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "since", value, sizeof(value)) == ESP_OK) {
+            since_ms = strtoull(value, NULL, 10);
+        }
+        if (httpd_query_key_value(query, "sensor", value, sizeof(value)) == ESP_OK) {
+            for (idx = 0; idx < sensor_count(); idx++) {
+                if (strcmp(sensor_def(idx)->name, value) == 0) {
+                    break;
+                }
+            }
+            if (idx == sensor_count()) {
+                httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown sensor");
+                http_request_done(start);
+                return ESP_OK;
+            }
+        }
+    }
+
+    DLOG_RL(ESP_LOG_INFO, TAG, 1000, "HTTP Request: GET /history (sensor %s, since %u ms)",
+            DLOG_STR(sensor_def(idx)->name), (uint32_t)since_ms);
+
+    // Failed sends end the request too, so they are counted and timed like the rest
+    esp_err_t err = send_history(req, idx, since_ms);
+    http_request_done(start);
+    return err;
+}
+
+static esp_err_t metrics_emit(void *ctx, const char *data, size_t len)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, data, len);
+}
+
+// Prometheus scrape endpoint, streamed with chunked encoding
+static esp_err_t metrics_handler(httpd_req_t *req)
+{
+    int64_t start = esp_timer_get_time();
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    esp_err_t err = metrics_write(metrics_emit, req);
+    if (err == ESP_OK) {
+        err = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    http_request_done(start);
+    return err;
+}
+
+// Build identity, totals and latency percentiles as one JSON document, for comparing
+// builds: take two snapshots under load and divide the differences by the uptime delta
+static esp_err_t perf_handler(httpd_req_t *req)
+{
+    // About 1.2KB with every histogram and the OTA block; httpd runs handlers one at a time
+    static char buf[2048];
+    const esp_app_desc_t *app = esp_ota_get_app_description();
+    int64_t start = esp_timer_get_time();
+    char built[40];
+    json_writer_t w;
+
+    snprintf(built, sizeof(built), "%s %s", app->date, app->time);
+    json_init(&w, buf, sizeof(buf));
+    json_obj_open(&w, NULL);
+    json_str(&w, "version", app->version);
+    json_str(&w, "idf", app->idf_ver);
+    json_str(&w, "built", built);
+    json_uint(&w, "uptime_ms", (uint64_t)start / 1000);
+    json_uint(&w, "sample_period_ms", sched_sample_period());
+
+    json_obj_open(&w, "totals");
+    json_uint(&w, "reads", metrics_counter(METRIC_READS));
+    json_uint(&w, "read_failures", (uint64_t)metrics_counter(METRIC_READ_CHECKSUM_FAILURES) +
+              metrics_counter(METRIC_READ_TIMEOUT_FAILURES) + metrics_counter(METRIC_READ_OTHER_FAILURES));
+    json_uint(&w, "readings_rejected", metrics_counter(METRIC_READ_REJECTED));
+    json_uint(&w, "mqtt_publishes", metrics_counter(METRIC_MQTT_PUBLISHES));
+    json_uint(&w, "mqtt_publish_failures", metrics_counter(METRIC_MQTT_PUBLISH_FAILURES));
+    json_uint(&w, "mqtt_probes", metrics_counter(METRIC_MQTT_PROBES));
+    json_uint(&w, "http_requests", metrics_counter(METRIC_HTTP_REQUESTS));
+    json_uint(&w, "gateway_packets", metrics_counter(METRIC_GATEWAY_PACKETS));
+    json_uint(&w, "gateway_duplicates", metrics_counter(METRIC_GATEWAY_DUPLICATES));
+    json_uint(&w, "gateway_dropped", metrics_counter(METRIC_GATEWAY_DROPPED));
+    json_uint(&w, "gateway_batches", metrics_counter(METRIC_GATEWAY_BATCHES));
+    json_obj_close(&w);
+
+    ota_stats_t ota;
+    ota_get_stats(&ota);
+    json_obj_open(&w, "ota");
+    json_uint(&w, "updates", ota.updates);
+    json_uint(&w, "failures", ota.failures);
+    json_bool(&w, "in_progress", ota.in_progress);
+    json_uint(&w, "bytes", ota.bytes);
+    json_uint(&w, "elapsed_ms", ota.elapsed_ms);
+    json_uint(&w, "rate_bps", ota.rate_bps);
+    json_obj_close(&w);
+
+    json_obj_open(&w, "latency_us");
+    for (size_t i = 0; i < METRIC_HIST_COUNT; i++) {
+        metrics_hist_summary_t h;
+        metrics_hist_summary((metric_hist_t)i, &h);
+        json_obj_open(&w, h.key);
+        json_uint(&w, "count", h.count);
+        json_uint(&w, "mean", h.count ? h.sum_us / h.count : 0);
+        json_uint(&w, "p50", h.p50_us);
+        json_uint(&w, "p90", h.p90_us);
+        json_uint(&w, "p99", h.p99_us);
+        json_obj_close(&w);
+    }
+    json_obj_close(&w);
+    json_obj_close(&w);
+
+    // A truncated document would still parse up to the cut, so never send one
+    if (w.overflow) {
+        ESP_LOGE(TAG, "/perf document does not fit in %u bytes", (unsigned)sizeof(buf));
+        http_request_done(start);
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Response too large");
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    esp_err_t err = httpd_resp_send(req, w.buf, w.len);
+    http_request_done(start);
+    return err;
 }
 
 static void start_webserver(void)
@@ -134,6 +619,9 @@ static void start_webserver(void)
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = 80;
+    config.max_uri_handlers = 10 + SENSOR_MAX;
+    // Stream subscribers keep their socket; leave room for ordinary requests
+    config.max_open_sockets = STREAM_MAX_CLIENTS + 4;
 
     ESP_LOGI(TAG, "Starting HTTP server on port: '%d'", config.server_port);
     if (httpd_start(&server, &config) == ESP_OK) {
@@ -160,7 +648,75 @@ static void start_webserver(void)
 
         httpd_register_uri_handler(server, &temp_uri);
         httpd_register_uri_handler(server, &humidity_uri);
+        httpd_uri_t history_uri = {
+            .uri       = "/history",
+            .method    = HTTP_GET,
+            .handler   = history_handler,
+            .user_ctx  = NULL
+        };
+
         httpd_register_uri_handler(server, &status_uri);
+        httpd_register_uri_handler(server, &history_uri);
+
+        httpd_uri_t metrics_uri = {
+            .uri       = "/metrics",
+            .method    = HTTP_GET,
+            .handler   = metrics_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &metrics_uri);
+
+        httpd_uri_t perf_uri = {
+            .uri       = "/perf",
+            .method    = HTTP_GET,
+            .handler   = perf_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &perf_uri);
+
+        http_cache_init(&s_http_cache_config);
+        stream_init(server);
+        httpd_uri_t stream_uri = {
+            .uri       = "/stream",
+            .method    = HTTP_GET,
+            .handler   = stream_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &stream_uri);
+
+        httpd_uri_t config_get_uri = {
+            .uri       = "/config",
+            .method    = HTTP_GET,
+            .handler   = config_get_handler,
+            .user_ctx  = NULL
+        };
+        httpd_uri_t config_post_uri = {
+            .uri       = "/config",
+            .method    = HTTP_POST,
+            .handler   = config_post_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &config_get_uri);
+        httpd_register_uri_handler(server, &config_post_uri);
+
+        httpd_uri_t ota_uri = {
+            .uri       = "/ota",
+            .method    = HTTP_POST,
+            .handler   = ota_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &ota_uri);
+
+        for (size_t i = 0; i < sensor_count(); i++) {
+            snprintf(s_sensor_uris[i], sizeof(s_sensor_uris[i]), "/sensor/%s", sensor_def(i)->name);
+            httpd_uri_t sensor_uri = {
+                .uri       = s_sensor_uris[i],
+                .method    = HTTP_GET,
+                .handler   = sensor_handler,
+                .user_ctx  = (void *)(uintptr_t)i
+            };
+            httpd_register_uri_handler(server, &sensor_uri);
+        }
     }
 }
 
@@ -168,18 +724,23 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t e
 {
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
         ESP_LOGI(TAG, "WiFi Station Started - Attempting connection...");
-        esp_wifi_connect();
+        wifi_select_on_sta_start();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_SCAN_DONE) {
+        wifi_select_on_scan_done();
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
         wifi_event_sta_disconnected_t* disconnected = (wifi_event_sta_disconnected_t*)event_data;
         ESP_LOGW(TAG, "WiFi Disconnected - Reason: %d", disconnected->reason);
         ESP_LOGI(TAG, "Network Status: DISCONNECTED");
         ESP_LOGI(TAG, "Data Transmission: PAUSED");
         wifi_connected = false;
-        led_error_state = true;
-        esp_wifi_connect();
+        status_set_wifi(false);
         xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        mqtt_link_network_down();
+        wifi_select_on_disconnected(disconnected->reason);
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
+        metrics_boot_phase(METRIC_BOOT_GOT_IP);
+        wifi_select_on_got_ip();
         ESP_LOGI(TAG, "WiFi Connected Successfully!");
         ESP_LOGI(TAG, "IP Address: " IPSTR, IP2STR(&event->ip_info.ip));
         ESP_LOGI(TAG, "Gateway: " IPSTR, IP2STR(&event->ip_info.gw));
@@ -187,42 +748,438 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t e
         ESP_LOGI(TAG, "Network Status: CONNECTED");
         ESP_LOGI(TAG, "Data Transmission: ACTIVE");
         ESP_LOGI(TAG, "HTTP Server Available at: http://" IPSTR, IP2STR(&event->ip_info.ip));
+        ESP_LOGI(TAG, "Boot: IP after %u ms", (unsigned)metrics_boot_phase_ms(METRIC_BOOT_GOT_IP));
         wifi_connected = true;
-        led_error_state = false;
+        status_set_wifi(true);
+        // Reaching the network is the health check for a freshly updated image
+        ota_mark_valid();
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
-        start_mqtt();
-        publish_ha_discovery();
+#if GATEWAY_MODE != GATEWAY_MODE_NODE
+        mqtt_link_network_up();
+#endif
+    }
+}
+
+static void sensor_topic(size_t idx, const char *quantity, char *buf, size_t len)
+{
+    sensor_topic_suffix(idx, quantity, "state", buf, len);
+}
+
+static void sensor_topic_suffix(size_t idx, const char *quantity, const char *suffix, char *buf, size_t len)
+{
+    if (idx == 0) {
+        snprintf(buf, len, "%s/%s", quantity, suffix);
+    } else {
+        snprintf(buf, len, "%s/%s/%s", sensor_def(idx)->name, quantity, suffix);
+    }
+}
+
+static void sensor_unique_id(size_t idx, const char *quantity, char *buf, size_t len)
+{
+    if (idx == 0) {
+        snprintf(buf, len, "%s", quantity);
+    } else {
+        snprintf(buf, len, "%s_%s", sensor_def(idx)->name, quantity);
+    }
+}
+
+// One retained discovery message for a sensor entity
+static void publish_ha_entity(const char *unique_id, const char *name, const char *unit,
+                              const char *state_topic, const char *value_template)
+{
+    char config_topic[MQTT_TOPIC_MAX + 32];
+    char cfg[448];
+
+    snprintf(config_topic, sizeof(config_topic), HA_DISCOVERY_PREFIX "/sensor/%s/config", unique_id);
+    snprintf(cfg, sizeof(cfg), "{"
+      "\"name\": \"%s\","
+      "\"unit_of_measurement\": \"%s\","
+      "\"state_topic\": \"%s\","
+      "\"value_template\": \"%s\","
+      "\"unique_id\": \"%s\""
+    "}",
+      name, unit, state_topic, value_template, unique_id);
+
+    mqtt_publish(config_topic, cfg, 0, MQTT_QOS_DISCOVERY, 1);
+}
+
+static void publish_ha_sensor_config(size_t idx, const char *quantity, const char *label, const char *unit)
+{
+    char state_topic[MQTT_TOPIC_MAX];
+    char unique_id[MQTT_TOPIC_MAX];
+    char name[48];
+    char value_template[48];
+
+#if MQTT_PUBLISH_COMBINED
+    // Both entities read their field from the combined message via value_template
+    sensor_topic(idx, MQTT_COMBINED_QUANTITY, state_topic, sizeof(state_topic));
+#else
+    sensor_topic(idx, quantity, state_topic, sizeof(state_topic));
+#endif
+    sensor_unique_id(idx, quantity, unique_id, sizeof(unique_id));
+    snprintf(name, sizeof(name), "%s%s%s", idx == 0 ? "" : sensor_def(idx)->name, idx == 0 ? "" : " ", label);
+    snprintf(value_template, sizeof(value_template), "{{ value_json.%s }}", quantity);
+
+    publish_ha_entity(unique_id, name, unit, state_topic, value_template);
+}
+
+#if GATEWAY_MODE == GATEWAY_MODE_GATEWAY
+// A node sensor's entity reads its field from the batches; batches without the
+// peer keep the current state
+static void publish_peer_sensor_config(const char *peer, const char *quantity, const char *label, const char *unit)
+{
+    char unique_id[MQTT_TOPIC_MAX];
+    char name[48];
+    char value_template[160];
+
+    snprintf(unique_id, sizeof(unique_id), "%s_%s", peer, quantity);
+    snprintf(name, sizeof(name), "%s %s", peer, label);
+    snprintf(value_template, sizeof(value_template),
+             "{{ value_json['%s'].%s if '%s' in value_json else this.state }}", peer, quantity, peer);
+
+    publish_ha_entity(unique_id, name, unit, GATEWAY_STATE_TOPIC, value_template);
+}
+
+static void publish_peer_discovery(size_t idx)
+{
+    const char *peer = gateway_peer_name(idx);
+
+    if (peer) {
+        publish_peer_sensor_config(peer, "temperature", "Temperature", "°C");
+        publish_peer_sensor_config(peer, "humidity", "Humidity", "%");
+    }
+}
+
+// Gateway task: discovery for a node sensor seen for the first time. Peers that
+// appear while the broker is down are covered by publish_ha_discovery() on connect.
+static void gateway_peer_added(size_t idx)
+{
+    if (wifi_connected && mqtt_link_connected()) {
+        publish_peer_discovery(idx);
+    }
+}
+
+// Gateway task: one batch of node readings
+static bool gateway_publish_batch(const char *payload, size_t len)
+{
+    if (!(wifi_connected && mqtt_link_connected())) {
+        return false;
     }
+    return mqtt_publish(GATEWAY_STATE_TOPIC, payload, len, MQTT_QOS_GATEWAY, 0) >= 0;
 }
 
+static const gateway_config_t s_gateway_config = {
+    .transport = GATEWAY_TRANSPORT,
+    .udp_port = GATEWAY_UDP_PORT,
+    .batch_ms = GATEWAY_BATCH_MS,
+    .sim_nodes = GATEWAY_SIM_NODES,
+    .sim_interval_ms = GATEWAY_SIM_INTERVAL_MS,
+    .on_peer_added = gateway_peer_added,
+    .publish_batch = gateway_publish_batch,
+};
+#endif
+
 static void publish_ha_discovery(void)
 {
-    // Temperature sensor config
-    const char *temp_cfg = "{"
-      "\"name\": \"Temperature\","
-      "\"unit_of_measurement\": \"°C\","
-      "\"state_topic\": \"" MQTT_TEMP_STATE_TOPIC "\","
-      "\"value_template\": \"{{ value_json.temperature }}\","
-      "\"unique_id\": \"" HA_TEMP_UNIQUE_ID "\""
-    "}";
-
-    // Humidity sensor config
-    const char *hum_cfg = "{"
-      "\"name\": \"Humidity\","
-      "\"unit_of_measurement\": \"%\","
-      "\"state_topic\": \"" MQTT_HUM_STATE_TOPIC "\","
-      "\"value_template\": \"{{ value_json.humidity }}\","
-      "\"unique_id\": \"" HA_HUM_UNIQUE_ID "\""
-    "}";
-
-    esp_mqtt_client_publish(mqtt_client, HA_TEMP_CONFIG_TOPIC, temp_cfg, 0, 1, 1);
-    vTaskDelay(pdMS_TO_TICKS(100));  // small delay
-    esp_mqtt_client_publish(mqtt_client, HA_HUM_CONFIG_TOPIC, hum_cfg, 0, 1, 1);
+    for (size_t i = 0; i < sensor_count(); i++) {
+        // Temperature sensor config
+        publish_ha_sensor_config(i, "temperature", "Temperature", "°C");
+        // Humidity sensor config
+        publish_ha_sensor_config(i, "humidity", "Humidity", "%");
+    }
+#if GATEWAY_MODE == GATEWAY_MODE_GATEWAY
+    for (size_t i = 0; i < gateway_peer_count(); i++) {
+        publish_peer_discovery(i);
+    }
+#endif
+}
+
+// Send time of the outstanding round-trip probe, 0 = none
+static _Atomic int64_t s_probe_sent_us;
+
+// Publishes a probe if the last one is MQTT_PROBE_INTERVAL_MS old; called by the publisher
+static void send_probe(void)
+{
+    static int64_t last_us;
+    int64_t now = esp_timer_get_time();
+    char payload[24];
+
+    if (last_us && now - last_us < (int64_t)MQTT_PROBE_INTERVAL_MS * 1000) {
+        return;
+    }
+    last_us = now;
+    int len = snprintf(payload, sizeof(payload), "%lld", (long long)now);
+    atomic_store(&s_probe_sent_us, now);
+    if (mqtt_publish(MQTT_PROBE_TOPIC, payload, len, 0, 0) >= 0) {
+        metrics_inc(METRIC_MQTT_PROBES);
+    }
+}
+
+// Runs on the MQTT task for messages on subscribed topics
+static void mqtt_message(const char *topic, int topic_len, const char *data, int data_len)
+{
+    char buf[24];
+
+    if (topic_len != (int)strlen(MQTT_PROBE_TOPIC) || memcmp(topic, MQTT_PROBE_TOPIC, topic_len) != 0 ||
+        data_len >= (int)sizeof(buf)) {
+        return;
+    }
+    memcpy(buf, data, data_len);
+    buf[data_len] = '\0';
+
+    // Only our own outstanding probe counts, not stale or foreign ones on the same topic
+    int64_t sent = strtoll(buf, NULL, 10);
+    int64_t expected = sent;
+    if (sent != 0 && atomic_compare_exchange_strong(&s_probe_sent_us, &expected, 0)) {
+        metrics_observe_us(METRIC_HIST_MQTT_ROUNDTRIP, (uint32_t)(esp_timer_get_time() - sent));
+    }
+}
+
+// The backlog batch waiting for its PUBACK. Its records are only marked replayed once
+// the broker has them, and only one batch is in flight at a time. The PUBACK can be
+// handled before esp_mqtt_client_publish() has even returned the msg_id, so the last
+// acknowledged msg_id is kept too and checked by the publisher.
+static struct {
+    atomic_int msg_id;              // 0 = none, -1 = being published, else the batch's msg_id
+    atomic_int acked;               // Last msg_id acknowledged while a batch was in flight
+    size_t count;
+    wal_ref_t refs[WAL_REPLAY_BATCH];
+    int64_t sent_us;
+} s_replay;
+
+// Consume the in-flight batch if msg_id is it; whoever gets here first does it
+static void replay_acknowledged(int msg_id)
+{
+    int expected = msg_id;
+
+    if (msg_id > 0 && atomic_compare_exchange_strong(&s_replay.msg_id, &expected, 0)) {
+        wal_consume(s_replay.refs, s_replay.count);
+        DLOGI(TAG, "Replayed %u logged reading(s)", s_replay.count);
+    }
+}
+
+// Runs on the MQTT task for every PUBACK
+static void mqtt_published(int msg_id)
+{
+    atomic_fetch_add(&s_qos_acked, 1);
+    atomic_store(&s_replay.acked, msg_id);
+    replay_acknowledged(msg_id);
+}
+
+// Runs on the MQTT task once per broker session
+static void mqtt_session_started(void)
+{
+    mqtt_resync = true;
+    status_set_mqtt(true);
+    mem_plan_checkpoint();
+#if !DUTY_CYCLE_MODE
+    // Retained, so once per session is enough; duty_cycle_run() only sends it once per power-on
+    publish_ha_discovery();
+    esp_mqtt_client_subscribe(mqtt_link_client(), MQTT_PROBE_TOPIC, 0);
+#endif
+}
+
+static void mqtt_session_lost(void)
+{
+    int msg_id = atomic_load(&s_replay.msg_id);
+
+    ESP_LOGW(TAG, "MQTT disconnected, logging readings to flash");
+    status_set_mqtt(false);
+    // Every session is clean, so an unacknowledged batch is resent in the next one
+    if (msg_id > 0) {
+        atomic_compare_exchange_strong(&s_replay.msg_id, &msg_id, 0);
+    }
+}
+
+static const mqtt_link_config_t s_mqtt_link_config = {
+    .uri = MQTT_BROKER_URI,
+    .on_connected = mqtt_session_started,
+    .on_disconnected = mqtt_session_lost,
+    .on_message = mqtt_message,
+    .on_published = mqtt_published,
+};
+
+// Last values sent per sensor, for the deadband and heartbeat. Kept in RTC memory
+// so a duty-cycle wake can tell whether anything changed without the radio.
+static RTC_DATA_ATTR struct {
+    int16_t temperature;
+    int16_t humidity;
+    int64_t sent_us;
+    bool sent;
+} s_published[SENSOR_MAX];
+
+static uint32_t s_publish_count;
+static uint32_t s_publish_skipped;
+
+static bool beyond_deadband(int16_t value, int16_t last, int16_t deadband)
+{
+    return abs(value - last) >= deadband;
 }
 
+// Time base for the heartbeat. esp_timer restarts on every deep-sleep wake, the
+// RTC-backed system time does not.
+static int64_t publish_clock_us(void)
+{
+#if DUTY_CYCLE_MODE
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#else
+    return esp_timer_get_time();
+#endif
+}
+
+// Whether a reading needs publishing; reports which values moved past their deadband
+static bool publish_due(size_t idx, const reading_t *r, bool force, bool *temp_moved, bool *hum_moved)
+{
+    if (!r->valid || idx >= SENSOR_MAX) {
+        return false;
+    }
+
+    bool heartbeat = !s_published[idx].sent || force ||
+                     (publish_clock_us() - s_published[idx].sent_us) >= (int64_t)MQTT_HEARTBEAT_MS * 1000;
+    *temp_moved = heartbeat || beyond_deadband(r->temperature, s_published[idx].temperature, MQTT_DEADBAND_TEMP);
+    *hum_moved = heartbeat || beyond_deadband(r->humidity, s_published[idx].humidity, MQTT_DEADBAND_HUM);
+    return *temp_moved || *hum_moved;
+}
+
+// Publish a sensor's reading if it moved beyond the deadband or the heartbeat is due
+static void publish_sensor_state(size_t idx, const reading_t *r, bool force)
+{
+    static char payload[64];     // publish_task, or the main task in duty cycle mode; never both
+    char topic[MQTT_TOPIC_MAX];
+    bool temp_moved, hum_moved;
+    bool temp_sent = false, hum_sent = false;
+    uint32_t messages = 0;
+#if MQTT_STATE_JSON
+    json_writer_t w;
+#endif
+#if MQTT_STATE_CBOR
+    cbor_writer_t cw;
+#endif
+
+    if (!r->valid || idx >= SENSOR_MAX) {
+        return;
+    }
+    if (!publish_due(idx, r, force, &temp_moved, &hum_moved)) {
+        s_publish_skipped++;
+        return;
+    }
+
+#if MQTT_STATE_CBOR
+    // One message with both values, whichever of them moved
+    sensor_topic_suffix(idx, MQTT_CBOR_QUANTITY, MQTT_CBOR_SUFFIX, topic, sizeof(topic));
+    cbor_init(&cw, (uint8_t *)payload, sizeof(payload));
+    encode_reading_cbor(&cw, idx, r);
+    if (cw.overflow) {
+        // A truncated map would not decode; count it as a failed publish
+        DLOG_RL(ESP_LOG_ERROR, TAG, 10000, "Sensor '%s' CBOR state does not fit in %u bytes",
+                DLOG_STR(sensor_def(idx)->name), (unsigned)sizeof(payload));
+        metrics_inc(METRIC_MQTT_PUBLISH_FAILURES);
+    } else if (mqtt_publish(topic, payload, cw.len, MQTT_QOS_CBOR, 0) >= 0) {
+        temp_sent = hum_sent = true;
+        messages++;
+    }
+#endif
+
+#if !MQTT_STATE_JSON
+    // Nothing else to send
+#elif MQTT_PUBLISH_COMBINED
+    sensor_topic(idx, MQTT_COMBINED_QUANTITY, topic, sizeof(topic));
+    json_init(&w, payload, sizeof(payload));
+    json_obj_open(&w, NULL);
+    json_tenths(&w, "temperature", r->temperature);
+    json_tenths(&w, "humidity", r->humidity);
+    json_obj_close(&w);
+    if (mqtt_publish_json(topic, &w, MQTT_QOS_COMBINED, 0) >= 0) {
+        temp_sent = hum_sent = true;
+        messages++;
+    }
+#else
+    if (temp_moved) {
+        sensor_topic(idx, "temperature", topic, sizeof(topic));
+        json_init(&w, payload, sizeof(payload));
+        json_obj_open(&w, NULL);
+        json_tenths(&w, "temperature", r->temperature);
+        json_obj_close(&w);
+        if (mqtt_publish_json(topic, &w, MQTT_QOS_TEMPERATURE, 0) >= 0) {
+            temp_sent = true;
+            messages++;
+        }
+    }
+    if (hum_moved) {
+        sensor_topic(idx, "humidity", topic, sizeof(topic));
+        json_init(&w, payload, sizeof(payload));
+        json_obj_open(&w, NULL);
+        json_tenths(&w, "humidity", r->humidity);
+        json_obj_close(&w);
+        if (mqtt_publish_json(topic, &w, MQTT_QOS_HUMIDITY, 0) >= 0) {
+            hum_sent = true;
+            messages++;
+        }
+    }
+#endif
+
+    // Only what the client accepted counts as published; s_published survives deep sleep,
+    // so a failed send must leave the reading due for the next attempt
+    if (messages == 0) {
+        return;
+    }
+    if (temp_sent) {
+        s_published[idx].temperature = r->temperature;
+    }
+    if (hum_sent) {
+        s_published[idx].humidity = r->humidity;
+    }
+    s_publish_count += messages;
+    // The heartbeat is measured from the last message that carried both values
+    if (temp_sent && hum_sent) {
+        s_published[idx].sent_us = publish_clock_us();
+        s_published[idx].sent = true;
+    }
+    metrics_observe_us(METRIC_HIST_SAMPLE_TO_PUBLISH, (uint32_t)(esp_timer_get_time() - r->timestamp_us));
+    metrics_boot_phase(METRIC_BOOT_FIRST_PUBLISH);
+}
+
+#if GATEWAY_MODE == GATEWAY_MODE_NODE
+// Node mode counterpart of publish_sensor_state(): same deadband and heartbeat, but the
+// reading goes to the gateway in one packet
+static void send_to_gateway(size_t idx, const reading_t *r, bool force)
+{
+    bool temp_moved, hum_moved;
+
+    if (!publish_due(idx, r, force, &temp_moved, &hum_moved)) {
+        s_publish_skipped++;
+        return;
+    }
+    if (gateway_node_send((uint8_t)idx, sensor_def(idx)->name, r) != ESP_OK) {
+        DLOG_RL(ESP_LOG_WARN, TAG, 10000, "Sending sensor '%s' to the gateway failed",
+                DLOG_STR(sensor_def(idx)->name));
+        return;
+    }
+    s_published[idx].temperature = r->temperature;
+    s_published[idx].humidity = r->humidity;
+    s_published[idx].sent_us = publish_clock_us();
+    s_published[idx].sent = true;
+    s_publish_count++;
+}
+#endif
+
+static const wifi_network_t s_wifi_networks[] = {
+    { WIFI_SSID_1, WIFI_PASS_1 },
+    { WIFI_SSID_2, WIFI_PASS_2 },
+};
+
+static const wifi_select_config_t s_wifi_select_config = {
+    .networks = s_wifi_networks,
+    .network_count = sizeof(s_wifi_networks) / sizeof(s_wifi_networks[0]),
+    .ap_ssid = AP_SSID,
+    .ap_password = AP_PASS,
+};
+
 static void wifi_init_sta(void)
 {
-    s_wifi_event_group = xEventGroupCreate();
+    s_wifi_event_group = xEventGroupCreateStatic(&s_wifi_event_group_buf);
 
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
@@ -245,330 +1202,512 @@ static void wifi_init_sta(void)
                                                         NULL,
                                                         &instance_got_ip));
 
-    // Try first WiFi network
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = WIFI_SSID_1,
-            .password = WIFI_PASS_1,
-            .threshold.authmode = WIFI_AUTH_WPA2_PSK,
-            .pmf_cfg = {
-                .capable = true,
-                .required = false
-            },
-        },
-    };
-
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
-
-    // Setup AP mode as fallback
-    wifi_config_t ap_config = {
-        .ap = {
-            .ssid = AP_SSID,
-            .password = AP_PASS,
-            .ssid_len = strlen(AP_SSID),
-            .channel = 1,
-            .authmode = WIFI_AUTH_WPA_WPA2_PSK,
-            .max_connection = 4
-        }
-    };
-
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &ap_config));
+    // Station only; wifi_select switches to AP+STA when no network can be reached
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    wifi_select_init(&s_wifi_select_config);
     ESP_ERROR_CHECK(esp_wifi_start());
 
     ESP_LOGI(TAG, "WiFi init finished.");
 }
 
-static void start_mqtt(void)
+static void configure_gpio(void)
 {
-    esp_mqtt_client_config_t cfg = {
-        .uri = MQTT_BROKER_URI,
-        // .username = "...",   // if needed
-        // .password = "...",
-    };
-    mqtt_client = esp_mqtt_client_init(&cfg);
-    esp_mqtt_client_start(mqtt_client);
-        // give broker time to connect
-    vTaskDelay(pdMS_TO_TICKS(500));
-    publish_ha_discovery();
+    // Configure DHT pins and capture channels; the status LED belongs to status.c
+    sensors_init();
 }
 
-static void configure_gpio(void)
+static void dht11_task(void *pvParameters)
 {
-    gpio_config_t io_conf;
-    
-    // Configure status LED
-    io_conf.intr_type = GPIO_INTR_DISABLE;
-    io_conf.mode = GPIO_MODE_OUTPUT;
-    io_conf.pin_bit_mask = (1ULL << STATUS_LED_PIN);
-    io_conf.pull_down_en = 0;
-    io_conf.pull_up_en = 0;
-    gpio_config(&io_conf);
-    
-    // Configure DHT11 pin
-    io_conf.mode = GPIO_MODE_INPUT_OUTPUT_OD;
-    io_conf.pin_bit_mask = (1ULL << DHT11_PIN);
-    io_conf.pull_up_en = 1;
-    gpio_config(&io_conf);
+    static uint32_t cycle_count = 0;
+    static int16_t last_temp[SENSOR_MAX];
+    static int16_t last_hum[SENSOR_MAX];
+
+    sched_loop_init(&s_sample_loop);
+    while (1) {
+        sched_config_t cfg;
+        bool changed = false;
+
+        sched_get_config(&cfg);
+        cycle_count++;
+        DLOGI(TAG, "=== DHT11 Reading Cycle #%u ===", cycle_count);
+
+        uint32_t wall_ms = sensors_read_all();
+        bool any_ok = false;
+
+        for (size_t i = 0; i < sensor_count(); i++) {
+            const sensor_def_t *def = sensor_def(i);
+            const sensor_state_t *st = sensor_state(i);
+
+            if (st->last.valid) {
+                bool temp_changed = (st->last.temperature != last_temp[i]);
+                bool hum_changed  = (st->last.humidity    != last_hum[i]);
+                any_ok = true;
+                changed |= abs(st->last.temperature - last_temp[i]) >= cfg.change_temp ||
+                           abs(st->last.humidity - last_hum[i]) >= cfg.change_hum;
+
+                int32_t rate = (int32_t)(st->success_count * 1000ULL / st->read_count);
+
+                DLOGI(TAG, "Sensor '%s' Reading SUCCESS:", DLOG_STR(def->name));
+                DLOGI(TAG, "  Temperature: %s%d.%d°C %s",
+                      DLOG_TENTHS(st->last.temperature), DLOG_STR(temp_changed ? "(CHANGED)" : "(UNCHANGED)"));
+                DLOGI(TAG, "  Humidity: %s%d.%d%% %s",
+                      DLOG_TENTHS(st->last.humidity), DLOG_STR(hum_changed ? "(CHANGED)" : "(UNCHANGED)"));
+                DLOGI(TAG, "  Success Rate: %u/%u (%s%d.%d%%)",
+                      st->success_count, st->read_count, DLOG_TENTHS(rate));
+                DLOGI(TAG, "  Read CPU Time: %u us", st->cpu_us);
+                DLOGI(TAG, "  Bit timing: threshold %u us, margin %u us (lowest %u), jitter %u us",
+                      st->bit_threshold_us, st->bit_margin_us, st->bit_margin_us_min, st->bit_jitter_us);
+                DLOGI(TAG, "  Retries: %u (%u recovered), outliers rejected: %u",
+                      st->retries, st->retry_successes, st->filter.rejected);
+            } else {
+                int32_t rate = (int32_t)(st->fail_count * 1000ULL / st->read_count);
+
+                DLOG_RL(ESP_LOG_WARN, TAG, 10000, "Sensor '%s' Reading FAILED: %u/%u attempts (%s%d.%d%%)",
+                        DLOG_STR(def->name), st->fail_count, st->read_count, DLOG_TENTHS(rate));
+            }
+            last_temp[i] = st->last.temperature;
+            last_hum[i]  = st->last.humidity;
+
+            history_append((uint8_t)i, &st->last);
+            stream_push(i, &st->last);
+
+            // Keep readings the broker would miss; they are replayed by wal_replay_task
+            // Nodes have no broker session to be offline from
+            if (GATEWAY_MODE != GATEWAY_MODE_NODE && st->last.valid && !(wifi_connected && mqtt_link_connected())) {
+                wal_append((uint8_t)i, &st->last);
+            }
+        }
+
+        // Sensor timeout and the LED blink on a good reading are handled by the status task
+        status_reading(sensor_state(0)->last.valid, any_ok);
+
+        // Log current data state
+        const reading_t *primary = &sensor_state(0)->last;
+        DLOGI(TAG, "Current Data State:");
+        DLOGI(TAG, "  Sensors: %u read in %u ms", sensor_count(), wall_ms);
+        DLOGI(TAG, "  Reading: #%u", primary->seq);
+        DLOGI(TAG, "  Temperature: %s%d.%d°C", DLOG_TENTHS(primary->temperature));
+        DLOGI(TAG, "  Humidity: %s%d.%d%%", DLOG_TENTHS(primary->humidity));
+        DLOGI(TAG, "  Wi-Fi Status: %s", DLOG_STR(wifi_connected ? "CONNECTED" : "DISCONNECTED"));
+        DLOGI(TAG, "  Data Available for HTTP: %s",
+              DLOG_STR(primary->have_value ? "YES" : "NO"));
+
+        // Sample faster while readings move, back off while they are stable
+        uint32_t period = sched_next_sample_period(changed);
+        DLOGI(TAG, "  Next sample in %u ms", period);
+        sched_loop_wait(&s_sample_loop, period);
+    }
 }
 
-static bool read_dht11(float *temperature, float *humidity)
+// Publishes the latest readings on the configured cadence, independent of sampling.
+// The deadband and heartbeat in publish_sensor_state() decide what is actually sent.
+static void publish_task(void *pvParameters)
 {
-    uint8_t data[5] = {0};
-    int timeout = 0;
-    
-    ESP_LOGD(TAG, "DHT11: Starting sensor read cycle");
-    
-    // Send start signal
-    gpio_set_direction(DHT11_PIN, GPIO_MODE_OUTPUT);
-    gpio_set_level(DHT11_PIN, 0);
-    vTaskDelay(pdMS_TO_TICKS(20));
-    gpio_set_level(DHT11_PIN, 1);
-    esp_rom_delay_us(30);
-    
-    // Switch to input mode
-    gpio_set_direction(DHT11_PIN, GPIO_MODE_INPUT);
-    
-    // Wait for DHT11 response
-    timeout = 0;
-    while (gpio_get_level(DHT11_PIN) == 1 && timeout < 100) {
-        esp_rom_delay_us(1);
-        timeout++;
-    }
-    if (timeout >= 100) {
-        ESP_LOGW(TAG, "DHT11: Timeout waiting for response start");
-        return false;
+    sched_loop_init(&s_publish_loop);
+    while (1) {
+        sched_config_t cfg;
+        sched_get_config(&cfg);
+
+#if GATEWAY_MODE == GATEWAY_MODE_NODE
+        // No broker connection of our own; the gateway publishes for us
+        for (size_t i = 0; i < sensor_count(); i++) {
+            reading_t r;
+            if (sensor_latest(i, &r)) {
+                send_to_gateway(i, &r, false);
+            }
+        }
+#else
+        if (wifi_connected && mqtt_link_connected()) {
+            bool force = atomic_exchange(&mqtt_resync, false);
+            for (size_t i = 0; i < sensor_count(); i++) {
+                reading_t r;
+                if (sensor_latest(i, &r)) {
+                    publish_sensor_state(i, &r, force);
+                }
+            }
+            send_probe();
+        }
+#endif
+        sched_loop_wait(&s_publish_loop, cfg.publish_ms);
     }
-    
-    timeout = 0;
-    while (gpio_get_level(DHT11_PIN) == 0 && timeout < 100) {
-        esp_rom_delay_us(1);
-        timeout++;
+}
+
+// Periodic status log, run on the status task every STATUS_REPORT_MS
+static void status_report(void)
+{
+    reading_t r;
+    sensor_latest(0, &r);
+
+    ESP_LOGI(TAG, "=== SYSTEM STATUS REPORT ===");
+    ESP_LOGI(TAG, "WiFi: %s", wifi_connected ? "CONNECTED" : "DISCONNECTED");
+    ESP_LOGI(TAG, "Sensor: %s", status_sensor_online() ? "ONLINE" : "OFFLINE");
+    ESP_LOGI(TAG, "LED Error State: %s", status_state() == STATUS_ERROR ? "ERROR" : "NORMAL");
+    ESP_LOGI(TAG, "Data Values: T=%.2f°C, H=%.2f%% (reading #%u, %lld ms old)",
+             r.temperature / 10.0f, r.humidity / 10.0f, r.seq,
+             (long long)((esp_timer_get_time() - r.timestamp_us) / 1000));
+    ESP_LOGI(TAG, "Free Heap: %d bytes", esp_get_free_heap_size());
+
+    history_stats_t hist;
+    history_get_stats(&hist);
+    ESP_LOGI(TAG, "History: %u samples in %u bytes (%.2f B/sample), max append %u us",
+             hist.samples, hist.bytes_used,
+             hist.samples ? (float)hist.bytes_used / hist.samples : 0.0f,
+             hist.append_us_max);
+
+    mqtt_link_stats_t link;
+    mqtt_link_get_stats(&link);
+    ESP_LOGI(TAG, "MQTT: %u state messages sent, %u unchanged readings suppressed",
+             s_publish_count, s_publish_skipped);
+    ESP_LOGI(TAG, "MQTT link: %s, %u sessions, %u disconnects, %u retries, backoff %u ms",
+             mqtt_link_connected() ? "CONNECTED" : "DISCONNECTED",
+             link.connects, link.disconnects, link.attempts, link.backoff_ms);
+
+    dlog_stats_t dl;
+    dlog_get_stats(&dl);
+    ESP_LOGI(TAG, "Deferred log: %u records, %u dropped, %u rate limited; %u cycles/record in caller vs %u to format",
+             dl.written, dl.dropped, dl.suppressed, dl.write_cycles_avg, dl.print_cycles_avg);
+
+    wal_stats_t wal;
+    wal_get_stats(&wal);
+    ESP_LOGI(TAG, "Offline log: %u pending, %u logged, %u replayed, %u dropped, max erase count %u/%u segments",
+             wal.pending, wal.appended, wal.replayed, wal.dropped,
+             wal.max_erase_count, wal.segments);
+
+    ESP_LOGI(TAG, "HTTP: %u requests, %u answered 304, %u responses rendered",
+             metrics_counter(METRIC_HTTP_REQUESTS),
+             metrics_counter(METRIC_HTTP_NOT_MODIFIED),
+             metrics_counter(METRIC_HTTP_CACHE_RENDERS));
+
+#if GATEWAY_MODE == GATEWAY_MODE_GATEWAY
+    gateway_stats_t gs;
+    gateway_get_stats(&gs);
+    ESP_LOGI(TAG, "Gateway: %u peers, %u packets, %u repeats, %u dropped, %u batches, %u pending, %u simulated",
+             gs.peers, metrics_counter(METRIC_GATEWAY_PACKETS), metrics_counter(METRIC_GATEWAY_DUPLICATES),
+             metrics_counter(METRIC_GATEWAY_DROPPED), gs.batches, gs.pending, gs.sim_sent);
+#endif
+
+    stream_stats_t ss;
+    stream_get_stats(&ss);
+    ESP_LOGI(TAG, "Stream: %u clients, %u events, %u deliveries, %u slow clients dropped, %u skipped ahead, "
+             "max push latency %u us", ss.clients, ss.events, ss.sent, ss.dropped_clients, ss.skipped_clients,
+             ss.latency_us_max);
+
+    sched_loop_stats_t ls;
+    sched_loop_stats(&s_sample_loop, &ls);
+    ESP_LOGI(TAG, "Sampler: period %u ms, %u runs, %u overruns, jitter avg %u us max %u us, drift %d ms",
+             sched_sample_period(), ls.runs, ls.overruns, ls.jitter_us_avg, ls.jitter_us_max, ls.drift_ms);
+    sched_loop_stats(&s_publish_loop, &ls);
+    ESP_LOGI(TAG, "Publisher: %u runs, %u overruns, jitter avg %u us max %u us, drift %d ms",
+             ls.runs, ls.overruns, ls.jitter_us_avg, ls.jitter_us_max, ls.drift_ms);
+
+    wifi_select_info_t wi;
+    wifi_select_get_info(&wi);
+    ESP_LOGI(TAG, "Boot: IP after %u ms, first publish after %u ms; last connect to '%s' via %s in %u ms "
+                  "(%u scans, %u hotspot fallbacks)",
+             metrics_boot_phase_ms(METRIC_BOOT_GOT_IP), metrics_boot_phase_ms(METRIC_BOOT_FIRST_PUBLISH),
+             wi.ssid ? wi.ssid : "-",
+             wi.via == WIFI_SELECT_VIA_CACHE ? "cache" : wi.via == WIFI_SELECT_VIA_SCAN ? "scan" : "-",
+             wi.connect_ms, wi.scans, wi.ap_fallbacks);
+
+    metrics_cpu_t cpu[portNUM_PROCESSORS];
+    size_t cores = metrics_cpu_sample(cpu, portNUM_PROCESSORS);
+    for (size_t i = 0; i < cores; i++) {
+        ESP_LOGI(TAG, "CPU%u: %u wakeups/s, idle %u.%u%%",
+                 (unsigned)i, cpu[i].wakeups_per_s, cpu[i].idle_permille / 10, cpu[i].idle_permille % 10);
     }
-    if (timeout >= 100) {
-        ESP_LOGW(TAG, "DHT11: Timeout waiting for response phase 1");
-        return false;
+
+    // Stack headroom changes slowly; once a minute is enough
+    static int mem_report_counter = 0;
+    if (++mem_report_counter >= 6) {
+        mem_report_counter = 0;
+        mem_plan_report();
     }
-    
-    timeout = 0;
-    while (gpio_get_level(DHT11_PIN) == 1 && timeout < 100) {
-        esp_rom_delay_us(1);
-        timeout++;
+}
+
+// Publishes one batch of readings logged while offline, oldest first. The records are
+// marked replayed when the broker acknowledges the publish (see s_replay), so a batch
+// lost with the connection is sent again; readings carry seq for deduplication.
+// Returns the number of readings sent, 0 if nothing was sent (including while the
+// previous batch is still waiting for its PUBACK).
+static size_t wal_replay_batch(void)
+{
+    static wal_entry_t entries[WAL_REPLAY_BATCH];
+    static char payload[WAL_REPLAY_BATCH * 128 + 4];
+
+    int pending = atomic_load(&s_replay.msg_id);
+    if (pending != 0) {
+        if (pending < 0 || esp_timer_get_time() - s_replay.sent_us < WAL_REPLAY_ACK_TIMEOUT_MS * 1000LL) {
+            return 0;
+        }
+        if (!atomic_compare_exchange_strong(&s_replay.msg_id, &pending, 0)) {
+            return 0;           // Acknowledged just now
+        }
+        DLOG_RL(ESP_LOG_WARN, TAG, 10000, "Backlog batch %d not acknowledged, sending it again", pending);
     }
-    if (timeout >= 100) {
-        ESP_LOGW(TAG, "DHT11: Timeout waiting for response phase 2");
-        return false;
+
+    size_t n = wal_peek(entries, WAL_REPLAY_BATCH);
+    if (n == 0) {
+        return 0;
     }
-    
-    // Read 40 bits of data
-    for (int i = 0; i < 40; i++) {
-        // Wait for start of bit
-        timeout = 0;
-        while (gpio_get_level(DHT11_PIN) == 0 && timeout < 100) {
-            esp_rom_delay_us(1);
-            timeout++;
+
+    json_writer_t w;
+    json_init(&w, payload, sizeof(payload));
+    json_arr_open(&w, NULL);
+    for (size_t i = 0; i < n; i++) {
+        const sensor_def_t *def = sensor_def(entries[i].sensor);
+        json_writer_t before = w;
+        json_obj_open(&w, NULL);
+        json_str(&w, "sensor", def ? def->name : "?");
+        json_uint(&w, "boot", entries[i].boot);
+        json_uint(&w, "t_ms", entries[i].uptime_ms);
+        json_uint(&w, "seq", entries[i].seq);
+        json_tenths(&w, "temperature", entries[i].temperature);
+        json_tenths(&w, "humidity", entries[i].humidity);
+        json_obj_close(&w);
+        // Keep one byte for the closing bracket; the rest goes in the next batch
+        if (w.overflow || w.len + 1 >= w.cap) {
+            w = before;
+            w.buf[w.len] = '\0';
+            n = i;
+            break;
         }
-        if (timeout >= 100) {
-            ESP_LOGW(TAG, "DHT11: Timeout reading bit %d", i);
-            return false;
+    }
+    json_arr_close(&w);
+
+    if (n == 0) {
+        // Not even one record fits, so it never will; drop it rather than stall the log
+        DLOG_RL(ESP_LOG_ERROR, TAG, 10000, "Logged reading does not fit in a backlog message, dropped");
+        wal_consume(&entries[0].ref, 1);
+        return 0;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        s_replay.refs[i] = entries[i].ref;
+    }
+    s_replay.count = n;
+    atomic_store(&s_replay.acked, 0);
+    atomic_store(&s_replay.msg_id, -1);
+
+    int msg_id = mqtt_publish(MQTT_BACKLOG_TOPIC, w.buf, w.len, MQTT_QOS_BACKLOG, 0);
+    if (msg_id < 0) {
+        atomic_store(&s_replay.msg_id, 0);
+        DLOG_RL(ESP_LOG_WARN, TAG, 10000, "Backlog publish failed, will retry");
+        return 0;
+    }
+    if (msg_id == 0) {
+        // QoS 0: there will be no PUBACK, handing it to the client is all there is
+        atomic_store(&s_replay.msg_id, 0);
+        wal_consume(s_replay.refs, n);
+        DLOGI(TAG, "Replayed %u logged reading(s)", n);
+        return n;
+    }
+    s_replay.sent_us = esp_timer_get_time();
+    atomic_store(&s_replay.msg_id, msg_id);
+    if (atomic_load(&s_replay.acked) == msg_id) {
+        replay_acknowledged(msg_id);
+    }
+    return n;
+}
+
+#if SOAK_RECONNECTS
+static void soak_task(void *pvParameters)
+{
+    for (uint32_t i = 1; i <= SOAK_RECONNECTS; i++) {
+        while (!mqtt_link_connected()) {
+            vTaskDelay(pdMS_TO_TICKS(100));
         }
-        
-        // Measure pulse width
-        timeout = 0;
-        while (gpio_get_level(DHT11_PIN) == 1 && timeout < 100) {
-            esp_rom_delay_us(1);
-            timeout++;
+        // Let the session do its usual work (discovery, resync) before tearing it down
+        vTaskDelay(pdMS_TO_TICKS(1000));
+        esp_wifi_disconnect();
+        while (mqtt_link_connected()) {
+            vTaskDelay(pdMS_TO_TICKS(10));
         }
-        if (timeout >= 100) {
-            ESP_LOGW(TAG, "DHT11: Timeout measuring bit %d", i);
-            return false;
+        if (i % 100 == 0) {
+            mem_plan_info_t mem;
+            mem_plan_get_info(&mem);
+            ESP_LOGI(TAG, "Soak: %u/%u reconnects, heap free %u, largest block %u, drift %d",
+                     i, SOAK_RECONNECTS, mem.heap_free, mem.heap_largest_block, mem.heap_drift);
         }
-        
-        // Determine bit value
-        data[i / 8] <<= 1;
-        if (timeout > 40) {
-            data[i / 8] |= 1;
+    }
+    ESP_LOGI(TAG, "Soak: done");
+    mem_plan_report();
+    vTaskDelete(NULL);
+}
+#endif
+
+// Drains the offline log once the broker is reachable again
+static void wal_replay_task(void *pvParameters)
+{
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(WAL_REPLAY_INTERVAL_MS));
+
+        if (wifi_connected && mqtt_link_connected()) {
+            wal_replay_batch();
         }
     }
-    
-    // Log raw data bytes
-    ESP_LOGD(TAG, "DHT11: Raw data bytes: [0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X]", 
-             data[0], data[1], data[2], data[3], data[4]);
-    
-    // Verify checksum
-    uint8_t checksum = data[0] + data[1] + data[2] + data[3];
-    if (checksum != data[4]) {
-        ESP_LOGW(TAG, "DHT11: Checksum failed! Calculated: 0x%02X, Received: 0x%02X", 
-                 checksum, data[4]);
-        return false;
+}
+
+#if DUTY_CYCLE_MODE
+// Survives deep sleep; zeroed on power-on
+static RTC_DATA_ATTR struct {
+    uint32_t cycles;
+    uint32_t radio_cycles;      // Wakes that brought WiFi up
+    uint32_t offline_cycles;    // Radio wakes that could not reach the broker
+    uint32_t awake_ms_total;
+    bool discovery_done;
+} s_duty;
+
+// Waits until every QoS 1 publish so far has been acknowledged, the connection drops or
+// deadline_us passes. Returns whether everything was acknowledged.
+static bool duty_wait_acked(int64_t deadline_us)
+{
+    while (atomic_load(&s_qos_acked) < atomic_load(&s_qos_sent)) {
+        if (!mqtt_link_connected() || esp_timer_get_time() >= deadline_us) {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
     }
-    
-    // Convert to actual values
-    *humidity = (float)data[0];
-    *temperature = (float)data[2];
-    
-    ESP_LOGD(TAG, "DHT11: Checksum OK");
-    ESP_LOGD(TAG, "DHT11: Parsed Temperature: %.2f°C", *temperature);
-    ESP_LOGD(TAG, "DHT11: Parsed Humidity: %.2f%%", *humidity);
-    
     return true;
 }
 
-static void dht11_task(void *pvParameters)
+// Phase timestamp in ms since the wake, -1 if the phase was not reached
+static int32_t phase_ms(int64_t t_us)
 {
-    float temp, hum;
-    static uint32_t read_count   = 0;
-    static uint32_t success_count= 0;
-    static uint32_t fail_count   = 0;
+    return t_us ? (int32_t)(t_us / 1000) : -1;
+}
 
-    while (1) {
-        read_count++;
-        ESP_LOGI(TAG, "=== DHT11 Reading Cycle #%u ===", read_count);
-
-        if (read_dht11(&temp, &hum)) {
-            success_count++;
-            if (!isnan(temp) && !isnan(hum)) {
-                bool temp_changed = (temp != room_temp);
-                bool hum_changed  = (hum  != room_humidity);
-
-                room_temp     = temp;
-                room_humidity = hum;
-
-                ESP_LOGI(TAG, "Sensor Reading SUCCESS:");
-                ESP_LOGI(TAG, "  Temperature: %.2f°C %s",
-                         temp, temp_changed ? "(CHANGED)" : "(UNCHANGED)");
-                ESP_LOGI(TAG, "  Humidity: %.2f%% %s",
-                         hum, hum_changed ? "(CHANGED)" : "(UNCHANGED)");
-                ESP_LOGI(TAG, "  Success Rate: %u/%u (%.1f%%)",
-                         success_count, read_count,
-                         (float)success_count/read_count * 100.0f);
-
-                // LED blink on successful reading when Wi-Fi is connected
-                if (wifi_connected && !led_error_state) {
-                    ESP_LOGI(TAG, "Status LED: Quick blink (data ready)");
-                    gpio_set_level(STATUS_LED_PIN, 1);
-                    vTaskDelay(pdMS_TO_TICKS(100));
-                    gpio_set_level(STATUS_LED_PIN, 0);
-
-                    // Publish to MQTT state topics
-                    if (mqtt_client) {
-                        char payload[64];
-                        int len;
-
-                        // temperature
-                        len = snprintf(payload, sizeof(payload),
-                                       "{\"temperature\": %.2f}", room_temp);
-                        esp_mqtt_client_publish(mqtt_client,
-                                               MQTT_TEMP_STATE_TOPIC,
-                                               payload, len, 1, 0);
-
-                        // humidity
-                        len = snprintf(payload, sizeof(payload),
-                                       "{\"humidity\": %.2f}", room_humidity);
-                        esp_mqtt_client_publish(mqtt_client,
-                                               MQTT_HUM_STATE_TOPIC,
-                                               payload, len, 1, 0);
-                    }
+// One duty cycle: read, publish if anything changed, deep sleep. Does not return.
+static void duty_cycle_run(void)
+{
+    int64_t t_wifi = 0, t_mqtt = 0, t_done = 0;
+    bool due = false;
+    wal_stats_t wal;
+
+    s_duty.cycles++;
+    sensors_read_all();
+    int64_t t_read = esp_timer_get_time();
+
+    for (size_t i = 0; i < sensor_count(); i++) {
+        bool temp_moved, hum_moved;
+        due |= publish_due(i, &sensor_state(i)->last, false, &temp_moved, &hum_moved);
+    }
+    wal_get_stats(&wal);
+
+    // Unchanged readings and nothing queued: skip the radio entirely
+    if (due || wal.pending > 0) {
+        s_duty.radio_cycles++;
+        wifi_init_sta();
+        EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group, WIFI_CONNECTED_BIT, pdFALSE, pdTRUE,
+                                               pdMS_TO_TICKS(DUTY_CYCLE_CONNECT_TIMEOUT_MS));
+        if (bits & WIFI_CONNECTED_BIT) {
+            t_wifi = esp_timer_get_time();
+            while (!mqtt_link_connected() && esp_timer_get_time() - t_wifi < DUTY_CYCLE_CONNECT_TIMEOUT_MS * 1000LL) {
+                vTaskDelay(pdMS_TO_TICKS(10));
+            }
+        }
+
+        if (mqtt_link_connected()) {
+            t_mqtt = esp_timer_get_time();
+            int64_t ack_deadline = t_mqtt + DUTY_CYCLE_ACK_TIMEOUT_MS * 1000LL;
+            if (!s_duty.discovery_done) {
+                publish_ha_discovery();
+            }
+            for (size_t i = 0; i < sensor_count(); i++) {
+                publish_sensor_state(i, &sensor_state(i)->last, false);
+            }
+            // One backlog batch is in flight at a time, so each waits for its PUBACK
+            for (int i = 0; i < DUTY_CYCLE_REPLAY_BATCHES; i++) {
+                if (wal_replay_batch() == 0 || !duty_wait_acked(ack_deadline)) {
+                    break;
                 }
+            }
+            // Stopping the client discards whatever it has not got a PUBACK for
+            if (duty_wait_acked(ack_deadline)) {
+                s_duty.discovery_done = true;
             } else {
-                ESP_LOGW(TAG, "Sensor data contains NaN values");
-                room_temp     = 0.0f;
-                room_humidity = 0.0f;
-                fail_count++;
+                ESP_LOGW(TAG, "%u publish(es) not acknowledged, sending them again next wake",
+                         atomic_load(&s_qos_sent) - atomic_load(&s_qos_acked));
             }
+            mqtt_link_stop();
+            t_done = esp_timer_get_time();
         } else {
-            fail_count++;
-            ESP_LOGW(TAG, "Sensor Reading FAILED:");
-            ESP_LOGW(TAG, "  Failed attempts: %u/%u (%.1f%%)",
-                     fail_count, read_count,
-                     (float)fail_count/read_count * 100.0f);
-            room_temp     = 0.0f;
-            room_humidity = 0.0f;
+            s_duty.offline_cycles++;
+            for (size_t i = 0; i < sensor_count(); i++) {
+                if (sensor_state(i)->last.valid) {
+                    wal_append((uint8_t)i, &sensor_state(i)->last);
+                }
+            }
         }
+        esp_wifi_stop();
+    }
 
-        // Log current data state
-        ESP_LOGI(TAG, "Current Data State:");
-        ESP_LOGI(TAG, "  Temperature: %.2f°C", room_temp);
-        ESP_LOGI(TAG, "  Humidity: %.2f%%", room_humidity);
-        ESP_LOGI(TAG, "  Wi-Fi Status: %s", wifi_connected ? "CONNECTED" : "DISCONNECTED");
-        ESP_LOGI(TAG, "  Data Available for HTTP: %s",
-                 (room_temp != 0.0f || room_humidity != 0.0f) ? "YES" : "NO");
+    int64_t awake_us = esp_timer_get_time();
+    s_duty.awake_ms_total += (uint32_t)(awake_us / 1000);
+
+    // Timeline of this wake; esp_timer starts at 0 on every wake
+    ESP_LOGI(TAG, "Duty cycle #%u: read %d ms, wifi %d ms, mqtt %d ms, published %d ms, awake %d ms%s",
+             s_duty.cycles, phase_ms(t_read), phase_ms(t_wifi), phase_ms(t_mqtt),
+             phase_ms(t_done), phase_ms(awake_us), (due || wal.pending) ? "" : " (radio skipped)");
+    ESP_LOGI(TAG, "Duty totals: %u wakes, %u with radio, %u offline, avg awake %u ms",
+             s_duty.cycles, s_duty.radio_cycles, s_duty.offline_cycles,
+             s_duty.awake_ms_total / s_duty.cycles);
+    dlog_flush(200);
 
-        vTaskDelay(pdMS_TO_TICKS(3000)); // Update every 3 seconds
+    int64_t sleep_us = (int64_t)DUTY_CYCLE_INTERVAL_S * 1000000 - esp_timer_get_time();
+    if (sleep_us < 1000000) {
+        sleep_us = 1000000;
     }
+    esp_sleep_enable_timer_wakeup((uint64_t)sleep_us);
+    esp_deep_sleep_start();
 }
+#endif
+
+static const status_config_t s_status_config = {
+    .led_pin = STATUS_LED_PIN,
+    .stale_ms = SENSOR_STALE_MS,
+    .report_ms = STATUS_REPORT_MS,
+    .on_report = status_report,
+};
 
-static void sensor_check_task(void *pvParameters)
+// Runs just before the restart into a new image: end the broker session cleanly and
+// get the deferred log out
+static void ota_before_restart(void)
 {
-    static bool last_sensor_state = false;
-    
-    while (1) {
-        // Check sensor connectivity
-        sensor_connectivity = !(room_temp == 0.0 && room_humidity == 0.0);
-        
-        // Log state changes
-        if (sensor_connectivity != last_sensor_state) {
-            ESP_LOGI(TAG, "=== SENSOR CONNECTIVITY CHANGED ===");
-            ESP_LOGI(TAG, "Sensor Status: %s", sensor_connectivity ? "ONLINE" : "OFFLINE");
-            if (!sensor_connectivity) {
-                ESP_LOGW(TAG, "Sensor appears to be offline - no valid data received");
-                led_error_state = true;
-            }
-            last_sensor_state = sensor_connectivity;
-        }
-        
-        // Periodic status report
-        static int status_counter = 0;
-        if (++status_counter >= 10) { // Every 10 seconds
-            status_counter = 0;
-            ESP_LOGI(TAG, "=== SYSTEM STATUS REPORT ===");
-            ESP_LOGI(TAG, "WiFi: %s", wifi_connected ? "CONNECTED" : "DISCONNECTED");
-            ESP_LOGI(TAG, "Sensor: %s", sensor_connectivity ? "ONLINE" : "OFFLINE");
-            ESP_LOGI(TAG, "LED Error State: %s", led_error_state ? "ERROR" : "NORMAL");
-            ESP_LOGI(TAG, "Data Values: T=%.2f°C, H=%.2f%%", room_temp, room_humidity);
-            ESP_LOGI(TAG, "Free Heap: %d bytes", esp_get_free_heap_size());
-        }
-        
-        vTaskDelay(pdMS_TO_TICKS(1000)); // Check every second
-    }
+    mqtt_link_stop();
+    dlog_flush(200);
 }
 
-static void led_blink_task(void *pvParameters)
+static const ota_config_t s_ota_config = {
+    .token = OTA_TOKEN,
+    .before_restart = ota_before_restart,
+    .upload_start = stream_pause,
+    .upload_end = stream_resume,
+};
+
+// Frequency scaling and automatic light sleep; sensors.c holds a PM lock while it reads
+static void power_init(void)
 {
-    TickType_t last_blink = 0;
-    bool led_state = false;
-    static bool last_error_state = false;
-    
-    while (1) {
-        TickType_t now = xTaskGetTickCount();
-        
-        // Log LED state changes
-        if (led_error_state != last_error_state) {
-            ESP_LOGI(TAG, "LED Status Changed: %s", led_error_state ? "ERROR BLINK MODE" : "NORMAL MODE");
-            last_error_state = led_error_state;
-        }
-        
-        if (led_error_state) {
-            // Fast blink when there's an error
-            if ((now - last_blink) >= pdMS_TO_TICKS(75)) {
-                led_state = !led_state;
-                gpio_set_level(STATUS_LED_PIN, led_state);
-                last_blink = now;
-            }
-        } else {
-            // Turn off LED if it's on and enough time has passed
-            if (led_state && (now - last_blink) >= pdMS_TO_TICKS(200)) {
-                gpio_set_level(STATUS_LED_PIN, 0);
-                led_state = false;
-            }
-        }
-        
-        vTaskDelay(pdMS_TO_TICKS(10));
+#if CONFIG_PM_ENABLE
+    esp_pm_config_esp32_t pm = {
+        .max_freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = POWER_MIN_FREQ_MHZ,
+        .light_sleep_enable = POWER_LIGHT_SLEEP,
+    };
+    esp_err_t err = esp_pm_configure(&pm);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Power management not enabled: %s", esp_err_to_name(err));
+        return;
     }
+    ESP_LOGI(TAG, "Power management: %d-%d MHz, light sleep %s",
+             pm.min_freq_mhz, pm.max_freq_mhz, pm.light_sleep_enable ? "on" : "off");
+#endif
 }
 
 void app_main(void)
 {
+    // Deferred logging for the sampler and HTTP paths
+    dlog_init();
+
     // Initialize NVS
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -581,17 +1720,52 @@ void app_main(void)
     
     // Configure GPIO
     configure_gpio();
+
+    // The one MQTT client; it connects once WiFi has an address
+    ESP_ERROR_CHECK(mqtt_link_init(&s_mqtt_link_config));
+
+#if DUTY_CYCLE_MODE
+    wal_init();
+    duty_cycle_run();
+#endif
     
+    // Reading history buffer
+    history_init();
+
+    // Sample/publish cadence, possibly changed at run time and stored in NVS
+    sched_init(sensors_min_interval_ms());
+
+    // Flash log for readings taken while offline (needs NVS for the boot counter)
+    wal_init();
+
+    // Event-driven LED and connectivity state; must exist before WiFi reports to it
+    metrics_cpu_init();
+    ESP_ERROR_CHECK(status_init(&s_status_config));
+    power_init();
+
     // Initialize WiFi
     wifi_init_sta();
+
+#if GATEWAY_MODE == GATEWAY_MODE_GATEWAY
+    ESP_ERROR_CHECK(gateway_init(&s_gateway_config));
+#elif GATEWAY_MODE == GATEWAY_MODE_NODE
+    ESP_ERROR_CHECK(gateway_node_init(GATEWAY_TRANSPORT, GATEWAY_UDP_PORT));
+#endif
     
     // Start web server
+    ESP_ERROR_CHECK(ota_init(&s_ota_config));
     start_webserver();
     
     // Create tasks
-    xTaskCreate(dht11_task, "dht11_task", 4096, NULL, 5, NULL);
-    xTaskCreate(led_blink_task, "led_blink_task", 2048, NULL, 3, NULL);
-    xTaskCreate(sensor_check_task, "sensor_check_task", 2048, NULL, 4, NULL);
+    // Stacks come from static storage, sized in mem_plan.h
+    // Pinned to the app core when the sensors are read with interrupts masked
+    MEM_PLAN_TASK_PINNED(dht11_task, "dht11_task", STACK_DHT11_TASK, NULL, 5, sensors_task_core());
+    MEM_PLAN_TASK(wal_replay_task, "wal_replay_task", STACK_WAL_REPLAY_TASK, NULL, 2);
+    MEM_PLAN_TASK(publish_task, "publish_task", STACK_PUBLISH_TASK, NULL, 4);
+#if SOAK_RECONNECTS
+    MEM_PLAN_TASK(soak_task, "soak_task", STACK_SOAK_TASK, NULL, 1);
+#endif
+    mem_plan_report();
     
     ESP_LOGI(TAG, "Office Temperature Monitor Started");
 }
\ No newline at end of file
@@ -0,0 +1,111 @@
+/*
+    * Static memory plan and RAM budget report
+    *
+    * App tasks get their stacks and control blocks from static storage (MEM_PLAN_TASK), so
+    * they are counted in the image's .bss and cannot fail or fragment the heap at run time.
+    * The report puts static RAM, stack headroom and the heap side by side; checkpoints at a
+    * recurring event such as a broker reconnect show whether the heap stays flat.
+*/
+
+#include <stdatomic.h>
+#include "mem_plan.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+static const char *TAG = "mem";
+
+_Static_assert(MEM_PLAN_STACK_TOTAL <= MEM_PLAN_STACK_BUDGET, "task stacks exceed MEM_PLAN_STACK_BUDGET");
+
+// Section bounds from the ESP32 linker script
+extern int _data_start, _data_end, _bss_start, _bss_end;
+
+typedef struct {
+    const char *name;
+    uint32_t stack_bytes;
+    TaskHandle_t handle;
+} planned_task_t;
+
+// Written during start-up only; the count is published after each entry is complete
+static planned_task_t s_tasks[MEM_PLAN_MAX_TASKS];
+static atomic_uint s_task_count;
+
+static atomic_uint s_checkpoints;
+static atomic_int s_first_free;
+static atomic_int s_last_free;
+
+TaskHandle_t mem_plan_task_create(TaskFunction_t fn, const char *name, uint32_t stack_bytes, void *arg,
+                                  UBaseType_t prio, StackType_t *stack, StaticTask_t *tcb, BaseType_t core)
+{
+    TaskHandle_t handle = xTaskCreateStaticPinnedToCore(fn, name, stack_bytes, arg, prio, stack, tcb, core);
+    unsigned n = atomic_load_explicit(&s_task_count, memory_order_relaxed);
+
+    if (n < MEM_PLAN_MAX_TASKS) {
+        s_tasks[n] = (planned_task_t){ .name = name, .stack_bytes = stack_bytes, .handle = handle };
+        atomic_store_explicit(&s_task_count, n + 1, memory_order_release);
+    } else {
+        ESP_LOGW(TAG, "Task '%s' not tracked, raise MEM_PLAN_MAX_TASKS", name);
+    }
+    return handle;
+}
+
+bool mem_plan_task_info(size_t idx, const char **name, uint32_t *stack_bytes, uint32_t *min_free)
+{
+    if (idx >= atomic_load_explicit(&s_task_count, memory_order_acquire)) {
+        return false;
+    }
+    *name = s_tasks[idx].name;
+    *stack_bytes = s_tasks[idx].stack_bytes;
+    // Bytes on ESP-IDF, where stacks are StackType_t = uint8_t
+    *min_free = uxTaskGetStackHighWaterMark(s_tasks[idx].handle) * sizeof(StackType_t);
+    return true;
+}
+
+void mem_plan_checkpoint(void)
+{
+    int free_now = (int)heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
+    if (atomic_fetch_add(&s_checkpoints, 1) == 0) {
+        atomic_store(&s_first_free, free_now);
+    }
+    atomic_store(&s_last_free, free_now);
+}
+
+void mem_plan_get_info(mem_plan_info_t *info)
+{
+    unsigned n = atomic_load_explicit(&s_task_count, memory_order_acquire);
+
+    info->data_bytes = (uint32_t)((char *)&_data_end - (char *)&_data_start);
+    info->bss_bytes = (uint32_t)((char *)&_bss_end - (char *)&_bss_start);
+    info->task_stack_bytes = 0;
+    for (unsigned i = 0; i < n; i++) {
+        info->task_stack_bytes += s_tasks[i].stack_bytes;
+    }
+    info->heap_free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    info->heap_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    info->heap_largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    info->checkpoints = atomic_load(&s_checkpoints);
+    info->heap_drift = info->checkpoints ? atomic_load(&s_last_free) - atomic_load(&s_first_free) : 0;
+}
+
+void mem_plan_report(void)
+{
+    mem_plan_info_t info;
+    const char *name;
+    uint32_t stack_bytes, min_free;
+
+    mem_plan_get_info(&info);
+    ESP_LOGI(TAG, "Static RAM: .data %u + .bss %u bytes, of which %u in %u task stacks (budget %u)",
+             info.data_bytes, info.bss_bytes, info.task_stack_bytes,
+             (unsigned)atomic_load(&s_task_count), MEM_PLAN_STACK_BUDGET);
+    for (size_t i = 0; mem_plan_task_info(i, &name, &stack_bytes, &min_free); i++) {
+        if (min_free < MEM_PLAN_STACK_MARGIN) {
+            ESP_LOGW(TAG, "  %-16s stack %5u, min free %5u: below the %u byte margin",
+                     name, stack_bytes, min_free, MEM_PLAN_STACK_MARGIN);
+        } else {
+            ESP_LOGI(TAG, "  %-16s stack %5u, min free %5u, could be %u",
+                     name, stack_bytes, min_free, stack_bytes - min_free + MEM_PLAN_STACK_MARGIN);
+        }
+    }
+    ESP_LOGI(TAG, "Heap: free %u, min free %u, largest block %u; drift %d bytes over %u checkpoints",
+             info.heap_free, info.heap_min_free, info.heap_largest_block, info.heap_drift, info.checkpoints);
+}
@@ -0,0 +1,93 @@
+#ifndef MEM_PLAN_H
+#define MEM_PLAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Stack sizes in bytes of every task the app creates, kept in one place so the total is
+// checked at build time. Start from these, then trim with the "min free" column of the
+// memory report after running under load; keep at least MEM_PLAN_STACK_MARGIN free.
+#define STACK_DHT11_TASK            4096
+#define STACK_PUBLISH_TASK          3072
+#define STACK_STATUS_TASK           2048
+#define STACK_WAL_REPLAY_TASK       3072
+#define STACK_DLOG_TASK             3072
+#define STACK_GATEWAY_TASK          3072
+#define STACK_GATEWAY_UDP_TASK      3072
+#define STACK_GATEWAY_SIM_TASK      2048
+#define STACK_SOAK_TASK             2048
+
+#define MEM_PLAN_STACK_TOTAL (STACK_DHT11_TASK + STACK_PUBLISH_TASK + STACK_STATUS_TASK + STACK_WAL_REPLAY_TASK + \
+                              STACK_DLOG_TASK + STACK_GATEWAY_TASK + STACK_GATEWAY_UDP_TASK + \
+                              STACK_GATEWAY_SIM_TASK + STACK_SOAK_TASK)
+
+// Upper bound for all app task stacks together, and the headroom the report asks for
+#define MEM_PLAN_STACK_BUDGET       (28 * 1024)
+#define MEM_PLAN_STACK_MARGIN       512
+
+#define MEM_PLAN_MAX_TASKS          12
+
+/**
+ * @brief Create a task on a static stack and record it for the memory report
+ *
+ * Expands to static storage of stack_bytes, so each use site owns its stack;
+ * evaluates to the task handle.
+ */
+#define MEM_PLAN_TASK(fn, name, stack_bytes, arg, prio) \
+        MEM_PLAN_TASK_PINNED(fn, name, stack_bytes, arg, prio, tskNO_AFFINITY)
+
+/**
+ * @brief MEM_PLAN_TASK() for a task that must run on one core (or tskNO_AFFINITY)
+ */
+#define MEM_PLAN_TASK_PINNED(fn, name, stack_bytes, arg, prio, core) ({                     \
+        static StackType_t stack_[(stack_bytes) / sizeof(StackType_t)];                     \
+        static StaticTask_t tcb_;                                                           \
+        mem_plan_task_create((fn), (name), (stack_bytes), (arg), (prio), stack_, &tcb_, (core)); \
+    })
+
+TaskHandle_t mem_plan_task_create(TaskFunction_t fn, const char *name, uint32_t stack_bytes, void *arg,
+                                  UBaseType_t prio, StackType_t *stack, StaticTask_t *tcb, BaseType_t core);
+
+typedef struct {
+    uint32_t data_bytes;            // Initialised static RAM (.data)
+    uint32_t bss_bytes;             // Zeroed static RAM (.bss), including all static task stacks
+    uint32_t task_stack_bytes;      // Stacks of the tasks created with MEM_PLAN_TASK
+    uint32_t heap_free;
+    uint32_t heap_min_free;         // Lowest free heap since boot
+    uint32_t heap_largest_block;    // Largest single allocation that would succeed now
+    uint32_t checkpoints;           // mem_plan_checkpoint() calls
+    int32_t heap_drift;             // Free heap at the latest checkpoint minus the first
+} mem_plan_info_t;
+
+void mem_plan_get_info(mem_plan_info_t *info);
+
+/**
+ * @brief Stack size and least free stack seen of a planned task
+ *
+ * @return false once idx is past the last task
+ */
+bool mem_plan_task_info(size_t idx, const char **name, uint32_t *stack_bytes, uint32_t *min_free);
+
+/**
+ * @brief Record free heap at a point the app returns to repeatedly (e.g. each broker
+ *        session), so a leak shows up as drift between checkpoints
+ */
+void mem_plan_checkpoint(void);
+
+/**
+ * @brief Log the memory report: static RAM, per-task stack headroom and heap
+ */
+void mem_plan_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MEM_PLAN_H
@@ -0,0 +1,358 @@
+/*
+    * Runtime metrics in the Prometheus text format
+    *
+    * Hot paths only do relaxed atomic increments: one for the counter or histogram bucket and
+    * one for the sum. All formatting, and the FreeRTOS task snapshot, happens when /metrics is
+    * scraped.
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include "metrics.h"
+#include "mem_plan.h"
+#include "esp_freertos_hooks.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Finite buckets per histogram; bounds are in microseconds and a final +Inf bucket is implicit
+#define HIST_BUCKETS    8
+
+// Room for the task snapshot; IDF's own tasks plus ours stay well below this
+#define METRICS_MAX_TASKS   32
+
+typedef struct {
+    const char *name;
+    const char *key;
+    const char *help;
+    uint32_t bounds_us[HIST_BUCKETS];
+    atomic_uint buckets[HIST_BUCKETS + 1];
+    atomic_uint count;
+    _Atomic uint64_t sum_us;        // 64-bit so it does not wrap; emulated with a short critical section on Xtensa
+} histogram_t;
+
+atomic_uint metrics_counters[METRIC_COUNTER_COUNT];
+
+static const struct {
+    const char *name;
+    const char *help;
+    const char *labels;
+} s_counter_info[METRIC_COUNTER_COUNT] = {
+    [METRIC_READS]                  = { "dht_reads_total", "Sensor reads attempted", "" },
+    [METRIC_READ_CHECKSUM_FAILURES] = { "dht_read_failures_total", "Failed sensor reads by cause", "{reason=\"checksum\"}" },
+    [METRIC_READ_TIMEOUT_FAILURES]  = { "dht_read_failures_total", NULL, "{reason=\"timeout\"}" },
+    [METRIC_READ_OTHER_FAILURES]    = { "dht_read_failures_total", NULL, "{reason=\"other\"}" },
+    [METRIC_READ_REJECTED]          = { "dht_readings_rejected_total", "Readings rejected as implausible jumps", "" },
+    [METRIC_MQTT_PUBLISHES]         = { "mqtt_publishes_total", "MQTT messages handed to the client", "" },
+    [METRIC_MQTT_PUBLISH_FAILURES]  = { "mqtt_publish_failures_total", "MQTT publishes rejected by the client", "" },
+    [METRIC_HTTP_REQUESTS]          = { "http_requests_total", "HTTP requests served", "" },
+    [METRIC_HTTP_NOT_MODIFIED]      = { "http_not_modified_total", "HTTP requests answered with 304 Not Modified", "" },
+    [METRIC_HTTP_CACHE_RENDERS]     = { "http_cache_renders_total", "Cached HTTP responses rendered", "" },
+    [METRIC_MQTT_PROBES]            = { "mqtt_probes_total", "Round-trip probes published to the broker", "" },
+    [METRIC_GATEWAY_PACKETS]        = { "gateway_packets_total", "Node packets received by the gateway", "" },
+    [METRIC_GATEWAY_DUPLICATES]     = { "gateway_duplicates_total", "Node packets dropped as repeats", "" },
+    [METRIC_GATEWAY_DROPPED]        = { "gateway_dropped_total", "Node packets lost to bad format, a full queue or peer table", "" },
+    [METRIC_GATEWAY_BATCHES]        = { "gateway_batches_total", "Batch messages published for nodes", "" },
+};
+
+static histogram_t s_hist[METRIC_HIST_COUNT] = {
+    [METRIC_HIST_READ] = {
+        .name = "dht_read_duration_seconds", .key = "read_cycle",
+        .help = "Wall time of a sensor read cycle",
+        .bounds_us = { 5000, 10000, 20000, 25000, 30000, 40000, 60000, 100000 },
+    },
+    [METRIC_HIST_PUBLISH] = {
+        .name = "mqtt_publish_duration_seconds", .key = "mqtt_publish_call",
+        .help = "Time spent queueing an MQTT publish",
+        .bounds_us = { 50, 100, 250, 500, 1000, 5000, 20000, 100000 },
+    },
+    [METRIC_HIST_HTTP] = {
+        .name = "http_handler_duration_seconds", .key = "http_handler",
+        .help = "HTTP handler run time",
+        .bounds_us = { 100, 250, 500, 1000, 2500, 10000, 50000, 250000 },
+    },
+    [METRIC_HIST_STREAM] = {
+        .name = "sse_push_latency_seconds", .key = "sse_push",
+        .help = "Time from a new reading to its delivery to a /stream client",
+        .bounds_us = { 500, 1000, 2500, 5000, 10000, 50000, 250000, 1000000 },
+    },
+    [METRIC_HIST_SAMPLE_TO_PUBLISH] = {
+        .name = "sample_to_publish_seconds", .key = "sample_to_publish",
+        .help = "Time from a sensor sample to its MQTT publish",
+        .bounds_us = { 1000, 10000, 100000, 500000, 1000000, 2500000, 5000000, 20000000 },
+    },
+    [METRIC_HIST_MQTT_ROUNDTRIP] = {
+        .name = "mqtt_roundtrip_seconds", .key = "mqtt_roundtrip",
+        .help = "Time from publishing a probe to receiving it back through the broker",
+        .bounds_us = { 2000, 5000, 10000, 25000, 50000, 100000, 250000, 1000000 },
+    },
+    [METRIC_HIST_GATEWAY_DELAY] = {
+        .name = "gateway_batch_delay_seconds", .key = "gateway_delay",
+        .help = "Time from a node packet arriving to its batch being published",
+        .bounds_us = { 10000, 100000, 250000, 500000, 1000000, 1500000, 2500000, 5000000 },
+    },
+    [METRIC_HIST_BIT_MARGIN] = {
+        .name = "dht_bit_margin_seconds", .key = "dht_bit_margin",
+        .help = "Smallest distance of a bit's high time from the 0/1 threshold, per frame",
+        .bounds_us = { 2, 4, 6, 8, 10, 14, 18, 22 },
+    },
+    [METRIC_HIST_BIT_JITTER] = {
+        .name = "dht_bit_jitter_seconds", .key = "dht_bit_jitter",
+        .help = "Spread of the bit low times within a frame",
+        .bounds_us = { 1, 2, 4, 6, 8, 12, 16, 24 },
+    },
+};
+
+void metrics_observe_us(metric_hist_t hist, uint32_t us)
+{
+    histogram_t *h = &s_hist[hist];
+    size_t i = 0;
+
+    while (i < HIST_BUCKETS && us > h->bounds_us[i]) {
+        i++;
+    }
+    atomic_fetch_add_explicit(&h->buckets[i], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_us, us, memory_order_relaxed);
+}
+
+// Value below which permille/1000 of the observations fall, assuming they are spread
+// evenly within their bucket
+static uint32_t hist_quantile_us(histogram_t *h, const unsigned *buckets, unsigned count, unsigned permille)
+{
+    uint64_t rank = ((uint64_t)count * permille + 999) / 1000;
+    unsigned cumulative = 0;
+
+    for (size_t i = 0; i < HIST_BUCKETS; i++) {
+        if (cumulative + buckets[i] >= rank) {
+            uint32_t lo = i ? h->bounds_us[i - 1] : 0;
+            uint32_t span = h->bounds_us[i] - lo;
+            return lo + (uint32_t)((uint64_t)span * (rank - cumulative) / buckets[i]);
+        }
+        cumulative += buckets[i];
+    }
+    return h->bounds_us[HIST_BUCKETS - 1];
+}
+
+void metrics_hist_summary(metric_hist_t hist, metrics_hist_summary_t *out)
+{
+    histogram_t *h = &s_hist[hist];
+    unsigned buckets[HIST_BUCKETS + 1];
+    unsigned count = 0;
+
+    // Counted from one copy of the buckets so the percentiles are consistent with each other
+    for (size_t i = 0; i <= HIST_BUCKETS; i++) {
+        buckets[i] = atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        count += buckets[i];
+    }
+    out->key = h->key;
+    out->count = count;
+    out->sum_us = atomic_load_explicit(&h->sum_us, memory_order_relaxed);
+    out->p50_us = count ? hist_quantile_us(h, buckets, count, 500) : 0;
+    out->p90_us = count ? hist_quantile_us(h, buckets, count, 900) : 0;
+    out->p99_us = count ? hist_quantile_us(h, buckets, count, 990) : 0;
+}
+
+// Microseconds since reset, 0 = not reached
+static _Atomic uint64_t s_boot_phase_us[METRIC_BOOT_PHASE_COUNT];
+
+static const char *const s_boot_phase_names[METRIC_BOOT_PHASE_COUNT] = {
+    [METRIC_BOOT_GOT_IP]        = "got_ip",
+    [METRIC_BOOT_FIRST_PUBLISH] = "first_publish",
+};
+
+void metrics_boot_phase(metric_boot_phase_t phase)
+{
+    uint64_t expected = 0;
+
+    if (atomic_load_explicit(&s_boot_phase_us[phase], memory_order_relaxed) != 0) {
+        return;
+    }
+    atomic_compare_exchange_strong(&s_boot_phase_us[phase], &expected, (uint64_t)esp_timer_get_time());
+}
+
+uint32_t metrics_boot_phase_ms(metric_boot_phase_t phase)
+{
+    return (uint32_t)(atomic_load_explicit(&s_boot_phase_us[phase], memory_order_relaxed) / 1000);
+}
+
+static atomic_uint s_wakeups[portNUM_PROCESSORS];
+
+// IDF runs the idle hooks once per pass of the idle loop and then waits for an interrupt,
+// so each call is one wakeup of this core
+static bool count_wakeup(void)
+{
+    atomic_fetch_add_explicit(&s_wakeups[xPortGetCoreID()], 1, memory_order_relaxed);
+    return true;
+}
+
+esp_err_t metrics_cpu_init(void)
+{
+    for (unsigned cpu = 0; cpu < portNUM_PROCESSORS; cpu++) {
+        esp_err_t err = esp_register_freertos_idle_hook_for_cpu(count_wakeup, cpu);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+size_t metrics_cpu_sample(metrics_cpu_t *out, size_t max)
+{
+    static int64_t last_us;
+    static uint32_t last_wakeups[portNUM_PROCESSORS];
+    static uint32_t last_idle_us[portNUM_PROCESSORS];
+    int64_t now = esp_timer_get_time();
+    uint64_t elapsed_us = now - last_us;
+    size_t n = max < portNUM_PROCESSORS ? max : portNUM_PROCESSORS;
+
+    for (size_t cpu = 0; cpu < n; cpu++) {
+        TaskStatus_t idle;
+        uint32_t wakeups = atomic_load_explicit(&s_wakeups[cpu], memory_order_relaxed);
+
+        // Run time counters are esp_timer microseconds and wrap after 71 minutes; the
+        // unsigned difference is right as long as samples are closer together than that
+        vTaskGetInfo(xTaskGetIdleTaskHandleForCPU(cpu), &idle, pdFALSE, eInvalid);
+        out[cpu].wakeups_per_s = elapsed_us ? (uint32_t)((wakeups - last_wakeups[cpu]) * 1000000ULL / elapsed_us) : 0;
+        out[cpu].idle_permille = elapsed_us ? (uint32_t)((idle.ulRunTimeCounter - last_idle_us[cpu]) * 1000ULL / elapsed_us) : 0;
+        last_wakeups[cpu] = wakeups;
+        last_idle_us[cpu] = idle.ulRunTimeCounter;
+    }
+    last_us = now;
+    return n;
+}
+
+typedef struct {
+    metrics_emit_t emit;
+    void *ctx;
+    char buf[256];
+    esp_err_t err;
+} writer_t;
+
+static void out(writer_t *w, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void out(writer_t *w, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (w->err != ESP_OK) {
+        return;
+    }
+    va_start(ap, fmt);
+    int len = vsnprintf(w->buf, sizeof(w->buf), fmt, ap);
+    va_end(ap);
+    if (len >= (int)sizeof(w->buf)) {
+        len = sizeof(w->buf) - 1;
+    }
+    w->err = w->emit(w->ctx, w->buf, len);
+}
+
+static void write_histogram(writer_t *w, histogram_t *h)
+{
+    unsigned cumulative = 0;
+
+    out(w, "# HELP %s %s\n# TYPE %s histogram\n", h->name, h->help, h->name);
+    for (size_t i = 0; i <= HIST_BUCKETS; i++) {
+        cumulative += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        if (i < HIST_BUCKETS) {
+            out(w, "%s_bucket{le=\"%u.%06u\"} %u\n", h->name,
+                h->bounds_us[i] / 1000000, h->bounds_us[i] % 1000000, cumulative);
+        } else {
+            out(w, "%s_bucket{le=\"+Inf\"} %u\n", h->name, cumulative);
+        }
+    }
+    uint64_t sum_us = atomic_load_explicit(&h->sum_us, memory_order_relaxed);
+    out(w, "%s_sum %llu.%06u\n%s_count %u\n", h->name,
+        (unsigned long long)(sum_us / 1000000), (unsigned)(sum_us % 1000000),
+        h->name, atomic_load_explicit(&h->count, memory_order_relaxed));
+}
+
+static void write_tasks(writer_t *w)
+{
+    static TaskStatus_t tasks[METRICS_MAX_TASKS];   // Only the httpd task scrapes
+    uint32_t total_runtime = 0;
+    const char *name;
+    uint32_t stack_bytes, min_free;
+
+    // Returns 0 if the array is too small
+    UBaseType_t n = uxTaskGetSystemState(tasks, METRICS_MAX_TASKS, &total_runtime);
+
+    // Run time counters come from esp_timer (microseconds) with
+    // CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS and wrap with 32 bits.
+    out(w, "# HELP freertos_task_runtime_us_total CPU time used by the task\n"
+           "# TYPE freertos_task_runtime_us_total counter\n");
+    for (UBaseType_t i = 0; i < n; i++) {
+        out(w, "freertos_task_runtime_us_total{task=\"%s\"} %u\n",
+            tasks[i].pcTaskName, (unsigned)tasks[i].ulRunTimeCounter);
+    }
+    out(w, "# HELP freertos_task_stack_free_min_bytes Stack high-water mark (least free stack seen)\n"
+           "# TYPE freertos_task_stack_free_min_bytes gauge\n");
+    for (UBaseType_t i = 0; i < n; i++) {
+        out(w, "freertos_task_stack_free_min_bytes{task=\"%s\"} %u\n",
+            tasks[i].pcTaskName, (unsigned)tasks[i].usStackHighWaterMark);
+    }
+    out(w, "# HELP freertos_task_stack_size_bytes Stack size of the app's statically allocated tasks\n"
+           "# TYPE freertos_task_stack_size_bytes gauge\n");
+    for (size_t i = 0; mem_plan_task_info(i, &name, &stack_bytes, &min_free); i++) {
+        out(w, "freertos_task_stack_size_bytes{task=\"%s\"} %u\n", name, (unsigned)stack_bytes);
+    }
+}
+
+esp_err_t metrics_write(metrics_emit_t emit, void *ctx)
+{
+    static writer_t w;              // Only the httpd task scrapes
+
+    w.emit = emit;
+    w.ctx = ctx;
+    w.err = ESP_OK;
+
+    for (size_t i = 0; i < METRIC_COUNTER_COUNT; i++) {
+        if (s_counter_info[i].help) {
+            out(&w, "# HELP %s %s\n# TYPE %s counter\n",
+                s_counter_info[i].name, s_counter_info[i].help, s_counter_info[i].name);
+        }
+        out(&w, "%s%s %u\n", s_counter_info[i].name, s_counter_info[i].labels,
+            atomic_load_explicit(&metrics_counters[i], memory_order_relaxed));
+    }
+    for (size_t i = 0; i < METRIC_HIST_COUNT; i++) {
+        write_histogram(&w, &s_hist[i]);
+    }
+    write_tasks(&w);
+
+    out(&w, "# HELP cpu_wakeups_total Times the core was woken from its idle wait\n"
+           "# TYPE cpu_wakeups_total counter\n");
+    for (unsigned cpu = 0; cpu < portNUM_PROCESSORS; cpu++) {
+        out(&w, "cpu_wakeups_total{cpu=\"%u\"} %u\n", cpu,
+            atomic_load_explicit(&s_wakeups[cpu], memory_order_relaxed));
+    }
+
+    out(&w, "# HELP heap_free_bytes Free heap\n# TYPE heap_free_bytes gauge\nheap_free_bytes %u\n",
+        (unsigned)esp_get_free_heap_size());
+    out(&w, "# HELP heap_free_min_bytes Lowest free heap since boot\n# TYPE heap_free_min_bytes gauge\n"
+           "heap_free_min_bytes %u\n", (unsigned)esp_get_minimum_free_heap_size());
+
+    mem_plan_info_t mem;
+    mem_plan_get_info(&mem);
+    out(&w, "# HELP heap_largest_free_block_bytes Largest allocation that would succeed\n"
+           "# TYPE heap_largest_free_block_bytes gauge\nheap_largest_free_block_bytes %u\n",
+        (unsigned)mem.heap_largest_block);
+    out(&w, "# HELP static_ram_bytes Statically allocated RAM by section\n# TYPE static_ram_bytes gauge\n"
+           "static_ram_bytes{section=\"data\"} %u\nstatic_ram_bytes{section=\"bss\"} %u\n",
+        (unsigned)mem.data_bytes, (unsigned)mem.bss_bytes);
+    out(&w, "# HELP heap_checkpoint_drift_bytes Free heap change between the first and latest broker session\n"
+           "# TYPE heap_checkpoint_drift_bytes gauge\nheap_checkpoint_drift_bytes %d\n", (int)mem.heap_drift);
+    out(&w, "# HELP boot_phase_seconds Time from reset until the boot phase was reached\n"
+           "# TYPE boot_phase_seconds gauge\n");
+    for (size_t i = 0; i < METRIC_BOOT_PHASE_COUNT; i++) {
+        uint64_t us = atomic_load_explicit(&s_boot_phase_us[i], memory_order_relaxed);
+        if (us != 0) {
+            out(&w, "boot_phase_seconds{phase=\"%s\"} %u.%06u\n", s_boot_phase_names[i],
+                (unsigned)(us / 1000000), (unsigned)(us % 1000000));
+        }
+    }
+    out(&w, "# HELP uptime_seconds Time since boot\n# TYPE uptime_seconds gauge\nuptime_seconds %u\n",
+        (unsigned)(xTaskGetTickCount() / configTICK_RATE_HZ));
+
+    return w.err;
+}
@@ -0,0 +1,136 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    METRIC_READS,                   // Sensor reads attempted
+    METRIC_READ_CHECKSUM_FAILURES,
+    METRIC_READ_TIMEOUT_FAILURES,
+    METRIC_READ_OTHER_FAILURES,
+    METRIC_READ_REJECTED,           // Good frames dropped by the outlier filter
+    METRIC_MQTT_PUBLISHES,
+    METRIC_MQTT_PUBLISH_FAILURES,
+    METRIC_HTTP_REQUESTS,
+    METRIC_HTTP_NOT_MODIFIED,       // Answered with 304 from a matching ETag
+    METRIC_HTTP_CACHE_RENDERS,      // Cached HTTP responses re-rendered after a change
+    METRIC_MQTT_PROBES,             // Round-trip probes sent to the broker
+    METRIC_GATEWAY_PACKETS,         // Valid node packets received, including repeats
+    METRIC_GATEWAY_DUPLICATES,      // Node packets that were not newer than the last one
+    METRIC_GATEWAY_DROPPED,         // Malformed, queue full or peer table full
+    METRIC_GATEWAY_BATCHES,         // Batch messages published for nodes
+    METRIC_COUNTER_COUNT
+} metric_counter_t;
+
+typedef enum {
+    METRIC_HIST_READ,               // Wall time of one sensor read cycle
+    METRIC_HIST_PUBLISH,            // Time spent in esp_mqtt_client_publish()
+    METRIC_HIST_HTTP,               // HTTP handler run time
+    METRIC_HIST_STREAM,             // New reading to its delivery on a /stream socket
+    METRIC_HIST_SAMPLE_TO_PUBLISH,  // Sensor sample to its MQTT publish
+    METRIC_HIST_MQTT_ROUNDTRIP,     // Probe publish to its delivery back from the broker
+    METRIC_HIST_GATEWAY_DELAY,      // Node packet arrival to its batch being published
+    METRIC_HIST_BIT_MARGIN,         // Closest a DHT bit's high time came to the 0/1 threshold
+    METRIC_HIST_BIT_JITTER,         // Spread of the DHT bit low times within one frame
+    METRIC_HIST_COUNT
+} metric_hist_t;
+
+typedef enum {
+    METRIC_BOOT_GOT_IP,             // First IP address after reset
+    METRIC_BOOT_FIRST_PUBLISH,      // First MQTT message handed to the client
+    METRIC_BOOT_PHASE_COUNT
+} metric_boot_phase_t;
+
+extern atomic_uint metrics_counters[METRIC_COUNTER_COUNT];
+
+/**
+ * @brief Increment a counter; a single relaxed atomic add, safe from any task
+ */
+static inline void metrics_inc(metric_counter_t counter)
+{
+    atomic_fetch_add_explicit(&metrics_counters[counter], 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Record a duration in a fixed-bucket histogram
+ */
+void metrics_observe_us(metric_hist_t hist, uint32_t us);
+
+/**
+ * @brief Current value of a counter
+ */
+static inline uint32_t metrics_counter(metric_counter_t counter)
+{
+    return atomic_load_explicit(&metrics_counters[counter], memory_order_relaxed);
+}
+
+typedef struct {
+    const char *key;                // Short name, e.g. "http_handler"
+    uint32_t count;
+    uint64_t sum_us;
+    uint32_t p50_us;                // Percentiles interpolated within the bucket bounds
+    uint32_t p90_us;
+    uint32_t p99_us;
+} metrics_hist_summary_t;
+
+/**
+ * @brief Count, sum and estimated percentiles of a histogram
+ *
+ * Percentiles falling in the +Inf bucket are reported as the largest bound.
+ */
+void metrics_hist_summary(metric_hist_t hist, metrics_hist_summary_t *out);
+
+/**
+ * @brief Record the time since reset at which a boot phase was reached
+ *
+ * Only the first call per phase counts, so this can sit on a hot path.
+ */
+void metrics_boot_phase(metric_boot_phase_t phase);
+
+/**
+ * @brief Milliseconds from reset to the phase, or 0 if it was not reached yet
+ */
+uint32_t metrics_boot_phase_ms(metric_boot_phase_t phase);
+
+typedef struct {
+    uint32_t wakeups_per_s;         // Times the core left its idle wait (interrupts, including ticks)
+    uint32_t idle_permille;         // Share of wall time in the idle task, light sleep included
+} metrics_cpu_t;
+
+/**
+ * @brief Count wakeups on every core through an idle hook
+ */
+esp_err_t metrics_cpu_init(void);
+
+/**
+ * @brief Wakeup rate and idle share per core since the previous call
+ *
+ * The previous sample is kept here, so there should be one caller (the status report).
+ *
+ * @return Number of cores written to out, at most max
+ */
+size_t metrics_cpu_sample(metrics_cpu_t *out, size_t max);
+
+// Output callback for metrics_write(); called with successive pieces of the page
+typedef esp_err_t (*metrics_emit_t)(void *ctx, const char *data, size_t len);
+
+/**
+ * @brief Render all metrics in the Prometheus text exposition format
+ *
+ * Also collects per-task CPU time and stack high-water marks and the heap
+ * low-water mark at the time of the call.
+ */
+esp_err_t metrics_write(metrics_emit_t emit, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // METRICS_H
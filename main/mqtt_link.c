@@ -0,0 +1,180 @@
+/*
+    * MQTT connection manager
+    *
+    * Owns the one MQTT client for the lifetime of the firmware. The client's own reconnect loop is
+    * disabled; after a lost connection the next attempt is scheduled on an esp_timer with
+    * exponential backoff and jitter, so a broker restart does not get hammered by every device at
+    * once. Retries pause while WiFi is down and restart immediately, with the backoff reset, when
+    * an IP address is obtained again.
+*/
+
+#include <stdatomic.h>
+#include "mqtt_link.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+static const char *TAG = "mqtt_link";
+
+#define MQTT_BACKOFF_MIN_MS     1000
+#define MQTT_BACKOFF_MAX_MS     60000
+
+static const mqtt_link_config_t *s_cfg;
+static esp_mqtt_client_handle_t s_client;
+static esp_timer_handle_t s_retry_timer;
+static atomic_bool s_started;
+static atomic_bool s_connected;
+static atomic_bool s_network_up;
+static atomic_uint s_backoff_ms;
+static atomic_uint s_connects;
+static atomic_uint s_disconnects;
+static atomic_uint s_attempts;
+
+static void retry_cb(void *arg)
+{
+    if (!s_network_up || s_connected) {
+        return;
+    }
+    s_attempts++;
+    esp_mqtt_client_reconnect(s_client);
+}
+
+// Schedules the next attempt after the current backoff (+ up to 25% jitter) and doubles it
+static void schedule_retry(void)
+{
+    uint32_t delay = s_backoff_ms;
+
+    if (delay == 0) {
+        delay = MQTT_BACKOFF_MIN_MS;
+    }
+    s_backoff_ms = delay * 2 > MQTT_BACKOFF_MAX_MS ? MQTT_BACKOFF_MAX_MS : delay * 2;
+    delay += esp_random() % (delay / 4 + 1);
+
+    ESP_LOGI(TAG, "Reconnecting in %u ms", (unsigned)delay);
+    esp_timer_stop(s_retry_timer);
+    esp_timer_start_once(s_retry_timer, (uint64_t)delay * 1000);
+}
+
+static void event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    switch (event_id) {
+    case MQTT_EVENT_CONNECTED:
+        ESP_LOGI(TAG, "Connected to broker");
+        s_connected = true;
+        s_backoff_ms = 0;
+        s_connects++;
+        if (s_cfg->on_connected) {
+            s_cfg->on_connected();
+        }
+        break;
+    case MQTT_EVENT_DISCONNECTED:
+        // Also raised for every failed connect attempt
+        if (s_connected) {
+            ESP_LOGW(TAG, "Disconnected from broker");
+            s_connected = false;
+            s_disconnects++;
+            if (s_cfg->on_disconnected) {
+                s_cfg->on_disconnected();
+            }
+        }
+        if (s_network_up && s_started) {
+            schedule_retry();
+        }
+        break;
+    case MQTT_EVENT_DATA: {
+        esp_mqtt_event_handle_t event = event_data;
+        // Messages larger than the client buffer arrive in pieces; none of ours are
+        if (s_cfg->on_message && event->current_data_offset == 0 && event->data_len == event->total_data_len) {
+            s_cfg->on_message(event->topic, event->topic_len, event->data, event->data_len);
+        }
+        break;
+    }
+    case MQTT_EVENT_PUBLISHED:
+        if (s_cfg->on_published) {
+            s_cfg->on_published(((esp_mqtt_event_handle_t)event_data)->msg_id);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+esp_err_t mqtt_link_init(const mqtt_link_config_t *config)
+{
+    esp_mqtt_client_config_t cfg = {
+        .uri = config->uri,
+        // .username = "...",   // if needed
+        // .password = "...",
+        .disable_auto_reconnect = true,
+    };
+    const esp_timer_create_args_t timer_args = {
+        .callback = retry_cb,
+        .name = "mqtt_retry",
+    };
+
+    if (s_client) {
+        return ESP_OK;
+    }
+    s_cfg = config;
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &s_retry_timer));
+
+    s_client = esp_mqtt_client_init(&cfg);
+    if (s_client == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    return esp_mqtt_client_register_event(s_client, ESP_EVENT_ANY_ID, event_handler, NULL);
+}
+
+void mqtt_link_network_up(void)
+{
+    if (s_client == NULL) {
+        return;
+    }
+    s_network_up = true;
+
+    if (!atomic_exchange(&s_started, true)) {
+        esp_mqtt_client_start(s_client);
+    } else if (!s_connected) {
+        // The network just came back; do not wait out a backoff that grew while it was gone
+        esp_timer_stop(s_retry_timer);
+        s_backoff_ms = 0;
+        s_attempts++;
+        esp_mqtt_client_reconnect(s_client);
+    }
+}
+
+void mqtt_link_network_down(void)
+{
+    s_network_up = false;
+    if (s_retry_timer) {
+        esp_timer_stop(s_retry_timer);
+    }
+}
+
+void mqtt_link_stop(void)
+{
+    mqtt_link_network_down();
+    if (s_client && atomic_exchange(&s_started, false)) {
+        esp_mqtt_client_disconnect(s_client);
+        esp_mqtt_client_stop(s_client);
+        s_connected = false;
+    }
+}
+
+bool mqtt_link_connected(void)
+{
+    return s_connected;
+}
+
+esp_mqtt_client_handle_t mqtt_link_client(void)
+{
+    return s_client;
+}
+
+void mqtt_link_get_stats(mqtt_link_stats_t *stats)
+{
+    stats->connects = s_connects;
+    stats->disconnects = s_disconnects;
+    stats->attempts = s_attempts;
+    stats->backoff_ms = s_backoff_ms;
+}
@@ -0,0 +1,69 @@
+#ifndef MQTT_LINK_H
+#define MQTT_LINK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "mqtt_client.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const char *uri;
+    // Called on the MQTT task after each successful connect; every connect is a new
+    // clean session, so this is where per-session messages (discovery) go.
+    void (*on_connected)(void);
+    // Called on the MQTT task when the broker connection is lost
+    void (*on_disconnected)(void);
+    // Called on the MQTT task for each message on a subscribed topic; neither string is NUL terminated
+    void (*on_message)(const char *topic, int topic_len, const char *data, int data_len);
+    // Called on the MQTT task when the broker acknowledges a QoS 1 or 2 publish. The
+    // client's API lock is held, so this must not wait on anything a publisher holds.
+    void (*on_published)(int msg_id);
+} mqtt_link_config_t;
+
+typedef struct {
+    uint32_t connects;              // Sessions established since boot
+    uint32_t disconnects;
+    uint32_t attempts;              // Reconnects started by the backoff timer
+    uint32_t backoff_ms;            // Current retry delay, 0 while connected
+} mqtt_link_stats_t;
+
+/**
+ * @brief Create the single MQTT client; it is not started until the network is up
+ *
+ * The configuration must outlive the module.
+ */
+esp_err_t mqtt_link_init(const mqtt_link_config_t *config);
+
+/**
+ * @brief Network (IP) is available: start the client, or retry right away if it is disconnected
+ */
+void mqtt_link_network_up(void);
+
+/**
+ * @brief Network is gone: stop scheduling reconnects until mqtt_link_network_up()
+ */
+void mqtt_link_network_down(void);
+
+/**
+ * @brief Disconnect and stop the client, e.g. before deep sleep
+ */
+void mqtt_link_stop(void);
+
+bool mqtt_link_connected(void);
+
+/**
+ * @brief The client handle for publishing; NULL before mqtt_link_init()
+ */
+esp_mqtt_client_handle_t mqtt_link_client(void);
+
+void mqtt_link_get_stats(mqtt_link_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MQTT_LINK_H
@@ -0,0 +1,329 @@
+/*
+    * Streaming firmware update over HTTP
+    *
+    * POST /ota carries the raw application image (build/<project>.bin) as the request body. It
+    * is received in OTA_CHUNK pieces into one static buffer, each piece is fed to SHA-256 and
+    * written straight to the next OTA partition, so RAM use does not depend on the image size.
+    * The image is only made bootable if the digest matches the X-Image-SHA256 header and
+    * esp_ota_end() accepts it; any failure aborts the update and leaves the running image
+    * alone.
+    *
+    * The handler runs on the httpd task, which drops to OTA_TASK_PRIORITY for the upload so the
+    * sampler, publisher and status task keep their schedule. A CPU_FREQ_MAX lock keeps the CPU
+    * at full speed and out of light sleep until the upload ends. Flash writes stall the other
+    * core briefly; a DHT capture caught by one fails its checksum and is retried as usual.
+    *
+    * httpd runs one handler at a time, so for the length of the upload (about 10 s for a 900 KB
+    * image on a good link, far longer on a slow one) every other endpoint waits: new requests sit
+    * in the socket backlog and are served once the upload ends, or time out on the client side.
+    * /stream is told through the upload_start/upload_end hooks, so its subscribers get the latest
+    * readings afterwards instead of being dropped as too slow.
+    *
+    * The new image boots pending verification (CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE) and the
+    * bootloader rolls back to the previous one unless ota_mark_valid() runs first.
+*/
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include "ota.h"
+#include "dlog.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_pm.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "mbedtls/sha256.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "ota";
+
+#define OTA_CHUNK               4096    // One flash sector per write
+#define OTA_RECV_RETRIES        3       // Socket timeouts tolerated in a row
+#define OTA_TASK_PRIORITY       2       // httpd task priority during an upload
+#define OTA_PROGRESS_BYTES      (64 * 1024)
+#define OTA_RESTART_DELAY_MS    1000    // Lets the response and the last publish go out
+#define OTA_AUTH_MAX            96
+#define OTA_SHA256_LEN          32
+
+static const ota_config_t *s_cfg;
+static esp_pm_lock_handle_t s_pm_lock;
+static esp_timer_handle_t s_restart_timer;
+static atomic_bool s_restart_pending;
+
+static atomic_uint s_updates;
+static atomic_uint s_failures;
+static atomic_bool s_in_progress;
+static atomic_uint s_bytes;
+static atomic_uint s_elapsed_ms;
+static atomic_uint s_rate_bps;
+
+static void restart_cb(void *arg)
+{
+    ESP_LOGI(TAG, "Restarting into the new image");
+    if (s_cfg->before_restart) {
+        s_cfg->before_restart();
+    }
+    esp_restart();
+}
+
+esp_err_t ota_init(const ota_config_t *config)
+{
+    const esp_timer_create_args_t args = {
+        .callback = restart_cb,
+        .name = "ota_restart",
+    };
+    esp_err_t err;
+
+    s_cfg = config;
+    err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "ota", &s_pm_lock);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = esp_timer_create(&args, &s_restart_timer);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (config->token[0] == '\0') {
+        ESP_LOGW(TAG, "No OTA token set, POST /ota is disabled");
+    }
+    return ESP_OK;
+}
+
+// Compares the whole token whatever the input, so the time taken does not tell how much matched
+static bool token_matches(const char *given, size_t given_len)
+{
+    size_t len = strlen(s_cfg->token);
+    uint8_t diff = given_len != len;
+
+    for (size_t i = 0; i < len; i++) {
+        diff |= (uint8_t)(s_cfg->token[i] ^ (i < given_len ? given[i] : 0));
+    }
+    return diff == 0;
+}
+
+static bool authorized(httpd_req_t *req)
+{
+    static const char prefix[] = "Bearer ";
+    char value[OTA_AUTH_MAX];
+
+    if (httpd_req_get_hdr_value_str(req, "Authorization", value, sizeof(value)) != ESP_OK ||
+        strncmp(value, prefix, sizeof(prefix) - 1) != 0) {
+        return false;
+    }
+    const char *given = value + sizeof(prefix) - 1;
+    return token_matches(given, strlen(given));
+}
+
+static int hex_nibble(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+static bool parse_sha256(httpd_req_t *req, uint8_t out[OTA_SHA256_LEN])
+{
+    char hex[OTA_SHA256_LEN * 2 + 1];
+
+    if (httpd_req_get_hdr_value_str(req, "X-Image-SHA256", hex, sizeof(hex)) != ESP_OK ||
+        strlen(hex) != OTA_SHA256_LEN * 2) {
+        return false;
+    }
+    for (size_t i = 0; i < OTA_SHA256_LEN; i++) {
+        int hi = hex_nibble(hex[2 * i]);
+        int lo = hex_nibble(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        out[i] = (uint8_t)(hi << 4 | lo);
+    }
+    return true;
+}
+
+static esp_err_t send_status(httpd_req_t *req, const char *status, const char *msg)
+{
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, "text/plain");
+    return httpd_resp_sendstr(req, msg);
+}
+
+// Receives the body into the partition; returns a short reason on failure, NULL on success
+static const char *receive_image(httpd_req_t *req, esp_ota_handle_t handle,
+                                 mbedtls_sha256_context *sha, int64_t start)
+{
+    static char buf[OTA_CHUNK];         // httpd runs handlers one at a time
+    size_t remaining = req->content_len;
+    size_t done = 0;
+    size_t next_progress = OTA_PROGRESS_BYTES;
+    int timeouts = 0;
+
+    while (remaining > 0) {
+        int n = httpd_req_recv(req, buf, remaining < sizeof(buf) ? remaining : sizeof(buf));
+        if (n == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts <= OTA_RECV_RETRIES) {
+            continue;
+        }
+        if (n <= 0) {
+            return "Receive failed";
+        }
+        timeouts = 0;
+
+        mbedtls_sha256_update_ret(sha, (const unsigned char *)buf, n);
+        esp_err_t err = esp_ota_write(handle, buf, n);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Write at %u failed: %s", (unsigned)done, esp_err_to_name(err));
+            return err == ESP_ERR_OTA_VALIDATE_FAILED ? "Not an app image" : "Flash write failed";
+        }
+        remaining -= n;
+        done += n;
+        s_bytes = done;
+
+        if (done >= next_progress) {
+            uint32_t ms = (uint32_t)((esp_timer_get_time() - start) / 1000);
+            DLOGI(TAG, "Received %u of %u bytes, %u kB/s", (unsigned)done, (unsigned)req->content_len,
+                  ms ? (unsigned)(done / ms) : 0);
+            next_progress += OTA_PROGRESS_BYTES;
+        }
+    }
+    return NULL;
+}
+
+// The caller holds the PM lock and has lowered the task priority
+static esp_err_t run_update(httpd_req_t *req, const esp_partition_t *part, const uint8_t expected[OTA_SHA256_LEN])
+{
+    static mbedtls_sha256_context sha;
+    uint8_t digest[OTA_SHA256_LEN];
+    esp_ota_handle_t handle;
+    int64_t start = esp_timer_get_time();
+
+    esp_err_t err = esp_ota_begin(part, OTA_WITH_SEQUENTIAL_WRITES, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_begin failed: %s", esp_err_to_name(err));
+        return send_status(req, "500 Internal Server Error", "Could not start the update");
+    }
+
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts_ret(&sha, 0);
+    const char *failure = receive_image(req, handle, &sha, start);
+    mbedtls_sha256_finish_ret(&sha, digest);
+    mbedtls_sha256_free(&sha);
+
+    if (!failure && memcmp(digest, expected, sizeof(digest)) != 0) {
+        failure = "SHA-256 mismatch";
+    }
+    if (failure) {
+        esp_ota_abort(handle);
+        s_failures++;
+        ESP_LOGE(TAG, "Update aborted after %u bytes: %s", (unsigned)s_bytes, failure);
+        return send_status(req, "400 Bad Request", failure);
+    }
+
+    err = esp_ota_end(handle);
+    if (err == ESP_OK) {
+        err = esp_ota_set_boot_partition(part);
+    }
+    if (err != ESP_OK) {
+        s_failures++;
+        ESP_LOGE(TAG, "Image rejected: %s", esp_err_to_name(err));
+        return send_status(req, "400 Bad Request", "Image rejected");
+    }
+
+    uint32_t ms = (uint32_t)((esp_timer_get_time() - start) / 1000);
+    s_elapsed_ms = ms;
+    s_rate_bps = ms ? (uint32_t)((uint64_t)req->content_len * 1000 / ms) : 0;
+    s_updates++;
+    ESP_LOGI(TAG, "Wrote %u bytes to %s in %u ms (%u kB/s)", (unsigned)req->content_len, part->label,
+             (unsigned)ms, (unsigned)(s_rate_bps / 1000));
+
+    char body[128];
+    snprintf(body, sizeof(body), "{\"partition\":\"%s\",\"bytes\":%u,\"ms\":%u,\"rate_bps\":%u}",
+             part->label, (unsigned)req->content_len, (unsigned)ms, (unsigned)s_rate_bps);
+    httpd_resp_set_type(req, "application/json");
+    err = httpd_resp_sendstr(req, body);
+
+    s_restart_pending = true;
+    esp_timer_start_once(s_restart_timer, OTA_RESTART_DELAY_MS * 1000);
+    return err;
+}
+
+esp_err_t ota_handler(httpd_req_t *req)
+{
+    uint8_t expected[OTA_SHA256_LEN];
+
+    if (s_cfg->token[0] == '\0') {
+        return httpd_resp_send_err(req, HTTPD_403_FORBIDDEN, "OTA disabled");
+    }
+    if (!authorized(req)) {
+        ESP_LOGW(TAG, "Rejected unauthorized update");
+        httpd_resp_set_hdr(req, "WWW-Authenticate", "Bearer");
+        return httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, "Unauthorized");
+    }
+    if (s_restart_pending) {
+        return send_status(req, "503 Service Unavailable", "Restart pending");
+    }
+    if (!parse_sha256(req, expected)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "X-Image-SHA256 missing or malformed");
+    }
+    if (req->content_len == 0) {
+        return httpd_resp_send_err(req, HTTPD_411_LENGTH_REQUIRED, "Content-Length required");
+    }
+
+    const esp_partition_t *part = esp_ota_get_next_update_partition(NULL);
+    if (!part) {
+        return send_status(req, "500 Internal Server Error", "No OTA partition");
+    }
+    if (req->content_len > part->size) {
+        return send_status(req, "413 Payload Too Large", "Image larger than the OTA partition");
+    }
+
+    ESP_LOGI(TAG, "Receiving %u bytes into %s at 0x%x", (unsigned)req->content_len, part->label,
+             (unsigned)part->address);
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    UBaseType_t priority = uxTaskPriorityGet(self);
+    vTaskPrioritySet(self, OTA_TASK_PRIORITY);
+    esp_pm_lock_acquire(s_pm_lock);
+    s_in_progress = true;
+    s_bytes = 0;
+    if (s_cfg->upload_start) {
+        s_cfg->upload_start();
+    }
+
+    esp_err_t err = run_update(req, part, expected);
+
+    if (s_cfg->upload_end) {
+        s_cfg->upload_end();
+    }
+    s_in_progress = false;
+    esp_pm_lock_release(s_pm_lock);
+    vTaskPrioritySet(self, priority);
+    return err;
+}
+
+void ota_mark_valid(void)
+{
+    static bool done;
+    esp_ota_img_states_t state;
+
+    if (done) {
+        return;
+    }
+    done = true;
+    if (esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) == ESP_OK &&
+        state == ESP_OTA_IMG_PENDING_VERIFY) {
+        ESP_LOGI(TAG, "New image is up, cancelling rollback");
+        esp_ota_mark_app_valid_cancel_rollback();
+    }
+}
+
+void ota_get_stats(ota_stats_t *out)
+{
+    out->updates = s_updates;
+    out->failures = s_failures;
+    out->in_progress = s_in_progress;
+    out->bytes = s_bytes;
+    out->elapsed_ms = s_elapsed_ms;
+    out->rate_bps = s_rate_bps;
+}
@@ -0,0 +1,61 @@
+#ifndef OTA_H
+#define OTA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const char *token;              // Bearer token for POST /ota; empty = endpoint disabled
+    // Called on the esp_timer task just before the restart into the new image
+    void (*before_restart)(void);
+    // Called on the httpd task when an upload starts and when it ends, successful or not. The
+    // upload holds the httpd task throughout, so nothing else is served in between.
+    void (*upload_start)(void);
+    void (*upload_end)(void);
+} ota_config_t;
+
+typedef struct {
+    uint32_t updates;               // Images written and accepted since boot
+    uint32_t failures;              // Uploads that were started and then aborted
+    bool in_progress;
+    uint32_t bytes;                 // Last (or current) upload
+    uint32_t elapsed_ms;            // Last completed upload
+    uint32_t rate_bps;              // Average rate of the last completed upload, bytes/s
+} ota_stats_t;
+
+/**
+ * @brief Set the token and restart hook; the configuration must outlive the module
+ */
+esp_err_t ota_init(const ota_config_t *config);
+
+/**
+ * @brief httpd handler for POST /ota
+ *
+ * The body is the raw application image, streamed into the next OTA partition
+ * and hashed as it arrives. The X-Image-SHA256 header must carry the image's
+ * SHA-256 in hex. The device restarts into the new image shortly after the
+ * response is sent.
+ */
+esp_err_t ota_handler(httpd_req_t *req);
+
+/**
+ * @brief Cancel the rollback of a freshly updated image
+ *
+ * Call once the app has shown it works (it got an IP address). No-op when the
+ * running image is not pending verification.
+ */
+void ota_mark_valid(void);
+
+void ota_get_stats(ota_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OTA_H
@@ -0,0 +1,49 @@
+/*
+    * Seqlock for the latest sensor reading
+    *
+    * The sequence counter is odd while a write is in progress. Readers copy the payload between two
+    * loads of the counter and retry if it changed or was odd, so they never see temperature and
+    * humidity from different cycles and never hold anything the sampler has to wait for.
+*/
+
+#include <string.h>
+#include "reading.h"
+
+void reading_store_publish(reading_store_t *store, reading_t *reading)
+{
+    uint32_t words[READING_WORDS] = {0};
+    unsigned seq = atomic_load_explicit(&store->seq, memory_order_relaxed);
+
+    // Readings are numbered 1, 2, ... so seq == 0 means "never published".
+    reading->seq = seq / 2 + 1;
+    memcpy(words, reading, sizeof(*reading));
+
+    atomic_store_explicit(&store->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (size_t i = 0; i < READING_WORDS; i++) {
+        atomic_store_explicit(&store->words[i], words[i], memory_order_relaxed);
+    }
+    atomic_store_explicit(&store->seq, seq + 2, memory_order_release);
+}
+
+bool reading_store_read(const reading_store_t *store, reading_t *out)
+{
+    uint32_t words[READING_WORDS];
+    unsigned before, after;
+
+    do {
+        before = atomic_load_explicit(&store->seq, memory_order_acquire);
+        for (size_t i = 0; i < READING_WORDS; i++) {
+            words[i] = atomic_load_explicit(&store->words[i], memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&store->seq, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+
+    if (before == 0) {
+        memset(out, 0, sizeof(*out));
+        return false;
+    }
+    memcpy(out, words, sizeof(*out));
+    return true;
+}
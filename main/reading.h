@@ -0,0 +1,51 @@
+#ifndef READING_H
+#define READING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// One sensor reading, in the fixed-point units produced by dht_read_data()
+typedef struct {
+    uint32_t seq;               // Incremented for every published reading
+    int64_t timestamp_us;       // esp_timer_get_time() when the values were measured
+    int16_t temperature;        // in 0.1°C
+    int16_t humidity;           // in 0.1%
+    bool valid;                 // Measured and accepted in the latest read cycle
+    bool have_value;            // Values are real, possibly carried over from an earlier cycle
+} reading_t;
+
+#define READING_WORDS ((sizeof(reading_t) + sizeof(uint32_t) - 1) / sizeof(uint32_t))
+
+// Latest reading shared between one writer and any number of readers.
+// This is a seqlock: the writer never waits, readers retry if they overlap a
+// write, and the payload is stored as relaxed atomic words so a copy is never
+// a data race.
+typedef struct {
+    atomic_uint seq;
+    atomic_uint words[READING_WORDS];
+} reading_store_t;
+
+/**
+ * @brief Publish a new reading; must only be called from the owning task
+ *
+ * The store's sequence number is assigned to reading->seq.
+ */
+void reading_store_publish(reading_store_t *store, reading_t *reading);
+
+/**
+ * @brief Copy the latest reading out of the store without blocking the writer
+ *
+ * @return false if nothing has been published yet (out is zeroed)
+ */
+bool reading_store_read(const reading_store_t *store, reading_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // READING_H
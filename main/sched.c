@@ -0,0 +1,186 @@
+/*
+    * Sampling scheduler
+    *
+    * Periodic tasks sleep until a deadline on the esp_timer clock, so their period does not
+    * stretch by the time the work takes. The sampler period adapts: it drops to sample_min_ms
+    * as soon as a reading moves and doubles per stable sample up to sample_max_ms. The
+    * configuration is kept in NVS and can be changed while running; readers see each field
+    * atomically.
+*/
+
+#include <stdlib.h>
+#include "sched.h"
+#include "history.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "sensors.h"
+
+static const char *TAG = "sched";
+
+#define SCHED_SAMPLE_MIN_MS     2000
+#define SCHED_SAMPLE_MAX_MS     20000
+#define SCHED_PUBLISH_MS        5000
+#define SCHED_CHANGE_TEMP       2       // 0.2°C
+#define SCHED_CHANGE_HUM        5       // 0.5%
+#define SCHED_PUBLISH_MIN_MS    500
+
+#define NVS_NAMESPACE           "sched"
+#define NVS_KEY_CONFIG          "cfg"
+
+// A stable sensor at sample_max_ms must still fit one history delta record per sample
+_Static_assert(SENSOR_STALE_MS / 2 <= HISTORY_MAX_GAP_MS, "sample_max_ms may exceed the history time delta");
+
+static uint32_t s_hw_min_ms = 1000;
+static atomic_uint s_sample_min_ms = SCHED_SAMPLE_MIN_MS;
+static atomic_uint s_sample_max_ms = SCHED_SAMPLE_MAX_MS;
+static atomic_uint s_publish_ms = SCHED_PUBLISH_MS;
+static atomic_int s_change_temp = SCHED_CHANGE_TEMP;
+static atomic_int s_change_hum = SCHED_CHANGE_HUM;
+static atomic_uint s_period_ms = SCHED_SAMPLE_MIN_MS;
+
+static bool config_ok(const sched_config_t *c)
+{
+    // The upper bound keeps a stable sensor from looking stale between samples
+    return c->sample_min_ms >= s_hw_min_ms &&
+           c->sample_max_ms >= c->sample_min_ms &&
+           c->sample_max_ms <= SENSOR_STALE_MS / 2 &&
+           c->publish_ms >= SCHED_PUBLISH_MIN_MS &&
+           c->change_temp >= 0 && c->change_hum >= 0;
+}
+
+static void apply(const sched_config_t *c)
+{
+    s_sample_min_ms = c->sample_min_ms;
+    s_sample_max_ms = c->sample_max_ms;
+    s_publish_ms = c->publish_ms;
+    s_change_temp = c->change_temp;
+    s_change_hum = c->change_hum;
+    s_period_ms = c->sample_min_ms;
+}
+
+void sched_init(uint32_t hw_min_ms)
+{
+    sched_config_t cfg;
+    size_t len = sizeof(cfg);
+    nvs_handle_t nvs;
+
+    s_hw_min_ms = hw_min_ms;
+    if (s_sample_min_ms < hw_min_ms) {
+        s_sample_min_ms = hw_min_ms;
+        s_period_ms = hw_min_ms;
+    }
+
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    if (nvs_get_blob(nvs, NVS_KEY_CONFIG, &cfg, &len) == ESP_OK && len == sizeof(cfg)) {
+        if (config_ok(&cfg)) {
+            apply(&cfg);
+            ESP_LOGI(TAG, "Sampling every %u-%u ms, publishing every %u ms (from NVS)",
+                     cfg.sample_min_ms, cfg.sample_max_ms, cfg.publish_ms);
+        } else {
+            ESP_LOGW(TAG, "Stored configuration out of range, using defaults");
+        }
+    }
+    nvs_close(nvs);
+}
+
+void sched_get_config(sched_config_t *config)
+{
+    config->sample_min_ms = s_sample_min_ms;
+    config->sample_max_ms = s_sample_max_ms;
+    config->publish_ms = s_publish_ms;
+    config->change_temp = (int16_t)s_change_temp;
+    config->change_hum = (int16_t)s_change_hum;
+}
+
+esp_err_t sched_set_config(const sched_config_t *config)
+{
+    nvs_handle_t nvs;
+
+    if (!config_ok(config)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    apply(config);
+    ESP_LOGI(TAG, "Sampling every %u-%u ms, publishing every %u ms",
+             config->sample_min_ms, config->sample_max_ms, config->publish_ms);
+
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_blob(nvs, NVS_KEY_CONFIG, config, sizeof(*config));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err;
+}
+
+uint32_t sched_next_sample_period(bool changed)
+{
+    uint32_t min = s_sample_min_ms;
+    uint32_t max = s_sample_max_ms;
+    uint32_t period = changed ? min : s_period_ms * 2;
+
+    if (period < min) {
+        period = min;
+    }
+    if (period > max) {
+        period = max;
+    }
+    s_period_ms = period;
+    return period;
+}
+
+uint32_t sched_sample_period(void)
+{
+    return s_period_ms;
+}
+
+void sched_loop_init(sched_loop_t *loop)
+{
+    loop->due_us = esp_timer_get_time();
+}
+
+void sched_loop_wait(sched_loop_t *loop, uint32_t period_ms)
+{
+    const int64_t tick_us = (int64_t)portTICK_PERIOD_MS * 1000;
+
+    loop->runs++;
+    loop->due_us += (int64_t)period_ms * 1000;
+
+    int64_t left_us = loop->due_us - esp_timer_get_time();
+    if (left_us <= 0) {
+        // Overran: restart the schedule from now rather than firing back to back
+        loop->overruns++;
+        loop->drift_ms += (int32_t)(-left_us / 1000);
+        loop->due_us -= left_us;
+        return;
+    }
+
+    // Round up: vTaskDelay() wakes on a tick edge, up to a tick short of the count
+    vTaskDelay((TickType_t)((left_us + tick_us - 1) / tick_us));
+
+    int64_t late_us = esp_timer_get_time() - loop->due_us;
+    uint32_t jitter = (uint32_t)llabs(late_us);
+    loop->jitter_us_sum += jitter;
+    loop->jitter_runs++;
+    if (jitter > loop->jitter_us_max) {
+        loop->jitter_us_max = jitter;
+    }
+}
+
+void sched_loop_stats(sched_loop_t *loop, sched_loop_stats_t *stats)
+{
+    uint32_t runs = loop->jitter_runs;
+    uint64_t sum = loop->jitter_us_sum;
+
+    stats->runs = loop->runs;
+    stats->overruns = loop->overruns;
+    stats->jitter_us_avg = runs ? (uint32_t)(sum / runs) : 0;
+    stats->jitter_us_max = loop->jitter_us_max;
+    stats->drift_ms = loop->drift_ms;
+}
@@ -0,0 +1,89 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Sampling and publishing cadence, changeable at run time through /config
+typedef struct {
+    uint32_t sample_min_ms;     // Period while readings are changing
+    uint32_t sample_max_ms;     // Period the sampler backs off to while readings are stable
+    uint32_t publish_ms;        // MQTT publish period, independent of sampling
+    int16_t change_temp;        // Change between samples that counts as "changing", 0.1°C
+    int16_t change_hum;         // As above, 0.1%
+} sched_config_t;
+
+// Timing of one periodic task, updated by that task and readable from any other
+typedef struct {
+    int64_t due_us;             // When the current wake was due, on the esp_timer clock
+    atomic_uint runs;
+    atomic_uint overruns;       // Work took longer than the period; the schedule was reset
+    atomic_uint jitter_us_max;  // Largest wake-up lateness
+    _Atomic uint64_t jitter_us_sum;
+    atomic_uint jitter_runs;    // Wakes that slept, the base of the average
+    atomic_int drift_ms;        // Time lost against the ideal schedule through overruns
+} sched_loop_t;
+
+typedef struct {
+    uint32_t runs;
+    uint32_t overruns;
+    uint32_t jitter_us_avg;
+    uint32_t jitter_us_max;
+    int32_t drift_ms;
+} sched_loop_stats_t;
+
+/**
+ * @brief Load the configuration from NVS, clamped to what the sensors allow
+ *
+ * @param hw_min_ms Shortest period the attached sensors can be read at
+ */
+void sched_init(uint32_t hw_min_ms);
+
+void sched_get_config(sched_config_t *config);
+
+/**
+ * @brief Validate, apply and persist a new configuration
+ *
+ * @return ESP_ERR_INVALID_ARG if the values are inconsistent; nothing is changed then
+ */
+esp_err_t sched_set_config(const sched_config_t *config);
+
+/**
+ * @brief Period until the next sample: the minimum while readings change,
+ *        otherwise doubling up to the maximum
+ */
+uint32_t sched_next_sample_period(bool changed);
+
+/**
+ * @brief Current sample period in ms
+ */
+uint32_t sched_sample_period(void);
+
+/**
+ * @brief Start a periodic loop at the current time; call from the task that runs it
+ */
+void sched_loop_init(sched_loop_t *loop);
+
+/**
+ * @brief Sleep until period_ms after the previous wake and record jitter
+ *
+ * The deadline is kept on esp_timer and the time left converted to ticks on each wait, so
+ * tick rounding does not accumulate. If the work already took longer than the period the
+ * loop continues at once and the schedule restarts from now instead of bursting to catch up.
+ */
+void sched_loop_wait(sched_loop_t *loop, uint32_t period_ms);
+
+void sched_loop_stats(sched_loop_t *loop, sched_loop_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SCHED_H
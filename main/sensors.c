@@ -0,0 +1,343 @@
+/*
+    * Sensor table and read scheduler
+    *
+    * Every sensor in s_sensors is read once per cycle through dht_read_group(), which staggers
+    * the start pulses and captures all responses in parallel on their own RMT channels.
+    *
+    * Sensors that fail are re-read up to SENSOR_READ_RETRIES times, no sooner than the minimum
+    * interval their type allows between start pulses. Good samples then pass through the filter
+    * in filter.c; a failed or rejected cycle keeps the previous values and their timestamp and
+    * only clears reading_t.valid, so consumers see the age of the data rather than zeros.
+    *
+    * With power management enabled, a PM lock keeps the CPU and APB clocks at full speed, and the
+    * chip out of light sleep, for the duration of each group read and released between retries.
+*/
+
+#include <string.h>
+#include <sys/time.h>
+#include "sensors.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "dlog.h"
+#include "metrics.h"
+
+static const char *TAG = "sensors";
+
+// DHT capture backend: 1 = RMT edge capture, 0 = CPU polling
+#define SENSORS_USE_RMT 1
+
+// CPU polling flavour: 1 = edges timed by the cycle counter with interrupts masked, on the app core
+// (see dht_init_timed()), 0 = plain polling from whatever core the sampler runs on
+#define SENSORS_CPU_TIMED 1
+
+// 1 = serve every sensor from the virtual DHT in dht_sim.c, to run the firmware without hardware
+#define SENSORS_USE_SIM 0
+
+// Extra reads of a sensor that failed, within the same cycle
+#define SENSOR_READ_RETRIES 2
+
+// Filter used for sensors without their own; see filter_config_t
+static const filter_config_t s_default_filter = {
+    .median_window = 3,
+    .ema_alpha = 96,            // ~0.375: settles within a few samples
+    .temp_step = 20,            // 2°C, a DHT11 step plus noise
+    .temp_slew = 1,             // 0.1°C/s
+    .hum_step = 50,             // 5%
+    .hum_slew = 5,              // 0.5%/s
+    .max_rejects = 3,
+};
+
+// Attached sensors -- add one entry per DHT. The first entry is the primary
+// sensor and is also served on the legacy endpoints and topics.
+static const sensor_def_t s_sensors[] = {
+    { .name = "room", .pin = GPIO_NUM_18, .type = DHT_TYPE_DHT11 },
+};
+
+#if SENSORS_USE_SIM
+// Room-like values drifting over ten minutes, with a few of each fault the decoder and filter handle
+static const dht_sim_config_t s_sim_config = {
+    .temperature = 215,
+    .humidity = 450,
+    .temperature_swing = 20,
+    .humidity_swing = 80,
+    .period_s = 600,
+    .faults = {
+        .jitter_us = 12,
+        .no_response = 20,
+        .dropped_bit = 20,
+        .bad_checksum = 30,
+        .spike = 10,
+    },
+};
+#endif
+
+#define SENSOR_COUNT (sizeof(s_sensors) / sizeof(s_sensors[0]))
+
+_Static_assert(SENSOR_COUNT <= SENSOR_MAX, "too many sensors for the available RMT channels");
+
+// RTC memory so counters, filter state and reading sequence numbers carry over deep sleep
+static RTC_DATA_ATTR sensor_state_t s_state[SENSOR_COUNT];
+static RTC_DATA_ATTR reading_store_t s_latest[SENSOR_COUNT];
+
+#if CONFIG_PM_ENABLE
+// RMT capture and the polling decoder time pulses off APB/CPU clocks that DFS would slow down
+static esp_pm_lock_handle_t s_read_lock;
+#endif
+
+void sensors_init(void)
+{
+    gpio_config_t io_conf = {
+        .intr_type = GPIO_INTR_DISABLE,
+        .mode = GPIO_MODE_INPUT_OUTPUT_OD,
+        .pull_up_en = 1,
+        .pull_down_en = 0,
+    };
+
+#if CONFIG_PM_ENABLE
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "dht_read", &s_read_lock));
+#endif
+
+    for (size_t i = 0; i < SENSOR_COUNT; i++) {
+        io_conf.pin_bit_mask = (1ULL << s_sensors[i].pin);
+        gpio_config(&io_conf);
+        // Keep the pull-up through light sleep; losing it would look like a start pulse
+        gpio_sleep_sel_dis(s_sensors[i].pin);
+#if SENSORS_USE_SIM
+        ESP_ERROR_CHECK(dht_init_sim(s_sensors[i].pin, &s_sim_config));
+#elif SENSORS_USE_RMT
+        ESP_ERROR_CHECK(dht_init_rmt(s_sensors[i].pin, (rmt_channel_t)i));
+#elif SENSORS_CPU_TIMED
+        ESP_ERROR_CHECK(dht_init_timed(s_sensors[i].pin));
+#endif
+        ESP_LOGI(TAG, "Sensor '%s' on GPIO %d", s_sensors[i].name, s_sensors[i].pin);
+
+        // A reading carried over deep sleep has an esp_timer timestamp from before the wake,
+        // when the timer restarted at 0, so it would look fresh for the whole next cycle.
+        // Counters and filter state are kept; the reading has to be taken again.
+        s_state[i].last.have_value = false;
+        s_state[i].last.valid = false;
+        reading_store_publish(&s_latest[i], &s_state[i].last);
+    }
+}
+
+int sensors_task_core(void)
+{
+#if !SENSORS_USE_SIM && !SENSORS_USE_RMT && SENSORS_CPU_TIMED
+    // Masking interrupts on the protocol core would stall WiFi for the length of a response
+    return portNUM_PROCESSORS > 1 ? APP_CPU_NUM : PRO_CPU_NUM;
+#else
+    return tskNO_AFFINITY;
+#endif
+}
+
+size_t sensor_count(void)
+{
+    return SENSOR_COUNT;
+}
+
+const sensor_def_t *sensor_def(size_t idx)
+{
+    return idx < SENSOR_COUNT ? &s_sensors[idx] : NULL;
+}
+
+const sensor_state_t *sensor_state(size_t idx)
+{
+    return idx < SENSOR_COUNT ? &s_state[idx] : NULL;
+}
+
+bool sensor_latest(size_t idx, reading_t *out)
+{
+    if (idx >= SENSOR_COUNT) {
+        return false;
+    }
+    return reading_store_read(&s_latest[idx], out);
+}
+
+bool sensor_online(const reading_t *r)
+{
+    return r->have_value && esp_timer_get_time() - r->timestamp_us < (int64_t)SENSOR_STALE_MS * 1000;
+}
+
+// Shortest time between two start pulses to the same sensor
+static uint32_t min_interval_ms(dht_sensor_type_t type)
+{
+    return type == DHT_TYPE_DHT11 ? 1000 : 2000;
+}
+
+uint32_t sensors_min_interval_ms(void)
+{
+    uint32_t ms = 0;
+
+    for (size_t i = 0; i < SENSOR_COUNT; i++) {
+        if (min_interval_ms(s_sensors[i].type) > ms) {
+            ms = min_interval_ms(s_sensors[i].type);
+        }
+    }
+    return ms;
+}
+
+// Filter timing needs a clock that keeps running across deep sleep; esp_timer restarts
+static int64_t filter_clock_us(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// One group read, holding the PM lock only while the sensors are being captured
+static void read_group(dht_group_read_t *reads, size_t n)
+{
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_acquire(s_read_lock);
+#endif
+    dht_read_group(reads, n, SENSOR_STAGGER_MS);
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_release(s_read_lock);
+#endif
+}
+
+// Bit timing of every frame that got through all 40 bits, checksum failures included,
+// since those are the reads that show how close the timing came to the threshold
+static void record_timing(size_t i, const dht_read_stats_t *stats)
+{
+    const dht_decode_timing_t *t = &stats->timing;
+    sensor_state_t *st = &s_state[i];
+
+    if (t->bits < DHT_DATA_BITS) {
+        return;
+    }
+    st->bit_threshold_us = t->threshold_us;
+    st->bit_margin_us = t->margin_us;
+    st->bit_jitter_us = t->jitter_us;
+    if (st->timed_reads++ == 0 || t->margin_us < st->bit_margin_us_min) {
+        st->bit_margin_us_min = t->margin_us;
+    }
+    metrics_observe_us(METRIC_HIST_BIT_MARGIN, t->margin_us);
+    metrics_observe_us(METRIC_HIST_BIT_JITTER, t->jitter_us);
+}
+
+static void count_failure(size_t i, esp_err_t result)
+{
+    metrics_inc(result == ESP_ERR_INVALID_CRC ? METRIC_READ_CHECKSUM_FAILURES :
+                result == ESP_ERR_TIMEOUT ? METRIC_READ_TIMEOUT_FAILURES :
+                METRIC_READ_OTHER_FAILURES);
+    DLOG_RL(ESP_LOG_WARN, TAG, 10000, "Sensor '%s' read failed: %s",
+            DLOG_STR(s_sensors[i].name), DLOG_STR(esp_err_to_name(result)));
+}
+
+// Re-reads the sensors whose entry in reads failed, as one group per attempt
+static void retry_failed(dht_group_read_t *reads, int64_t t_start)
+{
+    for (int attempt = 0; attempt < SENSOR_READ_RETRIES; attempt++) {
+        dht_group_read_t retry[SENSOR_COUNT];
+        size_t which[SENSOR_COUNT];
+        size_t n = 0;
+        uint32_t wait_ms = 0;
+
+        for (size_t i = 0; i < SENSOR_COUNT; i++) {
+            if (reads[i].result != ESP_OK) {
+                which[n] = i;
+                retry[n] = reads[i];
+                n++;
+                if (min_interval_ms(reads[i].type) > wait_ms) {
+                    wait_ms = min_interval_ms(reads[i].type);
+                }
+            }
+        }
+        if (n == 0) {
+            return;
+        }
+
+        int64_t elapsed_ms = (esp_timer_get_time() - t_start) / 1000;
+        if (elapsed_ms < wait_ms) {
+            vTaskDelay(pdMS_TO_TICKS(wait_ms - elapsed_ms));
+        }
+        t_start = esp_timer_get_time();
+        read_group(retry, n);
+
+        for (size_t k = 0; k < n; k++) {
+            size_t i = which[k];
+            s_state[i].retries++;
+            metrics_inc(METRIC_READS);
+            reads[i] = retry[k];
+            record_timing(i, &retry[k].stats);
+            if (retry[k].result == ESP_OK) {
+                s_state[i].retry_successes++;
+            } else {
+                count_failure(i, retry[k].result);
+            }
+        }
+    }
+}
+
+uint32_t sensors_read_all(void)
+{
+    dht_group_read_t reads[SENSOR_COUNT];
+
+    for (size_t i = 0; i < SENSOR_COUNT; i++) {
+        memset(&reads[i], 0, sizeof(reads[i]));
+        reads[i].type = s_sensors[i].type;
+        reads[i].pin = s_sensors[i].pin;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    read_group(reads, SENSOR_COUNT);
+    int64_t now = esp_timer_get_time();
+    metrics_observe_us(METRIC_HIST_READ, (uint32_t)(now - t0));
+
+    for (size_t i = 0; i < SENSOR_COUNT; i++) {
+        metrics_inc(METRIC_READS);
+        s_state[i].cpu_us = reads[i].stats.cpu_us;
+        record_timing(i, &reads[i].stats);
+        if (reads[i].result != ESP_OK) {
+            count_failure(i, reads[i].result);
+        }
+    }
+    retry_failed(reads, t0);
+    now = esp_timer_get_time();
+    uint32_t wall_ms = (uint32_t)((now - t0) / 1000);
+    int64_t filter_us = filter_clock_us();
+
+    for (size_t i = 0; i < SENSOR_COUNT; i++) {
+        sensor_state_t *st = &s_state[i];
+        const filter_config_t *cfg = s_sensors[i].filter ? s_sensors[i].filter : &s_default_filter;
+        int16_t temp = reads[i].temperature;
+        int16_t hum = reads[i].humidity;
+        bool ok = reads[i].result == ESP_OK;
+
+        if (ok && filter_update(&st->filter, cfg, filter_us, &temp, &hum) == FILTER_REJECTED) {
+            DLOG_RL(ESP_LOG_WARN, TAG, 10000, "Sensor '%s' outlier rejected (raw T=%d H=%d, 0.1 units)",
+                    DLOG_STR(s_sensors[i].name), reads[i].temperature, reads[i].humidity);
+            metrics_inc(METRIC_READ_REJECTED);
+            ok = false;
+        }
+
+        // On failure keep the last good values with their timestamp
+        reading_t r = st->last;
+        r.valid = ok;
+        if (ok) {
+            r.have_value = true;
+            r.timestamp_us = now;
+            r.temperature = temp;
+            r.humidity = hum;
+        }
+
+        st->read_count++;
+        if (ok) {
+            st->success_count++;
+        } else {
+            st->fail_count++;
+        }
+
+        reading_store_publish(&s_latest[i], &r);
+        st->last = r;
+    }
+
+    DLOGI(TAG, "Read %u sensor(s) in %u ms", SENSOR_COUNT, wall_ms);
+    return wall_ms;
+}
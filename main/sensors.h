@@ -0,0 +1,108 @@
+#ifndef SENSORS_H
+#define SENSORS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "dht.h"
+#include "filter.h"
+#include "reading.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// One RMT RX channel per sensor, so at most 8 sensors on the ESP32.
+#define SENSOR_MAX 8
+// Offset between consecutive start pulses within one read cycle.
+#define SENSOR_STAGGER_MS 2
+// A sensor whose last good reading is older than this counts as offline.
+// The sampler backs off to at most half of it while readings are stable.
+#define SENSOR_STALE_MS 60000
+
+// Static description of one attached sensor
+typedef struct {
+    const char *name;           // Used in the HTTP path, MQTT topics and HA unique ids
+    gpio_num_t pin;
+    dht_sensor_type_t type;
+    const filter_config_t *filter;  // NULL = default filter in sensors.c
+} sensor_def_t;
+
+// Read statistics for one sensor, owned by the sampler task
+typedef struct {
+    reading_t last;             // Last reading published for this sensor
+    uint32_t read_count;
+    uint32_t success_count;
+    uint32_t fail_count;
+    uint32_t cpu_us;            // CPU time of the last read
+    uint32_t retries;           // Extra reads after a failure
+    uint32_t retry_successes;   // Retries that produced a good frame
+    uint32_t timed_reads;       // Frames with all 40 bits, the base of the bit timing below
+    uint16_t bit_threshold_us;  // High time separating 0 from 1 bits in the last such frame
+    uint16_t bit_margin_us;     // Closest any bit came to that threshold
+    uint16_t bit_margin_us_min; // Closest since power-on
+    uint16_t bit_jitter_us;     // Spread of the bit low times
+    filter_state_t filter;
+} sensor_state_t;
+
+/**
+ * @brief Configure the GPIO and RMT channel of every sensor in the table
+ */
+void sensors_init(void);
+
+/**
+ * @brief Core the task calling sensors_read_all() should be pinned to
+ *
+ * @return APP_CPU_NUM when the sensors are read with interrupts masked, otherwise tskNO_AFFINITY
+ */
+int sensors_task_core(void);
+
+/**
+ * @brief Number of sensors in the table
+ */
+size_t sensor_count(void);
+
+/**
+ * @brief Table entry for a sensor, or NULL if idx is out of range
+ */
+const sensor_def_t *sensor_def(size_t idx);
+
+/**
+ * @brief Sampler-side state for a sensor, or NULL if idx is out of range
+ *
+ * Only the task calling sensors_read_all() may use this; other tasks must
+ * use sensor_latest().
+ */
+const sensor_state_t *sensor_state(size_t idx);
+
+/**
+ * @brief Copy the latest reading of a sensor; safe from any task
+ *
+ * @return false if idx is out of range or no reading has been taken yet
+ */
+bool sensor_latest(size_t idx, reading_t *out);
+
+/**
+ * @brief Shortest period at which every sensor in the table may be read
+ */
+uint32_t sensors_min_interval_ms(void);
+
+/**
+ * @brief True if the reading holds values measured within SENSOR_STALE_MS
+ */
+bool sensor_online(const reading_t *r);
+
+/**
+ * @brief Read all sensors in one staggered, overlapped cycle
+ *
+ * Failed sensors are retried and good samples filtered before they are
+ * published.
+ *
+ * @return Wall time of the cycle including retries (in ms)
+ */
+uint32_t sensors_read_all(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SENSORS_H
@@ -0,0 +1,256 @@
+/*
+    * Device status and the status LED
+    *
+    * WiFi, MQTT and the sampler report changes through the status_set_*() and status_reading()
+    * calls, which store the new value and set a bit in an event group. The status task sleeps on
+    * that group, so it only runs when something happened, and keeps the state machine:
+    *
+    *     STARTING --(WiFi up, sensor online)--> NORMAL --(WiFi lost or sensor stale)--> ERROR
+    *
+    * ERROR is left again once both are back. The LED patterns run on esp_timer: a periodic timer
+    * toggles it while in ERROR, a one-shot timer ends the short blink after each good reading.
+    * Sensor staleness is a one-shot timer restarted by every good reading of the primary sensor.
+    * Nothing here polls, so no task wakes up unless an event or a blink is due.
+*/
+
+#include <stdatomic.h>
+#include "status.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "mem_plan.h"
+
+static const char *TAG = "status";
+
+#define LED_ERROR_TOGGLE_MS     75
+#define LED_DATA_BLINK_MS       100
+
+#define STATUS_EVT_WIFI         BIT0
+#define STATUS_EVT_MQTT         BIT1
+#define STATUS_EVT_READING      BIT2
+#define STATUS_EVT_STALE        BIT3
+#define STATUS_EVT_REPORT       BIT4
+#define STATUS_EVT_ALL          (STATUS_EVT_WIFI | STATUS_EVT_MQTT | STATUS_EVT_READING | \
+                                 STATUS_EVT_STALE | STATUS_EVT_REPORT)
+
+static const char *const s_state_names[] = {
+    [STATUS_STARTING] = "STARTING",
+    [STATUS_NORMAL]   = "NORMAL",
+    [STATUS_ERROR]    = "ERROR",
+};
+
+static const status_config_t *s_cfg;
+static EventGroupHandle_t s_events;
+static StaticEventGroup_t s_events_buf;
+static esp_timer_handle_t s_blink_timer;
+static esp_timer_handle_t s_pulse_timer;
+static esp_timer_handle_t s_stale_timer;
+static esp_timer_handle_t s_report_timer;
+
+static atomic_int s_state = STATUS_STARTING;
+static atomic_bool s_wifi_up;
+static atomic_bool s_mqtt_up;
+static atomic_bool s_sensor_online;
+static atomic_bool s_reading_primary_ok;    // Latest cycle's flags, consumed by the task
+static atomic_bool s_reading_any_ok;
+
+static void post(EventBits_t bits)
+{
+    if (s_events) {
+        xEventGroupSetBits(s_events, bits);
+    }
+}
+
+// Both LED callbacks run on the esp_timer task, so they never overlap each other
+static void blink_cb(void *arg)
+{
+    static bool on;
+
+    if (s_state != STATUS_ERROR) {
+        // Left ERROR since the last toggle: end with the LED off
+        on = false;
+        gpio_set_level(s_cfg->led_pin, 0);
+        esp_timer_stop(s_blink_timer);
+        return;
+    }
+    on = !on;
+    gpio_set_level(s_cfg->led_pin, on);
+}
+
+static void pulse_cb(void *arg)
+{
+    if (s_state != STATUS_ERROR) {
+        gpio_set_level(s_cfg->led_pin, 0);
+    }
+}
+
+static void stale_cb(void *arg)
+{
+    post(STATUS_EVT_STALE);
+}
+
+static void report_cb(void *arg)
+{
+    post(STATUS_EVT_REPORT);
+}
+
+static void restart_stale_timer(void)
+{
+    esp_timer_stop(s_stale_timer);
+    esp_timer_start_once(s_stale_timer, (uint64_t)s_cfg->stale_ms * 1000);
+}
+
+static void set_sensor_online(bool online)
+{
+    if (atomic_exchange(&s_sensor_online, online) == online) {
+        return;
+    }
+    ESP_LOGI(TAG, "=== SENSOR CONNECTIVITY CHANGED ===");
+    ESP_LOGI(TAG, "Sensor Status: %s", online ? "ONLINE" : "OFFLINE");
+    if (!online) {
+        ESP_LOGW(TAG, "Sensor appears to be offline - no valid data for %u ms", (unsigned)s_cfg->stale_ms);
+    }
+}
+
+static void enter_state(status_state_t state)
+{
+    status_state_t prev = atomic_exchange(&s_state, state);
+
+    if (prev == state) {
+        return;
+    }
+    ESP_LOGI(TAG, "Status changed: %s -> %s", s_state_names[prev], s_state_names[state]);
+    if (state == STATUS_ERROR) {
+        // Fails harmlessly if blink_cb has not stopped itself since the last ERROR
+        esp_timer_start_periodic(s_blink_timer, LED_ERROR_TOGGLE_MS * 1000);
+    }
+}
+
+static void status_task(void *arg)
+{
+    bool wifi_fault = false;
+    bool sensor_fault = false;
+
+    while (1) {
+        EventBits_t ev = xEventGroupWaitBits(s_events, STATUS_EVT_ALL, pdTRUE, pdFALSE, portMAX_DELAY);
+
+        if (ev & STATUS_EVT_WIFI) {
+            wifi_fault = !s_wifi_up;
+        }
+        if (ev & STATUS_EVT_MQTT) {
+            ESP_LOGI(TAG, "Broker: %s", s_mqtt_up ? "CONNECTED" : "DISCONNECTED");
+        }
+        // Before the reading: a good reading that raced with the timeout is the newer news
+        if (ev & STATUS_EVT_STALE) {
+            sensor_fault = true;
+            set_sensor_online(false);
+        }
+        bool blink = false;
+        if (ev & STATUS_EVT_READING) {
+            if (atomic_exchange(&s_reading_primary_ok, false)) {
+                restart_stale_timer();
+                sensor_fault = false;
+                set_sensor_online(true);
+            }
+            blink = atomic_exchange(&s_reading_any_ok, false);
+        }
+
+        if (wifi_fault || sensor_fault) {
+            enter_state(STATUS_ERROR);
+        } else if (s_wifi_up && s_sensor_online) {
+            enter_state(STATUS_NORMAL);
+        }
+
+        if (blink && s_wifi_up && s_state != STATUS_ERROR) {
+            gpio_set_level(s_cfg->led_pin, 1);
+            esp_timer_stop(s_pulse_timer);
+            esp_timer_start_once(s_pulse_timer, LED_DATA_BLINK_MS * 1000);
+        }
+
+        if ((ev & STATUS_EVT_REPORT) && s_cfg->on_report) {
+            s_cfg->on_report();
+        }
+    }
+}
+
+esp_err_t status_init(const status_config_t *config)
+{
+    gpio_config_t io_conf = {
+        .intr_type = GPIO_INTR_DISABLE,
+        .mode = GPIO_MODE_OUTPUT,
+        .pin_bit_mask = (1ULL << config->led_pin),
+        .pull_down_en = 0,
+        .pull_up_en = 0,
+    };
+    const struct {
+        esp_timer_cb_t cb;
+        const char *name;
+        esp_timer_handle_t *handle;
+    } timers[] = {
+        { blink_cb, "led_blink", &s_blink_timer },
+        { pulse_cb, "led_pulse", &s_pulse_timer },
+        { stale_cb, "sensor_stale", &s_stale_timer },
+        { report_cb, "status_report", &s_report_timer },
+    };
+
+    s_cfg = config;
+    ESP_ERROR_CHECK(gpio_config(&io_conf));
+    // Keep driving the LED through automatic light sleep
+    gpio_sleep_sel_dis(config->led_pin);
+    gpio_set_level(config->led_pin, 0);
+
+    for (size_t i = 0; i < sizeof(timers) / sizeof(timers[0]); i++) {
+        const esp_timer_create_args_t args = {
+            .callback = timers[i].cb,
+            .name = timers[i].name,
+        };
+        esp_err_t err = esp_timer_create(&args, timers[i].handle);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    s_events = xEventGroupCreateStatic(&s_events_buf);
+    MEM_PLAN_TASK(status_task, "status_task", STACK_STATUS_TASK, NULL, 3);
+
+    // A sensor that never answers goes offline after stale_ms as well
+    restart_stale_timer();
+    if (config->report_ms) {
+        esp_timer_start_periodic(s_report_timer, (uint64_t)config->report_ms * 1000);
+    }
+    return ESP_OK;
+}
+
+void status_set_wifi(bool connected)
+{
+    s_wifi_up = connected;
+    post(STATUS_EVT_WIFI);
+}
+
+void status_set_mqtt(bool connected)
+{
+    s_mqtt_up = connected;
+    post(STATUS_EVT_MQTT);
+}
+
+void status_reading(bool primary_ok, bool any_ok)
+{
+    if (primary_ok) {
+        s_reading_primary_ok = true;
+    }
+    if (any_ok) {
+        s_reading_any_ok = true;
+    }
+    post(STATUS_EVT_READING);
+}
+
+status_state_t status_state(void)
+{
+    return atomic_load(&s_state);
+}
+
+bool status_sensor_online(void)
+{
+    return s_sensor_online;
+}
@@ -0,0 +1,64 @@
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    STATUS_STARTING,                // No fault seen yet; LED off, blinks once per reading
+    STATUS_NORMAL,                  // WiFi up and the primary sensor online
+    STATUS_ERROR,                   // WiFi lost or the primary sensor offline; LED blinks fast
+} status_state_t;
+
+typedef struct {
+    gpio_num_t led_pin;
+    uint32_t stale_ms;              // Primary sensor is offline after this long without a good reading
+    uint32_t report_ms;             // Period of on_report, 0 = never
+    // Called on the status task every report_ms, for the periodic status log
+    void (*on_report)(void);
+} status_config_t;
+
+/**
+ * @brief Configure the LED and start the status task and its timers
+ *
+ * Call before WiFi is started; events posted earlier are ignored. The
+ * configuration must outlive the module.
+ */
+esp_err_t status_init(const status_config_t *config);
+
+/**
+ * @brief WiFi gained or lost its IP address
+ */
+void status_set_wifi(bool connected);
+
+/**
+ * @brief Broker session started or lost
+ */
+void status_set_mqtt(bool connected);
+
+/**
+ * @brief A sample cycle finished
+ *
+ * @param primary_ok The primary sensor returned a good reading; restarts the offline timeout
+ * @param any_ok     At least one sensor did; the LED blinks once if nothing is wrong
+ */
+void status_reading(bool primary_ok, bool any_ok);
+
+status_state_t status_state(void);
+
+/**
+ * @brief The primary sensor returned a good reading within stale_ms
+ */
+bool status_sensor_online(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STATUS_H
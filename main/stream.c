@@ -0,0 +1,290 @@
+/*
+    * Server-Sent Events stream of live readings
+    *
+    * The sampler renders every new reading once into a small shared ring and queues a flush on
+    * the httpd task. Each client only keeps a cursor into the ring, so its queue is bounded by
+    * construction: a client that is more than STREAM_CLIENT_QUEUE events behind, or whose socket
+    * errors, is disconnected instead of being waited for. Sends are non-blocking, so one stuck
+    * browser costs at most a partial write per flush.
+    *
+    * Client slots are only touched on the httpd task (handler, flush work and session close), so
+    * they need no lock; the ring is shared with the sampler and guarded by a mutex.
+    *
+    * A long handler such as POST /ota holds the httpd task, so no flush can run until it returns.
+    * It brackets itself with stream_pause() and stream_resume(): events are still stored while
+    * paused, and on resume clients that fell behind meanwhile skip ahead to the latest readings
+    * instead of being dropped as too slow.
+*/
+
+#include <stdatomic.h>
+#include <string.h>
+#include "stream.h"
+#include "dlog.h"
+#include "json_writer.h"
+#include "metrics.h"
+#include "sensors.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "stream";
+
+#define STREAM_RING             8       // Events kept for clients that are behind
+#define STREAM_CLIENT_QUEUE     4       // Events a client may lag before it is dropped
+#define STREAM_EVENT_MAX        128
+
+_Static_assert(STREAM_CLIENT_QUEUE < STREAM_RING, "client queue must fit in the event ring");
+
+typedef struct {
+    uint32_t seq;
+    int64_t t_us;                       // When stream_push() stored it
+    uint16_t len;
+    char data[STREAM_EVENT_MAX];
+} event_t;
+
+typedef struct {
+    int fd;                             // -1 = free slot
+    uint32_t next_seq;                  // Next event to send
+    uint16_t offset;                    // Bytes of next_seq already written
+    bool closing;                       // Dropped; the slot is freed when the session closes
+} client_t;
+
+static const char EVENT_PREFIX[] = "event: reading\ndata: ";
+
+static const char STREAM_HEADERS[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "\r\n"
+    "retry: 3000\n\n";
+
+static httpd_handle_t s_server;
+static SemaphoreHandle_t s_lock;
+static StaticSemaphore_t s_lock_buf;
+static event_t s_ring[STREAM_RING];
+static uint32_t s_head;                 // Sequence number of the next event
+static client_t s_clients[STREAM_MAX_CLIENTS] = {
+    [0 ... STREAM_MAX_CLIENTS - 1] = { .fd = -1 },
+};
+static atomic_bool s_flush_queued;
+static atomic_bool s_paused;
+static atomic_uint s_client_count;
+static atomic_uint s_sent;
+static atomic_uint s_dropped;
+static atomic_uint s_skipped;
+static atomic_uint s_latency_us_max;
+
+void stream_init(httpd_handle_t server)
+{
+    s_server = server;
+    s_lock = xSemaphoreCreateMutexStatic(&s_lock_buf);
+}
+
+// First event of the latest one per sensor that is still in the ring; the lock must be held
+static uint32_t latest_seq(void)
+{
+    uint32_t backlog = sensor_count() < STREAM_CLIENT_QUEUE ? sensor_count() : STREAM_CLIENT_QUEUE;
+
+    return s_head > backlog ? s_head - backlog : 0;
+}
+
+static void drop_client(client_t *c, const char *why)
+{
+    ESP_LOGW(TAG, "Dropping stream client %d: %s", c->fd, why);
+    s_dropped++;
+    // The slot is released by client_free() once the session is really closed
+    c->closing = true;
+    httpd_sess_trigger_close(s_server, c->fd);
+}
+
+// Writes as much of the client's backlog as the socket takes without blocking
+static void flush_client(client_t *c)
+{
+    static event_t ev;                  // Only used on the httpd task
+
+    while (c->fd >= 0 && !c->closing) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        uint32_t head = s_head;
+        bool behind = head - c->next_seq > STREAM_CLIENT_QUEUE;
+        if (!behind && c->next_seq != head) {
+            ev = s_ring[c->next_seq % STREAM_RING];
+        }
+        xSemaphoreGive(s_lock);
+
+        if (behind) {
+            drop_client(c, "too slow");
+            return;
+        }
+        if (c->next_seq == head) {
+            return;
+        }
+
+        int ret = httpd_socket_send(s_server, c->fd, ev.data + c->offset, ev.len - c->offset, MSG_DONTWAIT);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            return;                     // Socket buffer full; retried on the next push
+        }
+        if (ret < 0) {
+            drop_client(c, "send failed");
+            return;
+        }
+        c->offset += ret;
+        if (c->offset < ev.len) {
+            return;
+        }
+
+        c->offset = 0;
+        c->next_seq++;
+        s_sent++;
+        uint32_t latency = (uint32_t)(esp_timer_get_time() - ev.t_us);
+        metrics_observe_us(METRIC_HIST_STREAM, latency);
+        if (latency > s_latency_us_max) {
+            s_latency_us_max = latency;
+        }
+    }
+}
+
+static void flush_work(void *arg)
+{
+    s_flush_queued = false;
+    for (size_t i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        flush_client(&s_clients[i]);
+    }
+}
+
+static void queue_flush(void)
+{
+    if (!atomic_exchange(&s_flush_queued, true) && httpd_queue_work(s_server, flush_work, NULL) != ESP_OK) {
+        s_flush_queued = false;
+    }
+}
+
+// Session context destructor: runs on the httpd task when the stream socket closes
+static void client_free(void *ctx)
+{
+    client_t *c = ctx;
+
+    c->fd = -1;
+    s_client_count--;
+}
+
+esp_err_t stream_handler(httpd_req_t *req)
+{
+    client_t *c = NULL;
+
+    if (s_lock == NULL) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "stream not initialised");
+    }
+    for (size_t i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        if (s_clients[i].fd < 0) {
+            c = &s_clients[i];
+            break;
+        }
+    }
+    if (c == NULL) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "10");
+        return httpd_resp_sendstr(req, "Too many stream clients");
+    }
+
+    // Headers are written by hand: the response stays open after the handler returns
+    if (httpd_send(req, STREAM_HEADERS, sizeof(STREAM_HEADERS) - 1) < 0) {
+        return ESP_FAIL;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    c->next_seq = latest_seq();
+    xSemaphoreGive(s_lock);
+
+    c->fd = httpd_req_to_sockfd(req);
+    c->offset = 0;
+    c->closing = false;
+    req->sess_ctx = c;
+    req->free_ctx = client_free;
+    s_client_count++;
+    ESP_LOGI(TAG, "Stream client %d subscribed (%u open)", c->fd, (unsigned)s_client_count);
+
+    flush_client(c);
+    return ESP_OK;
+}
+
+void stream_push(size_t sensor, const reading_t *reading)
+{
+    json_writer_t w;
+    event_t *ev;
+
+    if (s_lock == NULL || !reading->valid) {
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    ev = &s_ring[s_head % STREAM_RING];
+    const size_t prefix = sizeof(EVENT_PREFIX) - 1;
+    memcpy(ev->data, EVENT_PREFIX, prefix);
+    json_init(&w, ev->data + prefix, sizeof(ev->data) - prefix - 2);
+    json_obj_open(&w, NULL);
+    json_str(&w, "sensor", sensor_def(sensor)->name);
+    json_uint(&w, "seq", reading->seq);
+    json_tenths(&w, "temperature", reading->temperature);
+    json_tenths(&w, "humidity", reading->humidity);
+    json_obj_close(&w);
+    if (w.overflow) {
+        // Leave the slot to be overwritten; a cut-off event would break the client's parser
+        xSemaphoreGive(s_lock);
+        DLOG_RL(ESP_LOG_ERROR, TAG, 10000, "Stream event does not fit in %u bytes", (unsigned)sizeof(ev->data));
+        return;
+    }
+    memcpy(ev->data + prefix + w.len, "\n\n", 2);
+    ev->len = prefix + w.len + 2;
+    ev->seq = s_head;
+    ev->t_us = esp_timer_get_time();
+    s_head++;
+    xSemaphoreGive(s_lock);
+
+    // Events are kept even without subscribers so a new client starts with the latest readings
+    if (s_client_count == 0 || s_paused) {
+        return;
+    }
+    queue_flush();
+}
+
+void stream_pause(void)
+{
+    s_paused = true;
+}
+
+void stream_resume(void)
+{
+    if (s_lock == NULL || !atomic_exchange(&s_paused, false)) {
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t head = s_head;
+    uint32_t latest = latest_seq();
+    for (size_t i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        client_t *c = &s_clients[i];
+        // A client half way through an event cannot skip without breaking its parser
+        if (c->fd >= 0 && !c->closing && c->offset == 0 && head - c->next_seq > STREAM_CLIENT_QUEUE) {
+            c->next_seq = latest;
+            s_skipped++;
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    if (s_client_count > 0) {
+        queue_flush();
+    }
+}
+
+void stream_get_stats(stream_stats_t *stats)
+{
+    stats->clients = s_client_count;
+    stats->events = s_head;
+    stats->sent = s_sent;
+    stats->dropped_clients = s_dropped;
+    stats->skipped_clients = s_skipped;
+    stats->latency_us_max = atomic_exchange(&s_latency_us_max, 0);
+}
@@ -0,0 +1,66 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "reading.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Concurrent /stream subscribers; each one holds an httpd socket for as long as it is open
+#define STREAM_MAX_CLIENTS      8
+
+typedef struct {
+    uint32_t clients;           // Currently subscribed
+    uint32_t events;            // Readings pushed into the stream since boot
+    uint32_t sent;              // Event deliveries to clients
+    uint32_t dropped_clients;   // Disconnected for falling too far behind
+    uint32_t skipped_clients;   // Moved ahead to the latest readings by stream_resume()
+    uint32_t latency_us_max;    // Worst time from stream_push() to the socket, since last call
+} stream_stats_t;
+
+/**
+ * @brief Remember the server that /stream is registered on
+ */
+void stream_init(httpd_handle_t server);
+
+/**
+ * @brief GET /stream: turns the connection into a Server-Sent Events stream
+ */
+esp_err_t stream_handler(httpd_req_t *req);
+
+/**
+ * @brief Fan a new reading out to all subscribers
+ *
+ * Never blocks on clients: the event is stored in a shared ring and the
+ * sends run as queued work on the httpd task.
+ */
+void stream_push(size_t sensor, const reading_t *reading);
+
+/**
+ * @brief Stop queueing flushes while a long handler holds the httpd task
+ *
+ * Readings are still stored. Call on the httpd task, paired with stream_resume().
+ */
+void stream_pause(void);
+
+/**
+ * @brief Flush again after stream_pause()
+ *
+ * Clients that fell more than a few events behind while paused continue from
+ * the latest reading of each sensor, as a new subscriber would, instead of
+ * being dropped. Call on the httpd task.
+ */
+void stream_resume(void);
+
+void stream_get_stats(stream_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STREAM_H
@@ -0,0 +1,421 @@
+/*
+    * Flash-backed write-ahead log of readings taken while offline
+    *
+    * The "wal" data partition is split into 4KB segments. Each segment starts with a header slot
+    * (magic, generation, erase count) followed by 16-byte records. Segments are filled in ring
+    * order, so every segment is erased once per pass and wear is spread evenly; a segment is only
+    * erased right before it is reused.
+    *
+    * Records are only ever programmed 1 -> 0: the body is written with the state byte left erased,
+    * the state is then set to VALID to commit it, and cleared further to REPLAYED once the
+    * reading has reached the broker. A record whose body was written but never committed (power
+    * loss) is skipped.
+*/
+
+#include <string.h>
+#include "wal.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "wal";
+
+#define WAL_MAGIC               0x314C4157  // "WAL1"
+#define WAL_SEGMENT_SIZE        4096
+#define WAL_RECORD_SIZE         16
+#define WAL_RECORDS_PER_SEGMENT (WAL_SEGMENT_SIZE / WAL_RECORD_SIZE - 1)
+#define WAL_MAX_SEGMENTS        64
+#define WAL_PEEK_MAX            32
+
+#define REC_FREE                0xFF
+#define REC_VALID               0xFE
+#define REC_REPLAYED            0xFC
+
+typedef struct {
+    uint32_t magic;
+    uint32_t gen;               // Incremented every time a segment is started
+    uint32_t erase_count;
+    uint32_t reserved;
+} seg_hdr_t;
+
+typedef struct {
+    uint16_t boot;
+    uint8_t sensor;
+    uint8_t state;              // REC_*, programmed after the rest of the record
+    uint32_t uptime_ms;
+    uint32_t seq;
+    int16_t temperature;
+    int16_t humidity;
+} rec_t;
+
+_Static_assert(sizeof(seg_hdr_t) == WAL_RECORD_SIZE, "segment header must fill one slot");
+_Static_assert(sizeof(rec_t) == WAL_RECORD_SIZE, "record size mismatch");
+
+typedef struct {
+    uint32_t seg;
+    uint32_t slot;
+} wal_pos_t;
+
+static const esp_partition_t *s_part;
+static SemaphoreHandle_t s_lock;
+static StaticSemaphore_t s_lock_buf;
+static uint32_t s_segments;
+static uint32_t s_erase_count[WAL_MAX_SEGMENTS];
+static bool s_formatted[WAL_MAX_SEGMENTS];
+static uint32_t s_seg_gen[WAL_MAX_SEGMENTS];    // Header generation, changes when the segment is reused
+static uint32_t s_head_gen;
+static wal_pos_t s_head;        // Next free slot
+static wal_pos_t s_tail;        // Oldest slot that may still hold a VALID record
+static uint16_t s_boot;
+static wal_stats_t s_stats;
+
+static size_t rec_offset(wal_pos_t pos)
+{
+    return (size_t)pos.seg * WAL_SEGMENT_SIZE + (size_t)(pos.slot + 1) * WAL_RECORD_SIZE;
+}
+
+static bool rec_is_free(const rec_t *r)
+{
+    static const uint8_t erased[WAL_RECORD_SIZE] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    };
+    return memcmp(r, erased, sizeof(*r)) == 0;
+}
+
+static bool pos_equal(wal_pos_t a, wal_pos_t b)
+{
+    return a.seg == b.seg && a.slot == b.slot;
+}
+
+static wal_pos_t pos_next(wal_pos_t pos)
+{
+    if (++pos.slot == WAL_RECORDS_PER_SEGMENT) {
+        pos.seg = (pos.seg + 1) % s_segments;
+        pos.slot = 0;
+    }
+    return pos;
+}
+
+static esp_err_t start_segment(uint32_t seg)
+{
+    esp_err_t err = esp_partition_erase_range(s_part, (size_t)seg * WAL_SEGMENT_SIZE, WAL_SEGMENT_SIZE);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Erasing segment %u failed: %s", seg, esp_err_to_name(err));
+        return err;
+    }
+
+    seg_hdr_t hdr = {
+        .magic = WAL_MAGIC,
+        .gen = ++s_head_gen,
+        .erase_count = ++s_erase_count[seg],
+        .reserved = 0xFFFFFFFF,
+    };
+    err = esp_partition_write(s_part, (size_t)seg * WAL_SEGMENT_SIZE, &hdr, sizeof(hdr));
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    s_formatted[seg] = true;
+    s_seg_gen[seg] = hdr.gen;
+    if (s_erase_count[seg] > s_stats.max_erase_count) {
+        s_stats.max_erase_count = s_erase_count[seg];
+    }
+    s_head = (wal_pos_t){ .seg = seg, .slot = 0 };
+    return ESP_OK;
+}
+
+// Count VALID records from pos to the end of its segment
+static uint32_t count_valid(wal_pos_t pos)
+{
+    uint32_t valid = 0;
+    rec_t r;
+
+    for (; pos.slot < WAL_RECORDS_PER_SEGMENT; pos.slot++) {
+        if (esp_partition_read(s_part, rec_offset(pos), &r, sizeof(r)) != ESP_OK) {
+            break;
+        }
+        if (rec_is_free(&r)) {
+            break;
+        }
+        if (r.state == REC_VALID) {
+            valid++;
+        }
+    }
+    return valid;
+}
+
+// Move the head into the next segment, dropping whatever it still holds.
+static esp_err_t rotate(void)
+{
+    uint32_t next = (s_head.seg + 1) % s_segments;
+
+    if (s_tail.seg == next && s_formatted[next]) {
+        uint32_t lost = count_valid(s_tail);
+        s_stats.dropped += lost;
+        s_stats.pending -= lost;
+        s_tail = (wal_pos_t){ .seg = (next + 1) % s_segments, .slot = 0 };
+        if (lost) {
+            ESP_LOGW(TAG, "Log full, dropped %u unreplayed readings", lost);
+        }
+    }
+
+    esp_err_t err = start_segment(next);
+    if (err == ESP_OK && s_stats.pending == 0) {
+        s_tail = s_head;
+    }
+    return err;
+}
+
+static void load_boot_counter(void)
+{
+    nvs_handle_t nvs;
+    uint32_t boot = 0;
+
+    if (nvs_open("wal", NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    nvs_get_u32(nvs, "boot", &boot);
+    boot++;
+    nvs_set_u32(nvs, "boot", boot);
+    nvs_commit(nvs);
+    nvs_close(nvs);
+    s_boot = (uint16_t)boot;
+}
+
+esp_err_t wal_init(void)
+{
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, WAL_PARTITION_SUBTYPE, WAL_PARTITION_LABEL);
+    if (s_part == NULL) {
+        ESP_LOGW(TAG, "No '%s' partition, offline readings will not be kept", WAL_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    s_lock = xSemaphoreCreateMutexStatic(&s_lock_buf);
+    s_segments = s_part->size / WAL_SEGMENT_SIZE;
+    if (s_segments > WAL_MAX_SEGMENTS) {
+        s_segments = WAL_MAX_SEGMENTS;
+    }
+    if (s_segments < 2) {
+        ESP_LOGE(TAG, "Partition too small");
+        s_part = NULL;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    s_stats.segments = s_segments;
+    load_boot_counter();
+
+    // Find the newest segment; its first free slot is the write head.
+    bool any = false;
+    for (uint32_t seg = 0; seg < s_segments; seg++) {
+        seg_hdr_t hdr;
+        esp_partition_read(s_part, (size_t)seg * WAL_SEGMENT_SIZE, &hdr, sizeof(hdr));
+        s_formatted[seg] = hdr.magic == WAL_MAGIC;
+        if (!s_formatted[seg]) {
+            continue;
+        }
+        s_erase_count[seg] = hdr.erase_count;
+        s_seg_gen[seg] = hdr.gen;
+        if (hdr.erase_count > s_stats.max_erase_count) {
+            s_stats.max_erase_count = hdr.erase_count;
+        }
+        if (!any || hdr.gen > s_head_gen) {
+            s_head_gen = hdr.gen;
+            s_head.seg = seg;
+            any = true;
+        }
+    }
+
+    if (!any) {
+        ESP_LOGI(TAG, "Formatting log (%u segments)", s_segments);
+        esp_err_t err = start_segment(0);
+        s_tail = s_head;
+        return err;
+    }
+
+    rec_t r;
+    for (s_head.slot = 0; s_head.slot < WAL_RECORDS_PER_SEGMENT; s_head.slot++) {
+        esp_partition_read(s_part, rec_offset(s_head), &r, sizeof(r));
+        if (rec_is_free(&r)) {
+            break;
+        }
+    }
+
+    // Walk the ring from the oldest segment (the one after the head) to find
+    // the first unreplayed record and count the backlog.
+    bool have_tail = false;
+    for (uint32_t i = 1; i <= s_segments; i++) {
+        uint32_t seg = (s_head.seg + i) % s_segments;
+        if (!s_formatted[seg]) {
+            continue;
+        }
+        for (uint32_t slot = 0; slot < WAL_RECORDS_PER_SEGMENT; slot++) {
+            wal_pos_t pos = { .seg = seg, .slot = slot };
+            if (seg == s_head.seg && slot >= s_head.slot) {
+                break;
+            }
+            esp_partition_read(s_part, rec_offset(pos), &r, sizeof(r));
+            if (rec_is_free(&r)) {
+                break;
+            }
+            if (r.state == REC_VALID) {
+                if (!have_tail) {
+                    s_tail = pos;
+                    have_tail = true;
+                }
+                s_stats.pending++;
+            }
+        }
+    }
+    if (!have_tail) {
+        s_tail = s_head;
+    }
+
+    ESP_LOGI(TAG, "Log mounted: boot %u, %u readings pending, head %u/%u",
+             s_boot, s_stats.pending, s_head.seg, s_head.slot);
+    return ESP_OK;
+}
+
+esp_err_t wal_append(uint8_t sensor, const reading_t *reading)
+{
+    if (s_part == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!reading->valid) {
+        return ESP_OK;
+    }
+
+    rec_t r = {
+        .boot = s_boot,
+        .sensor = sensor,
+        .state = REC_FREE,
+        .uptime_ms = (uint32_t)(reading->timestamp_us / 1000),
+        .seq = reading->seq,
+        .temperature = reading->temperature,
+        .humidity = reading->humidity,
+    };
+    uint8_t state = REC_VALID;
+    esp_err_t err = ESP_OK;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    if (s_head.slot == WAL_RECORDS_PER_SEGMENT) {
+        err = rotate();
+    }
+    if (err == ESP_OK) {
+        size_t off = rec_offset(s_head);
+        err = esp_partition_write(s_part, off, &r, sizeof(r));
+        if (err == ESP_OK) {
+            err = esp_partition_write(s_part, off + offsetof(rec_t, state), &state, sizeof(state));
+        }
+        // Even a failed write has used the slot.
+        s_head.slot++;
+    }
+    if (err == ESP_OK) {
+        s_stats.pending++;
+        s_stats.appended++;
+    }
+
+    xSemaphoreGive(s_lock);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Append failed: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+size_t wal_peek(wal_entry_t *out, size_t max)
+{
+    size_t n = 0;
+    rec_t r;
+
+    if (s_part == NULL) {
+        return 0;
+    }
+    if (max > WAL_PEEK_MAX) {
+        max = WAL_PEEK_MAX;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    for (wal_pos_t pos = s_tail; n < max && !pos_equal(pos, s_head); pos = pos_next(pos)) {
+        if (esp_partition_read(s_part, rec_offset(pos), &r, sizeof(r)) != ESP_OK) {
+            break;
+        }
+        if (rec_is_free(&r)) {
+            // Unused tail of a segment that was rotated early.
+            continue;
+        }
+        if (r.state != REC_VALID) {
+            // Already replayed or never committed; move the tail past it.
+            if (n == 0) {
+                s_tail = pos_next(pos);
+            }
+            continue;
+        }
+        out[n] = (wal_entry_t){
+            .ref = { .gen = s_seg_gen[pos.seg], .seg = (uint16_t)pos.seg, .slot = (uint16_t)pos.slot },
+            .boot = r.boot,
+            .sensor = r.sensor,
+            .uptime_ms = r.uptime_ms,
+            .seq = r.seq,
+            .temperature = r.temperature,
+            .humidity = r.humidity,
+        };
+        n++;
+    }
+
+    xSemaphoreGive(s_lock);
+    return n;
+}
+
+esp_err_t wal_consume(const wal_ref_t *refs, size_t count)
+{
+    uint8_t state = REC_REPLAYED;
+    esp_err_t err = ESP_OK;
+    rec_t r;
+
+    if (s_part == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    for (size_t i = 0; i < count && err == ESP_OK; i++) {
+        wal_pos_t pos = { .seg = refs[i].seg, .slot = refs[i].slot };
+        // The segment may have been reused by rotate() since the peek; its records were
+        // counted as dropped then.
+        if (pos.seg >= s_segments || pos.slot >= WAL_RECORDS_PER_SEGMENT || s_seg_gen[pos.seg] != refs[i].gen) {
+            continue;
+        }
+        // Consumed before (a repeated acknowledgement) or never committed
+        err = esp_partition_read(s_part, rec_offset(pos), &r, sizeof(r));
+        if (err != ESP_OK || r.state != REC_VALID) {
+            continue;
+        }
+        err = esp_partition_write(s_part, rec_offset(pos) + offsetof(rec_t, state), &state, sizeof(state));
+        if (err == ESP_OK) {
+            s_stats.pending--;
+            s_stats.replayed++;
+        }
+    }
+    // Replayed records at the tail are skipped by the next wal_peek()
+    if (s_stats.pending == 0) {
+        s_tail = s_head;
+    }
+
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+void wal_get_stats(wal_stats_t *stats)
+{
+    if (s_lock) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+    }
+    *stats = s_stats;
+    if (s_lock) {
+        xSemaphoreGive(s_lock);
+    }
+}
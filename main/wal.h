@@ -0,0 +1,88 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "reading.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Data partition subtype of the "wal" partition in partitions.csv
+#define WAL_PARTITION_SUBTYPE   0x40
+#define WAL_PARTITION_LABEL     "wal"
+
+// Where a peeked record is stored; it goes stale once its segment is reused
+typedef struct {
+    uint32_t gen;               // Generation of the segment at the time of the peek
+    uint16_t seg;
+    uint16_t slot;
+} wal_ref_t;
+
+// One logged reading as returned by wal_peek()
+typedef struct {
+    wal_ref_t ref;              // For wal_consume()
+    uint16_t boot;              // Boot counter when the reading was taken
+    uint8_t sensor;
+    uint32_t uptime_ms;         // Milliseconds since that boot
+    uint32_t seq;               // Reading sequence number
+    int16_t temperature;        // in 0.1°C
+    int16_t humidity;           // in 0.1%
+} wal_entry_t;
+
+typedef struct {
+    uint32_t pending;           // Logged but not yet replayed
+    uint32_t appended;          // Since boot
+    uint32_t replayed;          // Since boot
+    uint32_t dropped;           // Overwritten before replay, since boot
+    uint32_t segments;
+    uint32_t max_erase_count;   // Highest erase count of any segment
+} wal_stats_t;
+
+/**
+ * @brief Mount the write-ahead log partition and recover its state
+ *
+ * Scans all segments to find the write head and the oldest record that
+ * has not been replayed. Also bumps the boot counter stored in NVS.
+ *
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if there is no wal partition
+ */
+esp_err_t wal_init(void);
+
+/**
+ * @brief Append a valid reading taken while offline
+ *
+ * When the log is full the oldest segment is erased and its unreplayed
+ * records are dropped.
+ */
+esp_err_t wal_append(uint8_t sensor, const reading_t *reading);
+
+/**
+ * @brief Copy up to max of the oldest unreplayed records, oldest first
+ *
+ * @return Number of entries written to out
+ */
+size_t wal_peek(wal_entry_t *out, size_t max);
+
+/**
+ * @brief Mark records returned by wal_peek() as replayed
+ *
+ * May be called any time after the peek, e.g. once the broker has acknowledged
+ * the records. References to records that were dropped since (their segment was
+ * reused) or that are already marked replayed are skipped.
+ */
+esp_err_t wal_consume(const wal_ref_t *refs, size_t count);
+
+/**
+ * @brief Current log statistics
+ */
+void wal_get_stats(wal_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WAL_H
@@ -0,0 +1,353 @@
+/*
+    * Station network selection
+    *
+    * The network that last produced an IP address is cached in NVS with its BSSID and channel, so
+    * the next boot associates directly without scanning. If that fails, one scan ranks the access
+    * points of every configured network by RSSI and they are tried best first. The fallback
+    * hotspot is only brought up after WIFI_SCAN_ROUNDS full rounds fail, and from then on a rescan
+    * runs every WIFI_AP_RESCAN_MS until a network is back.
+    *
+    * All state changes run on the default event loop task: the entry points are called from the
+    * application's WiFi/IP event handler, and the rescan timer only posts WIFI_SELECT_EVENT to the
+    * same loop. So the state needs no locking.
+*/
+
+#include <string.h>
+#include "wifi_select.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "nvs.h"
+
+static const char *TAG = "wifi_select";
+
+ESP_EVENT_DEFINE_BASE(WIFI_SELECT_EVENT);
+
+enum {
+    WIFI_SELECT_EVENT_RESCAN,
+};
+
+#define WIFI_CACHED_ATTEMPTS    2       // Direct connects to the cached AP before scanning
+#define WIFI_SCAN_ROUNDS        2       // Failed scan rounds before starting the hotspot
+#define WIFI_MAX_CANDIDATES     8
+#define WIFI_MAX_SCAN_RECORDS   20
+#define WIFI_AP_RESCAN_MS       60000
+
+#define NVS_NAMESPACE           "wifi"
+#define NVS_KEY_LAST            "last"
+
+typedef enum {
+    SEL_IDLE,
+    SEL_CACHED,
+    SEL_SCANNING,
+    SEL_CANDIDATES,
+    SEL_CONNECTED,
+} sel_state_t;
+
+// Last network that produced an IP, as stored in NVS
+typedef struct {
+    char ssid[33];
+    uint8_t bssid[6];
+    uint8_t channel;
+} cached_ap_t;
+
+typedef struct {
+    uint8_t network;                // Index into the configured networks
+    uint8_t bssid[6];
+    uint8_t channel;
+    int8_t rssi;
+} candidate_t;
+
+static const wifi_select_config_t *s_cfg;
+static sel_state_t s_state;
+static cached_ap_t s_cache;
+static bool s_cache_valid;
+static uint8_t s_cached_network;
+static int s_cached_failures;
+static candidate_t s_candidates[WIFI_MAX_CANDIDATES];
+static size_t s_candidate_count;
+static size_t s_candidate_next;
+static int s_failed_rounds;
+static bool s_ap_active;
+static esp_timer_handle_t s_rescan_timer;
+static int64_t s_attempt_start_us;
+static wifi_select_info_t s_info;
+static wifi_select_via_t s_attempt_via;
+static uint8_t s_attempt_network;
+
+static int find_network(const char *ssid)
+{
+    for (size_t i = 0; i < s_cfg->network_count; i++) {
+        const char *name = s_cfg->networks[i].ssid;
+        if (name && name[0] && strcmp(name, ssid) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static void connect_to(uint8_t network, const uint8_t *bssid, uint8_t channel, wifi_select_via_t via)
+{
+    const wifi_network_t *net = &s_cfg->networks[network];
+    wifi_config_t wifi_config = {
+        .sta = {
+            .threshold.authmode = WIFI_AUTH_WPA2_PSK,
+            .pmf_cfg = {
+                .capable = true,
+                .required = false
+            },
+        },
+    };
+
+    strncpy((char *)wifi_config.sta.ssid, net->ssid, sizeof(wifi_config.sta.ssid));
+    strncpy((char *)wifi_config.sta.password, net->password, sizeof(wifi_config.sta.password));
+    if (bssid) {
+        // Pinning BSSID and channel lets the driver skip its own scan
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.channel = channel;
+    }
+
+    ESP_LOGI(TAG, "Connecting to '%s' (channel %u, via %s)", net->ssid, channel,
+             via == WIFI_SELECT_VIA_CACHE ? "cache" : "scan");
+    s_attempt_via = via;
+    s_attempt_network = network;
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    esp_wifi_connect();
+}
+
+static void start_scan(void)
+{
+    s_state = SEL_SCANNING;
+    s_info.scans++;
+    if (esp_wifi_scan_start(NULL, false) != ESP_OK) {
+        ESP_LOGW(TAG, "Scan could not be started");
+        s_state = SEL_IDLE;
+    }
+}
+
+// esp_timer task: hand the rescan over to the event loop, where the state lives
+static void rescan_cb(void *arg)
+{
+    if (esp_event_post(WIFI_SELECT_EVENT, WIFI_SELECT_EVENT_RESCAN, NULL, 0, 0) != ESP_OK) {
+        ESP_LOGW(TAG, "Event queue full, rescan skipped");
+    }
+}
+
+static void rescan_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    if (s_state == SEL_IDLE && s_ap_active) {
+        start_scan();
+    }
+}
+
+static void start_ap_fallback(void)
+{
+    wifi_config_t ap_config = {
+        .ap = {
+            .channel = 1,
+            .authmode = WIFI_AUTH_WPA_WPA2_PSK,
+            .max_connection = 4
+        }
+    };
+
+    s_state = SEL_IDLE;
+    if (s_ap_active) {
+        return;
+    }
+
+    ESP_LOGW(TAG, "No configured network reachable, starting hotspot '%s'", s_cfg->ap_ssid);
+    strncpy((char *)ap_config.ap.ssid, s_cfg->ap_ssid, sizeof(ap_config.ap.ssid));
+    strncpy((char *)ap_config.ap.password, s_cfg->ap_password, sizeof(ap_config.ap.password));
+    ap_config.ap.ssid_len = strlen(s_cfg->ap_ssid);
+
+    esp_wifi_set_mode(WIFI_MODE_APSTA);
+    esp_wifi_set_config(WIFI_IF_AP, &ap_config);
+    s_ap_active = true;
+    s_info.ap_fallbacks++;
+
+    if (s_rescan_timer == NULL) {
+        const esp_timer_create_args_t args = {
+            .callback = rescan_cb,
+            .name = "wifi_rescan",
+        };
+        esp_timer_create(&args, &s_rescan_timer);
+    }
+    esp_timer_start_periodic(s_rescan_timer, (uint64_t)WIFI_AP_RESCAN_MS * 1000);
+}
+
+// Try the next scan candidate, or give up on this round
+static void next_candidate(void)
+{
+    if (s_candidate_next < s_candidate_count) {
+        const candidate_t *c = &s_candidates[s_candidate_next++];
+        s_state = SEL_CANDIDATES;
+        connect_to(c->network, c->bssid, c->channel, WIFI_SELECT_VIA_SCAN);
+        return;
+    }
+
+    if (++s_failed_rounds >= WIFI_SCAN_ROUNDS) {
+        start_ap_fallback();
+    } else {
+        start_scan();
+    }
+}
+
+void wifi_select_init(const wifi_select_config_t *config)
+{
+    nvs_handle_t nvs;
+    size_t len = sizeof(s_cache);
+
+    s_cfg = config;
+    esp_event_handler_register(WIFI_SELECT_EVENT, WIFI_SELECT_EVENT_RESCAN, rescan_handler, NULL);
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    if (nvs_get_blob(nvs, NVS_KEY_LAST, &s_cache, &len) == ESP_OK && len == sizeof(s_cache)) {
+        s_cache.ssid[sizeof(s_cache.ssid) - 1] = '\0';
+        int idx = find_network(s_cache.ssid);
+        if (idx >= 0) {
+            s_cache_valid = true;
+            s_cached_network = (uint8_t)idx;
+        }
+    }
+    nvs_close(nvs);
+}
+
+void wifi_select_on_sta_start(void)
+{
+    s_attempt_start_us = esp_timer_get_time();
+    s_failed_rounds = 0;
+
+    if (s_cache_valid) {
+        s_state = SEL_CACHED;
+        s_cached_failures = 0;
+        connect_to(s_cached_network, s_cache.bssid, s_cache.channel, WIFI_SELECT_VIA_CACHE);
+    } else {
+        start_scan();
+    }
+}
+
+void wifi_select_on_disconnected(uint8_t reason)
+{
+    switch (s_state) {
+    case SEL_CONNECTED:
+        // Lost an established link: go straight back to the same AP first
+        s_attempt_start_us = esp_timer_get_time();
+        s_failed_rounds = 0;
+        s_cached_failures = 0;
+        s_state = s_cache_valid ? SEL_CACHED : SEL_IDLE;
+        if (s_cache_valid) {
+            connect_to(s_cached_network, s_cache.bssid, s_cache.channel, WIFI_SELECT_VIA_CACHE);
+        } else {
+            start_scan();
+        }
+        break;
+    case SEL_CACHED:
+        if (++s_cached_failures < WIFI_CACHED_ATTEMPTS) {
+            esp_wifi_connect();
+        } else {
+            ESP_LOGI(TAG, "Cached network unavailable (reason %u), scanning", reason);
+            start_scan();
+        }
+        break;
+    case SEL_CANDIDATES:
+        next_candidate();
+        break;
+    default:
+        break;
+    }
+}
+
+void wifi_select_on_scan_done(void)
+{
+    static wifi_ap_record_t records[WIFI_MAX_SCAN_RECORDS];
+    uint16_t count = WIFI_MAX_SCAN_RECORDS;
+
+    if (s_state != SEL_SCANNING) {
+        return;
+    }
+    if (esp_wifi_scan_get_ap_records(&count, records) != ESP_OK) {
+        count = 0;
+    }
+
+    // Keep APs of configured networks, strongest first
+    s_candidate_count = 0;
+    s_candidate_next = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        int net = find_network((const char *)records[i].ssid);
+        if (net < 0) {
+            continue;
+        }
+        candidate_t c = {
+            .network = (uint8_t)net,
+            .channel = records[i].primary,
+            .rssi = records[i].rssi,
+        };
+        memcpy(c.bssid, records[i].bssid, sizeof(c.bssid));
+
+        size_t pos = s_candidate_count;
+        while (pos > 0 && s_candidates[pos - 1].rssi < c.rssi) {
+            if (pos < WIFI_MAX_CANDIDATES) {
+                s_candidates[pos] = s_candidates[pos - 1];
+            }
+            pos--;
+        }
+        if (pos < WIFI_MAX_CANDIDATES) {
+            s_candidates[pos] = c;
+            if (s_candidate_count < WIFI_MAX_CANDIDATES) {
+                s_candidate_count++;
+            }
+        }
+    }
+
+    ESP_LOGI(TAG, "Scan found %u APs, %u of configured networks", count, (unsigned)s_candidate_count);
+    next_candidate();
+}
+
+void wifi_select_on_got_ip(void)
+{
+    wifi_ap_record_t ap;
+    const wifi_network_t *net = &s_cfg->networks[s_attempt_network];
+
+    s_state = SEL_CONNECTED;
+    s_info.via = s_attempt_via;
+    s_info.ssid = net->ssid;
+    s_info.connect_ms = (uint32_t)((esp_timer_get_time() - s_attempt_start_us) / 1000);
+    ESP_LOGI(TAG, "Connected to '%s' via %s in %u ms", net->ssid,
+             s_attempt_via == WIFI_SELECT_VIA_CACHE ? "cache" : "scan", s_info.connect_ms);
+
+    if (s_ap_active) {
+        esp_timer_stop(s_rescan_timer);
+        esp_wifi_set_mode(WIFI_MODE_STA);
+        s_ap_active = false;
+    }
+
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) {
+        return;
+    }
+
+    // Only write NVS when the AP actually changed
+    cached_ap_t cache = { .channel = ap.primary };
+    strncpy(cache.ssid, net->ssid, sizeof(cache.ssid) - 1);
+    memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+    if (s_cache_valid && memcmp(&cache, &s_cache, sizeof(cache)) == 0) {
+        return;
+    }
+    s_cache = cache;
+    s_cache_valid = true;
+    s_cached_network = s_attempt_network;
+
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+        nvs_set_blob(nvs, NVS_KEY_LAST, &s_cache, sizeof(s_cache));
+        nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+}
+
+void wifi_select_get_info(wifi_select_info_t *info)
+{
+    *info = s_info;
+}
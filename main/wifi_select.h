@@ -0,0 +1,62 @@
+#ifndef WIFI_SELECT_H
+#define WIFI_SELECT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const char *ssid;               // Empty entries are skipped
+    const char *password;
+} wifi_network_t;
+
+typedef struct {
+    const wifi_network_t *networks;
+    size_t network_count;
+    const char *ap_ssid;            // Fallback hotspot, only started when no network works
+    const char *ap_password;
+} wifi_select_config_t;
+
+typedef enum {
+    WIFI_SELECT_VIA_NONE,
+    WIFI_SELECT_VIA_CACHE,          // Cached SSID/BSSID/channel from NVS, no scan
+    WIFI_SELECT_VIA_SCAN,           // RSSI-ranked scan of the configured networks
+} wifi_select_via_t;
+
+typedef struct {
+    wifi_select_via_t via;          // How the current/last connection was made
+    const char *ssid;               // Network of the current/last connection
+    uint32_t connect_ms;            // Start of selection to association, last connection
+    uint32_t scans;
+    uint32_t ap_fallbacks;
+} wifi_select_info_t;
+
+/**
+ * @brief Load the cached network from NVS; call before esp_wifi_start()
+ *
+ * Needs the default event loop: the hotspot rescan timer posts to it.
+ *
+ * The configuration (and the strings it points to) must outlive the module.
+ */
+void wifi_select_init(const wifi_select_config_t *config);
+
+/**
+ * @brief WiFi event hooks, called from the application's WIFI_EVENT/IP_EVENT handler
+ */
+void wifi_select_on_sta_start(void);
+void wifi_select_on_disconnected(uint8_t reason);
+void wifi_select_on_scan_done(void);
+void wifi_select_on_got_ip(void);
+
+void wifi_select_get_info(wifi_select_info_t *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WIFI_SELECT_H
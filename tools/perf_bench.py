@@ -0,0 +1,294 @@
+#!/usr/bin/env python3
+"""
+Load run with /perf snapshots taken around it, on a device or the host build, and a diff of two runs
+
+    perf_bench.py run  --host 192.168.1.50 [--duration 60] [--clients 4] [--path /status]
+                       [--pin-sampler] [-o result.json]
+    perf_bench.py host [--binary build_host/test_perf] [-o result.json]
+    perf_bench.py diff base.json new.json [--threshold 10]
+
+`run` takes a /perf snapshot, drives GET <path> from a number of clients for the given time,
+takes a second snapshot and writes one JSON document: the client-side requests/s and latency
+percentiles, the device's rates over the window (totals difference / uptime difference), and the
+device latency histograms (window count and mean; percentiles are the device's since boot).
+--pin-sampler sets sample_min_ms = sample_max_ms = 1000 for the run and restores the schedule
+afterwards, so MQTT publishes/s are taken at the fastest sampling rate. The probe behind
+mqtt_roundtrip goes out every 30 s, so a run shorter than a few minutes has few or none of them.
+
+`host` runs host_test/test_perf, which is the firmware built for the PC: app_main() on the shim
+scheduler, a simulated sensor, and the in-process broker stand-in that hands the probe back after a
+fixed delay. It loads /status for 600 simulated seconds with the sampler pinned, so sample-to-publish
+and the round trip are on the simulated clock and repeat exactly from run to run; only the load
+figures, host CPU time per request, vary with the machine. The result has the same shape as `run`,
+so CI can diff the host results of two commits. It says nothing about WiFi, a real broker or the
+ESP32's CPU; use `run` against a device for those.
+
+`diff` compares two results, e.g. from two commits, and writes a JSON document with the change
+of every figure. Figures where a change beyond the threshold (in percent) is worse are listed as
+regressions, and the exit status is 1 if there are any.
+
+Only the Python standard library is used.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import urllib.parse
+import urllib.request
+
+# Figures compared by `diff`, with the direction that is better
+HIGHER_IS_BETTER = ("load.requests_per_s",)
+LOWER_IS_BETTER_SUFFIXES = (".p50_ms", ".p90_ms", ".p99_ms", ".mean_us", ".p99_us", ".error_rate")
+
+
+def fetch(host, path, method="GET", timeout=10.0):
+    req = urllib.request.Request("http://%s%s" % (host, path), method=method)
+    with urllib.request.urlopen(req, timeout=timeout) as resp:
+        return resp.read()
+
+
+def fetch_json(host, path, method="GET"):
+    return json.loads(fetch(host, path, method))
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0.0
+    k = (len(sorted_values) - 1) * p / 100.0
+    lo = int(k)
+    hi = min(lo + 1, len(sorted_values) - 1)
+    return sorted_values[lo] + (sorted_values[hi] - sorted_values[lo]) * (k - lo)
+
+
+def load(host, path, clients, duration):
+    """GET path from `clients` threads for `duration` seconds; returns latencies (ms) and errors"""
+    latencies = []
+    errors = [0]
+    lock = threading.Lock()
+    stop_at = time.monotonic() + duration
+
+    def client():
+        mine = []
+        failed = 0
+        while time.monotonic() < stop_at:
+            t0 = time.monotonic()
+            try:
+                fetch(host, path, timeout=5.0)
+                mine.append((time.monotonic() - t0) * 1000.0)
+            except Exception:
+                failed += 1
+        with lock:
+            latencies.extend(mine)
+            errors[0] += failed
+
+    threads = [threading.Thread(target=client) for _ in range(clients)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    return sorted(latencies), errors[0]
+
+
+def window(before, after):
+    """Device figures over the run from two /perf snapshots"""
+    seconds = (after["uptime_ms"] - before["uptime_ms"]) / 1000.0
+    if seconds <= 0:
+        raise SystemExit("device restarted during the run (uptime went from %d to %d ms)"
+                         % (before["uptime_ms"], after["uptime_ms"]))
+
+    rates = {}
+    for key, value in after["totals"].items():
+        rates[key + "_per_s"] = round((value - before["totals"].get(key, 0)) / seconds, 3)
+
+    latency = {}
+    for key, h in after["latency_us"].items():
+        b = before["latency_us"].get(key, {"count": 0, "mean": 0})
+        count = h["count"] - b["count"]
+        # The snapshot means are since boot; their weighted difference is the window's mean
+        mean = (h["count"] * h["mean"] - b["count"] * b["mean"]) / count if count > 0 else 0
+        latency[key] = {"count": count, "mean_us": round(mean), "p50_us": h["p50"],
+                        "p90_us": h["p90"], "p99_us": h["p99"]}
+    return seconds, rates, latency
+
+
+def cmd_run(args):
+    saved = None
+    if args.pin_sampler:
+        saved = fetch_json(args.host, "/config")
+        fetch(args.host, "/config?sample_min_ms=1000&sample_max_ms=1000", method="POST")
+
+    try:
+        before = fetch_json(args.host, "/perf")
+        latencies, errors = load(args.host, args.path, args.clients, args.duration)
+        after = fetch_json(args.host, "/perf")
+    finally:
+        if saved is not None:
+            query = urllib.parse.urlencode({"sample_min_ms": saved["sample_min_ms"],
+                                            "sample_max_ms": saved["sample_max_ms"]})
+            fetch(args.host, "/config?" + query, method="POST")
+
+    seconds, rates, latency = window(before, after)
+    total = len(latencies) + errors
+    result = {
+        "device": {k: after.get(k) for k in ("version", "idf", "built")},
+        "window_s": round(seconds, 3),
+        "sampler_pinned": bool(args.pin_sampler),
+        "load": {
+            "path": args.path,
+            "clients": args.clients,
+            "requests": len(latencies),
+            "errors": errors,
+            "error_rate": round(errors / total, 4) if total else 0.0,
+            "requests_per_s": round(len(latencies) / seconds, 2),
+            "p50_ms": round(percentile(latencies, 50), 2),
+            "p90_ms": round(percentile(latencies, 90), 2),
+            "p99_ms": round(percentile(latencies, 99), 2),
+            "max_ms": round(latencies[-1], 2) if latencies else 0.0,
+        },
+        "rates": rates,
+        "latency": latency,
+        "before": before,
+        "after": after,
+    }
+    write_json(result, args.output)
+    return 0
+
+
+def cmd_host(args):
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, "perf.json")
+        proc = subprocess.run([args.binary, path], stdout=subprocess.DEVNULL, stderr=subprocess.PIPE,
+                              universal_newlines=True)
+        if proc.returncode != 0:
+            raise SystemExit("%s failed:\n%s" % (args.binary, proc.stderr))
+        with open(path) as f:
+            doc = json.load(f)
+
+    before, after = doc["before"], doc["after"]
+    seconds, rates, latency = window(before, after)
+    load = doc["load"]
+    cpu_s = load["cpu_ms"] / 1000.0
+    result = {
+        "device": {k: after.get(k) for k in ("version", "idf", "built")},
+        "window_s": round(seconds, 3),
+        "sampler_pinned": True,
+        "load": {
+            "path": load["path"],
+            "clients": 1,
+            "requests": load["requests"],
+            "errors": load["errors"],
+            "error_rate": round(load["errors"] / load["requests"], 4) if load["requests"] else 0.0,
+            # Handler throughput on one host core, not a rate over the simulated window
+            "requests_per_s": round(load["requests"] / cpu_s, 2) if cpu_s > 0 else 0.0,
+            "p50_ms": load["p50_ms"],
+            "p90_ms": load["p90_ms"],
+            "p99_ms": load["p99_ms"],
+            "max_ms": load["max_ms"],
+        },
+        "rates": rates,
+        "latency": latency,
+        "before": before,
+        "after": after,
+    }
+    write_json(result, args.output)
+    return 0
+
+
+def flatten(doc, prefix=""):
+    """Numeric leaves of a result as {"load.p99_ms": 12.3, ...}, without the raw snapshots"""
+    out = {}
+    for key, value in doc.items():
+        if key in ("before", "after", "device"):
+            continue
+        name = prefix + key
+        if isinstance(value, dict):
+            out.update(flatten(value, name + "."))
+        elif isinstance(value, (int, float)) and not isinstance(value, bool):
+            out[name] = value
+    return out
+
+
+def worse(name, change_pct, threshold):
+    if name in HIGHER_IS_BETTER:
+        return change_pct < -threshold
+    if name.endswith(LOWER_IS_BETTER_SUFFIXES):
+        return change_pct > threshold
+    return False
+
+
+def cmd_diff(args):
+    with open(args.base) as f:
+        base = json.load(f)
+    with open(args.new) as f:
+        new = json.load(f)
+
+    a, b = flatten(base), flatten(new)
+    figures = []
+    for name in sorted(set(a) & set(b)):
+        change = None
+        if a[name]:
+            change = round((b[name] - a[name]) * 100.0 / abs(a[name]), 2)
+        figures.append({
+            "name": name,
+            "base": a[name],
+            "new": b[name],
+            "change_pct": change,
+            "regression": change is not None and worse(name, change, args.threshold),
+        })
+
+    regressions = [f["name"] for f in figures if f["regression"]]
+    write_json({
+        "base": base.get("device"),
+        "new": new.get("device"),
+        "threshold_pct": args.threshold,
+        "regressions": regressions,
+        "figures": figures,
+    }, args.output)
+    return 1 if regressions else 0
+
+
+def write_json(doc, path):
+    text = json.dumps(doc, indent=2, sort_keys=False) + "\n"
+    if path and path != "-":
+        with open(path, "w") as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    run = sub.add_parser("run", help="load run with /perf snapshots around it")
+    run.add_argument("--host", required=True, help="device address, e.g. 192.168.1.50 or officetemp.local")
+    run.add_argument("--duration", type=float, default=60.0, help="seconds of load (default 60)")
+    run.add_argument("--clients", type=int, default=4, help="concurrent HTTP clients (default 4)")
+    run.add_argument("--path", default="/status", help="path to load (default /status)")
+    run.add_argument("--pin-sampler", action="store_true", help="sample every second during the run")
+    run.add_argument("-o", "--output", help="result file (default stdout)")
+    run.set_defaults(func=cmd_run)
+
+    host = sub.add_parser("host", help="the same run on the host build, on the simulated clock")
+    host.add_argument("--binary", default="build_host/test_perf", help="test_perf from the host build")
+    host.add_argument("-o", "--output", help="result file (default stdout)")
+    host.set_defaults(func=cmd_host)
+
+    diff = sub.add_parser("diff", help="compare two results")
+    diff.add_argument("base")
+    diff.add_argument("new")
+    diff.add_argument("--threshold", type=float, default=10.0, help="percent change counted as a regression")
+    diff.add_argument("-o", "--output", help="diff file (default stdout)")
+    diff.set_defaults(func=cmd_diff)
+
+    args = parser.parse_args()
+    return args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())